@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <sysexits.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include <iperf_api.h>
+
+/* Multi-threaded client: runs several tests at once, one per thread,
+** against servers listening on consecutive ports.  Each thread has its
+** own timers and its own i_errno, so the tests don't interfere.
+*/
+
+struct job {
+    pthread_t thread;
+    char* host;
+    int port;
+    int result;
+    char error[256];
+    int intervals;
+    double peak_bps;
+};
+
+/* Interval callback: keeps track of the best interval of each test
+** without having to parse the JSON.
+*/
+static int
+on_interval( struct iperf_test* test, const struct iperf_interval_stats* streams, int nstreams, const struct iperf_interval_stats* sum, void* arg )
+{
+    struct job* job = (struct job*) arg;
+
+    ++job->intervals;
+    if ( ! sum->omitted && sum->bits_per_second > job->peak_bps )
+	job->peak_bps = sum->bits_per_second;
+    return 0;
+}
+
+static void*
+run_job( void* arg )
+{
+    struct job* job = (struct job*) arg;
+    struct iperf_test *test;
+
+    test = iperf_new_test();
+    if ( test == NULL ) {
+	job->result = -1;
+	snprintf( job->error, sizeof(job->error), "failed to create test" );
+	return NULL;
+    }
+    iperf_defaults( test );
+
+    /* Several tests share the process, so none of them may use SIGALRM;
+    ** that is the default, set here to make it plain.
+    */
+    iperf_set_test_may_use_sigalrm( test, 0 );
+
+    /* One JSON document per test keeps the output of the threads apart. */
+    iperf_set_test_json_output( test, 1 );
+    iperf_set_test_role( test, 'c' );
+    iperf_set_test_server_hostname( test, job->host );
+    iperf_set_test_server_port( test, job->port );
+    iperf_set_test_duration( test, 5 );
+    iperf_set_test_reporter_interval( test, 1 );
+    iperf_set_test_stats_interval( test, 1 );
+    iperf_set_test_interval_callback( test, on_interval, job );
+
+    job->result = iperf_run_client( test );
+    if ( job->result < 0 )
+	snprintf( job->error, sizeof(job->error), "%s", iperf_strerror( i_errno ) );
+
+    iperf_free_test( test );
+    return NULL;
+}
+
+int
+main( int argc, char** argv )
+{
+    char* argv0;
+    char* host;
+    int port, nthreads, i, failures;
+    struct job* jobs;
+
+    argv0 = strrchr( argv[0], '/' );
+    if ( argv0 != (char*) 0 )
+	++argv0;
+    else
+	argv0 = argv[0];
+
+    if ( argc != 4 ) {
+	fprintf( stderr, "usage: %s [host] [first port] [threads]\n", argv0 );
+	exit( EXIT_FAILURE );
+    }
+    host = argv[1];
+    port = atoi( argv[2] );
+    nthreads = atoi( argv[3] );
+    if ( nthreads < 1 ) {
+	fprintf( stderr, "%s: need at least one thread\n", argv0 );
+	exit( EXIT_FAILURE );
+    }
+
+    jobs = (struct job*) calloc( nthreads, sizeof(struct job) );
+    if ( jobs == NULL ) {
+	fprintf( stderr, "%s: out of memory\n", argv0 );
+	exit( EXIT_FAILURE );
+    }
+    for ( i = 0; i < nthreads; ++i ) {
+	jobs[i].host = host;
+	jobs[i].port = port + i;
+	if ( pthread_create( &jobs[i].thread, NULL, run_job, &jobs[i] ) != 0 ) {
+	    fprintf( stderr, "%s: failed to create thread\n", argv0 );
+	    exit( EXIT_FAILURE );
+	}
+    }
+
+    failures = 0;
+    for ( i = 0; i < nthreads; ++i ) {
+	pthread_join( jobs[i].thread, NULL );
+	if ( jobs[i].result < 0 ) {
+	    fprintf( stderr, "%s: port %d: error - %s\n", argv0, jobs[i].port, jobs[i].error );
+	    ++failures;
+	} else
+	    fprintf( stderr, "%s: port %d: %d intervals, peak %.0f bits/sec\n", argv0, jobs[i].port, jobs[i].intervals, jobs[i].peak_bps );
+    }
+
+    free( jobs );
+    exit( failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE );
+}
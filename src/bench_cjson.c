@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2014, The Regents of the University of California,
+ * through Lawrence Berkeley National Laboratory (subject to receipt of any
+ * required approvals from the U.S. Dept. of Energy).  All rights reserved.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE file
+ * for complete information.
+ */
+
+/* bench_cjson
+ *
+ * Times the cJSON printer on a tree shaped like the -J output of a
+ * long, single-stream test: one "intervals" entry per reporting
+ * interval, each with its stream and sum objects.
+ *
+ * usage: bench_cjson [-a] [intervals]	(default 1000000)
+ *
+ * -a builds the tree in an arena, as iperf does for -J.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "cjson.h"
+
+static double
+now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* Peak resident set size, in MB. */
+static double
+maxrss(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss / 1024.0;
+}
+
+static cJSON *
+make_interval_stream(int i, double start, double seconds, int64_t bytes)
+{
+    cJSON *j = cJSON_CreateObject();
+
+    cJSON_AddIntToObject(j, "socket", 5);
+    cJSON_AddFloatToObject(j, "start", start);
+    cJSON_AddFloatToObject(j, "end", start + seconds);
+    cJSON_AddFloatToObject(j, "seconds", seconds);
+    cJSON_AddIntToObject(j, "bytes", bytes);
+    cJSON_AddFloatToObject(j, "bits_per_second", bytes * 8 / seconds);
+    cJSON_AddIntToObject(j, "retransmits", i % 7);
+    cJSON_AddFalseToObject(j, "omitted");
+    return j;
+}
+
+static cJSON *
+make_tree(int n)
+{
+    cJSON *top, *intervals, *interval, *streams, *last;
+    double start, seconds;
+    int64_t bytes;
+    int i;
+
+    top = cJSON_CreateObject();
+    intervals = cJSON_CreateArray();
+    cJSON_AddItemToObject(top, "intervals", intervals);
+    last = NULL;
+    start = 0.0;
+    for (i = 0; i < n; ++i) {
+	/* Jitter the values so every number takes the general path. */
+	seconds = 1.0 + (i % 997) * 0.0000131;
+	bytes = 4000000000LL + (i * 2654435761LL) % 100000000;
+	interval = cJSON_CreateObject();
+	streams = cJSON_CreateArray();
+	cJSON_AddItemToObject(interval, "streams", streams);
+	cJSON_AddItemToArray(streams, make_interval_stream(i, start, seconds, bytes));
+	cJSON_AddItemToObject(interval, "sum", make_interval_stream(i, start, seconds, bytes));
+	/* cJSON_AddItemToArray() walks the whole array to find its end;
+	** link the new entry directly so building the tree stays linear.
+	*/
+	if (last == NULL)
+	    intervals->child = interval;
+	else {
+	    last->next = interval;
+	    interval->prev = last;
+	}
+	last = interval;
+	start += seconds;
+    }
+    return top;
+}
+
+static void
+report(const char *what, double t, size_t len, double rss0)
+{
+    printf("%-22s %8.3f s  %9.1f MB  %8.1f MB/s  peak +%.0f MB\n",
+	   what, t, len / 1e6, len / 1e6 / t, maxrss() - rss0);
+}
+
+int
+main(int argc, char **argv)
+{
+    cJSON *top;
+    cJSON_Arena *arena = NULL;
+    char *str;
+    FILE *fp;
+    double t, rss0;
+    size_t len;
+    int n;
+
+    if (argc > 1 && strcmp(argv[1], "-a") == 0) {
+	arena = cJSON_NewArena();
+	cJSON_SetArena(arena);
+	--argc;
+	++argv;
+    }
+    n = argc > 1 ? atoi(argv[1]) : 1000000;
+    if (n <= 0) {
+	fprintf(stderr, "usage: bench_cjson [-a] [intervals]\n");
+	return 1;
+    }
+
+    t = now();
+    top = make_tree(n);
+    printf("%d intervals, tree built in %.3f s, %.0f MB resident\n", n, now() - t, maxrss());
+
+    rss0 = maxrss();
+    t = now();
+    str = cJSON_Print(top);
+    t = now() - t;
+    if (str == NULL) {
+	fprintf(stderr, "cJSON_Print failed\n");
+	return 1;
+    }
+    len = strlen(str);
+    report("cJSON_Print", t, len, rss0);
+    free(str);
+
+    rss0 = maxrss();
+    t = now();
+    str = cJSON_PrintUnformatted(top);
+    t = now() - t;
+    if (str == NULL) {
+	fprintf(stderr, "cJSON_PrintUnformatted failed\n");
+	return 1;
+    }
+    report("cJSON_PrintUnformatted", t, strlen(str), rss0);
+    free(str);
+
+    fp = fopen("/dev/null", "w");
+    if (fp == NULL) {
+	perror("/dev/null");
+	return 1;
+    }
+    rss0 = maxrss();
+    t = now();
+    if (cJSON_PrintToFile(top, fp, 1) < 0) {
+	fprintf(stderr, "cJSON_PrintToFile failed\n");
+	return 1;
+    }
+    t = now() - t;
+    report("cJSON_PrintToFile", t, len, rss0);
+    fclose(fp);
+
+    t = now();
+    if (arena)
+	cJSON_DeleteArena(arena);
+    else
+	cJSON_Delete(top);
+    printf("tree freed in %.3f s\n", now() - t);
+    return 0;
+}
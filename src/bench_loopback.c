@@ -0,0 +1,427 @@
+/*
+ * Copyright (c) 2014, The Regents of the University of California,
+ * through Lawrence Berkeley National Laboratory (subject to receipt of any
+ * required approvals from the U.S. Dept. of Energy).  All rights reserved.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE file
+ * for complete information.
+ */
+
+/* bench_loopback
+ *
+ * Runs a matrix of tests with client and server in this process, each
+ * on its own thread, over the loopback interface or, for the unix
+ * cases, an AF_UNIX socket.  For every case it
+ * reports the receiver's throughput and what it cost: CPU seconds and
+ * system calls per GB (10^9 bytes) received.  The null cases (--null)
+ * report the sender's instead, the ceiling of iperf3's own send loop.  CPU and system calls are
+ * counted for the whole process, so they cover both ends.
+ *
+ * usage: bench_loopback [-t secs] [-p port] [-m match] [-o report.json]
+ *			 [-b baseline.json] [-T percent]
+ *
+ * -m runs only the cases whose name contains match.  -o writes the
+ * results as JSON, and -b compares them with such a file from an
+ * earlier run: the exit status is 2 if any case lost more than -T
+ * percent (default 10) of its throughput, or got that much costlier.
+ * "make bench" runs this with a stored baseline.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include "iperf_api.h"
+#include "cjson.h"
+
+struct bench_case {
+    const char *name;
+    int protocol;		/* Ptcp, Pudp, Punix, Punixseq or Pshm */
+    int blksize;
+    int streams;
+    int reverse;
+    int zerocopy;
+    uint64_t rate;		/* bits/sec, UDP only */
+    int null_send;		/* --null: measured at the sender */
+};
+
+static const struct bench_case cases[] = {
+    { "tcp-128K-P1",		Ptcp, 131072, 1, 0, 0, 0 },
+    { "tcp-128K-P1-R",		Ptcp, 131072, 1, 1, 0, 0 },
+    { "tcp-128K-P1-Z",		Ptcp, 131072, 1, 0, 1, 0 },
+    { "tcp-128K-P4",		Ptcp, 131072, 4, 0, 0, 0 },
+    { "tcp-128K-P4-R",		Ptcp, 131072, 4, 1, 0, 0 },
+    { "tcp-8K-P1",		Ptcp, 8192, 1, 0, 0, 0 },
+    { "tcp-8K-P1-R",		Ptcp, 8192, 1, 1, 0, 0 },
+    { "tcp-8K-P4",		Ptcp, 8192, 4, 0, 0, 0 },
+    { "udp-1470-100M",		Pudp, 1470, 1, 0, 0, 100000000 },
+    { "udp-1470-1G",		Pudp, 1470, 1, 0, 0, 1000000000 },
+    { "udp-1470-1G-R",		Pudp, 1470, 1, 1, 0, 1000000000 },
+    { "udp-8K-1G",		Pudp, 8192, 1, 0, 0, 1000000000 },
+    { "udp-8K-1G-P4",		Pudp, 8192, 4, 0, 0, 1000000000 },
+    { "unix-128K-P1",		Punix, 131072, 1, 0, 0, 0 },
+    { "unix-128K-P4",		Punix, 131072, 4, 0, 0, 0 },
+    { "unix-8K-P1",		Punix, 8192, 1, 0, 0, 0 },
+    { "unixseq-128K-P1",	Punixseq, 131072, 1, 0, 0, 0 },
+    { "unixseq-8K-P1",		Punixseq, 8192, 1, 0, 0, 0 },
+    { "shm-128K-P1",		Pshm, 131072, 1, 0, 0, 0 },
+    { "shm-128K-P1-R",		Pshm, 131072, 1, 1, 0, 0 },
+    { "shm-8K-P1",		Pshm, 8192, 1, 0, 0, 0 },
+    { "null-128K-P1",		Ptcp, 131072, 1, 0, 0, 0, 1 },
+    { "null-1K-P1",		Ptcp, 1024, 1, 0, 0, 0, 1 },
+    { "null-1K-P4",		Ptcp, 1024, 4, 0, 0, 0, 1 },
+};
+
+#define NCASES (sizeof(cases) / sizeof(cases[0]))
+
+/* What one end saw, summed over its intervals. */
+struct side {
+    uint64_t bytes;
+    double seconds;
+    long packets;
+    long lost;
+};
+
+struct result {
+    double bits_per_second;
+    double lost_percent;	/* UDP */
+    double cpu_per_gb;		/* CPU seconds */
+    double syscalls_per_gb;	/* -1 if the system does not count them */
+};
+
+struct server {
+    pthread_t thread;
+    struct iperf_test *test;
+    int rc;
+};
+
+static int
+on_interval(struct iperf_test *test, const struct iperf_interval_stats *streams, int nstreams, const struct iperf_interval_stats *sum, void *arg)
+{
+    struct side *side = (struct side *) arg;
+
+    if (sum->omitted)
+	return 0;
+    side->bytes += sum->bytes;
+    side->seconds += sum->duration;
+    side->packets += sum->packets;
+    side->lost += sum->lost_packets;
+    return 0;
+}
+
+static void *
+run_server(void *arg)
+{
+    struct server *server = (struct server *) arg;
+
+    server->rc = iperf_run_server(server->test);
+    return NULL;
+}
+
+static double
+cpu_seconds(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1000000.0 +
+	ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1000000.0;
+}
+
+/* Read and write system calls made so far, or -1 if unknown.  Linux
+** keeps the counts in /proc/self/io, for all threads together.
+*/
+static long long
+syscalls(void)
+{
+    FILE *fp;
+    char line[128];
+    long long n, total = 0;
+    int found = 0;
+
+    fp = fopen("/proc/self/io", "r");
+    if (fp == NULL)
+	return -1;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+	if (sscanf(line, "syscr: %lld", &n) == 1 || sscanf(line, "syscw: %lld", &n) == 1) {
+	    total += n;
+	    ++found;
+	}
+    }
+    fclose(fp);
+    return found == 2 ? total : -1;
+}
+
+static struct iperf_test *
+new_test(const struct bench_case *c, char role, int port, int duration, struct side *side)
+{
+    struct iperf_test *test;
+    char path[64];
+
+    test = iperf_new_test();
+    if (test == NULL)
+	return NULL;
+    iperf_defaults(test);
+    iperf_set_test_role(test, role);
+    iperf_set_test_server_port(test, port);
+    iperf_set_test_json_output(test, 1);
+    iperf_set_test_interval_callback(test, on_interval, side);
+    if (c->protocol == Punix || c->protocol == Punixseq || c->protocol == Pshm) {
+	snprintf(path, sizeof(path), "/tmp/bench_loopback-%d.sock", port);
+	iperf_set_test_unix(test, c->protocol == Punixseq);
+	if (role == 's')
+	    iperf_set_test_bind_address(test, path);
+	else
+	    iperf_set_test_server_hostname(test, path);
+    } else if (role == 'c')
+	iperf_set_test_server_hostname(test, "127.0.0.1");
+    if (role == 'c') {
+	set_protocol(test, c->protocol);
+	iperf_set_test_duration(test, duration);
+	iperf_set_test_blksize(test, c->blksize);
+	iperf_set_test_num_streams(test, c->streams);
+	iperf_set_test_reverse(test, c->reverse);
+	iperf_set_test_zerocopy(test, c->zerocopy);
+	iperf_set_test_null(test, c->null_send);
+	if (c->rate)
+	    iperf_set_test_rate(test, c->rate);
+    }
+    return test;
+}
+
+/* Run one case; 0 on success. */
+static int
+run_case(const struct bench_case *c, int port, int duration, struct result *r)
+{
+    struct server server;
+    struct iperf_test *client;
+    struct side server_side, client_side, *rx;
+    double cpu0;
+    long long sys0, sys1;
+    int tries, rc;
+
+    memset(r, 0, sizeof(*r));
+    memset(&server_side, 0, sizeof(server_side));
+    memset(&client_side, 0, sizeof(client_side));
+    server.test = new_test(c, 's', port, duration, &server_side);
+    if (server.test == NULL)
+	return -1;
+    if (pthread_create(&server.thread, NULL, run_server, &server) != 0) {
+	iperf_free_test(server.test);
+	return -1;
+    }
+
+    cpu0 = cpu_seconds();
+    sys0 = syscalls();
+    /* The server thread may not be listening yet. */
+    for (tries = 0; ; ++tries) {
+	client = new_test(c, 'c', port, duration, &client_side);
+	if (client == NULL) {
+	    rc = -1;
+	    break;
+	}
+	rc = iperf_run_client(client);
+	if (rc == 0 || i_errno != IECONNECT || tries == 50)
+	    break;
+	iperf_free_test(client);
+	client = NULL;
+	usleep(20000);
+    }
+    if (rc < 0)
+	fprintf(stderr, "bench_loopback: %s: %s\n", c->name, iperf_strerror(i_errno));
+    if (client != NULL)
+	iperf_free_test(client);
+    pthread_join(server.thread, NULL);
+    sys1 = syscalls();
+    if (rc == 0 && server.rc < 0)
+	rc = -1;
+
+    rx = c->reverse ? &client_side : &server_side;
+    /* With --null nothing arrives; the sender's figures are the point. */
+    if (c->null_send)
+	rx = c->reverse ? &server_side : &client_side;
+    if (rc == 0 && (rx->bytes == 0 || rx->seconds <= 0))
+	rc = -1;
+    if (rc == 0) {
+	r->bits_per_second = rx->bytes * 8 / rx->seconds;
+	r->lost_percent = rx->packets > 0 ? 100.0 * rx->lost / rx->packets : 0.0;
+	r->cpu_per_gb = (cpu_seconds() - cpu0) / (rx->bytes / 1e9);
+	r->syscalls_per_gb = sys0 >= 0 && sys1 >= 0 ? (sys1 - sys0) / (rx->bytes / 1e9) : -1;
+    }
+    iperf_free_test(server.test);
+    return rc;
+}
+
+/* The baseline entry for a case, or NULL. */
+static cJSON *
+find_case(cJSON *baseline, const char *name)
+{
+    cJSON *j, *n;
+
+    if (baseline == NULL || (j = cJSON_GetObjectItem(baseline, "cases")) == NULL)
+	return NULL;
+    for (j = j->child; j != NULL; j = j->next)
+	if ((n = cJSON_GetObjectItem(j, "name")) != NULL && n->valuestring != NULL &&
+	    strcmp(n->valuestring, name) == 0)
+	    return j;
+    return NULL;
+}
+
+/* Percent change of a metric against the baseline, or 0 if either is unknown. */
+static double
+change(cJSON *base, const char *key, double now)
+{
+    cJSON *j;
+
+    if (base == NULL || (j = cJSON_GetObjectItem(base, key)) == NULL || j->valuefloat <= 0 || now < 0)
+	return 0.0;
+    return 100.0 * (now - j->valuefloat) / j->valuefloat;
+}
+
+static cJSON *
+read_json(const char *path)
+{
+    FILE *fp;
+    char *buf;
+    long len;
+    cJSON *j;
+
+    fp = fopen(path, "r");
+    if (fp == NULL)
+	return NULL;
+    fseek(fp, 0, SEEK_END);
+    len = ftell(fp);
+    rewind(fp);
+    buf = (char *) malloc(len + 1);
+    if (buf == NULL || fread(buf, 1, len, fp) != (size_t) len) {
+	free(buf);
+	fclose(fp);
+	return NULL;
+    }
+    buf[len] = '\0';
+    fclose(fp);
+    j = cJSON_Parse(buf);
+    free(buf);
+    return j;
+}
+
+static void
+bench_usage(void)
+{
+    fprintf(stderr, "usage: bench_loopback [-t secs] [-p port] [-m match] [-o report.json] [-b baseline.json] [-T percent]\n");
+    exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+    const char *match = NULL, *outpath = NULL, *basepath = NULL;
+    int duration = 3, port = 5320, opt, failed = 0, regressed = 0;
+    double threshold = 10.0, dbps, dcpu, dsys;
+    cJSON *report, *jcases, *jc, *baseline = NULL, *base;
+    struct result r;
+    FILE *out, *fp;
+    char *str;
+    size_t i;
+
+    while ((opt = getopt(argc, argv, "t:p:m:o:b:T:")) != -1) {
+	switch (opt) {
+	    case 't': duration = atoi(optarg); break;
+	    case 'p': port = atoi(optarg); break;
+	    case 'm': match = optarg; break;
+	    case 'o': outpath = optarg; break;
+	    case 'b': basepath = optarg; break;
+	    case 'T': threshold = atof(optarg); break;
+	    default: bench_usage();
+	}
+    }
+    if (duration <= 0 || port <= 0 || optind != argc)
+	bench_usage();
+    if (basepath != NULL && (baseline = read_json(basepath)) == NULL) {
+	fprintf(stderr, "bench_loopback: cannot read baseline %s\n", basepath);
+	return 1;
+    }
+
+    /* libiperf writes its own reports to stdout; keep ours apart. */
+    out = fdopen(dup(STDOUT_FILENO), "w");
+    if (out == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+	perror("bench_loopback");
+	return 1;
+    }
+
+    report = cJSON_CreateObject();
+    jcases = cJSON_CreateArray();
+    cJSON_AddIntToObject(report, "duration", duration);
+    cJSON_AddItemToObject(report, "cases", jcases);
+
+    fprintf(out, "%-16s %10s %8s %10s %12s", "case", "Gbits/sec", "lost%", "CPU s/GB", "syscalls/GB");
+    if (baseline != NULL)
+	fprintf(out, "  %8s %8s %8s", "rate", "CPU", "syscalls");
+    fprintf(out, "\n");
+    fflush(out);
+    for (i = 0; i < NCASES; ++i) {
+	if (match != NULL && strstr(cases[i].name, match) == NULL)
+	    continue;
+	if (run_case(&cases[i], port + i, duration, &r) < 0) {
+	    fprintf(out, "%-16s failed\n", cases[i].name);
+	    fflush(out);
+	    ++failed;
+	    continue;
+	}
+	jc = cJSON_CreateObject();
+	cJSON_AddStringToObject(jc, "name", cases[i].name);
+	cJSON_AddFloatToObject(jc, "bits_per_second", r.bits_per_second);
+	cJSON_AddFloatToObject(jc, "lost_percent", r.lost_percent);
+	cJSON_AddFloatToObject(jc, "cpu_seconds_per_gb", r.cpu_per_gb);
+	cJSON_AddFloatToObject(jc, "syscalls_per_gb", r.syscalls_per_gb);
+	cJSON_AddItemToArray(jcases, jc);
+
+	fprintf(out, "%-16s %10.2f %8.2f %10.3f %12.0f", cases[i].name, r.bits_per_second / 1e9, r.lost_percent, r.cpu_per_gb, r.syscalls_per_gb);
+	if (baseline != NULL) {
+	    base = find_case(baseline, cases[i].name);
+	    if (base == NULL)
+		fprintf(out, "  %8s", "new");
+	    else {
+		dbps = change(base, "bits_per_second", r.bits_per_second);
+		dcpu = change(base, "cpu_seconds_per_gb", r.cpu_per_gb);
+		dsys = change(base, "syscalls_per_gb", r.syscalls_per_gb);
+		fprintf(out, "  %+7.1f%% %+7.1f%% %+7.1f%%", dbps, dcpu, dsys);
+		if (-dbps > threshold || dcpu > threshold || dsys > threshold) {
+		    fprintf(out, "  REGRESSION");
+		    ++regressed;
+		}
+	    }
+	}
+	fprintf(out, "\n");
+	fflush(out);
+    }
+
+    if (outpath != NULL) {
+	str = cJSON_Print(report);
+	fp = fopen(outpath, "w");
+	if (fp == NULL || str == NULL || fprintf(fp, "%s\n", str) < 0) {
+	    fprintf(stderr, "bench_loopback: cannot write %s\n", outpath);
+	    ++failed;
+	}
+	if (fp != NULL && fclose(fp) != 0)
+	    ++failed;
+	free(str);
+    }
+    cJSON_Delete(report);
+    cJSON_Delete(baseline);
+
+    if (failed)
+	return 1;
+    if (regressed) {
+	fprintf(out, "%d case%s regressed by more than %g%%\n", regressed, regressed == 1 ? "" : "s", threshold);
+	return 2;
+    }
+    return 0;
+}
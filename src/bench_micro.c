@@ -0,0 +1,621 @@
+/*
+ * Copyright (c) 2014, The Regents of the University of California,
+ * through Lawrence Berkeley National Laboratory (subject to receipt of any
+ * required approvals from the U.S. Dept. of Energy).  All rights reserved.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE file
+ * for complete information.
+ */
+
+/* bench_micro
+ *
+ * Times the functions on libiperf's per-block and per-interval paths,
+ * one at a time, against streams made in-process: iperf_send() and
+ * iperf_recv() dispatch, iperf_check_throttle(), tmr_timeout() and
+ * tmr_run(), the UDP header work in iperf_udp_send()/iperf_udp_recv(),
+ * iperf_stats_callback() at several stream counts, unit_snprintf(), and
+ * the cJSON printer and parser.  The data paths get a bare system call
+ * case next to them (write-devnull and so on) so the cost of the call
+ * itself can be subtracted.
+ *
+ * TCP sends go to /dev/null and receives come from /dev/zero, using
+ * small blocks so the copying does not hide the dispatch.  UDP runs over
+ * an AF_UNIX datagram socketpair.  iperf_stats_callback() uses real
+ * loopback TCP connections, since it reads TCP_INFO from each one.
+ *
+ * usage: bench_micro [-n ops | -t secs] [-m match] [-o report.json]
+ *
+ * By default each case runs for about -t seconds (0.2), in batches that
+ * grow until the clock is well above its resolution; -n runs exactly
+ * that many operations instead.  Times are in nanoseconds per operation
+ * from CLOCK_MONOTONIC.  On x86 the time stamp counter is read as well;
+ * it ticks at a fixed rate rather than with the core clock, so treat its
+ * cycles as a second opinion, not a count of executed cycles.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/time.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_udp.h"
+#include "timer.h"
+#include "units.h"
+#include "cjson.h"
+
+#define TCP_BLKSIZE	1024
+#define UDP_BLKSIZE	1470
+#define MAX_STREAMS	128
+#define NTIMERS		8
+
+struct micro {
+    const char *name;
+    int (*setup)(int arg);
+    void (*run)(long n);
+    void (*cleanup)(void);
+    int arg;
+};
+
+/* State shared by a case's setup, run and cleanup. */
+static struct iperf_test *test;
+static struct iperf_stream *stream, *peer;
+static int fds[2 * MAX_STREAMS], nfds;
+static int devfd = -1;
+static char block[TCP_BLKSIZE > UDP_BLKSIZE ? TCP_BLKSIZE : UDP_BLKSIZE];
+static cJSON *json;
+static char *json_text;
+static volatile long sink;
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_CYCLES 1
+static inline uint64_t
+cycles(void)
+{
+    uint32_t lo, hi;
+
+    __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t) hi << 32) | lo;
+}
+#else
+#define HAVE_CYCLES 0
+static inline uint64_t
+cycles(void)
+{
+    return 0;
+}
+#endif
+
+static uint64_t
+nsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* A connected pair of loopback TCP sockets. */
+static int
+tcp_pair(int sv[2])
+{
+    struct sockaddr_in sa;
+    socklen_t len = sizeof(sa);
+    int l;
+
+    if ((l = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+	return -1;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(l, (struct sockaddr *) &sa, sizeof(sa)) < 0 || listen(l, 1) < 0 ||
+	getsockname(l, (struct sockaddr *) &sa, &len) < 0 ||
+	(sv[0] = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+	close(l);
+	return -1;
+    }
+    if (connect(sv[0], (struct sockaddr *) &sa, sizeof(sa)) < 0 ||
+	(sv[1] = accept(l, NULL, NULL)) < 0) {
+	close(sv[0]);
+	close(l);
+	return -1;
+    }
+    close(l);
+    return 0;
+}
+
+static int
+new_test(int protocol, int blksize, char role)
+{
+    if ((test = iperf_new_test()) == NULL || iperf_defaults(test) < 0 ||
+	set_protocol(test, protocol) < 0)
+	return -1;
+    iperf_set_test_blksize(test, blksize);
+    iperf_set_test_role(test, role);
+    test->multisend = 1;	/* one block per iperf_send() */
+    return 0;
+}
+
+/* A stream on one end of a TCP pair, with its descriptor then pointed
+** at path so the data calls neither block nor fill a socket buffer.
+*/
+static struct iperf_stream *
+devnull_stream(const char *path, int flags)
+{
+    struct iperf_stream *sp;
+    int sv[2];
+
+    if (tcp_pair(sv) < 0)
+	return NULL;
+    fds[nfds++] = sv[0];
+    fds[nfds++] = sv[1];
+    if ((sp = iperf_new_stream(test, sv[0])) == NULL)
+	return NULL;
+    if ((devfd = open(path, flags)) < 0 || dup2(devfd, sv[0]) < 0)
+	return NULL;
+    sp->green_light = 1;
+    return sp;
+}
+
+static void
+cleanup_test(void)
+{
+    int i;
+
+    if (test != NULL)
+	iperf_free_test(test);
+    test = NULL;
+    stream = peer = NULL;
+    for (i = 0; i < nfds; ++i)
+	close(fds[i]);
+    nfds = 0;
+    if (devfd >= 0)
+	close(devfd);
+    devfd = -1;
+}
+
+
+static int
+setup_devnull(int arg)
+{
+    return (devfd = open("/dev/null", O_WRONLY)) < 0 ? -1 : 0;
+}
+
+static void
+run_write(long n)
+{
+    while (n-- > 0)
+	if (write(devfd, block, TCP_BLKSIZE) < 0)
+	    abort();
+}
+
+static int
+setup_devzero(int arg)
+{
+    return (devfd = open("/dev/zero", O_RDONLY)) < 0 ? -1 : 0;
+}
+
+static void
+run_read(long n)
+{
+    while (n-- > 0)
+	if (read(devfd, block, TCP_BLKSIZE) < 0)
+	    abort();
+}
+
+static int
+setup_tcp_send(int arg)
+{
+    if (new_test(Ptcp, TCP_BLKSIZE, 'c') < 0)
+	return -1;
+    return (stream = devnull_stream("/dev/null", O_WRONLY)) == NULL ? -1 : 0;
+}
+
+static void
+run_iperf_send(long n)
+{
+    while (n-- > 0)
+	if (iperf_send(test, NULL) < 0)
+	    abort();
+}
+
+static int
+setup_tcp_recv(int arg)
+{
+    if (new_test(Ptcp, TCP_BLKSIZE, 's') < 0)
+	return -1;
+    return (stream = devnull_stream("/dev/zero", O_RDONLY)) == NULL ? -1 : 0;
+}
+
+static void
+run_iperf_recv(long n)
+{
+    fd_set set;
+
+    FD_ZERO(&set);
+    while (n-- > 0) {
+	FD_SET(stream->socket, &set);
+	if (iperf_recv(test, &set) < 0)
+	    abort();
+    }
+}
+
+static int
+setup_udp(int arg)
+{
+    if (socketpair(AF_UNIX, SOCK_DGRAM, 0, fds) < 0)
+	return -1;
+    nfds = 2;
+    if (new_test(Pudp, UDP_BLKSIZE, 'c') < 0 ||
+	(stream = iperf_new_stream(test, fds[0])) == NULL ||
+	(peer = iperf_new_stream(test, fds[1])) == NULL)
+	return -1;
+    return 0;
+}
+
+static void
+run_sendrecv(long n)
+{
+    while (n-- > 0)
+	if (send(fds[0], block, UDP_BLKSIZE, 0) < 0 ||
+	    recv(fds[1], block, UDP_BLKSIZE, 0) < 0)
+	    abort();
+}
+
+static void
+run_udp(long n)
+{
+    while (n-- > 0)
+	if (iperf_udp_send(stream) < 0 || iperf_udp_recv(peer) < 0)
+	    abort();
+}
+
+static int
+setup_throttle(int arg)
+{
+    if (new_test(Pudp, UDP_BLKSIZE, 'c') < 0 ||
+	(stream = devnull_stream("/dev/null", O_WRONLY)) == NULL)
+	return -1;
+    iperf_set_test_rate(test, 1000000000);
+    gettimeofday(&stream->result->start_time, NULL);
+    --stream->result->start_time.tv_sec;
+    return 0;
+}
+
+static void
+run_throttle(long n)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    while (n-- > 0) {
+	/* Hover around the rate so the light keeps changing. */
+	stream->result->bytes_sent += stream->green_light ? 2 * UDP_BLKSIZE : 0;
+	iperf_check_throttle(stream, &now);
+	stream->result->bytes_sent -= UDP_BLKSIZE;
+    }
+}
+
+static struct timeval timer_now;
+
+static void
+timer_proc(TimerClientData client_data, struct timeval *nowP)
+{
+    ++sink;
+}
+
+static int
+setup_timers(int arg)
+{
+    int i;
+
+    gettimeofday(&timer_now, NULL);
+    for (i = 0; i < NTIMERS; ++i)
+	if (tmr_create(&timer_now, timer_proc, JunkClientData, 1000 * (i + 1), 1) == NULL)
+	    return -1;
+    return 0;
+}
+
+static void
+run_timers(long n)
+{
+    while (n-- > 0) {
+	timer_now.tv_usec += 250;
+	if (timer_now.tv_usec >= 1000000) {
+	    timer_now.tv_usec -= 1000000;
+	    ++timer_now.tv_sec;
+	}
+	if (tmr_timeout(&timer_now) != NULL)
+	    tmr_run(&timer_now);
+    }
+}
+
+static void
+cleanup_timers(void)
+{
+    tmr_destroy();
+}
+
+static int
+setup_stats(int arg)
+{
+    struct iperf_stream *sp;
+    int i, sv[2];
+
+    if (new_test(Ptcp, TCP_BLKSIZE, 'c') < 0)
+	return -1;
+    for (i = 0; i < arg; ++i) {
+	if (tcp_pair(sv) < 0)
+	    return -1;
+	fds[nfds++] = sv[0];
+	fds[nfds++] = sv[1];
+	if ((sp = iperf_new_stream(test, sv[0])) == NULL)
+	    return -1;
+	gettimeofday(&sp->result->start_time, NULL);
+    }
+    return 0;
+}
+
+static void
+run_stats(long n)
+{
+    struct iperf_stream *sp;
+    struct iperf_interval_results *irp;
+
+    while (n-- > 0) {
+	iperf_stats_callback(test);
+	/* Keep only the newest interval, which the next call needs. */
+	SLIST_FOREACH(sp, &test->streams, streams) {
+	    irp = TAILQ_FIRST(&sp->result->interval_results);
+	    if (irp != TAILQ_LAST(&sp->result->interval_results, irlisthead)) {
+		TAILQ_REMOVE(&sp->result->interval_results, irp, irlistentries);
+		free(irp);
+	    }
+	}
+    }
+}
+
+static void
+run_units(long n)
+{
+    char buf[16];
+    double v = 1234567890.0;
+
+    while (n-- > 0) {
+	unit_snprintf(buf, sizeof(buf), v, 'A');
+	unit_snprintf(buf, sizeof(buf), v * 8, 'a');
+	v += 1000.0;
+	sink += buf[0];
+    }
+}
+
+/* An entry the shape of one stream in one -J interval. */
+static cJSON *
+make_interval(void)
+{
+    cJSON *j = cJSON_CreateObject();
+
+    cJSON_AddIntToObject(j, "socket", 5);
+    cJSON_AddFloatToObject(j, "start", 11.000123);
+    cJSON_AddFloatToObject(j, "end", 12.000245);
+    cJSON_AddFloatToObject(j, "seconds", 1.000122);
+    cJSON_AddIntToObject(j, "bytes", 4113563648LL);
+    cJSON_AddFloatToObject(j, "bits_per_second", 32904494187.47);
+    cJSON_AddIntToObject(j, "retransmits", 3);
+    cJSON_AddIntToObject(j, "snd_cwnd", 3145728);
+    cJSON_AddFalseToObject(j, "omitted");
+    return j;
+}
+
+static int
+setup_json(int arg)
+{
+    json = make_interval();
+    json_text = cJSON_PrintUnformatted(json);
+    return json == NULL || json_text == NULL ? -1 : 0;
+}
+
+static void
+run_print(long n)
+{
+    char *s;
+
+    while (n-- > 0) {
+	if ((s = cJSON_PrintUnformatted(json)) == NULL)
+	    abort();
+	free(s);
+    }
+}
+
+static void
+run_parse(long n)
+{
+    cJSON *j;
+
+    while (n-- > 0) {
+	if ((j = cJSON_Parse(json_text)) == NULL)
+	    abort();
+	cJSON_Delete(j);
+    }
+}
+
+static void
+cleanup_json(void)
+{
+    cJSON_Delete(json);
+    free(json_text);
+    json = NULL;
+    json_text = NULL;
+}
+
+static const struct micro micros[] = {
+    { "write-devnull",		setup_devnull,	run_write,	cleanup_test },
+    { "iperf_send-tcp",		setup_tcp_send,	run_iperf_send,	cleanup_test },
+    { "read-devzero",		setup_devzero,	run_read,	cleanup_test },
+    { "iperf_recv-tcp",		setup_tcp_recv,	run_iperf_recv,	cleanup_test },
+    { "sendrecv-unix-dgram",	setup_udp,	run_sendrecv,	cleanup_test },
+    { "iperf_udp_send+recv",	setup_udp,	run_udp,	cleanup_test },
+    { "iperf_check_throttle",	setup_throttle,	run_throttle,	cleanup_test },
+    { "tmr_timeout+run-8",	setup_timers,	run_timers,	cleanup_timers },
+    { "stats_callback-1",	setup_stats,	run_stats,	cleanup_test, 1 },
+    { "stats_callback-8",	setup_stats,	run_stats,	cleanup_test, 8 },
+    { "stats_callback-128",	setup_stats,	run_stats,	cleanup_test, MAX_STREAMS },
+    { "unit_snprintf-x2",	NULL,		run_units,	NULL },
+    { "cJSON_print",		setup_json,	run_print,	cleanup_json },
+    { "cJSON_parse",		setup_json,	run_parse,	cleanup_json },
+};
+
+#define NMICROS (sizeof(micros) / sizeof(micros[0]))
+
+struct timing {
+    long ops;
+    uint64_t ns;
+    uint64_t cycles;
+};
+
+static void
+timed_run(const struct micro *m, long n, struct timing *t)
+{
+    uint64_t t0, c0;
+
+    t0 = nsec();
+    c0 = cycles();
+    m->run(n);
+    t->cycles += cycles() - c0;
+    t->ns += nsec() - t0;
+    t->ops += n;
+}
+
+/* Run exactly ops operations, or for about secs seconds if ops is 0. */
+static void
+measure(const struct micro *m, long ops, double secs, struct timing *t)
+{
+    uint64_t budget = secs * 1e9, before;
+    long batch = 1;
+
+    memset(t, 0, sizeof(*t));
+    if (ops > 0) {
+	m->run(ops < 100 ? ops : 100);		/* warm up */
+	timed_run(m, ops, t);
+	return;
+    }
+    /* Grow the batch until one takes a millisecond, then keep going. */
+    while (t->ns < budget) {
+	before = t->ns;
+	timed_run(m, batch, t);
+	if (t->ns - before < 1000000 && batch < (1L << 30))
+	    batch *= 2;
+    }
+}
+
+static void
+bench_usage(void)
+{
+    fprintf(stderr, "usage: bench_micro [-n ops | -t secs] [-m match] [-o report.json]\n");
+    exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+    const char *match = NULL, *outpath = NULL;
+    long ops = 0;
+    double secs = 0.2, ns, cyc;
+    int opt, failed = 0;
+    cJSON *report, *jcases, *jc;
+    struct timing t;
+    FILE *out, *fp;
+    char *str;
+    size_t i;
+
+    while ((opt = getopt(argc, argv, "n:t:m:o:")) != -1) {
+	switch (opt) {
+	    case 'n': ops = atol(optarg); break;
+	    case 't': secs = atof(optarg); break;
+	    case 'm': match = optarg; break;
+	    case 'o': outpath = optarg; break;
+	    default: bench_usage();
+	}
+    }
+    if (ops < 0 || secs <= 0 || optind != argc)
+	bench_usage();
+
+    /* libiperf may print; keep our report apart. */
+    out = fdopen(dup(STDOUT_FILENO), "w");
+    if (out == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+	perror("bench_micro");
+	return 1;
+    }
+
+    report = cJSON_CreateObject();
+    jcases = cJSON_CreateArray();
+    if (ops > 0)
+	cJSON_AddIntToObject(report, "ops", ops);
+    else
+	cJSON_AddFloatToObject(report, "seconds", secs);
+    cJSON_AddItemToObject(report, "cases", jcases);
+
+    fprintf(out, "%-22s %12s %10s %10s %10s\n", "case", "ops", "ns/op", "cycles/op", "Mops/sec");
+    fflush(out);
+    for (i = 0; i < NMICROS; ++i) {
+	if (match != NULL && strstr(micros[i].name, match) == NULL)
+	    continue;
+	if (micros[i].setup != NULL && micros[i].setup(micros[i].arg) < 0) {
+	    fprintf(out, "%-22s setup failed: %s\n", micros[i].name, i_errno ? iperf_strerror(i_errno) : strerror(errno));
+	    fflush(out);
+	    if (micros[i].cleanup != NULL)
+		micros[i].cleanup();
+	    i_errno = 0;
+	    ++failed;
+	    continue;
+	}
+	measure(&micros[i], ops, secs, &t);
+	if (micros[i].cleanup != NULL)
+	    micros[i].cleanup();
+
+	ns = (double) t.ns / t.ops;
+	cyc = (double) t.cycles / t.ops;
+	jc = cJSON_CreateObject();
+	cJSON_AddStringToObject(jc, "name", micros[i].name);
+	cJSON_AddIntToObject(jc, "ops", t.ops);
+	cJSON_AddFloatToObject(jc, "ns_per_op", ns);
+	if (HAVE_CYCLES)
+	    cJSON_AddFloatToObject(jc, "cycles_per_op", cyc);
+	else
+	    cJSON_AddNullToObject(jc, "cycles_per_op");
+	cJSON_AddItemToArray(jcases, jc);
+
+	fprintf(out, "%-22s %12ld %10.1f ", micros[i].name, t.ops, ns);
+	if (HAVE_CYCLES)
+	    fprintf(out, "%10.1f", cyc);
+	else
+	    fprintf(out, "%10s", "-");
+	fprintf(out, " %10.2f\n", 1e3 / ns);
+	fflush(out);
+    }
+
+    if (outpath != NULL) {
+	str = cJSON_Print(report);
+	fp = fopen(outpath, "w");
+	if (fp == NULL || str == NULL || fprintf(fp, "%s\n", str) < 0) {
+	    fprintf(stderr, "bench_micro: cannot write %s\n", outpath);
+	    ++failed;
+	}
+	if (fp != NULL && fclose(fp) != 0)
+	    ++failed;
+	free(str);
+    }
+    cJSON_Delete(report);
+
+    return failed ? 1 : 0;
+}
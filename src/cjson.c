@@ -30,6 +30,8 @@
 #include <float.h>
 #include <limits.h>
 #include <ctype.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <sys/types.h>
 #include "cjson.h"
 
@@ -78,23 +80,182 @@ void cJSON_InitHooks(cJSON_Hooks* hooks)
 }
 
 
-static char* cJSON_strdup( const char* str )
+/* Arenas.  While an arena is current, new items and their strings are
+   carved out of large slabs instead of being malloc'd one by one, and
+   are marked cJSON_InArena so that cJSON_Delete() leaves them alone.
+   Object keys are interned: a tree with a fixed vocabulary holds one
+   copy of each key however many objects use it.  The whole lot is
+   released at once by cJSON_DeleteArena(). */
+#ifndef CJSON_TLS
+#define CJSON_TLS __thread
+#endif
+
+#define ARENA_SLAB ( 256 * 1024 )
+
+struct arena_slab {
+	struct arena_slab *next;
+	size_t used;
+	size_t size;
+	double data[1];		/* aligned for any item */
+};
+
+struct cJSON_Arena {
+	struct arena_slab *slabs;	/* the first one is being filled */
+	char **keys;			/* interned keys, open addressing */
+	size_t nkeys;
+	size_t keyslots;
+};
+
+static CJSON_TLS cJSON_Arena *cJSON_arena;
+
+cJSON_Arena *cJSON_NewArena( void )
+{
+	cJSON_Arena *a = (cJSON_Arena*) cJSON_malloc( sizeof(cJSON_Arena) );
+	if ( a )
+		memset( a, 0, sizeof(cJSON_Arena) );
+	return a;
+}
+
+cJSON_Arena *cJSON_SetArena( cJSON_Arena *arena )
+{
+	cJSON_Arena *prev = cJSON_arena;
+	cJSON_arena = arena;
+	return prev;
+}
+
+void cJSON_DeleteArena( cJSON_Arena *arena )
+{
+	struct arena_slab *s;
+
+	if ( ! arena )
+		return;
+	if ( cJSON_arena == arena )
+		cJSON_arena = 0;
+	while ( ( s = arena->slabs ) ) {
+		arena->slabs = s->next;
+		cJSON_free( s );
+	}
+	if ( arena->keys )
+		cJSON_free( arena->keys );
+	cJSON_free( arena );
+}
+
+static void *arena_alloc( cJSON_Arena *a, size_t n )
+{
+	struct arena_slab *s = a->slabs;
+	size_t size;
+
+	n = ( n + sizeof(double) - 1 ) & ~( sizeof(double) - 1 );
+	if ( s && s->used + n <= s->size ) {
+		s->used += n;
+		return (char*) s->data + s->used - n;
+	}
+	/* Big requests get a slab of their own, behind the current one. */
+	size = n > ARENA_SLAB / 4 ? n : ARENA_SLAB;
+	if ( ! ( s = (struct arena_slab*) cJSON_malloc( offsetof( struct arena_slab, data ) + size ) ) )
+		return 0;
+	s->used = n;
+	s->size = size;
+	if ( a->slabs && size != ARENA_SLAB ) {
+		s->next = a->slabs->next;
+		a->slabs->next = s;
+	} else {
+		s->next = a->slabs;
+		a->slabs = s;
+	}
+	return s->data;
+}
+
+static char *arena_intern( cJSON_Arena *a, const char *str )
+{
+	size_t h = 2166136261U, i, len, nslots;
+	char **nkeys, *copy;
+	const char *cp;
+
+	for ( cp = str; *cp; ++cp )
+		h = ( h ^ (unsigned char) *cp ) * 16777619U;
+	len = cp - str + 1;
+
+	if ( a->keyslots ) {
+		for ( i = h & ( a->keyslots - 1 ); a->keys[i]; i = ( i + 1 ) & ( a->keyslots - 1 ) )
+			if ( ! strcmp( a->keys[i], str ) )
+				return a->keys[i];
+	}
+	if ( ( a->nkeys + 1 ) * 2 > a->keyslots ) {
+		/* Keep the table at most half full. */
+		nslots = a->keyslots ? a->keyslots * 2 : 64;
+		if ( ! ( nkeys = (char**) cJSON_malloc( nslots * sizeof(char*) ) ) )
+			return 0;
+		memset( nkeys, 0, nslots * sizeof(char*) );
+		for ( i = 0; i < a->keyslots; ++i )
+			if ( a->keys[i] ) {
+				size_t g = 2166136261U, j;
+				for ( cp = a->keys[i]; *cp; ++cp )
+					g = ( g ^ (unsigned char) *cp ) * 16777619U;
+				for ( j = g & ( nslots - 1 ); nkeys[j]; j = ( j + 1 ) & ( nslots - 1 ) )
+					;
+				nkeys[j] = a->keys[i];
+			}
+		if ( a->keys )
+			cJSON_free( a->keys );
+		a->keys = nkeys;
+		a->keyslots = nslots;
+	}
+	if ( ! ( copy = (char*) arena_alloc( a, len ) ) )
+		return 0;
+	memcpy( copy, str, len );
+	for ( i = h & ( a->keyslots - 1 ); a->keys[i]; i = ( i + 1 ) & ( a->keyslots - 1 ) )
+		;
+	a->keys[i] = copy;
+	++a->nkeys;
+	return copy;
+}
+
+/* Allocate memory owned by item: from the arena if the item is in one. */
+static void *cJSON_alloc_for( cJSON *item, size_t n )
+{
+	if ( ( item->type & cJSON_InArena ) && cJSON_arena )
+		return arena_alloc( cJSON_arena, n );
+	return cJSON_malloc( n );
+}
+
+static char* cJSON_strdup( cJSON *item, const char* str )
 {
 	size_t len;
 	char* copy;
 
 	len = strlen( str ) + 1;
-	if ( ! ( copy = (char*) cJSON_malloc( len ) ) )
+	if ( ! ( copy = (char*) cJSON_alloc_for( item, len ) ) )
 		return 0;
 	memcpy( copy, str, len );
 	return copy;
 }
 
+/* Copy an object key for item. */
+static char *cJSON_keydup( cJSON *item, const char *str )
+{
+	if ( ( item->type & cJSON_InArena ) && cJSON_arena )
+		return arena_intern( cJSON_arena, str );
+	return cJSON_strdup( item, str );
+}
+
+/* Set an item's type, keeping the flags that say how it was allocated. */
+#define cJSON_SetType( item, t )	( (item)->type = ( (item)->type & cJSON_InArena ) | (t) )
+
 
 /* Internal constructor. */
 static cJSON *cJSON_New_Item( void )
 {
-	cJSON* node = (cJSON*) cJSON_malloc( sizeof(cJSON) );
+	cJSON* node;
+
+	if ( cJSON_arena ) {
+		if ( ( node = (cJSON*) arena_alloc( cJSON_arena, sizeof(cJSON) ) ) ) {
+			memset( node, 0, sizeof(cJSON) );
+			node->type = cJSON_InArena;
+		}
+		return node;
+	}
+	node = (cJSON*) cJSON_malloc( sizeof(cJSON) );
 	if ( node )
 		memset( node, 0, sizeof(cJSON) );
 	return node;
@@ -110,11 +271,14 @@ void cJSON_Delete( cJSON *c )
 		next = c->next;
 		if ( ! ( c->type & cJSON_IsReference ) && c->child )
 			cJSON_Delete( c->child );
-		if ( ! ( c->type & cJSON_IsReference ) && c->valuestring )
-			cJSON_free( c->valuestring );
-		if ( c->string )
-			cJSON_free( c->string );
-		cJSON_free( c );
+		if ( ! ( c->type & cJSON_InArena ) ) {
+			/* Arena items go with their arena. */
+			if ( ! ( c->type & cJSON_IsReference ) && c->valuestring )
+				cJSON_free( c->valuestring );
+			if ( c->string )
+				cJSON_free( c->string );
+			cJSON_free( c );
+		}
 		c = next;
 	}
 }
@@ -199,29 +363,366 @@ static const char *parse_number( cJSON *item, const char *num )
 		item->valuefloat = f;
 	}
 
-	item->type = cJSON_Number;
+	cJSON_SetType( item, cJSON_Number );
 	return num;
 }
 
 
-/* Render the number nicely from the given item into a string. */
-static char *print_number( cJSON *item )
+/* Output buffer for the printer.  The whole document is appended to a
+   single buffer that doubles as it fills; when printing to a file the
+   buffer is a fixed-size window that is written out as it fills. */
+typedef struct {
+	char *buf;
+	size_t len;
+	size_t size;
+	FILE *fp;
+	int fail;
+} printbuffer;
+
+#define PRINTBUFFER_CHUNK 65536
+
+static void pb_flush( printbuffer *p )
+{
+	if ( p->fp && p->len > 0 && ! p->fail ) {
+		if ( fwrite( p->buf, 1, p->len, p->fp ) != p->len )
+			p->fail = 1;
+		p->len = 0;
+	}
+}
+
+/* Make room for n more bytes and return where they go. */
+static char *pb_reserve( printbuffer *p, size_t n )
 {
-	char *str;
-	double f, f2;
-	int64_t i;
+	char *nbuf;
+	size_t nsize;
 
-	str = (char*) cJSON_malloc( 64 );
-	if ( str ) {
-		f = item->valuefloat;
-		i = f;
-		f2 = i;
-		if ( f2 == f && item->valueint >= LLONG_MIN && item->valueint <= LLONG_MAX )
-			sprintf( str, "%lld", (long long) item->valueint );
-		else
-			sprintf( str, "%g", item->valuefloat );
+	if ( p->fail )
+		return 0;
+	if ( p->len + n <= p->size )
+		return p->buf + p->len;
+	if ( p->fp ) {
+		pb_flush( p );
+		if ( p->fail )
+			return 0;
+		if ( n <= p->size )
+			return p->buf;
 	}
-	return str;
+	nsize = p->size ? p->size : 256;
+	while ( nsize < p->len + n )
+		nsize *= 2;
+	if ( cJSON_malloc == malloc && cJSON_free == free )
+		nbuf = (char*) realloc( p->buf, nsize );
+	else if ( ( nbuf = (char*) cJSON_malloc( nsize ) ) && p->buf ) {
+		memcpy( nbuf, p->buf, p->len );
+		cJSON_free( p->buf );
+	}
+	if ( ! nbuf ) {
+		p->fail = 1;
+		return 0;
+	}
+	p->buf = nbuf;
+	p->size = nsize;
+	return p->buf + p->len;
+}
+
+static void pb_append( printbuffer *p, const char *s, size_t n )
+{
+	char *out = pb_reserve( p, n );
+
+	if ( out ) {
+		memcpy( out, s, n );
+		p->len += n;
+	}
+}
+
+static void pb_putc( printbuffer *p, char c )
+{
+	char *out = pb_reserve( p, 1 );
+
+	if ( out ) {
+		*out = c;
+		++p->len;
+	}
+}
+
+
+/* Integers, without going through printf. */
+static char *format_int( char *out, int64_t v )
+{
+	char tmp[20];
+	uint64_t u;
+	int n = 0;
+
+	if ( v < 0 ) {
+		*out++ = '-';
+		u = - (uint64_t) v;
+	} else
+		u = v;
+	do {
+		tmp[n++] = '0' + u % 10;
+		u /= 10;
+	} while ( u );
+	while ( n )
+		*out++ = tmp[--n];
+	return out;
+}
+
+
+/* Doubles are printed with the Grisu2 algorithm (Florian Loitsch,
+   "Printing Floating-Point Numbers Quickly and Accurately with
+   Integers", PLDI 2010): the digits always read back as the same
+   double, and are the shortest such digits in all but a tiny fraction
+   of cases.  It needs only 64-bit integer arithmetic. */
+typedef struct {
+	uint64_t f;
+	int e;
+} diyfp;
+
+/* 10^k for k = -348, -340, ..., 340, normalized. */
+static const diyfp cached_powers[] = {
+	{ 0xfa8fd5a0081c0288ULL, -1220 }, { 0xbaaee17fa23ebf76ULL, -1193 }, { 0x8b16fb203055ac76ULL, -1166 },
+	{ 0xcf42894a5dce35eaULL, -1140 }, { 0x9a6bb0aa55653b2dULL, -1113 }, { 0xe61acf033d1a45dfULL, -1087 },
+	{ 0xab70fe17c79ac6caULL, -1060 }, { 0xff77b1fcbebcdc4fULL, -1034 }, { 0xbe5691ef416bd60cULL, -1007 },
+	{ 0x8dd01fad907ffc3cULL, -980 }, { 0xd3515c2831559a83ULL, -954 }, { 0x9d71ac8fada6c9b5ULL, -927 },
+	{ 0xea9c227723ee8bcbULL, -901 }, { 0xaecc49914078536dULL, -874 }, { 0x823c12795db6ce57ULL, -847 },
+	{ 0xc21094364dfb5637ULL, -821 }, { 0x9096ea6f3848984fULL, -794 }, { 0xd77485cb25823ac7ULL, -768 },
+	{ 0xa086cfcd97bf97f4ULL, -741 }, { 0xef340a98172aace5ULL, -715 }, { 0xb23867fb2a35b28eULL, -688 },
+	{ 0x84c8d4dfd2c63f3bULL, -661 }, { 0xc5dd44271ad3cdbaULL, -635 }, { 0x936b9fcebb25c996ULL, -608 },
+	{ 0xdbac6c247d62a584ULL, -582 }, { 0xa3ab66580d5fdaf6ULL, -555 }, { 0xf3e2f893dec3f126ULL, -529 },
+	{ 0xb5b5ada8aaff80b8ULL, -502 }, { 0x87625f056c7c4a8bULL, -475 }, { 0xc9bcff6034c13053ULL, -449 },
+	{ 0x964e858c91ba2655ULL, -422 }, { 0xdff9772470297ebdULL, -396 }, { 0xa6dfbd9fb8e5b88fULL, -369 },
+	{ 0xf8a95fcf88747d94ULL, -343 }, { 0xb94470938fa89bcfULL, -316 }, { 0x8a08f0f8bf0f156bULL, -289 },
+	{ 0xcdb02555653131b6ULL, -263 }, { 0x993fe2c6d07b7facULL, -236 }, { 0xe45c10c42a2b3b06ULL, -210 },
+	{ 0xaa242499697392d3ULL, -183 }, { 0xfd87b5f28300ca0eULL, -157 }, { 0xbce5086492111aebULL, -130 },
+	{ 0x8cbccc096f5088ccULL, -103 }, { 0xd1b71758e219652cULL, -77 }, { 0x9c40000000000000ULL, -50 },
+	{ 0xe8d4a51000000000ULL, -24 }, { 0xad78ebc5ac620000ULL, 3 }, { 0x813f3978f8940984ULL, 30 },
+	{ 0xc097ce7bc90715b3ULL, 56 }, { 0x8f7e32ce7bea5c70ULL, 83 }, { 0xd5d238a4abe98068ULL, 109 },
+	{ 0x9f4f2726179a2245ULL, 136 }, { 0xed63a231d4c4fb27ULL, 162 }, { 0xb0de65388cc8ada8ULL, 189 },
+	{ 0x83c7088e1aab65dbULL, 216 }, { 0xc45d1df942711d9aULL, 242 }, { 0x924d692ca61be758ULL, 269 },
+	{ 0xda01ee641a708deaULL, 295 }, { 0xa26da3999aef774aULL, 322 }, { 0xf209787bb47d6b85ULL, 348 },
+	{ 0xb454e4a179dd1877ULL, 375 }, { 0x865b86925b9bc5c2ULL, 402 }, { 0xc83553c5c8965d3dULL, 428 },
+	{ 0x952ab45cfa97a0b3ULL, 455 }, { 0xde469fbd99a05fe3ULL, 481 }, { 0xa59bc234db398c25ULL, 508 },
+	{ 0xf6c69a72a3989f5cULL, 534 }, { 0xb7dcbf5354e9beceULL, 561 }, { 0x88fcf317f22241e2ULL, 588 },
+	{ 0xcc20ce9bd35c78a5ULL, 614 }, { 0x98165af37b2153dfULL, 641 }, { 0xe2a0b5dc971f303aULL, 667 },
+	{ 0xa8d9d1535ce3b396ULL, 694 }, { 0xfb9b7cd9a4a7443cULL, 720 }, { 0xbb764c4ca7a44410ULL, 747 },
+	{ 0x8bab8eefb6409c1aULL, 774 }, { 0xd01fef10a657842cULL, 800 }, { 0x9b10a4e5e9913129ULL, 827 },
+	{ 0xe7109bfba19c0c9dULL, 853 }, { 0xac2820d9623bf429ULL, 880 }, { 0x80444b5e7aa7cf85ULL, 907 },
+	{ 0xbf21e44003acdd2dULL, 933 }, { 0x8e679c2f5e44ff8fULL, 960 }, { 0xd433179d9c8cb841ULL, 986 },
+	{ 0x9e19db92b4e31ba9ULL, 1013 }, { 0xeb96bf6ebadf77d9ULL, 1039 }, { 0xaf87023b9bf0ee6bULL, 1066 },
+};
+
+static const uint64_t pow10_u64[] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+	10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+	100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+	100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+	100000000000000000ULL, 1000000000000000000ULL,
+	10000000000000000000ULL
+};
+
+static diyfp diyfp_mul( diyfp x, diyfp y )
+{
+	diyfp r;
+#if defined(__SIZEOF_INT128__)
+	unsigned __int128 p = (unsigned __int128) x.f * y.f;
+
+	r.f = (uint64_t) ( p >> 64 ) + ( ( (uint64_t) p >> 63 ) & 1 );
+#else
+	const uint64_t m32 = 0xffffffffULL;
+	uint64_t a = x.f >> 32, b = x.f & m32, c = y.f >> 32, d = y.f & m32;
+	uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+	uint64_t tmp = ( bd >> 32 ) + ( ad & m32 ) + ( bc & m32 );
+
+	tmp += 1ULL << 31;	/* round */
+	r.f = ac + ( ad >> 32 ) + ( bc >> 32 ) + ( tmp >> 32 );
+#endif
+	r.e = x.e + y.e + 64;
+	return r;
+}
+
+static diyfp diyfp_normalize( diyfp x )
+{
+	while ( ! ( x.f & ( 1ULL << 63 ) ) ) {
+		x.f <<= 1;
+		x.e--;
+	}
+	return x;
+}
+
+static void grisu_round( char *buf, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w )
+{
+	while ( rest < wp_w && delta - rest >= ten_kappa &&
+		( rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w ) ) {
+		buf[len - 1]--;
+		rest += ten_kappa;
+	}
+}
+
+static void grisu_digits( diyfp w, diyfp mp, uint64_t delta, char *buf, int *len, int *k )
+{
+	diyfp one;
+	uint64_t wp_w, p2, tmp;
+	uint32_t p1;
+	int kappa, d;
+
+	one.f = 1ULL << -mp.e;
+	one.e = mp.e;
+	wp_w = mp.f - w.f;
+	p1 = (uint32_t) ( mp.f >> -one.e );
+	p2 = mp.f & ( one.f - 1 );
+	for ( kappa = 1; kappa < 10 && p1 >= pow10_u64[kappa]; ++kappa )
+		;
+	*len = 0;
+
+	while ( kappa > 0 ) {
+		d = p1 / pow10_u64[kappa - 1];
+		p1 %= pow10_u64[kappa - 1];
+		if ( d || *len )
+			buf[(*len)++] = '0' + d;
+		kappa--;
+		tmp = ( (uint64_t) p1 << -one.e ) + p2;
+		if ( tmp <= delta ) {
+			*k += kappa;
+			grisu_round( buf, *len, delta, tmp, pow10_u64[kappa] << -one.e, wp_w );
+			return;
+		}
+	}
+	for ( ;; ) {
+		p2 *= 10;
+		delta *= 10;
+		d = p2 >> -one.e;
+		if ( d || *len )
+			buf[(*len)++] = '0' + d;
+		p2 &= one.f - 1;
+		kappa--;
+		if ( p2 < delta ) {
+			*k += kappa;
+			grisu_round( buf, *len, delta, p2, one.f, -kappa < 20 ? wp_w * pow10_u64[-kappa] : 0 );
+			return;
+		}
+	}
+}
+
+/* Shortest digits of a positive, finite d: d = buf[0..len) * 10^k. */
+static void grisu2( double d, char *buf, int *len, int *k )
+{
+	diyfp v, w, mi, pl, c;
+	uint64_t bits;
+	int be, ck;
+	double dk;
+
+	memcpy( &bits, &d, sizeof(bits) );
+	be = (int) ( ( bits >> 52 ) & 0x7ff );
+	v.f = bits & 0x000fffffffffffffULL;
+	if ( be ) {
+		v.f += 1ULL << 52;
+		v.e = be - 1075;
+	} else
+		v.e = -1074;
+
+	/* The boundaries halfway to the neighbouring doubles. */
+	pl.f = ( v.f << 1 ) + 1;
+	pl.e = v.e - 1;
+	pl = diyfp_normalize( pl );
+	if ( v.f == 1ULL << 52 ) {
+		mi.f = ( v.f << 2 ) - 1;
+		mi.e = v.e - 2;
+	} else {
+		mi.f = ( v.f << 1 ) - 1;
+		mi.e = v.e - 1;
+	}
+	mi.f <<= mi.e - pl.e;
+	mi.e = pl.e;
+
+	/* Scale by a cached power of ten into a convenient range. */
+	dk = ( -61 - pl.e ) * 0.30102999566398114 + 347;
+	ck = (int) dk;
+	if ( dk - ck > 0.0 )
+		ck++;
+	ck = ( ck >> 3 ) + 1;
+	*k = -( -348 + ck * 8 );
+	c = cached_powers[ck];
+
+	w = diyfp_mul( diyfp_normalize( v ), c );
+	pl = diyfp_mul( pl, c );
+	mi = diyfp_mul( mi, c );
+	mi.f++;
+	pl.f--;
+	grisu_digits( w, pl, pl.f - mi.f, buf, len, k );
+}
+
+static char *format_exponent( char *out, int e )
+{
+	*out++ = 'e';
+	if ( e < 0 ) {
+		*out++ = '-';
+		e = -e;
+	}
+	return format_int( out, e );
+}
+
+/* Lay out digits * 10^k the way %g would, but without its precision limit. */
+static char *format_double( char *out, double d )
+{
+	char digits[20];
+	int len, k, kk, i;
+
+	if ( d < 0 ) {
+		*out++ = '-';
+		d = -d;
+	}
+	grisu2( d, digits, &len, &k );
+	kk = len + k;	/* 10^(kk-1) <= d < 10^kk */
+
+	if ( k >= 0 && kk <= 21 ) {
+		/* 1234e7 -> 12340000000 */
+		memcpy( out, digits, len );
+		out += len;
+		for ( i = len; i < kk; ++i )
+			*out++ = '0';
+	} else if ( kk > 0 && kk <= 21 ) {
+		/* 1234e-2 -> 12.34 */
+		memcpy( out, digits, kk );
+		out += kk;
+		*out++ = '.';
+		memcpy( out, digits + kk, len - kk );
+		out += len - kk;
+	} else if ( kk > -6 && kk <= 0 ) {
+		/* 1234e-6 -> 0.001234 */
+		*out++ = '0';
+		*out++ = '.';
+		for ( i = kk; i < 0; ++i )
+			*out++ = '0';
+		memcpy( out, digits, len );
+		out += len;
+	} else {
+		/* 1234e30 -> 1.234e33 */
+		*out++ = digits[0];
+		if ( len > 1 ) {
+			*out++ = '.';
+			memcpy( out, digits + 1, len - 1 );
+			out += len - 1;
+		}
+		out = format_exponent( out, kk - 1 );
+	}
+	return out;
+}
+
+
+/* Render the number nicely from the given item into the buffer. */
+static void print_number( cJSON *item, printbuffer *p )
+{
+	char *out;
+	double f = item->valuefloat;
+
+	if ( ! ( out = pb_reserve( p, 64 ) ) )
+		return;
+	if ( f >= -9223372036854775808.0 && f < 9223372036854775808.0 && f == (double) (int64_t) f )
+		p->len = format_int( out, item->valueint ) - p->buf;
+	else if ( isfinite( f ) )
+		p->len = format_double( out, f ) - p->buf;
+	else
+		p->len += snprintf( out, 64, "%g", f );
 }
 
 
@@ -247,7 +748,7 @@ static const char *parse_string( cJSON *item, const char *str )
 		if ( *ptr++ == '\\' )
 			ptr++;
 	
-	if ( ! ( out = (char*) cJSON_malloc( len + 1 ) ) )
+	if ( ! ( out = (char*) cJSON_alloc_for( item, len + 1 ) ) )
 		return 0;
 	
 	ptr = str + 1;
@@ -311,21 +812,23 @@ static const char *parse_string( cJSON *item, const char *str )
 	if ( *ptr == '\"' )
 		++ptr;
 	item->valuestring = out;
-	item->type = cJSON_String;
+	cJSON_SetType( item, cJSON_String );
 	return ptr;
 }
 
 
 /* Render the cstring provided to an escaped version that can be printed. */
-static char *print_string_ptr( const char *str )
+static void print_string_ptr( const char *str, printbuffer *p )
 {
 	const char *ptr;
-	char *ptr2, *out;
-	int len = 0;
+	char *ptr2;
+	size_t len = 0;
 	unsigned char token;
 	
-	if ( ! str )
-		return cJSON_strdup( "" );
+	if ( ! str ) {
+		pb_append( p, "\"\"", 2 );
+		return;
+	}
 	ptr = str;
 	while ( ( token = *ptr ) && ++len ) {
 		if ( strchr( "\"\\\b\f\n\r\t", token ) )
@@ -335,53 +838,57 @@ static char *print_string_ptr( const char *str )
 		++ptr;
 	}
 	
-	if ( ! ( out = (char*) cJSON_malloc( len + 3 ) ) )
-		return 0;
+	if ( ! ( ptr2 = pb_reserve( p, len + 3 ) ) )
+		return;
 
-	ptr2 = out;
-	ptr = str;
 	*ptr2++ = '\"';
-	while ( *ptr ) {
-		if ( (unsigned char) *ptr > 31 && *ptr != '\"' && *ptr != '\\' )
-			*ptr2++ = *ptr++;
-		else {
-			*ptr2++ = '\\';
-			switch ( token = *ptr++ ) {
-				case '\\': *ptr2++ = '\\'; break;
-				case '\"': *ptr2++ = '\"'; break;
-				case '\b': *ptr2++ = 'b'; break;
-				case '\f': *ptr2++ = 'f'; break;
-				case '\n': *ptr2++ = 'n'; break;
-				case '\r': *ptr2++ = 'r'; break;
-				case '\t': *ptr2++ = 't'; break;
-				default:
-				/* Escape and print. */
-				sprintf( ptr2, "u%04x", token );
-				ptr2 += 5;
-				break;
+	if ( len == (size_t) ( ptr - str ) ) {
+		/* Nothing to escape. */
+		memcpy( ptr2, str, len );
+		ptr2 += len;
+	} else {
+		ptr = str;
+		while ( *ptr ) {
+			if ( (unsigned char) *ptr > 31 && *ptr != '\"' && *ptr != '\\' )
+				*ptr2++ = *ptr++;
+			else {
+				*ptr2++ = '\\';
+				switch ( token = *ptr++ ) {
+					case '\\': *ptr2++ = '\\'; break;
+					case '\"': *ptr2++ = '\"'; break;
+					case '\b': *ptr2++ = 'b'; break;
+					case '\f': *ptr2++ = 'f'; break;
+					case '\n': *ptr2++ = 'n'; break;
+					case '\r': *ptr2++ = 'r'; break;
+					case '\t': *ptr2++ = 't'; break;
+					default:
+					/* Escape and print. */
+					sprintf( ptr2, "u%04x", token );
+					ptr2 += 5;
+					break;
+				}
 			}
 		}
 	}
 	*ptr2++ = '\"';
-	*ptr2++ = 0;
-	return out;
+	p->len = ptr2 - p->buf;
 }
 
 
 /* Invote print_string_ptr (which is useful) on an item. */
-static char *print_string( cJSON *item )
+static void print_string( cJSON *item, printbuffer *p )
 {
-	return print_string_ptr( item->valuestring );
+	print_string_ptr( item->valuestring, p );
 }
 
 
 /* Predeclare these prototypes. */
 static const char *parse_value( cJSON *item, const char *value );
-static char *print_value( cJSON *item, int depth, int fmt );
+static void print_value( cJSON *item, int depth, int fmt, printbuffer *p );
 static const char *parse_array( cJSON *item, const char *value );
-static char *print_array( cJSON *item, int depth, int fmt );
+static void print_array( cJSON *item, int depth, int fmt, printbuffer *p );
 static const char *parse_object( cJSON *item, const char *value );
-static char *print_object( cJSON *item, int depth, int fmt );
+static void print_object( cJSON *item, int depth, int fmt, printbuffer *p );
 
 /* Utility to jump whitespace and cr/lf. */
 static const char *skip( const char *in )
@@ -409,13 +916,45 @@ cJSON *cJSON_Parse( const char *value )
 
 
 /* Render a cJSON item/entity/structure to text. */
+static char *print_buffer( cJSON *item, int fmt )
+{
+	printbuffer p;
+
+	memset( &p, 0, sizeof(p) );
+	if ( ! item )
+		return 0;
+	print_value( item, 0, fmt, &p );
+	pb_putc( &p, 0 );
+	if ( p.fail ) {
+		if ( p.buf )
+			cJSON_free( p.buf );
+		return 0;
+	}
+	return p.buf;
+}
 char *cJSON_Print( cJSON *item )
 {
-	return print_value( item, 0, 1 );
+	return print_buffer( item, 1 );
 }
 char *cJSON_PrintUnformatted( cJSON *item )
 {
-	return print_value( item, 0, 0 );
+	return print_buffer( item, 0 );
+}
+int cJSON_PrintToFile( cJSON *item, FILE *fp, int fmt )
+{
+	printbuffer p;
+
+	if ( ! item )
+		return -1;
+	memset( &p, 0, sizeof(p) );
+	if ( ! ( p.buf = (char*) cJSON_malloc( PRINTBUFFER_CHUNK ) ) )
+		return -1;
+	p.size = PRINTBUFFER_CHUNK;
+	p.fp = fp;
+	print_value( item, 0, fmt, &p );
+	pb_flush( &p );
+	cJSON_free( p.buf );
+	return p.fail ? -1 : 0;
 }
 
 
@@ -425,15 +964,15 @@ static const char *parse_value( cJSON *item, const char *value )
 	if ( ! value )
 		return 0;	/* Fail on null. */
 	if ( ! strncmp( value, "null", 4 ) ) {
-		item->type = cJSON_NULL;
+		cJSON_SetType( item, cJSON_NULL );
 		return value + 4;
 	}
 	if ( ! strncmp( value, "false", 5 ) ) {
-		item->type = cJSON_False;
+		cJSON_SetType( item, cJSON_False );
 		return value + 5;
 	}
 	if ( ! strncmp( value, "true", 4 ) ) {
-		item->type = cJSON_True;
+		cJSON_SetType( item, cJSON_True );
 		item->valueint = 1;
 		return value + 4;
 	}
@@ -453,22 +992,17 @@ static const char *parse_value( cJSON *item, const char *value )
 
 
 /* Render a value to text. */
-static char *print_value( cJSON *item, int depth, int fmt )
+static void print_value( cJSON *item, int depth, int fmt, printbuffer *p )
 {
-	char *out = 0;
-
-	if ( ! item )
-		return 0;
 	switch ( ( item->type ) & 255 ) {
-		case cJSON_NULL:   out = cJSON_strdup( "null" ); break;
-		case cJSON_False:  out = cJSON_strdup( "false" ); break;
-		case cJSON_True:   out = cJSON_strdup( "true" ); break;
-		case cJSON_Number: out = print_number( item ); break;
-		case cJSON_String: out = print_string( item ); break;
-		case cJSON_Array:  out = print_array( item, depth, fmt ); break;
-		case cJSON_Object: out = print_object( item, depth, fmt ); break;
+		case cJSON_NULL:   pb_append( p, "null", 4 ); break;
+		case cJSON_False:  pb_append( p, "false", 5 ); break;
+		case cJSON_True:   pb_append( p, "true", 4 ); break;
+		case cJSON_Number: print_number( item, p ); break;
+		case cJSON_String: print_string( item, p ); break;
+		case cJSON_Array:  print_array( item, depth, fmt, p ); break;
+		case cJSON_Object: print_object( item, depth, fmt, p ); break;
 	}
-	return out;
 }
 
 
@@ -483,7 +1017,7 @@ static const char *parse_array( cJSON *item, const char *value )
 		return 0;
 	}
 
-	item->type = cJSON_Array;
+	cJSON_SetType( item, cJSON_Array );
 	value = skip( value + 1 );
 	if ( *value == ']' )
 		return value + 1;	/* empty array. */
@@ -513,70 +1047,20 @@ static const char *parse_array( cJSON *item, const char *value )
 
 
 /* Render an array to text */
-static char *print_array( cJSON *item, int depth, int fmt )
+static void print_array( cJSON *item, int depth, int fmt, printbuffer *p )
 {
-	char **entries;
-	char *out = 0, *ptr, *ret;
-	int len = 5;
-	cJSON *child = item->child;
-	int numentries = 0, i = 0, fail = 0;
-	
-	/* How many entries in the array? */
-	while ( child ) {
-		++numentries;
-		child = child->next;
-	}
-	/* Allocate an array to hold the values for each. */
-	if ( ! ( entries = (char**) cJSON_malloc( numentries * sizeof(char*) ) ) )
-		return 0;
-	memset( entries, 0, numentries * sizeof(char*) );
-	/* Retrieve all the results. */
-	child = item->child;
-	while ( child && ! fail ) {
-		ret = print_value( child, depth + 1, fmt );
-		entries[i++] = ret;
-		if ( ret )
-			len += strlen( ret ) + 2 + ( fmt ? 1 : 0 );
-		else
-			fail = 1;
-		child = child -> next;
-	}
-	
-	/* If we didn't fail, try to malloc the output string. */
-	if ( ! fail ) {
-		out = (char*) cJSON_malloc( len );
-		if ( ! out )
-			fail = 1;
-	}
+	cJSON *child;
 
-	/* Handle failure. */
-	if ( fail ) {
-		for ( i = 0; i < numentries; ++i )
-			if ( entries[i] )
-				cJSON_free( entries[i] );
-		cJSON_free( entries );
-		return 0;
-	}
-	
-	/* Compose the output array. */
-	*out = '[';
-	ptr = out + 1;
-	*ptr = 0;
-	for ( i = 0; i < numentries; ++i ) {
-		strcpy( ptr, entries[i] );
-		ptr += strlen( entries[i] );
-		if ( i != numentries - 1 ) {
-			*ptr++ = ',';
+	pb_putc( p, '[' );
+	for ( child = item->child; child && ! p->fail; child = child->next ) {
+		print_value( child, depth + 1, fmt, p );
+		if ( child->next ) {
+			pb_putc( p, ',' );
 			if ( fmt )
-				*ptr++ = ' ';
-			*ptr = 0;
+				pb_putc( p, ' ' );
 		}
-		cJSON_free( entries[i] );
 	}
-	cJSON_free( entries );
-	*ptr++ = ']';
-	*ptr++ = 0;
-	return out;	
+	pb_putc( p, ']' );
 }
 
 
@@ -591,7 +1075,7 @@ static const char *parse_object( cJSON *item, const char *value )
 		return 0;
 	}
 	
-	item->type = cJSON_Object;
+	cJSON_SetType( item, cJSON_Object );
 	value =skip( value + 1 );
 	if ( *value == '}' )
 		return value + 1;	/* empty array. */
@@ -639,98 +1123,35 @@ static const char *parse_object( cJSON *item, const char *value )
 
 
 /* Render an object to text. */
-static char *print_object( cJSON *item, int depth, int fmt )
-{
-	char **entries = 0, **names = 0;
-	char *out = 0, *ptr, *ret, *str;
-	int len = 7, i = 0, j;
-	cJSON *child = item->child;
-	int numentries = 0, fail = 0;
-
-	/* Count the number of entries. */
-	while ( child ) {
-		++numentries;
-		child = child->next;
-	}
-	/* Allocate space for the names and the objects. */
-	if ( ! ( entries = (char**) cJSON_malloc( numentries * sizeof(char*) ) ) )
-		return 0;
-	if ( ! ( names = (char**) cJSON_malloc( numentries * sizeof(char*) ) ) ) {
-		cJSON_free( entries );
-		return 0;
-	}
-	memset( entries, 0, sizeof(char*) * numentries );
-	memset( names, 0, sizeof(char*) * numentries );
+static void print_object( cJSON *item, int depth, int fmt, printbuffer *p )
+{
+	cJSON *child;
+	char *out;
+	int i;
 
-	/* Collect all the results into our arrays. */
-	child = item->child;
 	++depth;
+	pb_putc( p, '{' );
 	if ( fmt )
-		len += depth;
-	while ( child ) {
-		names[i] = str = print_string_ptr( child->string );
-		entries[i++] = ret = print_value( child, depth, fmt );
-		if ( str && ret )
-			len += strlen( ret ) + strlen( str ) + 2 + ( fmt ? 2 + depth : 0 );
-		else
-			fail = 1;
-		child = child->next;
-	}
-	
-	/* Try to allocate the output string. */
-	if ( ! fail ) {
-		out = (char*) cJSON_malloc( len );
-		if ( ! out )
-			fail = 1;
-	}
-
-	/* Handle failure. */
-	if ( fail ) {
-		for ( i = 0; i < numentries; ++i ) {
-			if ( names[i] )
-				cJSON_free( names[i] );
-			if ( entries[i] )
-				cJSON_free( entries[i] );
+		pb_putc( p, '\n' );
+	for ( child = item->child; child && ! p->fail; child = child->next ) {
+		if ( fmt && ( out = pb_reserve( p, depth ) ) ) {
+			memset( out, '\t', depth );
+			p->len += depth;
 		}
-		cJSON_free( names );
-		cJSON_free( entries );
-		return 0;
-	}
-	
-	/* Compose the output. */
-	*out = '{';
-	ptr = out + 1;
-	if ( fmt )
-		*ptr++ = '\n';
-	*ptr = 0;
-	for ( i = 0; i < numentries; ++i ) {
+		print_string_ptr( child->string, p );
+		pb_putc( p, ':' );
 		if ( fmt )
-			for ( j = 0; j < depth; ++j )
-				*ptr++ = '\t';
-		strcpy( ptr, names[i] );
-		ptr += strlen( names[i] );
-		*ptr++ = ':';
+			pb_putc( p, '\t' );
+		print_value( child, depth, fmt, p );
+		if ( child->next )
+			pb_putc( p, ',' );
 		if ( fmt )
-			*ptr++ = '\t';
-		strcpy( ptr, entries[i] );
-		ptr += strlen( entries[i] );
-		if ( i != numentries - 1 )
-			*ptr++ = ',';
-		if ( fmt )
-			*ptr++ = '\n';
-		*ptr = 0;
-		cJSON_free( names[i] );
-		cJSON_free( entries[i] );
+			pb_putc( p, '\n' );
 	}
-	
-	cJSON_free( names );
-	cJSON_free( entries );
 	if ( fmt )
 		for ( i = 0; i < depth - 1; ++i )
-			*ptr++ = '\t';
-	*ptr++ = '}';
-	*ptr++ = 0;
-	return out;	
+			pb_putc( p, '\t' );
+	pb_putc( p, '}' );
 }
 
 
@@ -778,11 +1199,13 @@ static void suffix_object( cJSON *prev, cJSON *item )
 static cJSON *create_reference( cJSON *item )
 {
 	cJSON *ref;
+	int inarena;
 	if ( ! ( ref = cJSON_New_Item() ) )
 		return 0;
+	inarena = ref->type & cJSON_InArena;
 	memcpy( ref, item, sizeof(cJSON) );
 	ref->string = 0;
-	ref->type |= cJSON_IsReference;
+	ref->type = ( item->type & ~cJSON_InArena ) | inarena | cJSON_IsReference;
 	ref->next = ref->prev = 0;
 	return ref;
 }
@@ -807,9 +1230,9 @@ void cJSON_AddItemToObject( cJSON *object, const char *string, cJSON *item )
 {
 	if ( ! item )
 		return;
-	if ( item->string )
+	if ( item->string && ! ( item->type & cJSON_InArena ) )
 		cJSON_free( item->string );
-	item->string = cJSON_strdup( string );
+	item->string = cJSON_keydup( item, string );
 	cJSON_AddItemToArray( object, item );
 }
 
@@ -895,7 +1318,7 @@ void cJSON_ReplaceItemInObject( cJSON *object, const char *string, cJSON *newite
 		c = c->next;
 	}
 	if ( c ) {
-		newitem->string = cJSON_strdup( string );
+		newitem->string = cJSON_keydup( newitem, string );
 		cJSON_ReplaceItemInArray( object, i, newitem );
 	}
 }
@@ -907,7 +1330,7 @@ cJSON *cJSON_CreateNull( void )
 {
 	cJSON *item = cJSON_New_Item();
 	if ( item )
-		item->type = cJSON_NULL;
+		cJSON_SetType( item, cJSON_NULL );
 	return item;
 }
 
@@ -915,7 +1338,7 @@ cJSON *cJSON_CreateTrue( void )
 {
 	cJSON *item = cJSON_New_Item();
 	if ( item )
-		item->type = cJSON_True;
+		cJSON_SetType( item, cJSON_True );
 	return item;
 }
 
@@ -923,7 +1346,7 @@ cJSON *cJSON_CreateFalse( void )
 {
 	cJSON *item = cJSON_New_Item();
 	if ( item )
-		item->type = cJSON_False;
+		cJSON_SetType( item, cJSON_False );
 	return item;
 }
 
@@ -931,7 +1354,7 @@ cJSON *cJSON_CreateBool( int b )
 {
 	cJSON *item = cJSON_New_Item();
 	if ( item )
-		item->type = b ? cJSON_True : cJSON_False;
+		cJSON_SetType( item, b ? cJSON_True : cJSON_False );
 	return item;
 }
 
@@ -939,7 +1362,7 @@ cJSON *cJSON_CreateInt( int64_t num )
 {
 	cJSON *item = cJSON_New_Item();
 	if ( item ) {
-		item->type = cJSON_Number;
+		cJSON_SetType( item, cJSON_Number );
 		item->valuefloat = num;
 		item->valueint = num;
 	}
@@ -950,7 +1373,7 @@ cJSON *cJSON_CreateFloat( double num )
 {
 	cJSON *item = cJSON_New_Item();
 	if ( item ) {
-		item->type = cJSON_Number;
+		cJSON_SetType( item, cJSON_Number );
 		item->valuefloat = num;
 		item->valueint = num;
 	}
@@ -961,8 +1384,8 @@ cJSON *cJSON_CreateString( const char *string )
 {
 	cJSON *item = cJSON_New_Item();
 	if ( item ) {
-		item->type = cJSON_String;
-		item->valuestring = cJSON_strdup( string );
+		cJSON_SetType( item, cJSON_String );
+		item->valuestring = cJSON_strdup( item, string );
 	}
 	return item;
 }
@@ -971,7 +1394,7 @@ cJSON *cJSON_CreateArray( void )
 {
 	cJSON *item = cJSON_New_Item();
 	if ( item )
-		item->type = cJSON_Array;
+		cJSON_SetType( item, cJSON_Array );
 	return item;
 }
 
@@ -979,7 +1402,7 @@ cJSON *cJSON_CreateObject( void )
 {
 	cJSON *item = cJSON_New_Item();
 	if ( item )
-		item->type = cJSON_Object;
+		cJSON_SetType( item, cJSON_Object );
 	return item;
 }
 
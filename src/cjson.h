@@ -23,6 +23,8 @@
 #ifndef cJSON__h
 #define cJSON__h
 
+#include <stdio.h>
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -38,6 +40,7 @@ extern "C"
 #define cJSON_Object 6
 	
 #define cJSON_IsReference 256
+#define cJSON_InArena 512
 
 /* The cJSON structure: */
 typedef struct cJSON {
@@ -62,12 +65,22 @@ typedef struct cJSON_Hooks {
 extern void cJSON_InitHooks( cJSON_Hooks* hooks );
 
 
+/* Arenas: while an arena is current in a thread, the items created there (and their strings) are allocated from it in large slabs, and object keys are shared.  cJSON_Delete() skips such items; cJSON_DeleteArena() frees them all at once.  Add arena items to objects while their arena is current. */
+typedef struct cJSON_Arena cJSON_Arena;
+extern cJSON_Arena *cJSON_NewArena( void );
+/* Make arena current for this thread (NULL for none); returns the previous one. */
+extern cJSON_Arena *cJSON_SetArena( cJSON_Arena *arena );
+extern void cJSON_DeleteArena( cJSON_Arena *arena );
+
+
 /* Supply a block of JSON, and this returns a cJSON object you can interrogate. Call cJSON_Delete when finished. */
 extern cJSON *cJSON_Parse( const char *value );
 /* Render a cJSON entity to text for transfer/storage. Free the char* when finished. */
 extern char *cJSON_Print( cJSON *item );
 /* Render a cJSON entity to text for transfer/storage without any formatting. Free the char* when finished. */
 extern char *cJSON_PrintUnformatted( cJSON *item );
+/* Render a cJSON entity straight to fp, formatted if fmt is set, without building the text in memory. Returns 0, or -1 on error. */
+extern int cJSON_PrintToFile( cJSON *item, FILE *fp, int fmt );
 /* Delete a cJSON entity and all subentities. */
 extern void cJSON_Delete( cJSON *c );
 
@@ -15,6 +15,7 @@
 #include <stdint.h>
 #include <sys/socket.h>
 #include <netinet/tcp.h>
+#include <netdb.h>
 
 #if defined(__FreeBSD__)
 #include <sys/param.h>
@@ -24,6 +25,9 @@
 #include "timer.h"
 #include "queue.h"
 #include "cjson.h"
+#include "payload.h"
+#include "net.h"
+#include "perf_counters.h"
 
 typedef uint64_t iperf_size_t;
 
@@ -43,6 +47,18 @@ struct iperf_interval_results
     int       outoforder_packets;
     int       cnt_error;
 
+    /* for --verify, on the receiving side */
+    iperf_size_t interval_bytes_corrupted;
+    int       interval_blocks_misordered;
+
+    /* for -F, on the receiving side */
+    iperf_size_t interval_disk_bytes;
+    double    interval_disk_time;
+    size_t    disk_queued;	/* write-behind bytes not yet written */
+
+    /* system calls made for this stream in this interval, for -V */
+    struct net_counters interval_net;
+
     int omitted;
 #if defined(linux) || defined(__FreeBSD__)
     struct tcp_info tcpInfo;	/* getsockopt(TCP_INFO) for Linux and FreeBSD */
@@ -57,6 +73,16 @@ struct iperf_interval_results
     void     *custom_data;
 };
 
+struct iperf_interval_stats;
+
+/* Main loop activity while the test runs, for -V. */
+struct loop_counters
+{
+    uint64_t  wakeups;		/* select() returns */
+    uint64_t  idle_wakeups;	/* ... that moved no data and ran no timers */
+    uint64_t  timer_runs;
+};
+
 struct iperf_stream_result
 {
     iperf_size_t bytes_received;
@@ -70,10 +96,16 @@ struct iperf_stream_result
     struct timeval start_time;
     struct timeval end_time;
     TAILQ_HEAD(irlisthead, iperf_interval_results) interval_results;
+    struct iperf_interval_stats *remote_intervals;	/* the peer's series, if it sent one */
+    int       remote_interval_count;
+    int       remote_interval_size;
+    int       remote_interval_printed;
+    double    interval_printed_end;	/* end of the last local interval shown */
     void     *data;
 };
 
 #define COOKIE_SIZE 37		/* size of an ascii uuid */
+#define MAX_MPTCP_ENDPOINTS 8	/* --mptcp-endpoint addresses */
 struct iperf_settings
 {
     int       domain;               /* AF_INET or AF_INET6 */
@@ -111,7 +143,22 @@ struct iperf_stream
     int       green_light;
     int       buffer_fd;	/* data to send, file descriptor */
     char      *buffer;		/* data to send, mmapped */
+    size_t    buffer_len;	/* length mapped, 0 if the buffer is shared */
     int       diskfile_fd;	/* file to send, file descriptor */
+    off_t     diskfile_start;	/* this stream's slice of the file to send */
+    off_t     diskfile_end;
+    off_t     diskfile_offset;	/* next byte of the file to send */
+    int       diskfile_eof;
+    iperf_size_t diskfile_read_bytes;
+    double    diskfile_read_time;	/* seconds spent reading the file */
+    char      *diskfile_wb;	/* write-behind buffer for the received file */
+    size_t    diskfile_wb_len;
+    int       diskfile_pipe[2];	/* --file-write splice */
+    iperf_size_t diskfile_written;
+    double    diskfile_write_time;	/* seconds spent writing and syncing */
+    iperf_size_t diskfile_written_mark;	/* as of the last interval */
+    double    diskfile_write_time_mark;
+    int       diskfile_syncs;
 
     /*
      * for udp measurements - This can be a structure outside stream, and
@@ -125,6 +172,19 @@ struct iperf_stream
     int       cnt_error;
     uint64_t  target;
 
+    /* payload verification (--verify); totals as of the last interval in verify_mark */
+    struct payload_check verify;
+    struct payload_check verify_mark;
+
+    /* data-path system calls; totals as of the last interval in net_mark */
+    struct net_counters net;
+    struct net_counters net_mark;
+
+    struct iperf_shm *shm;	/* --shm ring, mapped at TEST_START */
+    struct iperf_mptcp *mptcp;	/* --mptcp subflows, as of the last sample */
+    struct iperf_sctp *sctp;	/* --sctp association, as of the last sample */
+    struct iperf_tls *tls;	/* --ktls directions done in user space */
+
     struct sockaddr_storage local_addr;
     struct sockaddr_storage remote_addr;
 
@@ -162,6 +222,7 @@ struct iperf_test
     signed char state;
     char     *server_hostname;                  /* -c option */
     char     *bind_address;                     /* -B option */
+    char     *unix_path;                        /* --unix server's -B, kept across tests */
     int       server_port;
     int       omit;                             /* duration of omit period (-O flag) */
     int       duration;                         /* total duration of test (-t flag) */
@@ -175,16 +236,42 @@ struct iperf_test
     char     *pidfile;				/* -P option */
 
     int       ctrl_sck;
+    int       ctrl_binary;			/* peer takes results in tlv.h form */
+    int       ctrl_live;			/* push each interval to the client */
+    char     *ctrl_out;				/* pushed bytes not yet sent */
+    size_t    ctrl_out_len;
+    size_t    ctrl_out_size;
+    char     *ctrl_in;				/* a push being received */
+    size_t    ctrl_in_len;
+    size_t    ctrl_in_size;
+    int       ctrl_in_pending;
     int       listener;
     int       prot_listener;
 
     /* boolean variables for Options */
     int       daemon;                           /* -D option */
     int       no_delay;                         /* -N option */
+    int       fast_open;                        /* --fast-open option */
+    int       ktls;                             /* --ktls option - kernel TLS on the streams */
+    int       mptcp;                            /* --mptcp option - Multipath TCP streams */
+    char     *mptcp_endpoint[MAX_MPTCP_ENDPOINTS]; /* --mptcp-endpoint addresses */
+    int       mptcp_endpoints;
+    unsigned  mptcp_endpoints_added;            /* bit i: mptcp_endpoint[i] was added by us */
+    int       sctp_streams;                     /* --sctp-streams option - stream ids per association */
+    int       sctp_unordered;                   /* --sctp-unordered option */
+    int       sctp_pr_ttl;                      /* --sctp-pr option - PR-SCTP lifetime, msecs */
+    char     *sctp_bindx;                       /* --sctp-bindx option - more local addresses */
     int       reverse;                          /* -R option */
     int	      verbose;                          /* -V option - verbose mode */
     int	      json_output;                      /* -J option - JSON output */
     int	      zerocopy;                         /* -Z option - use sendfile */
+    int       verify;                           /* --verify option - check received payload */
+    int       null_send;                        /* --null option - senders discard every block */
+    int       payload_type;                     /* --payload content class, PAYLOAD_* */
+    int       payload_compress;                 /* --payload random:N - percent compressible */
+    int       shared_buffer;                    /* --shared-buffer option - one buffer for all streams */
+    int       diskfile_sync;                    /* --file-sync option, DISKFILE_SYNC_* */
+    int       diskfile_write;                   /* --file-write option, DISKFILE_WRITE_* */
     int       debug;				/* -d option - enable debug */
 
     int	      multisend;
@@ -209,12 +296,38 @@ struct iperf_test
 
     double cpu_util[3];                            /* cpu utilization of the test - total, user, system */
     double remote_cpu_util[3];                     /* cpu utilization for the remote host/client - total, user, system */
+    double cpu_mark[2];                            /* user and system CPU seconds at the last interval */
+    double interval_cpu[2];                        /* ... used during the last interval */
+    iperf_size_t interval_bytes;                   /* bytes all streams moved in the last interval */
+    double cpu_seconds;                            /* CPU seconds over the intervals not omitted */
+    iperf_size_t cpu_bytes;                        /* ... and the bytes moved in them */
+    double remote_cpu_per_gb;                      /* the peer's CPU seconds per GB, -1 if unknown */
+    int    perf_events;                            /* --perf-counters */
+    struct perf_counters perf;
 
     int       num_streams;                      /* total streams in the test (-P) */
+    struct addrinfo *server_res;                /* stream endpoint, resolved once per test */
+    struct addrinfo *local_res;                 /* -B address, resolved once per test */
+    struct timeval stream_setup_start;          /* when stream establishment began */
+    double    stream_setup_time;                /* seconds taken to establish all streams */
+    int       fast_open_streams;                /* streams whose cookie rode in the SYN */
+    int       ktls_kernel_streams;              /* --ktls streams whose data the kernel's TLS carries */
 
     iperf_size_t bytes_sent;
     int       blocks_sent;
+    struct loop_counters loop;                  /* totals so far */
+    struct loop_counters loop_mark;             /* ... as of the previous interval */
+    struct loop_counters loop_interval;         /* the difference, for the last interval */
     char      cookie[COOKIE_SIZE];
+    char     *verify_template;                  /* expected payload for --verify */
+    char     *buffers;                          /* stream buffers, one mapping for the test */
+    int       buffers_fd;                       /* -Z: the file behind it */
+    size_t    buffers_len;
+    size_t    buffers_used;                     /* ... handed out to streams so far */
+    iperf_size_t buffer_bytes;                  /* memory mapped for stream buffers */
+    iperf_size_t buffer_hugetlb_bytes;          /* ... of which on hugetlb pages */
+    iperf_size_t buffer_thp_bytes;              /* ... of which advised for THP */
+    int       buffer_count;
 //    struct iperf_stream *streams;               /* pointer to list of struct stream */
     SLIST_HEAD(slisthead, iperf_stream) streams;
     struct iperf_settings *settings;
@@ -226,16 +339,22 @@ struct iperf_test
     void      (*on_test_start)(struct iperf_test *);
     void      (*on_connect)(struct iperf_test *);
     void      (*on_test_finish)(struct iperf_test *);
+    int       (*interval_callback)(struct iperf_test *, const struct iperf_interval_stats *, int, const struct iperf_interval_stats *, void *);
+    void     *interval_callback_arg;
+    struct iperf_interval_stats *interval_stats;	/* per-stream, reused each interval */
+    int       interval_stats_len;
 
     /* cJSON handles for use when in -J mode */\
     cJSON *json_top;
     cJSON *json_start;
     cJSON *json_intervals;
     cJSON *json_end;
+    cJSON_Arena *json_arena;	/* holds the tree above, freed in one go */
 };
 
 /* default settings */
 #define PORT 5201  /* default port to listen on (don't use the same port as iperf2) */
+#define UNIX_PATH "/tmp/iperf3-%d.sock"	/* default --unix server path, for the port */
 #define uS_TO_NS 1000
 #define SEC_TO_US 1000000LL
 #define UDP_RATE (1024 * 1024) /* 1 Mbps */
@@ -256,4 +375,8 @@ struct iperf_test
 #define MAX_MSS (9 * 1024)
 #define MAX_STREAMS 128
 
+/* -F receive path */
+#define DISKFILE_WB_SIZE (2 * MB)	/* write-behind buffer per stream */
+#define DISKFILE_ALIGN 4096		/* O_DIRECT buffer and length alignment */
+
 #endif /* !__IPERF_H */
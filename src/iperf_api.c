@@ -46,6 +46,9 @@
 #include "iperf_udp.h"
 #include "iperf_tcp.h"
 #include "iperf_sctp.h"
+#include "iperf_unix.h"
+#include "iperf_shm.h"
+#include "iperf_mptcp.h"
 #include "timer.h"
 
 #include "cjson.h"
@@ -53,6 +56,8 @@
 #include "tcp_window_size.h"
 #include "iperf_util.h"
 #include "locale.h"
+#include "tlv.h"
+#include "probes.h"
 
 
 /* Forwards. */
@@ -61,8 +66,29 @@ static int get_parameters(struct iperf_test *test);
 static int send_results(struct iperf_test *test);
 static int get_results(struct iperf_test *test);
 static int diskfile_send(struct iperf_stream *sp);
+static int diskfile_sendfile(struct iperf_stream *sp);
+static int diskfile_range(struct iperf_stream *sp);
+static int diskfile_open_recv(struct iperf_stream *sp);
+static void diskfile_close_recv(struct iperf_stream *sp);
+static void diskfile_interval(struct iperf_stream *sp, int final);
+#if defined(linux) && defined(SPLICE_F_MOVE)
+static int diskfile_splice(struct iperf_stream *sp);
+#endif
+static int verify_send(struct iperf_stream *sp);
+static int verify_recv(struct iperf_stream *sp);
+static int null_send(struct iperf_stream *sp);
+static void iperf_free_buffers(struct iperf_test *test);
 static int diskfile_recv(struct iperf_stream *sp);
 static int JSON_write(int fd, cJSON *json);
+static int iperf_interval_stats(struct iperf_test *test);
+static void interval_stats_fill(struct iperf_test *test, struct iperf_stream *sp, struct iperf_interval_results *irp, struct iperf_interval_stats *is);
+static char *ctrl_read(int fd, size_t *len);
+static int ctrl_write(int fd, const char *msg, size_t len);
+static int send_results_tlv(struct iperf_test *test);
+static int get_results_tlv(struct iperf_test *test, const char *msg, size_t len);
+static void print_remote_intervals(struct iperf_test *test);
+static void print_remote_interval_lines(struct iperf_test *test, int all);
+static void push_interval(struct iperf_test *test);
 static void print_interval_results(struct iperf_test *test, struct iperf_stream *sp, cJSON *json_interval_streams);
 static cJSON *JSON_read(int fd);
 
@@ -319,6 +345,19 @@ iperf_set_test_server_hostname(struct iperf_test *ipt, char *server_hostname)
     ipt->server_hostname = strdup(server_hostname);
 }
 
+void
+iperf_set_test_bind_address(struct iperf_test *ipt, char *bind_address)
+{
+    ipt->bind_address = strdup(bind_address);
+}
+
+void
+iperf_set_test_unix(struct iperf_test *ipt, int seqpacket)
+{
+    ipt->settings->domain = AF_UNIX;
+    set_protocol(ipt, seqpacket ? Punixseq : Punix);
+}
+
 void
 iperf_set_test_reverse(struct iperf_test *ipt, int reverse)
 {
@@ -346,12 +385,25 @@ iperf_set_test_zerocopy(struct iperf_test *ipt, int zerocopy)
     ipt->zerocopy = zerocopy;
 }
 
+void
+iperf_set_test_null(struct iperf_test *ipt, int null_send)
+{
+    ipt->null_send = null_send;
+}
+
 void
 iperf_set_test_may_use_sigalrm(struct iperf_test *ipt, int may_use_sigalrm)
 {
     ipt->may_use_sigalrm = may_use_sigalrm;
 }
 
+void
+iperf_set_test_interval_callback(struct iperf_test *ipt, iperf_interval_callback callback, void *arg)
+{
+    ipt->interval_callback = callback;
+    ipt->interval_callback_arg = arg;
+}
+
 void
 iperf_set_test_unit_format(struct iperf_test *ipt, char unit_format)
 {
@@ -402,13 +454,48 @@ iperf_on_new_stream(struct iperf_stream *sp)
     connect_msg(sp);
 }
 
+/* How many of the --mptcp-endpoint addresses the test added itself. */
+static int
+mptcp_endpoints_added(struct iperf_test *test)
+{
+    int i, n = 0;
+
+    for (i = 0; i < test->mptcp_endpoints; ++i)
+	if (test->mptcp_endpoints_added & (1u << i))
+	    ++n;
+    return n;
+}
+
 void
 iperf_on_test_start(struct iperf_test *test)
 {
+    char mbuf[UNIT_LEN], hbuf[UNIT_LEN], tbuf[UNIT_LEN];
+    cJSON_Arena *prev;
+
     if (test->json_output) {
-	cJSON_AddItemToObject(test->json_start, "test_start", iperf_json_printf("protocol: %s  num_streams: %d  blksize: %d  omit: %d  duration: %d  bytes: %d  blocks: %d", test->protocol->name, (int64_t) test->num_streams, (int64_t) test->settings->blksize, (int64_t) test->omit, (int64_t) test->duration, (int64_t) test->settings->bytes, (int64_t) test->settings->blocks));
+	prev = cJSON_SetArena(test->json_arena);
+	if (test->ktls)
+	    cJSON_AddItemToObject(test->json_start, "ktls", iperf_json_printf("version: %s  cipher: %s  kernel_streams: %d", "TLS 1.3", "AES-128-GCM", (int64_t) test->ktls_kernel_streams));
+	if (test->mptcp)
+	    cJSON_AddItemToObject(test->json_start, "mptcp", iperf_json_printf("endpoints: %d  endpoints_added: %d", (int64_t) test->mptcp_endpoints, (int64_t) mptcp_endpoints_added(test)));
+	cJSON_AddItemToObject(test->json_start, "test_start", iperf_json_printf("protocol: %s  num_streams: %d  blksize: %d  omit: %d  duration: %d  bytes: %d  blocks: %d  stream_setup_time: %f  fast_open_streams: %d  buffer_bytes: %d  buffer_hugetlb_bytes: %d  buffer_thp_bytes: %d", test->protocol->name, (int64_t) test->num_streams, (int64_t) test->settings->blksize, (int64_t) test->omit, (int64_t) test->duration, (int64_t) test->settings->bytes, (int64_t) test->settings->blocks, test->stream_setup_time, (int64_t) test->fast_open_streams, (int64_t) test->buffer_bytes, (int64_t) test->buffer_hugetlb_bytes, (int64_t) test->buffer_thp_bytes));
+	cJSON_SetArena(prev);
     } else {
 	if (test->verbose) {
+	    iprintf(test, report_stream_setup, test->num_streams, test->stream_setup_time * 1000.0);
+	    if (test->fast_open)
+		iprintf(test, report_fast_open, test->fast_open_streams, test->num_streams);
+	    if (test->ktls)
+		iprintf(test, report_ktls, "TLS 1.3", "AES-128-GCM", test->ktls_kernel_streams, test->num_streams);
+	    if (test->mptcp) {
+		iprintf(test, "%s", report_mptcp);
+		if (test->mptcp_endpoints)
+		    iprintf(test, report_mptcp_endpoints, mptcp_endpoints_added(test), test->mptcp_endpoints);
+	    }
+	    unit_snprintf(mbuf, UNIT_LEN, (double) test->buffer_bytes, 'A');
+	    unit_snprintf(hbuf, UNIT_LEN, (double) test->buffer_hugetlb_bytes, 'A');
+	    unit_snprintf(tbuf, UNIT_LEN, (double) test->buffer_thp_bytes, 'A');
+	    iprintf(test, report_buffers, mbuf, test->buffer_count, hbuf, tbuf);
 	    if (test->settings->bytes)
 		iprintf(test, test_start_bytes, test->protocol->name, test->num_streams, test->settings->blksize, test->omit, test->settings->bytes);
 	    else if (test->settings->blocks)
@@ -443,29 +530,45 @@ iperf_on_connect(struct iperf_test *test)
     time_t now_secs;
     const char* rfc1123_fmt = "%a, %d %b %Y %H:%M:%S GMT";
     char now_str[100];
+    struct tm now_tm;
     char ipr[INET6_ADDRSTRLEN];
+    char path[UNIX_PATH_LEN];
     int port;
     struct sockaddr_storage sa;
     struct sockaddr_in *sa_inP;
     struct sockaddr_in6 *sa_in6P;
     socklen_t len;
     int opt;
+    cJSON_Arena *prev;
 
+    prev = cJSON_SetArena(test->json_arena);
     now_secs = time((time_t*) 0);
-    (void) strftime(now_str, sizeof(now_str), rfc1123_fmt, gmtime(&now_secs));
+    (void) strftime(now_str, sizeof(now_str), rfc1123_fmt, gmtime_r(&now_secs, &now_tm));
     if (test->json_output)
 	cJSON_AddItemToObject(test->json_start, "timestamp", iperf_json_printf("time: %s  timesecs: %d", now_str, (int64_t) now_secs));
     else if (test->verbose)
 	iprintf(test, report_time, now_str);
 
     if (test->role == 'c') {
-	if (test->json_output)
-	    cJSON_AddItemToObject(test->json_start, "connecting_to", iperf_json_printf("host: %s  port: %d", test->server_hostname, (int64_t) test->server_port));
-	else {
-	    iprintf(test, report_connecting, test->server_hostname, test->server_port);
+	if (test->json_output) {
+	    if (test->settings->domain == AF_UNIX)
+		cJSON_AddItemToObject(test->json_start, "connecting_to", iperf_json_printf("path: %s", test->server_hostname));
+	    else
+		cJSON_AddItemToObject(test->json_start, "connecting_to", iperf_json_printf("host: %s  port: %d", test->server_hostname, (int64_t) test->server_port));
+	} else {
+	    if (test->settings->domain == AF_UNIX)
+		iprintf(test, report_connecting_unix, test->server_hostname);
+	    else
+		iprintf(test, report_connecting, test->server_hostname, test->server_port);
 	    if (test->reverse)
 		iprintf(test, report_reverse, test->server_hostname);
 	}
+    } else if (test->settings->domain == AF_UNIX) {
+	iperf_unix_path(test, 0, path, sizeof(path));
+	if (test->json_output)
+	    cJSON_AddItemToObject(test->json_start, "accepted_connection", iperf_json_printf("path: %s", path));
+	else
+	    iprintf(test, report_accepted_unix, path);
     } else {
         len = sizeof(sa);
         getpeername(test->ctrl_sck, (struct sockaddr *) &sa, &len);
@@ -508,6 +611,7 @@ iperf_on_connect(struct iperf_test *test)
         }
 
     }
+    cJSON_SetArena(prev);
 }
 
 void
@@ -560,6 +664,28 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
 #endif
 #if defined(linux) || defined(__FreeBSD__)
         {"sctp", no_argument, NULL, OPT_SCTP},
+#endif
+#if defined(linux) && defined(MSG_FASTOPEN)
+        {"fast-open", no_argument, NULL, OPT_FAST_OPEN},
+#endif
+        {"verify", no_argument, NULL, OPT_VERIFY},
+        {"payload", required_argument, NULL, OPT_PAYLOAD},
+        {"shared-buffer", no_argument, NULL, OPT_SHARED_BUFFER},
+        {"file-sync", required_argument, NULL, OPT_FILE_SYNC},
+        {"file-write", required_argument, NULL, OPT_FILE_WRITE},
+        {"perf-counters", no_argument, NULL, OPT_PERF_COUNTERS},
+        {"unix", no_argument, NULL, OPT_UNIX},
+        {"unix-seqpacket", no_argument, NULL, OPT_UNIX_SEQPACKET},
+        {"shm", no_argument, NULL, OPT_SHM},
+        {"null", no_argument, NULL, OPT_NULL},
+        {"ktls", no_argument, NULL, OPT_KTLS},
+        {"mptcp", no_argument, NULL, OPT_MPTCP},
+        {"mptcp-endpoint", required_argument, NULL, OPT_MPTCP_ENDPOINT},
+#if defined(linux) || defined(__FreeBSD__)
+        {"sctp-streams", required_argument, NULL, OPT_SCTP_STREAMS},
+        {"sctp-unordered", no_argument, NULL, OPT_SCTP_UNORDERED},
+        {"sctp-pr", required_argument, NULL, OPT_SCTP_PR},
+        {"sctp-bindx", required_argument, NULL, OPT_SCTP_BINDX},
 #endif
 	{"pidfile", required_argument, NULL, 'I'},
         {"debug", no_argument, NULL, 'd'},
@@ -634,6 +760,176 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
                 return -1;
 #endif /* linux */
             break;
+            case OPT_UNIX:
+                iperf_set_test_unix(test, 0);
+                break;
+            case OPT_UNIX_SEQPACKET:
+                iperf_set_test_unix(test, 1);
+                client_flag = 1;
+                break;
+            case OPT_SHM:
+                iperf_set_test_unix(test, 0);
+                set_protocol(test, Pshm);
+                client_flag = 1;
+                break;
+            case OPT_VERIFY:
+                test->verify = 1;
+                client_flag = 1;
+                break;
+            case OPT_NULL:
+                test->null_send = 1;
+                client_flag = 1;
+                break;
+            case OPT_FILE_SYNC:
+                if (strcmp(optarg, "none") == 0)
+                    test->diskfile_sync = DISKFILE_SYNC_NONE;
+                else if (strcmp(optarg, "interval") == 0)
+                    test->diskfile_sync = DISKFILE_SYNC_INTERVAL;
+                else if (strcmp(optarg, "end") == 0)
+                    test->diskfile_sync = DISKFILE_SYNC_END;
+                else {
+                    i_errno = IEFILESYNC;
+                    return -1;
+                }
+                break;
+            case OPT_FILE_WRITE:
+                if (strcmp(optarg, "buffered") == 0)
+                    test->diskfile_write = DISKFILE_WRITE_BUFFERED;
+#ifdef O_DIRECT
+                else if (strcmp(optarg, "direct") == 0)
+                    test->diskfile_write = DISKFILE_WRITE_DIRECT;
+#endif
+#if defined(linux) && defined(SPLICE_F_MOVE)
+                else if (strcmp(optarg, "splice") == 0)
+                    test->diskfile_write = DISKFILE_WRITE_SPLICE;
+#endif
+                else {
+                    i_errno = IEFILEWRITE;
+                    return -1;
+                }
+                break;
+            case OPT_PERF_COUNTERS:
+                if (!has_perf_counters()) {
+                    i_errno = IEUNIMP;
+                    return -1;
+                }
+                test->perf_events = 1;
+                break;
+            case OPT_SHARED_BUFFER:
+                test->shared_buffer = 1;
+                client_flag = 1;
+                break;
+            case OPT_PAYLOAD:
+                slash = strchr(optarg, ':');
+                if (slash) {
+                    *slash = '\0';
+                    ++slash;
+                    test->payload_compress = atoi(slash);
+                    if (test->payload_compress < 0 || test->payload_compress > 100) {
+                        i_errno = IEPAYLOAD;
+                        return -1;
+                    }
+                }
+                if (strcmp(optarg, "random") == 0)
+                    test->payload_type = PAYLOAD_RANDOM;
+                else if (strcmp(optarg, "zeros") == 0 && !slash)
+                    test->payload_type = PAYLOAD_ZEROS;
+                else if (strcmp(optarg, "pattern") == 0 && !slash)
+                    test->payload_type = PAYLOAD_PATTERN;
+                else {
+                    i_errno = IEPAYLOAD;
+                    return -1;
+                }
+                client_flag = 1;
+                break;
+            case OPT_FAST_OPEN:
+#if defined(linux) && defined(MSG_FASTOPEN)
+                test->fast_open = 1;
+                client_flag = 1;
+#else /* linux */
+                i_errno = IEUNIMP;
+                return -1;
+#endif /* linux */
+            break;
+            case OPT_KTLS:
+                test->ktls = 1;
+                client_flag = 1;
+                break;
+            case OPT_MPTCP:
+            case OPT_MPTCP_ENDPOINT:
+                if (!has_mptcp()) {
+                    i_errno = IEUNIMP;
+                    return -1;
+                }
+                if (flag == OPT_MPTCP_ENDPOINT) {
+                    struct in6_addr a;
+
+                    if (test->mptcp_endpoints == MAX_MPTCP_ENDPOINTS ||
+                        (inet_pton(AF_INET, optarg, &a) != 1 && inet_pton(AF_INET6, optarg, &a) != 1)) {
+                        i_errno = IEMPTCPENDPOINT;
+                        return -1;
+                    }
+                    test->mptcp_endpoint[test->mptcp_endpoints++] = strdup(optarg);
+                }
+                test->mptcp = 1;
+                client_flag = 1;
+                break;
+            case OPT_SCTP_STREAMS:
+            case OPT_SCTP_UNORDERED:
+                if (!has_sctp_streams()) {
+                    i_errno = IEUNIMP;
+                    return -1;
+                }
+                if (flag == OPT_SCTP_UNORDERED)
+                    test->sctp_unordered = 1;
+                else {
+                    test->sctp_streams = atoi(optarg);
+                    if (test->sctp_streams < 1 || test->sctp_streams > MAX_SCTP_STREAMS) {
+                        i_errno = IESCTP;
+                        return -1;
+                    }
+                }
+                client_flag = 1;
+                break;
+            case OPT_SCTP_PR:
+                if (!has_sctp_pr()) {
+                    i_errno = IEUNIMP;
+                    return -1;
+                }
+                test->sctp_pr_ttl = atoi(optarg);
+                if (test->sctp_pr_ttl < 1) {
+                    i_errno = IESCTP;
+                    return -1;
+                }
+                client_flag = 1;
+                break;
+            case OPT_SCTP_BINDX: {
+                char *list, *addr, *save;
+                struct in6_addr a;
+                int n = 0;
+
+                if (!has_sctp_bindx()) {
+                    i_errno = IEUNIMP;
+                    return -1;
+                }
+                list = strdup(optarg);
+                for (addr = strtok_r(list, ",", &save); addr != NULL; addr = strtok_r(NULL, ",", &save)) {
+                    if (++n > SCTP_MAX_PATHS ||
+                        (inet_pton(AF_INET, addr, &a) != 1 && inet_pton(AF_INET6, addr, &a) != 1)) {
+                        free(list);
+                        i_errno = IESCTP;
+                        return -1;
+                    }
+                }
+                free(list);
+                if (n == 0) {
+                    i_errno = IESCTP;
+                    return -1;
+                }
+                free(test->sctp_bindx);
+                test->sctp_bindx = strdup(optarg);
+                break;
+            }
 
             case 'b':
 		slash = strchr(optarg, '/');
@@ -808,6 +1104,47 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
 	return -1;
     }
 
+    /* The socket family and the protocol have to agree. */
+    if ((test->settings->domain == AF_UNIX) !=
+	(test->protocol->id == Punix || test->protocol->id == Punixseq ||
+	 test->protocol->id == Pshm)) {
+	i_errno = IEUNIX;
+	return -1;
+    }
+
+    /* Kernel TLS does not attach to MPTCP sockets. */
+    if (test->ktls && (test->protocol->id != Ptcp || test->mptcp)) {
+	i_errno = IEKTLS;
+	return -1;
+    }
+
+    if (test->mptcp && test->protocol->id != Ptcp) {
+	i_errno = IEMPTCP;
+	return -1;
+    }
+
+    if (test->fast_open && test->protocol->id != Ptcp) {
+	i_errno = IEFASTOPEN;
+	return -1;
+    }
+
+    /* A server learns the protocol from each client, so only a client
+    ** can tell --sctp-bindx is not for it.
+    */
+    if ((test->sctp_streams || test->sctp_unordered || test->sctp_pr_ttl ||
+	 (test->role == 'c' && test->sctp_bindx != NULL)) && test->protocol->id != Psctp) {
+	i_errno = IESCTP;
+	return -1;
+    }
+
+    /* --verify rewrites the send buffer for every block, which neither
+    ** the file contents (-F) nor sendfile from the buffer file (-Z) allow.
+    */
+    if (test->verify && (test->zerocopy || test->diskfile_name)) {
+	i_errno = IEVERIFY;
+	return -1;
+    }
+
     if (blksize == 0) {
 	if (test->protocol->id == Pudp)
 	    blksize = DEFAULT_UDP_BLKSIZE;
@@ -857,7 +1194,13 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
 int
 iperf_set_send_state(struct iperf_test *test, signed char state)
 {
+    IPERF_PROBE2(state, test->state, state);
     test->state = state;
+    /* Pushed intervals still queued go first, to keep the stream whole. */
+    if (test->ctrl_out_len > 0 && iperf_ctrl_flush(test, 1) < 0) {
+	i_errno = IESENDMESSAGE;
+	return -1;
+    }
     if (Nwrite(test->ctrl_sck, (char*) &state, sizeof(state), Ptcp) < 0) {
 	i_errno = IESENDMESSAGE;
 	return -1;
@@ -905,7 +1248,12 @@ iperf_send(struct iperf_test *test, fd_set *write_setP)
 	SLIST_FOREACH(sp, &test->streams, streams) {
 	    if (sp->green_light &&
 	        (write_setP == NULL || FD_ISSET(sp->socket, write_setP))) {
-		if ((r = sp->snd(sp)) < 0) {
+		net_counters = &sp->net;
+		IPERF_PROBE2(send_entry, sp->id, sp->socket);
+		r = sp->snd(sp);
+		IPERF_PROBE3(send_return, sp->id, sp->socket, r);
+		net_counters = NULL;
+		if (r < 0) {
 		    if (r == NET_SOFTERROR)
 			break;
 		    i_errno = IESTREAMWRITE;
@@ -943,7 +1291,12 @@ iperf_recv(struct iperf_test *test, fd_set *read_setP)
 
     SLIST_FOREACH(sp, &test->streams, streams) {
 	if (FD_ISSET(sp->socket, read_setP)) {
-	    if ((r = sp->rcv(sp)) < 0) {
+	    net_counters = &sp->net;
+	    IPERF_PROBE2(recv_entry, sp->id, sp->socket);
+	    r = sp->rcv(sp);
+	    IPERF_PROBE3(recv_return, sp->id, sp->socket, r);
+	    net_counters = NULL;
+	    if (r < 0) {
 		i_errno = IESTREAMREAD;
 		return r;
 	    }
@@ -975,6 +1328,9 @@ iperf_init_test(struct iperf_test *test)
     SLIST_FOREACH(sp, &test->streams, streams) {
 	sp->result->start_time = now;
     }
+    cpu_times(&test->cpu_mark[0], &test->cpu_mark[1]);
+    if (test->perf_events && perf_counters_open(&test->perf) == 0)
+	warning("no performance counters are available");
 
     if (test->on_test_start)
         test->on_test_start(test);
@@ -1020,6 +1376,59 @@ iperf_create_send_timers(struct iperf_test * test)
     return 0;
 }
 
+/**
+ * iperf_resolve_addresses - look up the server and -B addresses once per
+ * test; the control connection and every stream reuse the result
+ *
+ */
+
+int
+iperf_resolve_addresses(struct iperf_test *test)
+{
+    struct addrinfo hints;
+    char portstr[6];
+
+    if (test->bind_address && test->local_res == NULL) {
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = test->settings->domain;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(test->bind_address, NULL, &hints, &test->local_res) != 0) {
+            test->local_res = NULL;
+            return -1;
+        }
+    }
+
+    if (test->server_res == NULL) {
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = test->settings->domain;
+        hints.ai_socktype = SOCK_STREAM;
+        snprintf(portstr, sizeof(portstr), "%d", test->server_port);
+        if (getaddrinfo(test->server_hostname, portstr, &hints, &test->server_res) != 0) {
+            test->server_res = NULL;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Tell the client why the server will not run its test: SERVER_ERROR,
+** then i_errno and errno.
+*/
+static void
+send_server_error(struct iperf_test *test)
+{
+    int32_t err[2];
+
+    err[0] = htonl(i_errno);
+    err[1] = htonl(errno);
+    if (iperf_set_send_state(test, SERVER_ERROR) != 0)
+	return;
+    if (Nwrite(test->ctrl_sck, (char*) &err[0], sizeof(err[0]), Ptcp) < 0 ||
+	Nwrite(test->ctrl_sck, (char*) &err[1], sizeof(err[1]), Ptcp) < 0)
+	i_errno = IECTRLWRITE;
+}
+
 /**
  * iperf_exchange_parameters - handles the param_Exchange part for client
  *
@@ -1029,7 +1438,6 @@ int
 iperf_exchange_parameters(struct iperf_test *test)
 {
     int s;
-    int32_t err;
 
     if (test->role == 'c') {
 
@@ -1038,22 +1446,17 @@ iperf_exchange_parameters(struct iperf_test *test)
 
     } else {
 
-        if (get_parameters(test) < 0)
+        if (get_parameters(test) < 0) {
+	    /* Parameters that arrived but were refused: say why. */
+	    if (i_errno != IERECVPARAMS) {
+		errno = 0;
+		send_server_error(test);
+	    }
             return -1;
+	}
 
         if ((s = test->protocol->listen(test)) < 0) {
-	    if (iperf_set_send_state(test, SERVER_ERROR) != 0)
-                return -1;
-            err = htonl(i_errno);
-            if (Nwrite(test->ctrl_sck, (char*) &err, sizeof(err), Ptcp) < 0) {
-                i_errno = IECTRLWRITE;
-                return -1;
-            }
-            err = htonl(errno);
-            if (Nwrite(test->ctrl_sck, (char*) &err, sizeof(err), Ptcp) < 0) {
-                i_errno = IECTRLWRITE;
-                return -1;
-            }
+	    send_server_error(test);
             return -1;
         }
         FD_SET(s, &test->read_set);
@@ -1061,6 +1464,7 @@ iperf_exchange_parameters(struct iperf_test *test)
         test->prot_listener = s;
 
         // Send the control message to create streams and start the test
+	(void) gettimeofday(&test->stream_setup_start, NULL);
 	if (iperf_set_send_state(test, CREATE_STREAMS) != 0)
             return -1;
 
@@ -1111,6 +1515,12 @@ send_parameters(struct iperf_test *test)
 	    cJSON_AddTrueToObject(j, "udp");
         else if (test->protocol->id == Psctp)
             cJSON_AddTrueToObject(j, "sctp");
+	else if (test->protocol->id == Punix)
+	    cJSON_AddTrueToObject(j, "unix");
+	else if (test->protocol->id == Punixseq)
+	    cJSON_AddTrueToObject(j, "unix_seqpacket");
+	else if (test->protocol->id == Pshm)
+	    cJSON_AddTrueToObject(j, "shm");
 	cJSON_AddIntToObject(j, "omit", test->omit);
 	if (test->server_affinity != -1)
 	    cJSON_AddIntToObject(j, "server_affinity", test->server_affinity);
@@ -1124,6 +1534,28 @@ send_parameters(struct iperf_test *test)
 	    cJSON_AddIntToObject(j, "MSS", test->settings->mss);
 	if (test->no_delay)
 	    cJSON_AddTrueToObject(j, "nodelay");
+	if (test->fast_open)
+	    cJSON_AddTrueToObject(j, "fast_open");
+	if (test->ktls)
+	    cJSON_AddTrueToObject(j, "ktls");
+	if (test->mptcp)
+	    cJSON_AddTrueToObject(j, "mptcp");
+	if (test->sctp_streams)
+	    cJSON_AddIntToObject(j, "sctp_streams", test->sctp_streams);
+	if (test->sctp_unordered)
+	    cJSON_AddTrueToObject(j, "sctp_unordered");
+	if (test->sctp_pr_ttl)
+	    cJSON_AddIntToObject(j, "sctp_pr", test->sctp_pr_ttl);
+	if (test->verify)
+	    cJSON_AddTrueToObject(j, "verify");
+	if (test->payload_type != PAYLOAD_RANDOM)
+	    cJSON_AddIntToObject(j, "payload", test->payload_type);
+	if (test->payload_compress)
+	    cJSON_AddIntToObject(j, "payload_compress", test->payload_compress);
+	if (test->shared_buffer)
+	    cJSON_AddTrueToObject(j, "shared_buffer");
+	if (test->null_send)
+	    cJSON_AddTrueToObject(j, "null");
 	cJSON_AddIntToObject(j, "parallel", test->num_streams);
 	if (test->reverse)
 	    cJSON_AddTrueToObject(j, "reverse");
@@ -1143,6 +1575,10 @@ send_parameters(struct iperf_test *test)
 	    cJSON_AddStringToObject(j, "title", test->title);
 	if (test->congestion)
 	    cJSON_AddStringToObject(j, "congestion", test->congestion);
+	/* Servers that understand this send their results back in binary. */
+	cJSON_AddIntToObject(j, "binary", TLV_VERSION);
+	/* ...and push each interval as it closes; see push_interval(). */
+	cJSON_AddTrueToObject(j, "live_intervals");
 	if (JSON_write(test->ctrl_sck, j) < 0) {
 	    i_errno = IESENDPARAMS;
 	    r = -1;
@@ -1154,6 +1590,48 @@ send_parameters(struct iperf_test *test)
 
 /*************************************************************/
 
+/* The checks iperf_parse_arguments makes of the client's options, made
+** again by the server of what arrived, since nothing says it came from
+** an iperf3 that made them.
+*/
+static int
+check_parameters(struct iperf_test *test)
+{
+    if (test->payload_compress < 0 || test->payload_compress > 100 ||
+	(test->payload_type != PAYLOAD_RANDOM && test->payload_type != PAYLOAD_ZEROS &&
+	 test->payload_type != PAYLOAD_PATTERN)) {
+	i_errno = IEPAYLOAD;
+	return -1;
+    }
+    /* AF_UNIX protocols only on a --unix server, and only they. */
+    if ((test->settings->domain == AF_UNIX) !=
+	(test->protocol->id == Punix || test->protocol->id == Punixseq ||
+	 test->protocol->id == Pshm)) {
+	i_errno = IESERVERUNIX;
+	return -1;
+    }
+    if (test->sctp_streams < 0 || test->sctp_streams > MAX_SCTP_STREAMS || test->sctp_pr_ttl < 0) {
+	i_errno = IESCTP;
+	return -1;
+    }
+    if (test->ktls && (test->protocol->id != Ptcp || test->mptcp)) {
+	i_errno = IEKTLS;
+	return -1;
+    }
+    if (test->fast_open && test->protocol->id != Ptcp) {
+	i_errno = IEFASTOPEN;
+	return -1;
+    }
+    /* The server's own -F or -Z counts here as much as the client's. */
+    if (test->verify && (test->zerocopy || test->diskfile_name)) {
+	i_errno = IEVERIFY;
+	return -1;
+    }
+    return 0;
+}
+
+/*************************************************************/
+
 static int
 get_parameters(struct iperf_test *test)
 {
@@ -1172,6 +1650,12 @@ get_parameters(struct iperf_test *test)
 	    set_protocol(test, Pudp);
         if ((j_p = cJSON_GetObjectItem(j, "sctp")) != NULL)
             set_protocol(test, Psctp);
+	if ((j_p = cJSON_GetObjectItem(j, "unix")) != NULL)
+	    set_protocol(test, Punix);
+	if ((j_p = cJSON_GetObjectItem(j, "unix_seqpacket")) != NULL)
+	    set_protocol(test, Punixseq);
+	if ((j_p = cJSON_GetObjectItem(j, "shm")) != NULL)
+	    set_protocol(test, Pshm);
 	if ((j_p = cJSON_GetObjectItem(j, "omit")) != NULL)
 	    test->omit = j_p->valueint;
 	if ((j_p = cJSON_GetObjectItem(j, "server_affinity")) != NULL)
@@ -1186,6 +1670,28 @@ get_parameters(struct iperf_test *test)
 	    test->settings->mss = j_p->valueint;
 	if ((j_p = cJSON_GetObjectItem(j, "nodelay")) != NULL)
 	    test->no_delay = 1;
+	if ((j_p = cJSON_GetObjectItem(j, "fast_open")) != NULL)
+	    test->fast_open = 1;
+	if ((j_p = cJSON_GetObjectItem(j, "ktls")) != NULL)
+	    test->ktls = 1;
+	if ((j_p = cJSON_GetObjectItem(j, "mptcp")) != NULL)
+	    test->mptcp = 1;
+	if ((j_p = cJSON_GetObjectItem(j, "sctp_streams")) != NULL)
+	    test->sctp_streams = j_p->valueint;
+	if ((j_p = cJSON_GetObjectItem(j, "sctp_unordered")) != NULL)
+	    test->sctp_unordered = 1;
+	if ((j_p = cJSON_GetObjectItem(j, "sctp_pr")) != NULL)
+	    test->sctp_pr_ttl = j_p->valueint;
+	if ((j_p = cJSON_GetObjectItem(j, "verify")) != NULL)
+	    test->verify = 1;
+	if ((j_p = cJSON_GetObjectItem(j, "null")) != NULL)
+	    test->null_send = 1;
+	if ((j_p = cJSON_GetObjectItem(j, "payload")) != NULL)
+	    test->payload_type = j_p->valueint;
+	if ((j_p = cJSON_GetObjectItem(j, "payload_compress")) != NULL)
+	    test->payload_compress = j_p->valueint;
+	if ((j_p = cJSON_GetObjectItem(j, "shared_buffer")) != NULL)
+	    test->shared_buffer = 1;
 	if ((j_p = cJSON_GetObjectItem(j, "parallel")) != NULL)
 	    test->num_streams = j_p->valueint;
 	if ((j_p = cJSON_GetObjectItem(j, "reverse")) != NULL)
@@ -1206,13 +1712,26 @@ get_parameters(struct iperf_test *test)
 	    test->title = strdup(j_p->valuestring);
 	if ((j_p = cJSON_GetObjectItem(j, "congestion")) != NULL)
 	    test->congestion = strdup(j_p->valuestring);
+	if ((j_p = cJSON_GetObjectItem(j, "binary")) != NULL && j_p->valueint >= TLV_VERSION)
+	    test->ctrl_binary = 1;
+	if ((j_p = cJSON_GetObjectItem(j, "live_intervals")) != NULL)
+	    test->ctrl_live = 1;
 	if (test->sender && test->protocol->id == Ptcp && has_tcpinfo_retransmits())
 	    test->sender_has_retransmits = 1;
 	cJSON_Delete(j);
+	if (check_parameters(test) < 0)
+	    r = -1;
     }
     return r;
 }
 
+/* CPU seconds per GB (10^9 bytes) moved, or -1 if nothing moved. */
+static double
+cpu_per_gb(double seconds, iperf_size_t bytes)
+{
+    return bytes > 0 ? seconds * 1e9 / bytes : -1.0;
+}
+
 /*************************************************************/
 
 static int
@@ -1227,6 +1746,9 @@ send_results(struct iperf_test *test)
     iperf_size_t bytes_transferred;
     int retransmits;
 
+    if (test->ctrl_binary)
+	return send_results_tlv(test);
+
     j = cJSON_CreateObject();
     if (j == NULL) {
 	i_errno = IEPACKAGERESULTS;
@@ -1235,6 +1757,7 @@ send_results(struct iperf_test *test)
 	cJSON_AddFloatToObject(j, "cpu_util_total", test->cpu_util[0]);
 	cJSON_AddFloatToObject(j, "cpu_util_user", test->cpu_util[1]);
 	cJSON_AddFloatToObject(j, "cpu_util_system", test->cpu_util[2]);
+	cJSON_AddFloatToObject(j, "cpu_seconds_per_gb", cpu_per_gb(test->cpu_seconds, test->cpu_bytes));
 	if ( ! test->sender )
 	    sender_has_retransmits = -1;
 	else
@@ -1261,6 +1784,11 @@ send_results(struct iperf_test *test)
 		    cJSON_AddFloatToObject(j_stream, "jitter", sp->jitter);
 		    cJSON_AddIntToObject(j_stream, "errors", sp->cnt_error);
 		    cJSON_AddIntToObject(j_stream, "packets", sp->packet_count);
+		    if (test->verify && !test->sender) {
+			cJSON_AddIntToObject(j_stream, "verified", sp->verify.checked);
+			cJSON_AddIntToObject(j_stream, "corrupted", sp->verify.corrupted);
+			cJSON_AddIntToObject(j_stream, "misordered", sp->verify.misordered);
+		    }
 		}
 	    }
 	    if (r == 0 && JSON_write(test->ctrl_sck, j) < 0) {
@@ -1294,13 +1822,24 @@ get_results(struct iperf_test *test)
     cJSON *j_jitter;
     cJSON *j_errors;
     cJSON *j_packets;
+    cJSON *j_p;
     int sid, cerror, pcount;
     double jitter;
     iperf_size_t bytes_transferred;
     int retransmits;
     struct iperf_stream *sp;
-
-    j = JSON_read(test->ctrl_sck);
+    char *msg;
+    size_t len;
+
+    /* Peers that got "binary" in the parameters answer in binary. */
+    msg = ctrl_read(test->ctrl_sck, &len);
+    if (msg != NULL && tlv_is_message(msg, len)) {
+	r = get_results_tlv(test, msg, len);
+	free(msg);
+	return r;
+    }
+    j = msg != NULL ? cJSON_Parse(msg) : NULL;
+    free(msg);
     if (j == NULL) {
 	i_errno = IERECVRESULTS;
         r = -1;
@@ -1316,6 +1855,9 @@ get_results(struct iperf_test *test)
 	    test->remote_cpu_util[0] = j_cpu_util_total->valuefloat;
 	    test->remote_cpu_util[1] = j_cpu_util_user->valuefloat;
 	    test->remote_cpu_util[2] = j_cpu_util_system->valuefloat;
+	    /* Older peers do not send this. */
+	    if ((j_p = cJSON_GetObjectItem(j, "cpu_seconds_per_gb")) != NULL)
+		test->remote_cpu_per_gb = j_p->valuefloat;
 	    result_has_retransmits = j_sender_has_retransmits->valueint;
 	    if (! test->sender)
 		test->sender_has_retransmits = result_has_retransmits;
@@ -1358,6 +1900,12 @@ get_results(struct iperf_test *test)
 				    sp->cnt_error = cerror;
 				    sp->packet_count = pcount;
 				    sp->result->bytes_received = bytes_transferred;
+				    if ((j_p = cJSON_GetObjectItem(j_stream, "verified")) != NULL)
+					sp->verify.checked = j_p->valueint;
+				    if ((j_p = cJSON_GetObjectItem(j_stream, "corrupted")) != NULL)
+					sp->verify.corrupted = j_p->valueint;
+				    if ((j_p = cJSON_GetObjectItem(j_stream, "misordered")) != NULL)
+					sp->verify.misordered = j_p->valueint;
 				} else {
 				    sp->result->bytes_sent = bytes_transferred;
 				    sp->result->stream_retrans = retransmits;
@@ -1375,66 +1923,654 @@ get_results(struct iperf_test *test)
 
 /*************************************************************/
 
-static int
-JSON_write(int fd, cJSON *json)
+/* Tags of the binary results message (see tlv.h).  Numbers are part of
+** the protocol; add new ones, never reuse old ones.
+*/
+#define RESULTS_CPU_UTIL_TOTAL		1	/* double */
+#define RESULTS_CPU_UTIL_USER		2	/* double */
+#define RESULTS_CPU_UTIL_SYSTEM		3	/* double */
+#define RESULTS_SENDER_HAS_RETRANSMITS	4	/* int */
+#define RESULTS_STREAM			5	/* record of RS_* */
+#define RESULTS_CPU_PER_GB		6	/* double, CPU seconds per 10^9 bytes */
+
+#define RS_ID		1	/* int */
+#define RS_BYTES	2	/* int */
+#define RS_RETRANSMITS	3	/* int */
+#define RS_JITTER	4	/* double, seconds */
+#define RS_ERRORS	5	/* int */
+#define RS_PACKETS	6	/* int */
+#define RS_VERIFIED	7	/* int */
+#define RS_CORRUPTED	8	/* int */
+#define RS_MISORDERED	9	/* int */
+#define RS_INTERVALS	10	/* record of RI_* */
+
+/* The interval series goes column by column: RI_COUNT, then one packed
+** column of RI_COUNT values per field.  Fields that do not apply to the
+** sender's role are left out, and read back as zero.
+*/
+#define RI_COUNT	1	/* int */
+#define RI_START_US	2	/* ints, microseconds since the stream started */
+#define RI_DURATION_US	3	/* ints, microseconds */
+#define RI_BYTES	4	/* ints */
+#define RI_RETRANSMITS	5	/* ints */
+#define RI_SND_CWND	6	/* ints */
+#define RI_RTT		7	/* ints, microseconds */
+#define RI_PACKETS	8	/* ints */
+#define RI_LOST		9	/* ints */
+#define RI_JITTER	10	/* doubles, milliseconds */
+#define RI_OMITTED	11	/* ints */
+#define RI_RCV_RTT	12	/* ints, microseconds */
+
+static void
+put_interval_column(struct tlv_buf *b, struct tlv_buf *col, unsigned tag, const struct iperf_interval_stats *is, int n)
 {
-    uint32_t hsize, nsize;
-    char *str;
-    int r = 0;
+    int i;
 
-    str = cJSON_PrintUnformatted(json);
-    if (str == NULL)
-	r = -1;
-    else {
-	hsize = strlen(str);
-	nsize = htonl(hsize);
-	if (Nwrite(fd, (char*) &nsize, sizeof(nsize), Ptcp) < 0)
-	    r = -1;
-	else {
-	    if (Nwrite(fd, str, hsize, Ptcp) < 0)
-		r = -1;
+    col->len = 0;
+    for (i = 0; i < n; ++i) {
+	switch (tag) {
+	    case RI_START_US: tlv_append_int(col, (int64_t) (is[i].start * 1000000.0 + 0.5)); break;
+	    case RI_DURATION_US: tlv_append_int(col, (int64_t) (is[i].duration * 1000000.0 + 0.5)); break;
+	    case RI_BYTES: tlv_append_int(col, (int64_t) is[i].bytes); break;
+	    case RI_RETRANSMITS: tlv_append_int(col, is[i].retransmits); break;
+	    case RI_SND_CWND: tlv_append_int(col, is[i].snd_cwnd); break;
+	    case RI_RTT: tlv_append_int(col, is[i].rtt); break;
+	    case RI_PACKETS: tlv_append_int(col, is[i].packets); break;
+	    case RI_LOST: tlv_append_int(col, is[i].lost_packets); break;
+	    case RI_JITTER: tlv_append_double(col, is[i].jitter_ms); break;
+	    case RI_OMITTED: tlv_append_int(col, is[i].omitted); break;
+	    case RI_RCV_RTT: tlv_append_int(col, is[i].rcv_rtt); break;
 	}
-	free(str);
     }
-    return r;
+    tlv_put_bytes(b, tag, col->data, col->len);
 }
 
-/*************************************************************/
+/* Append a stream's interval series, from the given entry to the last,
+** to b as an RS_INTERVALS record.
+*/
+static int
+put_intervals(struct iperf_test *test, struct iperf_stream *sp, struct iperf_interval_results *from, struct tlv_buf *b)
+{
+    struct iperf_interval_results *irp;
+    struct iperf_interval_stats *is;
+    struct tlv_buf iv, col;
+    int n;
+
+    n = 0;
+    for (irp = from; irp != NULL; irp = TAILQ_NEXT(irp, irlistentries))
+	++n;
+    is = (struct iperf_interval_stats *) malloc((n ? n : 1) * sizeof(*is));
+    if (is == NULL)
+	return -1;
+    n = 0;
+    for (irp = from; irp != NULL; irp = TAILQ_NEXT(irp, irlistentries))
+	interval_stats_fill(test, sp, irp, &is[n++]);
+
+    tlv_init(&iv);
+    tlv_init(&col);
+    tlv_put_int(&iv, RI_COUNT, n);
+    put_interval_column(&iv, &col, RI_START_US, is, n);
+    put_interval_column(&iv, &col, RI_DURATION_US, is, n);
+    put_interval_column(&iv, &col, RI_BYTES, is, n);
+    put_interval_column(&iv, &col, RI_OMITTED, is, n);
+    if (test->protocol->id != Pudp) {
+	if (test->sender && test->sender_has_retransmits) {
+	    put_interval_column(&iv, &col, RI_RETRANSMITS, is, n);
+	    put_interval_column(&iv, &col, RI_SND_CWND, is, n);
+	    put_interval_column(&iv, &col, RI_RTT, is, n);
+	}
+	if (!test->sender && test->protocol->id == Ptcp)
+	    put_interval_column(&iv, &col, RI_RCV_RTT, is, n);
+    } else {
+	put_interval_column(&iv, &col, RI_PACKETS, is, n);
+	if (!test->sender) {
+	    put_interval_column(&iv, &col, RI_LOST, is, n);
+	    put_interval_column(&iv, &col, RI_JITTER, is, n);
+	}
+    }
+    tlv_put_bytes(b, RS_INTERVALS, iv.data, iv.len);
+    n = iv.fail || col.fail ? -1 : 0;
+    tlv_free(&col);
+    tlv_free(&iv);
+    free(is);
+    return n;
+}
 
-static cJSON *
-JSON_read(int fd)
+/* send_results() for a peer that asked for the binary form.  Besides the
+** totals the JSON form carries, each stream brings its interval series.
+*/
+static int
+send_results_tlv(struct iperf_test *test)
 {
-    uint32_t hsize, nsize;
-    char *str;
-    cJSON *json = NULL;
+    struct tlv_buf b, s;
+    struct iperf_stream *sp;
+    int r = 0;
 
-    if (Nread(fd, (char*) &nsize, sizeof(nsize), Ptcp) >= 0) {
-	hsize = ntohl(nsize);
-	str = (char *) malloc(hsize+1);	/* +1 for EOS */
-	if (str != NULL) {
-	    if (Nread(fd, str, hsize, Ptcp) >= 0) {
-		str[hsize] = '\0';	/* add the EOS */
-		json = cJSON_Parse(str);
+    tlv_init(&b);
+    tlv_init(&s);
+    tlv_start_message(&b);
+    tlv_put_double(&b, RESULTS_CPU_UTIL_TOTAL, test->cpu_util[0]);
+    tlv_put_double(&b, RESULTS_CPU_UTIL_USER, test->cpu_util[1]);
+    tlv_put_double(&b, RESULTS_CPU_UTIL_SYSTEM, test->cpu_util[2]);
+    tlv_put_double(&b, RESULTS_CPU_PER_GB, cpu_per_gb(test->cpu_seconds, test->cpu_bytes));
+    tlv_put_int(&b, RESULTS_SENDER_HAS_RETRANSMITS, test->sender ? test->sender_has_retransmits : -1);
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	s.len = 0;
+	tlv_put_int(&s, RS_ID, sp->id);
+	if (test->sender) {
+	    tlv_put_int(&s, RS_BYTES, sp->result->bytes_sent);
+	    tlv_put_int(&s, RS_RETRANSMITS, test->sender_has_retransmits ? sp->result->stream_retrans : -1);
+	} else {
+	    tlv_put_int(&s, RS_BYTES, sp->result->bytes_received);
+	    tlv_put_int(&s, RS_RETRANSMITS, -1);
+	    if (test->protocol->id == Pudp) {
+		tlv_put_double(&s, RS_JITTER, sp->jitter);
+		tlv_put_int(&s, RS_ERRORS, sp->cnt_error);
+		tlv_put_int(&s, RS_PACKETS, sp->packet_count);
+	    }
+	    if (test->verify) {
+		tlv_put_int(&s, RS_VERIFIED, sp->verify.checked);
+		tlv_put_int(&s, RS_CORRUPTED, sp->verify.corrupted);
+		tlv_put_int(&s, RS_MISORDERED, sp->verify.misordered);
 	    }
 	}
-	free(str);
+	if (put_intervals(test, sp, TAILQ_FIRST(&sp->result->interval_results), &s) < 0)
+	    r = -1;
+	tlv_put_bytes(&b, RESULTS_STREAM, s.data, s.len);
     }
-    return json;
+    if (r < 0 || b.fail || s.fail) {
+	i_errno = IEPACKAGERESULTS;
+	r = -1;
+    } else if (ctrl_write(test->ctrl_sck, (const char *) b.data, b.len) < 0) {
+	i_errno = IESENDRESULTS;
+	r = -1;
+    }
+    tlv_free(&s);
+    tlv_free(&b);
+    return r;
 }
 
-/*************************************************************/
-/**
- * add_to_interval_list -- adds new interval to the interval_list
- */
-
-void
-add_to_interval_list(struct iperf_stream_result * rp, struct iperf_interval_results * new)
+/* Read an RS_INTERVALS record into sp->result->remote_intervals,
+** replacing what is there or, for a push, adding to it.
+*/
+static int
+get_intervals_tlv(struct iperf_stream *sp, struct tlv_reader *r, int append)
 {
-    struct iperf_interval_results *irp;
+    struct iperf_stream_result *rp = sp->result;
+    struct iperf_interval_stats *grown;
+    int size;
+    struct iperf_interval_stats *is = NULL;
+    struct tlv_reader v;
+    unsigned tag;
+    int64_t n = -1, x;
+    double d;
+    int i, k;
+
+    while ((k = tlv_next(r, &tag, &v)) > 0) {
+	if (tag == RI_COUNT) {
+	    if (is != NULL || tlv_get_int(&v, &n) < 0 || n < 0)
+		goto bad;
+	    /* Every value in a column takes at least a byte: a count
+	    ** the rest of the record can't hold is malformed, and must
+	    ** not size the allocation.
+	    */
+	    if ((uint64_t) n > (uint64_t) (r->end - r->p))
+		goto bad;
+	    is = (struct iperf_interval_stats *) calloc(n ? n : 1, sizeof(*is));
+	    if (is == NULL)
+		goto bad;
+	    for (i = 0; i < n; ++i)
+		is[i].rtt = is[i].rcv_rtt = -1;
+	    continue;
+	}
+	if (is == NULL)
+	    goto bad;	/* a column before the count */
+	if (tag < RI_START_US || tag > RI_RCV_RTT)
+	    continue;
+	for (i = 0; i < n; ++i) {
+	    if (tag == RI_JITTER) {
+		if (tlv_get_double(&v, &d) < 0)
+		    goto bad;
+		is[i].jitter_ms = d;
+		continue;
+	    }
+	    if (tlv_get_int(&v, &x) < 0)
+		goto bad;
+	    switch (tag) {
+		case RI_START_US: is[i].start = x / 1000000.0; break;
+		case RI_DURATION_US: is[i].duration = x / 1000000.0; break;
+		case RI_BYTES: is[i].bytes = x; break;
+		case RI_RETRANSMITS: is[i].retransmits = x; break;
+		case RI_SND_CWND: is[i].snd_cwnd = x; break;
+		case RI_RTT: is[i].rtt = x; break;
+		case RI_PACKETS: is[i].packets = x; break;
+		case RI_LOST: is[i].lost_packets = x; break;
+		case RI_OMITTED: is[i].omitted = x != 0; break;
+		case RI_RCV_RTT: is[i].rcv_rtt = x; break;
+	    }
+	}
+    }
+    if (k < 0 || is == NULL)
+	goto bad;
+    for (i = 0; i < n; ++i) {
+	is[i].stream_id = sp->id;
+	is[i].end = is[i].start + is[i].duration;
+	if (is[i].duration > 0)
+	    is[i].bits_per_second = is[i].bytes * 8 / is[i].duration;
+	if (is[i].packets > 0)
+	    is[i].lost_percent = 100.0 * is[i].lost_packets / is[i].packets;
+    }
+    if (!append || rp->remote_intervals == NULL) {
+	/* When the whole series replaces the pushed one, carry on after
+	** the last interval already shown, wherever it is in the new one.
+	*/
+	if (rp->remote_interval_printed > 0) {
+	    d = rp->remote_intervals[rp->remote_interval_printed - 1].end;
+	    for (i = 0; i < n && is[i].start + is[i].duration / 2 < d; ++i)
+		;
+	    rp->remote_interval_printed = i;
+	}
+	free(rp->remote_intervals);
+	rp->remote_intervals = is;
+	rp->remote_interval_count = rp->remote_interval_size = n;
+	return 0;
+    }
+    if (rp->remote_interval_count + n > rp->remote_interval_size) {
+	size = rp->remote_interval_size * 2;
+	if (size < rp->remote_interval_count + n)
+	    size = rp->remote_interval_count + n;
+	grown = (struct iperf_interval_stats *) realloc(rp->remote_intervals, size * sizeof(*grown));
+	if (grown == NULL)
+	    goto bad;
+	rp->remote_intervals = grown;
+	rp->remote_interval_size = size;
+    }
+    memcpy(&rp->remote_intervals[rp->remote_interval_count], is, n * sizeof(*is));
+    rp->remote_interval_count += n;
+    free(is);
+    return 0;
 
-    irp = (struct iperf_interval_results *) malloc(sizeof(struct iperf_interval_results));
-    memcpy(irp, new, sizeof(struct iperf_interval_results));
-    TAILQ_INSERT_TAIL(&rp->interval_results, irp, irlistentries);
+  bad:
+    free(is);
+    return -1;
+}
+
+/* get_results() for a message in the binary form. */
+static int
+get_results_tlv(struct iperf_test *test, const char *msg, size_t len)
+{
+    struct tlv_reader r, v, f, intervals;
+    struct iperf_stream *sp;
+    unsigned tag, ftag;
+    int64_t x, sid, bytes, retransmits, errors, packets, verified, corrupted, misordered, has_retransmits;
+    double d, cpu[3] = { 0.0, 0.0, 0.0 }, jitter;
+    int k, seen, have_intervals;
+
+    if (tlv_open_message(&r, msg, len) < 0) {
+	i_errno = IERECVRESULTS;
+	return -1;
+    }
+    seen = 0;
+    has_retransmits = 0;
+    while ((k = tlv_next(&r, &tag, &v)) > 0) {
+	switch (tag) {
+	    case RESULTS_CPU_UTIL_TOTAL:
+	    case RESULTS_CPU_UTIL_USER:
+	    case RESULTS_CPU_UTIL_SYSTEM:
+		if (tlv_get_double(&v, &d) < 0)
+		    goto bad;
+		cpu[tag - RESULTS_CPU_UTIL_TOTAL] = d;
+		seen |= 1 << tag;
+		break;
+	    case RESULTS_CPU_PER_GB:
+		if (tlv_get_double(&v, &test->remote_cpu_per_gb) < 0)
+		    goto bad;
+		break;
+	    case RESULTS_SENDER_HAS_RETRANSMITS:
+		if (tlv_get_int(&v, &has_retransmits) < 0)
+		    goto bad;
+		seen |= 1 << tag;
+		break;
+	    case RESULTS_STREAM:
+		sid = bytes = -1;
+		retransmits = errors = packets = -1;
+		verified = corrupted = misordered = -1;
+		jitter = -1.0;
+		have_intervals = 0;
+		while ((k = tlv_next(&v, &ftag, &f)) > 0) {
+		    if (ftag == RS_JITTER) {
+			if (tlv_get_double(&f, &jitter) < 0)
+			    goto bad;
+			continue;
+		    }
+		    if (ftag == RS_INTERVALS) {
+			intervals = f;
+			have_intervals = 1;
+			continue;
+		    }
+		    if (tlv_get_int(&f, &x) < 0)
+			goto bad;
+		    switch (ftag) {
+			case RS_ID: sid = x; break;
+			case RS_BYTES: bytes = x; break;
+			case RS_RETRANSMITS: retransmits = x; break;
+			case RS_ERRORS: errors = x; break;
+			case RS_PACKETS: packets = x; break;
+			case RS_VERIFIED: verified = x; break;
+			case RS_CORRUPTED: corrupted = x; break;
+			case RS_MISORDERED: misordered = x; break;
+		    }
+		}
+		if (k < 0 || sid < 0 || bytes < 0)
+		    goto bad;
+		SLIST_FOREACH(sp, &test->streams, streams)
+		    if (sp->id == sid) break;
+		if (sp == NULL) {
+		    i_errno = IESTREAMID;
+		    return -1;
+		}
+		if (test->sender) {
+		    sp->result->bytes_received = bytes;
+		    if (jitter >= 0.0)
+			sp->jitter = jitter;
+		    if (errors >= 0)
+			sp->cnt_error = errors;
+		    if (packets >= 0)
+			sp->packet_count = packets;
+		    if (verified >= 0)
+			sp->verify.checked = verified;
+		    if (corrupted >= 0)
+			sp->verify.corrupted = corrupted;
+		    if (misordered >= 0)
+			sp->verify.misordered = misordered;
+		} else {
+		    sp->result->bytes_sent = bytes;
+		    sp->result->stream_retrans = retransmits;
+		}
+		if (have_intervals && get_intervals_tlv(sp, &intervals, 0) < 0)
+		    goto bad;
+		break;
+	}
+    }
+    if (k < 0 || (seen & 0x1e) != 0x1e)
+	goto bad;
+    test->remote_cpu_util[0] = cpu[0];
+    test->remote_cpu_util[1] = cpu[1];
+    test->remote_cpu_util[2] = cpu[2];
+    if (! test->sender)
+	test->sender_has_retransmits = has_retransmits;
+    return 0;
+
+  bad:
+    i_errno = IERECVRESULTS;
+    return -1;
+}
+
+/*************************************************************/
+
+/* Pushed intervals queued beyond this are dropped: the client is not
+** keeping up, and it gets the whole series with the results anyway.
+*/
+#define CTRL_OUT_MAX (64 * 1024)
+#define CTRL_IN_MAX (16 * 1024 * 1024)
+
+/* Queue the intervals that just closed for the client, as an
+** INTERVAL_RESULTS byte and a length-prefixed binary message, and send
+** what the socket takes without blocking.  Anything left goes out at the
+** next push, or before the next state change.
+*/
+static void
+push_interval(struct iperf_test *test)
+{
+    struct tlv_buf b, s;
+    struct iperf_stream *sp;
+    struct iperf_interval_results *irp;
+    uint32_t nsize;
+    size_t need;
+    int r = 0;
+
+    tlv_init(&b);
+    tlv_init(&s);
+    tlv_start_message(&b);
+    tlv_put_int(&b, RESULTS_SENDER_HAS_RETRANSMITS, test->sender ? test->sender_has_retransmits : -1);
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	irp = TAILQ_LAST(&sp->result->interval_results, irlisthead);
+	if (irp == NULL)
+	    continue;
+	s.len = 0;
+	tlv_put_int(&s, RS_ID, sp->id);
+	if (put_intervals(test, sp, irp, &s) < 0)
+	    r = -1;
+	tlv_put_bytes(&b, RESULTS_STREAM, s.data, s.len);
+    }
+    need = 1 + sizeof(nsize) + b.len;
+    if (test->ctrl_out == NULL) {
+	test->ctrl_out = (char *) malloc(CTRL_OUT_MAX);
+	test->ctrl_out_size = test->ctrl_out != NULL ? CTRL_OUT_MAX : 0;
+    }
+    if (r == 0 && !b.fail && !s.fail && test->ctrl_out_len + need <= test->ctrl_out_size) {
+	test->ctrl_out[test->ctrl_out_len] = INTERVAL_RESULTS;
+	nsize = htonl(b.len);
+	memcpy(test->ctrl_out + test->ctrl_out_len + 1, &nsize, sizeof(nsize));
+	memcpy(test->ctrl_out + test->ctrl_out_len + 1 + sizeof(nsize), b.data, b.len);
+	test->ctrl_out_len += need;
+    }
+    tlv_free(&s);
+    tlv_free(&b);
+
+    /* On an error, stop pushing; the main loop finds out what is wrong. */
+    if (iperf_ctrl_flush(test, 0) < 0)
+	test->ctrl_live = 0;
+}
+
+/* Send queued control bytes.  Without block, stop when the socket is full. */
+int
+iperf_ctrl_flush(struct iperf_test *test, int block)
+{
+    size_t done = 0;
+    ssize_t r;
+
+    while (done < test->ctrl_out_len) {
+	r = send(test->ctrl_sck, test->ctrl_out + done, test->ctrl_out_len - done, block ? 0 : MSG_DONTWAIT);
+	if (r < 0) {
+	    if (errno == EINTR)
+		continue;
+	    if (!block && (errno == EAGAIN || errno == EWOULDBLOCK))
+		break;
+	    return -1;
+	}
+	done += r;
+    }
+    memmove(test->ctrl_out, test->ctrl_out + done, test->ctrl_out_len - done);
+    test->ctrl_out_len -= done;
+    return 0;
+}
+
+/* Take in a pushed interval message, once its INTERVAL_RESULTS byte has
+** been read, without blocking: whatever has arrived is kept, and
+** ctrl_in_pending tells the caller to come back here when the control
+** socket is readable again.  The intervals are added to each stream's
+** remote_intervals.
+*/
+int
+iperf_recv_interval_push(struct iperf_test *test)
+{
+    struct tlv_reader r, v, f, intervals;
+    struct iperf_stream *sp;
+    unsigned tag, ftag;
+    uint32_t nsize;
+    size_t want;
+    ssize_t n;
+    char *grown;
+    int64_t sid;
+    int k, have_intervals;
+
+    test->ctrl_in_pending = 1;
+    for (;;) {
+	want = sizeof(nsize);
+	if (test->ctrl_in_len >= sizeof(nsize)) {
+	    memcpy(&nsize, test->ctrl_in, sizeof(nsize));
+	    want += ntohl(nsize);
+	    if (test->ctrl_in_len == want)
+		break;
+	}
+	if (want > CTRL_IN_MAX) {
+	    i_errno = IERECVMESSAGE;
+	    return -1;
+	}
+	if (want > test->ctrl_in_size) {
+	    grown = (char *) realloc(test->ctrl_in, want);
+	    if (grown == NULL) {
+		i_errno = IERECVMESSAGE;
+		return -1;
+	    }
+	    test->ctrl_in = grown;
+	    test->ctrl_in_size = want;
+	}
+	n = recv(test->ctrl_sck, test->ctrl_in + test->ctrl_in_len, want - test->ctrl_in_len, MSG_DONTWAIT);
+	if (n == 0) {
+	    i_errno = IECTRLCLOSE;
+	    return -1;
+	}
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+	    if (errno == EAGAIN || errno == EWOULDBLOCK)
+		return 0;
+	    i_errno = IERECVMESSAGE;
+	    return -1;
+	}
+	test->ctrl_in_len += n;
+    }
+    test->ctrl_in_pending = 0;
+    test->ctrl_in_len = 0;
+
+    if (tlv_open_message(&r, test->ctrl_in + sizeof(nsize), want - sizeof(nsize)) < 0)
+	goto bad;
+    while ((k = tlv_next(&r, &tag, &v)) > 0) {
+	if (tag == RESULTS_SENDER_HAS_RETRANSMITS) {
+	    /* What the columns of a sender's intervals are. */
+	    if (tlv_get_int(&v, &sid) < 0)
+		goto bad;
+	    if (! test->sender)
+		test->sender_has_retransmits = sid;
+	    continue;
+	}
+	if (tag != RESULTS_STREAM)
+	    continue;
+	sid = -1;
+	have_intervals = 0;
+	while ((k = tlv_next(&v, &ftag, &f)) > 0) {
+	    if (ftag == RS_ID && tlv_get_int(&f, &sid) < 0)
+		goto bad;
+	    if (ftag == RS_INTERVALS) {
+		intervals = f;
+		have_intervals = 1;
+	    }
+	}
+	if (k < 0)
+	    goto bad;
+	SLIST_FOREACH(sp, &test->streams, streams)
+	    if (sp->id == sid) break;
+	if (sp != NULL && have_intervals && get_intervals_tlv(sp, &intervals, 1) < 0)
+	    goto bad;
+    }
+    if (k < 0)
+	goto bad;
+    /* Show the ones whose local interval is out already. */
+    print_remote_interval_lines(test, 0);
+    return 0;
+
+  bad:
+    i_errno = IERECVMESSAGE;
+    return -1;
+}
+
+/*************************************************************/
+
+static int
+JSON_write(int fd, cJSON *json)
+{
+    char *str;
+    int r = 0;
+
+    str = cJSON_PrintUnformatted(json);
+    if (str == NULL)
+	r = -1;
+    else {
+	r = ctrl_write(fd, str, strlen(str));
+	free(str);
+    }
+    return r;
+}
+
+/*************************************************************/
+
+static cJSON *
+JSON_read(int fd)
+{
+    char *str;
+    size_t len;
+    cJSON *json = NULL;
+
+    str = ctrl_read(fd, &len);
+    if (str != NULL) {
+	json = cJSON_Parse(str);
+	free(str);
+    }
+    return json;
+}
+
+/* Read one length-prefixed control message, JSON or binary.  The
+** result is NUL-terminated for the JSON parser.
+*/
+static char *
+ctrl_read(int fd, size_t *len)
+{
+    uint32_t hsize, nsize;
+    char *str;
+
+    if (Nread(fd, (char*) &nsize, sizeof(nsize), Ptcp) < 0)
+	return NULL;
+    hsize = ntohl(nsize);
+    str = (char *) malloc(hsize+1);	/* +1 for EOS */
+    if (str == NULL)
+	return NULL;
+    if (Nread(fd, str, hsize, Ptcp) < 0) {
+	free(str);
+	return NULL;
+    }
+    str[hsize] = '\0';	/* add the EOS */
+    *len = hsize;
+    return str;
+}
+
+static int
+ctrl_write(int fd, const char *msg, size_t len)
+{
+    uint32_t nsize;
+
+    nsize = htonl(len);
+    if (Nwrite(fd, (char*) &nsize, sizeof(nsize), Ptcp) < 0)
+	return -1;
+    if (Nwrite(fd, msg, len, Ptcp) < 0)
+	return -1;
+    return 0;
+}
+
+/*************************************************************/
+/**
+ * add_to_interval_list -- adds new interval to the interval_list
+ */
+
+void
+add_to_interval_list(struct iperf_stream_result * rp, struct iperf_interval_results * new)
+{
+    struct iperf_interval_results *irp;
+
+    irp = (struct iperf_interval_results *) malloc(sizeof(struct iperf_interval_results));
+    memcpy(irp, new, sizeof(struct iperf_interval_results));
+    TAILQ_INSERT_TAIL(&rp->interval_results, irp, irlistentries);
 }
 
 
@@ -1450,7 +2586,20 @@ void
 connect_msg(struct iperf_stream *sp)
 {
     char ipl[INET6_ADDRSTRLEN], ipr[INET6_ADDRSTRLEN];
+    char path[UNIX_PATH_LEN];
     int lport, rport;
+    cJSON_Arena *prev;
+
+    if (getsockdomain(sp->socket) == AF_UNIX) {
+	iperf_unix_path(sp->test, sp->test->protocol->id == Punixseq, path, sizeof(path));
+	if (sp->test->json_output) {
+	    prev = cJSON_SetArena(sp->test->json_arena);
+	    cJSON_AddItemToObject(sp->test->json_start, "connected", iperf_json_printf("socket: %d  path: %s", (int64_t) sp->socket, path));
+	    cJSON_SetArena(prev);
+	} else
+	    iprintf(sp->test, report_connected_unix, sp->socket, path);
+	return;
+    }
 
     if (getsockdomain(sp->socket) == AF_INET) {
         inet_ntop(AF_INET, (void *) &((struct sockaddr_in *) &sp->local_addr)->sin_addr, ipl, sizeof(ipl));
@@ -1468,9 +2617,11 @@ connect_msg(struct iperf_stream *sp)
         rport = ntohs(((struct sockaddr_in6 *) &sp->remote_addr)->sin6_port);
     }
 
-    if (sp->test->json_output)
+    if (sp->test->json_output) {
+	prev = cJSON_SetArena(sp->test->json_arena);
         cJSON_AddItemToObject(sp->test->json_start, "connected", iperf_json_printf("socket: %d  local_host: %s  local_port: %d  remote_host: %s  remote_port: %d", (int64_t) sp->socket, ipl, (int64_t) lport, ipr, (int64_t) rport));
-    else
+	cJSON_SetArena(prev);
+    } else
 	iprintf(sp->test, report_connected, sp->socket, ipl, lport, ipr, rport);
 }
 
@@ -1527,11 +2678,13 @@ protocol_free(struct protocol *proto)
 int
 iperf_defaults(struct iperf_test *testp)
 {
-    struct protocol *tcp, *udp, *sctp;
+    struct protocol *tcp, *udp, *sctp, *unix_stream, *unix_seqpacket, *shm;
 
     testp->omit = OMIT;
     testp->duration = DURATION;
     testp->diskfile_name = (char*) 0;
+    testp->diskfile_sync = DISKFILE_SYNC_END;
+    testp->diskfile_write = DISKFILE_WRITE_BUFFERED;
     testp->affinity = -1;
     testp->server_affinity = -1;
 #if defined(__FreeBSD__)
@@ -1548,6 +2701,8 @@ iperf_defaults(struct iperf_test *testp)
 
     testp->stats_interval = testp->reporter_interval = 1;
     testp->num_streams = 1;
+    testp->remote_cpu_per_gb = -1;
+    perf_counters_init(&testp->perf);
 
     testp->settings->domain = AF_UNSPEC;
     testp->settings->unit_format = 'a';
@@ -1578,7 +2733,7 @@ iperf_defaults(struct iperf_test *testp)
     tcp->connect = iperf_tcp_connect;
     tcp->send = iperf_tcp_send;
     tcp->recv = iperf_tcp_recv;
-    tcp->init = NULL;
+    tcp->init = iperf_tcp_init;
     SLIST_INSERT_HEAD(&testp->protocols, tcp, protocols);
 
     udp = protocol_new();
@@ -1617,6 +2772,44 @@ iperf_defaults(struct iperf_test *testp)
 
     SLIST_INSERT_AFTER(udp, sctp, protocols);
 
+    unix_stream = protocol_new();
+    unix_seqpacket = protocol_new();
+    shm = protocol_new();
+    if (!unix_stream || !unix_seqpacket || !shm) {
+        protocol_free(tcp);
+        protocol_free(udp);
+        protocol_free(sctp);
+        if (unix_stream)
+            protocol_free(unix_stream);
+        if (unix_seqpacket)
+            protocol_free(unix_seqpacket);
+        return -1;
+    }
+
+    unix_stream->id = Punix;
+    unix_stream->name = "UNIX";
+    unix_stream->accept = iperf_unix_accept;
+    unix_stream->listen = iperf_unix_listen;
+    unix_stream->connect = iperf_unix_connect;
+    unix_stream->send = iperf_unix_send;
+    unix_stream->recv = iperf_unix_recv;
+    unix_stream->init = iperf_unix_init;
+    SLIST_INSERT_AFTER(sctp, unix_stream, protocols);
+
+    *unix_seqpacket = *unix_stream;
+    unix_seqpacket->id = Punixseq;
+    unix_seqpacket->name = "UNIX-SEQPACKET";
+    SLIST_INSERT_AFTER(unix_stream, unix_seqpacket, protocols);
+
+    /* Streams connect as for --unix, but the data goes through memory. */
+    *shm = *unix_stream;
+    shm->id = Pshm;
+    shm->name = "SHM";
+    shm->send = iperf_shm_send;
+    shm->recv = iperf_shm_recv;
+    shm->init = iperf_shm_init;
+    SLIST_INSERT_AFTER(unix_seqpacket, shm, protocols);
+
     testp->on_new_stream = iperf_on_new_stream;
     testp->on_test_start = iperf_on_test_start;
     testp->on_connect = iperf_on_connect;
@@ -1632,6 +2825,7 @@ iperf_free_test(struct iperf_test *test)
 {
     struct protocol *prot;
     struct iperf_stream *sp;
+    int i;
 
     /* Free streams */
     while (!SLIST_EMPTY(&test->streams)) {
@@ -1639,16 +2833,35 @@ iperf_free_test(struct iperf_test *test)
         SLIST_REMOVE_HEAD(&test->streams, streams);
         iperf_free_stream(sp);
     }
+    iperf_free_buffers(test);
+    perf_counters_close(&test->perf);
 
     if (test->server_hostname)
 	free(test->server_hostname);
     if (test->bind_address)
 	free(test->bind_address);
+    free(test->unix_path);
+    if (test->server_res)
+	freeaddrinfo(test->server_res);
+    if (test->local_res)
+	freeaddrinfo(test->local_res);
+    if (test->verify_template)
+	free(test->verify_template);
+    if (test->interval_stats)
+	free(test->interval_stats);
+    free(test->ctrl_out);
+    free(test->ctrl_in);
+    if (test->json_arena)
+	cJSON_DeleteArena(test->json_arena);
     free(test->settings);
     if (test->title)
 	free(test->title);
     if (test->congestion)
 	free(test->congestion);
+    iperf_mptcp_del_endpoints(test);
+    for (i = 0; i < test->mptcp_endpoints; ++i)
+	free(test->mptcp_endpoint[i]);
+    free(test->sctp_bindx);
     if (test->omit_timer != NULL)
 	tmr_cancel(test->omit_timer);
     if (test->timer != NULL)
@@ -1684,6 +2897,11 @@ iperf_reset_test(struct iperf_test *test)
         SLIST_REMOVE_HEAD(&test->streams, streams);
         iperf_free_stream(sp);
     }
+    iperf_free_buffers(test);
+    test->buffer_bytes = 0;
+    test->buffer_hugetlb_bytes = 0;
+    test->buffer_thp_bytes = 0;
+    test->buffer_count = 0;
     if (test->omit_timer != NULL) {
 	tmr_cancel(test->omit_timer);
 	test->omit_timer = NULL;
@@ -1707,6 +2925,17 @@ iperf_reset_test(struct iperf_test *test)
     test->role = 's';
     test->sender = 0;
     test->sender_has_retransmits = 0;
+    test->ctrl_binary = 0;
+    test->ctrl_live = 0;
+    test->ctrl_out_len = 0;
+    test->ctrl_in_len = 0;
+    test->ctrl_in_pending = 0;
+    memset(&test->loop, 0, sizeof(test->loop));
+    test->loop_mark = test->loop_interval = test->loop;
+    test->cpu_seconds = 0;
+    test->cpu_bytes = 0;
+    test->remote_cpu_per_gb = -1;
+    perf_counters_close(&test->perf);
     set_protocol(test, Ptcp);
     test->omit = OMIT;
     test->duration = DURATION;
@@ -1728,6 +2957,18 @@ iperf_reset_test(struct iperf_test *test)
         free(test->bind_address);
         test->bind_address = NULL;
     }
+    if(test->server_res) {
+        freeaddrinfo(test->server_res);
+        test->server_res = NULL;
+    }
+    if(test->local_res) {
+        freeaddrinfo(test->local_res);
+        test->local_res = NULL;
+    }
+    if(test->verify_template) {
+        free(test->verify_template);
+        test->verify_template = NULL;
+    }
     if(test->congestion) {
         free(test->congestion);
         test->congestion = NULL;
@@ -1738,9 +2979,23 @@ iperf_reset_test(struct iperf_test *test)
 
     test->bytes_sent = 0;
     test->blocks_sent = 0;
+    test->stream_setup_time = 0;
 
     test->reverse = 0;
     test->no_delay = 0;
+    test->fast_open = 0;
+    test->fast_open_streams = 0;
+    test->ktls = 0;
+    test->ktls_kernel_streams = 0;
+    test->mptcp = 0;
+    test->sctp_streams = 0;
+    test->sctp_unordered = 0;
+    test->sctp_pr_ttl = 0;
+    test->verify = 0;
+    test->null_send = 0;
+    test->payload_type = PAYLOAD_RANDOM;
+    test->payload_compress = 0;
+    test->shared_buffer = 0;
 
     FD_ZERO(&test->read_set);
     FD_ZERO(&test->write_set);
@@ -1774,6 +3029,8 @@ iperf_reset_stats(struct iperf_test *test)
 	sp->jitter = 0;
 	sp->outoforder_packets = 0;
 	sp->cnt_error = 0;
+	sp->verify.checked = sp->verify.corrupted = sp->verify.misordered = 0;
+	sp->verify_mark = sp->verify;
 	rp = sp->result;
         rp->bytes_sent = rp->bytes_received = 0;
         rp->bytes_sent_this_interval = rp->bytes_received_this_interval = 0;
@@ -1803,12 +3060,16 @@ iperf_stats_callback(struct iperf_test *test)
     struct iperf_stream *sp;
     struct iperf_stream_result *rp = NULL;
     struct iperf_interval_results *irp, temp;
+    double user, system;
 
+    memset(&temp, 0, sizeof(temp));
     temp.omitted = test->omitting;
+    test->interval_bytes = 0;
     SLIST_FOREACH(sp, &test->streams, streams) {
         rp = sp->result;
 
 	temp.bytes_transferred = test->sender ? rp->bytes_sent_this_interval : rp->bytes_received_this_interval;
+	test->interval_bytes += temp.bytes_transferred;
      
 	irp = TAILQ_LAST(&rp->interval_results, irlisthead);
         /* result->end_time contains timestamp of previous interval */
@@ -1847,10 +3108,222 @@ iperf_stats_callback(struct iperf_test *test)
 	    temp.jitter = sp->jitter;
 	    temp.outoforder_packets = sp->outoforder_packets;
 	    temp.cnt_error = sp->cnt_error;
+	    if (test->protocol->id == Psctp && test->verbose)
+		iperf_sctp_sample(sp);
 	}
+	if (sp->diskfile_fd >= 0 && !test->sender) {
+	    diskfile_interval(sp, test->done);
+	    temp.interval_disk_bytes = sp->diskfile_written - sp->diskfile_written_mark;
+	    temp.interval_disk_time = sp->diskfile_write_time - sp->diskfile_write_time_mark;
+	    temp.disk_queued = sp->diskfile_wb_len;
+	    sp->diskfile_written_mark = sp->diskfile_written;
+	    sp->diskfile_write_time_mark = sp->diskfile_write_time;
+	}
+	temp.interval_bytes_corrupted = sp->verify.corrupted - sp->verify_mark.corrupted;
+	temp.interval_blocks_misordered = sp->verify.misordered - sp->verify_mark.misordered;
+	sp->verify_mark = sp->verify;
+	temp.interval_net.syscalls = sp->net.syscalls - sp->net_mark.syscalls;
+	temp.interval_net.bytes = sp->net.bytes - sp->net_mark.bytes;
+	temp.interval_net.short_calls = sp->net.short_calls - sp->net_mark.short_calls;
+	temp.interval_net.soft_errors = sp->net.soft_errors - sp->net_mark.soft_errors;
+	sp->net_mark = sp->net;
         add_to_interval_list(rp, &temp);
         rp->bytes_sent_this_interval = rp->bytes_received_this_interval = 0;
     }
+    test->loop_interval.wakeups = test->loop.wakeups - test->loop_mark.wakeups;
+    test->loop_interval.idle_wakeups = test->loop.idle_wakeups - test->loop_mark.idle_wakeups;
+    test->loop_interval.timer_runs = test->loop.timer_runs - test->loop_mark.timer_runs;
+    test->loop_mark = test->loop;
+
+    /* The thread's CPU over the interval, and over the test so far. */
+    cpu_times(&user, &system);
+    test->interval_cpu[0] = user - test->cpu_mark[0];
+    test->interval_cpu[1] = system - test->cpu_mark[1];
+    test->cpu_mark[0] = user;
+    test->cpu_mark[1] = system;
+    if (!temp.omitted) {
+	test->cpu_seconds += test->interval_cpu[0] + test->interval_cpu[1];
+	test->cpu_bytes += test->interval_bytes;
+    }
+    if (test->perf_events)
+	perf_counters_sample(&test->perf, temp.omitted);
+    IPERF_PROBE3(stats, test->num_streams, test->interval_bytes, temp.omitted);
+
+    /* A client ends the test when its callback asks; the server has to
+    ** wait for the client's TEST_END.
+    */
+    if (test->interval_callback && iperf_interval_stats(test) < 0 && test->role == 'c')
+	test->done = 1;
+    if (test->role == 's' && test->ctrl_live)
+	push_interval(test);
+}
+
+/* Convert one entry of a stream's interval list to its public form. */
+static void
+interval_stats_fill(struct iperf_test *test, struct iperf_stream *sp, struct iperf_interval_results *irp, struct iperf_interval_stats *is)
+{
+    memset(is, 0, sizeof(*is));
+    is->stream_id = sp->id;
+    is->omitted = irp->omitted;
+    is->start = timeval_diff(&sp->result->start_time, &irp->interval_start_time);
+    is->end = timeval_diff(&sp->result->start_time, &irp->interval_end_time);
+    is->duration = irp->interval_duration;
+    is->bytes = irp->bytes_transferred;
+    if (is->duration > 0)
+	is->bits_per_second = is->bytes * 8 / is->duration;
+    if (test->protocol->id != Pudp) {
+	if (test->sender && test->sender_has_retransmits) {
+	    is->retransmits = irp->interval_retrans;
+	    is->snd_cwnd = irp->snd_cwnd;
+	    is->rtt = test->protocol->id == Ptcp && has_tcpinfo() ? get_rtt(irp) : -1;
+	} else if (test->sender) {
+	    is->retransmits = -1;
+	    is->snd_cwnd = -1;
+	    is->rtt = -1;
+	}
+	if (!test->sender)
+	    is->rcv_rtt = test->protocol->id == Ptcp && has_tcpinfo() ? get_rcv_rtt(irp) : -1;
+    } else {
+	is->packets = irp->interval_packet_count;
+	is->lost_packets = irp->interval_cnt_error;
+	if (is->packets > 0)
+	    is->lost_percent = 100.0 * is->lost_packets / is->packets;
+	is->jitter_ms = irp->jitter * 1000.0;
+    }
+}
+
+/*
+ * iperf_interval_stats -- hand the interval that just closed to the
+ * embedder's callback as plain structs.  The per-stream array is kept
+ * in the test and only grows, so after the first interval this does
+ * no allocation.  Returns what the callback did, or 0 if it was not
+ * called.
+ */
+static int
+iperf_interval_stats(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    struct iperf_interval_results *irp;
+    struct iperf_interval_stats *is, sum;
+    struct iperf_interval_stats *grown;
+    int n;
+
+    n = 0;
+    SLIST_FOREACH(sp, &test->streams, streams)
+	++n;
+    if (n == 0)
+	return 0;
+    if (n > test->interval_stats_len) {
+	grown = (struct iperf_interval_stats *) realloc(test->interval_stats, n * sizeof(*grown));
+	if (grown == NULL)
+	    return 0;
+	test->interval_stats = grown;
+	test->interval_stats_len = n;
+    }
+
+    memset(&sum, 0, sizeof(sum));
+    n = 0;
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	irp = TAILQ_LAST(&sp->result->interval_results, irlisthead);
+	if (irp == NULL)
+	    return 0;
+	is = &test->interval_stats[n++];
+	interval_stats_fill(test, sp, irp, is);
+
+	/* The sum takes its timing from the first stream, as the reports do. */
+	if (n == 1) {
+	    sum.omitted = is->omitted;
+	    sum.start = is->start;
+	    sum.end = is->end;
+	    sum.duration = is->duration;
+	    sum.retransmits = is->retransmits < 0 ? -1 : 0;
+	    sum.snd_cwnd = is->snd_cwnd < 0 ? -1 : 0;
+	    sum.rtt = is->rtt;
+	    sum.rcv_rtt = is->rcv_rtt;
+	}
+	sum.bytes += is->bytes;
+	if (is->retransmits > 0)
+	    sum.retransmits += is->retransmits;
+	if (is->snd_cwnd > 0)
+	    sum.snd_cwnd += is->snd_cwnd;
+	if (is->rtt > sum.rtt)
+	    sum.rtt = is->rtt;
+	if (is->rcv_rtt > sum.rcv_rtt)
+	    sum.rcv_rtt = is->rcv_rtt;
+	sum.packets += is->packets;
+	sum.lost_packets += is->lost_packets;
+	sum.jitter_ms += is->jitter_ms;
+    }
+    if (sum.duration > 0)
+	sum.bits_per_second = sum.bytes * 8 / sum.duration;
+    if (sum.packets > 0)
+	sum.lost_percent = 100.0 * sum.lost_packets / sum.packets;
+    sum.jitter_ms /= n;
+
+    return test->interval_callback(test, test->interval_stats, n, &sum, test->interval_callback_arg);
+}
+
+static char *
+format_per_gb(char *buf, double per_gb)
+{
+    if (per_gb < 0)
+	snprintf(buf, UNIT_LEN, "-");
+    else
+	snprintf(buf, UNIT_LEN, "%.3f", per_gb);
+    return buf;
+}
+
+static const char *perf_names[PC_COUNT] = {
+    "cycles", "instructions", "cache_misses", "context_switches", "page_faults"
+};
+
+/* --perf-counters figures as JSON: the counts, null where unavailable,
+** with instructions per cycle and cycles per byte moved.
+*/
+static cJSON *
+perf_json(const int64_t *counts, iperf_size_t bytes)
+{
+    cJSON *j;
+    int i;
+
+    j = cJSON_CreateObject();
+    if (j == NULL)
+	return NULL;
+    for (i = 0; i < PC_COUNT; ++i)
+	if (counts[i] < 0)
+	    cJSON_AddNullToObject(j, perf_names[i]);
+	else
+	    cJSON_AddIntToObject(j, perf_names[i], counts[i]);
+    if (counts[PC_CYCLES] > 0 && counts[PC_INSTRUCTIONS] >= 0)
+	cJSON_AddFloatToObject(j, "ipc", (double) counts[PC_INSTRUCTIONS] / counts[PC_CYCLES]);
+    else
+	cJSON_AddNullToObject(j, "ipc");
+    if (counts[PC_CYCLES] >= 0 && bytes > 0)
+	cJSON_AddFloatToObject(j, "cycles_per_byte", (double) counts[PC_CYCLES] / bytes);
+    else
+	cJSON_AddNullToObject(j, "cycles_per_byte");
+    return j;
+}
+
+/* The same as text; each buffer holds one figure, "-" if unavailable. */
+static void
+perf_text(const int64_t *counts, iperf_size_t bytes, char buf[PC_COUNT + 2][UNIT_LEN])
+{
+    int i;
+
+    for (i = 0; i < PC_COUNT; ++i)
+	if (counts[i] < 0)
+	    snprintf(buf[i], UNIT_LEN, "-");
+	else
+	    snprintf(buf[i], UNIT_LEN, "%lld", (long long) counts[i]);
+    if (counts[PC_CYCLES] > 0 && counts[PC_INSTRUCTIONS] >= 0)
+	snprintf(buf[PC_COUNT], UNIT_LEN, "%.2f", (double) counts[PC_INSTRUCTIONS] / counts[PC_CYCLES]);
+    else
+	snprintf(buf[PC_COUNT], UNIT_LEN, "-");
+    if (counts[PC_CYCLES] >= 0 && bytes > 0)
+	snprintf(buf[PC_COUNT + 1], UNIT_LEN, "%.2f", (double) counts[PC_CYCLES] / bytes);
+    else
+	snprintf(buf[PC_COUNT + 1], UNIT_LEN, "-");
 }
 
 static void
@@ -1867,7 +3340,8 @@ iperf_print_intermediate(struct iperf_test *test)
     cJSON *json_interval;
     cJSON *json_interval_streams;
     int total_packets = 0, lost_packets = 0;
-    double avg_jitter = 0.0, lost_percent;
+    double avg_jitter = 0.0, lost_percent, per_gb;
+    char pbuf[PC_COUNT + 2][UNIT_LEN];
 
     if (test->json_output) {
         json_interval = cJSON_CreateObject();
@@ -1914,7 +3388,7 @@ iperf_print_intermediate(struct iperf_test *test)
 
         start_time = timeval_diff(&sp->result->start_time,&irp->interval_start_time);
         end_time = timeval_diff(&sp->result->start_time,&irp->interval_end_time);
-	if (test->protocol->id == Ptcp || test->protocol->id == Psctp) {
+	if (test->protocol->id != Pudp) {
 	    if (test->sender && test->sender_has_retransmits) {
 		/* Interval sum, TCP with retransmits. */
 		if (test->json_output)
@@ -1945,6 +3419,30 @@ iperf_print_intermediate(struct iperf_test *test)
 	    }
 	}
     }
+
+    if ((sp = SLIST_FIRST(&test->streams)) == NULL)
+	return;
+    irp = TAILQ_LAST(&sp->result->interval_results, irlisthead);
+    start_time = timeval_diff(&sp->result->start_time, &irp->interval_start_time);
+    end_time = timeval_diff(&sp->result->start_time, &irp->interval_end_time);
+    if (test->verbose) {
+	per_gb = cpu_per_gb(test->interval_cpu[0] + test->interval_cpu[1], test->interval_bytes);
+	if (test->json_output) {
+	    cJSON_AddItemToObject(json_interval, "loop", iperf_json_printf("wakeups: %d  idle_wakeups: %d  timer_runs: %d", (int64_t) test->loop_interval.wakeups, (int64_t) test->loop_interval.idle_wakeups, (int64_t) test->loop_interval.timer_runs));
+	    cJSON_AddItemToObject(json_interval, "cpu", iperf_json_printf("user_seconds: %f  system_seconds: %f  seconds_per_gb: %f", test->interval_cpu[0], test->interval_cpu[1], per_gb));
+	} else {
+	    iprintf(test, report_loop_interval, start_time, end_time, (unsigned long long) test->loop_interval.wakeups, (unsigned long long) test->loop_interval.idle_wakeups, (unsigned long long) test->loop_interval.timer_runs);
+	    iprintf(test, report_cpu_interval, start_time, end_time, test->interval_cpu[0], test->interval_cpu[1], format_per_gb(nbuf, per_gb));
+	}
+    }
+    if (test->perf_events) {
+	if (test->json_output)
+	    cJSON_AddItemToObject(json_interval, "perf", perf_json(test->perf.interval, test->interval_bytes));
+	else {
+	    perf_text(test->perf.interval, test->interval_bytes, pbuf);
+	    iprintf(test, report_perf_interval, start_time, end_time, pbuf[PC_COUNT], pbuf[PC_COUNT + 1], pbuf[PC_CACHE_MISSES], pbuf[PC_CONTEXT_SWITCHES], pbuf[PC_PAGE_FAULTS]);
+	}
+    }
 }
 
 static void
@@ -1957,13 +3455,14 @@ iperf_print_results(struct iperf_test *test)
     int total_packets = 0, lost_packets = 0;
     char ubuf[UNIT_LEN];
     char nbuf[UNIT_LEN];
-    struct stat sb;
     char sbuf[UNIT_LEN];
     struct iperf_stream *sp = NULL;
     iperf_size_t bytes_sent, total_sent = 0;
     iperf_size_t bytes_received, total_received = 0;
+    iperf_size_t total_verified = 0, total_corrupted = 0, total_misordered = 0;
     double start_time, end_time, avg_jitter = 0.0, lost_percent;
     double bandwidth;
+    char pbuf[PC_COUNT + 2][UNIT_LEN];
 
     /* print final summary for all intervals */
 
@@ -1976,7 +3475,7 @@ iperf_print_results(struct iperf_test *test)
 	iprintf(test, "%s", report_bw_separator);
 	if (test->verbose)
 	    iprintf(test, "%s", report_summary);
-	if (test->protocol->id == Ptcp || test->protocol->id == Psctp) {
+	if (test->protocol->id != Pudp) {
 	    if (test->sender_has_retransmits)
 		iprintf(test, "%s", report_bw_retrans_header);
 	    else
@@ -2001,7 +3500,7 @@ iperf_print_results(struct iperf_test *test)
         total_sent += bytes_sent;
         total_received += bytes_received;
 
-        if (test->protocol->id == Ptcp || test->protocol->id == Psctp) {
+        if (test->protocol->id != Pudp) {
 	    if (test->sender_has_retransmits) {
 		total_retransmits += sp->result->stream_retrans;
 	    }
@@ -2014,7 +3513,7 @@ iperf_print_results(struct iperf_test *test)
 	unit_snprintf(ubuf, UNIT_LEN, (double) bytes_sent, 'A');
 	bandwidth = (double) bytes_sent / (double) end_time;
 	unit_snprintf(nbuf, UNIT_LEN, bandwidth, test->settings->unit_format);
-	if (test->protocol->id == Ptcp || test->protocol->id == Psctp) {
+	if (test->protocol->id != Pudp) {
 	    if (test->sender_has_retransmits) {
 		/* Summary, TCP with retransmits. */
 		if (test->json_output)
@@ -2042,21 +3541,46 @@ iperf_print_results(struct iperf_test *test)
 	    }
 	}
 
-	if (sp->diskfile_fd >= 0) {
-	    if (fstat(sp->diskfile_fd, &sb) == 0) {
-		int percent = (int) ( ( (double) bytes_sent / (double) sb.st_size ) * 100.0 );
-		unit_snprintf(sbuf, UNIT_LEN, (double) sb.st_size, 'A');
-		if (test->json_output)
-		    cJSON_AddItemToObject(json_summary_stream, "diskfile", iperf_json_printf("sent: %d  size: %d  percent: %d  filename: %s", (int64_t) bytes_sent, (int64_t) sb.st_size, (int64_t) percent, test->diskfile_name));
-		else
-		    iprintf(test, report_diskfile, ubuf, sbuf, percent, test->diskfile_name);
+	if (sp->diskfile_fd >= 0 && test->sender) {
+	    /* Report against this stream's slice of the file. */
+	    iperf_size_t size = sp->diskfile_end - sp->diskfile_start;
+	    int percent = size ? (int) ( ( (double) (sp->diskfile_offset - sp->diskfile_start) / (double) size ) * 100.0 ) : 100;
+	    double read_rate = sp->diskfile_read_time > 0 ? sp->diskfile_read_bytes / sp->diskfile_read_time : 0.0;
+	    unit_snprintf(sbuf, UNIT_LEN, (double) size, 'A');
+	    if (test->json_output)
+		cJSON_AddItemToObject(json_summary_stream, "diskfile", iperf_json_printf("sent: %d  size: %d  percent: %d  filename: %s  offset: %d  read_bytes: %d  read_seconds: %f  read_bits_per_second: %f  sendfile: %b", (int64_t) bytes_sent, (int64_t) size, (int64_t) percent, test->diskfile_name, (int64_t) sp->diskfile_start, (int64_t) sp->diskfile_read_bytes, sp->diskfile_read_time, read_rate * 8, sp->snd == diskfile_sendfile));
+	    else {
+		iprintf(test, report_diskfile, ubuf, sbuf, percent, test->diskfile_name);
+		unit_snprintf(sbuf, UNIT_LEN, (double) sp->diskfile_read_bytes, 'A');
+		unit_snprintf(nbuf, UNIT_LEN, read_rate, test->settings->unit_format);
+		iprintf(test, sp->snd == diskfile_sendfile ? report_diskfile_sendfile : report_diskfile_read, sbuf, sp->diskfile_read_time, nbuf);
+	    }
+	} else if (sp->diskfile_fd >= 0) {
+	    double write_rate = sp->diskfile_write_time > 0 ? sp->diskfile_written / sp->diskfile_write_time : 0.0;
+	    unit_snprintf(sbuf, UNIT_LEN, (double) sp->diskfile_written, 'A');
+	    if (test->json_output)
+		cJSON_AddItemToObject(json_summary_stream, "diskfile", iperf_json_printf("filename: %s  written_bytes: %d  write_seconds: %f  write_bits_per_second: %f  syncs: %d", test->diskfile_name, (int64_t) sp->diskfile_written, sp->diskfile_write_time, write_rate * 8, (int64_t) sp->diskfile_syncs));
+	    else {
+		unit_snprintf(nbuf, UNIT_LEN, write_rate, test->settings->unit_format);
+		iprintf(test, report_diskfile_written, sbuf, test->diskfile_name, sp->diskfile_write_time, nbuf, sp->diskfile_syncs);
 	    }
 	}
 
+	if (test->verify) {
+	    total_verified += sp->verify.checked;
+	    total_corrupted += sp->verify.corrupted;
+	    total_misordered += sp->verify.misordered;
+	    unit_snprintf(ubuf, UNIT_LEN, (double) sp->verify.checked, 'A');
+	    if (test->json_output)
+		cJSON_AddItemToObject(json_summary_stream, "verify", iperf_json_printf("verified_bytes: %d  corrupted_bytes: %d  misordered_blocks: %d", (int64_t) sp->verify.checked, (int64_t) sp->verify.corrupted, (int64_t) sp->verify.misordered));
+	    else
+		iprintf(test, report_verify, sp->socket, start_time, end_time, ubuf, (unsigned long long) sp->verify.corrupted, (unsigned long long) sp->verify.misordered);
+	}
+
 	unit_snprintf(ubuf, UNIT_LEN, (double) bytes_received, 'A');
 	bandwidth = (double) bytes_received / (double) end_time;
 	unit_snprintf(nbuf, UNIT_LEN, bandwidth, test->settings->unit_format);
-	if (test->protocol->id == Ptcp || test->protocol->id == Psctp) {
+	if (test->protocol->id != Pudp) {
 	    if (test->json_output)
 		cJSON_AddItemToObject(json_summary_stream, "receiver", iperf_json_printf("socket: %d  start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f", (int64_t) sp->socket, (double) start_time, (double) end_time, (double) end_time, (int64_t) bytes_received, bandwidth * 8));
 	    else
@@ -2068,7 +3592,7 @@ iperf_print_results(struct iperf_test *test)
         unit_snprintf(ubuf, UNIT_LEN, (double) total_sent, 'A');
 	bandwidth = (double) total_sent / (double) end_time;
         unit_snprintf(nbuf, UNIT_LEN, bandwidth, test->settings->unit_format);
-        if (test->protocol->id == Ptcp || test->protocol->id == Psctp) {
+        if (test->protocol->id != Pudp) {
 	    if (test->sender_has_retransmits) {
 		/* Summary sum, TCP with retransmits. */
 		if (test->json_output)
@@ -2098,35 +3622,186 @@ iperf_print_results(struct iperf_test *test)
 	    else
 		iprintf(test, report_sum_bw_udp_format, start_time, end_time, ubuf, nbuf, avg_jitter * 1000.0, lost_packets, total_packets, lost_percent, "");
         }
+	if (test->verify) {
+	    unit_snprintf(ubuf, UNIT_LEN, (double) total_verified, 'A');
+	    if (test->json_output)
+		cJSON_AddItemToObject(test->json_end, "sum_verify", iperf_json_printf("verified_bytes: %d  corrupted_bytes: %d  misordered_blocks: %d", (int64_t) total_verified, (int64_t) total_corrupted, (int64_t) total_misordered));
+	    else
+		iprintf(test, report_sum_verify, start_time, end_time, ubuf, (unsigned long long) total_corrupted, (unsigned long long) total_misordered);
+	}
     }
 
     if (test->json_output)
 	cJSON_AddItemToObject(test->json_end, "cpu_utilization_percent", iperf_json_printf("host_total: %f  host_user: %f  host_system: %f  remote_total: %f  remote_user: %f  remote_system: %f", (double) test->cpu_util[0], (double) test->cpu_util[1], (double) test->cpu_util[2], (double) test->remote_cpu_util[0], (double) test->remote_cpu_util[1], (double) test->remote_cpu_util[2]));
     else if (test->verbose)
         iprintf(test, report_cpu, report_local, test->sender?report_sender:report_receiver, test->cpu_util[0], test->cpu_util[1], test->cpu_util[2], report_remote, test->sender?report_receiver:report_sender, test->remote_cpu_util[0], test->remote_cpu_util[1], test->remote_cpu_util[2]);
+    if (test->json_output)
+	cJSON_AddItemToObject(test->json_end, "cpu_seconds_per_gb", iperf_json_printf("host: %f  remote: %f", cpu_per_gb(test->cpu_seconds, test->cpu_bytes), test->remote_cpu_per_gb));
+    else if (test->verbose)
+	iprintf(test, report_cpu_per_gb, report_local, test->sender?report_sender:report_receiver, format_per_gb(ubuf, cpu_per_gb(test->cpu_seconds, test->cpu_bytes)), report_remote, test->sender?report_receiver:report_sender, format_per_gb(nbuf, test->remote_cpu_per_gb));
+    if (test->perf_events) {
+	if (test->json_output) {
+	    json_summary_stream = perf_json(test->perf.total, test->cpu_bytes);
+	    if (json_summary_stream != NULL) {
+		cJSON_AddItemToObject(json_summary_stream, "user_mode_only", cJSON_CreateBool(test->perf.user_only));
+		cJSON_AddItemToObject(test->json_end, "perf", json_summary_stream);
+	    }
+	} else {
+	    perf_text(test->perf.total, test->cpu_bytes, pbuf);
+	    iprintf(test, report_perf, test->perf.user_only ? report_perf_user_only : "", pbuf[PC_CYCLES], pbuf[PC_INSTRUCTIONS], pbuf[PC_COUNT], pbuf[PC_COUNT + 1], pbuf[PC_CACHE_MISSES], pbuf[PC_CONTEXT_SWITCHES], pbuf[PC_PAGE_FAULTS]);
+	}
+    }
+
+    print_remote_intervals(test);
 }
 
 /**************************************************************************/
 
-/**
- * iperf_reporter_callback -- handles the report printing
- *
- */
-
-void
-iperf_reporter_callback(struct iperf_test *test)
+/* One of the peer's intervals, in the form of a JSON interval stream. */
+static cJSON *
+remote_interval_json(struct iperf_test *test, struct iperf_interval_stats *is)
 {
-    switch (test->state) {
-        case TEST_RUNNING:
-        case STREAM_RUNNING:
+    if (test->protocol->id != Pudp) {
+	if (!test->sender && test->sender_has_retransmits)
+	    return iperf_json_printf("start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  retransmits: %d  snd_cwnd: %d  rtt: %d  omitted: %b", is->start, is->end, is->duration, (int64_t) is->bytes, is->bits_per_second, (int64_t) is->retransmits, (int64_t) is->snd_cwnd, (int64_t) is->rtt, is->omitted);
+	else if (test->sender)
+	    return iperf_json_printf("start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  rcv_rtt: %d  omitted: %b", is->start, is->end, is->duration, (int64_t) is->bytes, is->bits_per_second, (int64_t) is->rcv_rtt, is->omitted);
+	else
+	    return iperf_json_printf("start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  omitted: %b", is->start, is->end, is->duration, (int64_t) is->bytes, is->bits_per_second, is->omitted);
+    }
+    if (!test->sender)
+	return iperf_json_printf("start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  packets: %d  omitted: %b", is->start, is->end, is->duration, (int64_t) is->bytes, is->bits_per_second, (int64_t) is->packets, is->omitted);
+    return iperf_json_printf("start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  jitter_ms: %f  lost_packets: %d  packets: %d  lost_percent: %f  omitted: %b", is->start, is->end, is->duration, (int64_t) is->bytes, is->bits_per_second, is->jitter_ms, (int64_t) is->lost_packets, (int64_t) is->packets, is->lost_percent, is->omitted);
+}
+
+/* Put the peer's intervals into the JSON intervals, as a "remote" array
+** in each stream's entry.  The two sides keep their own clocks and may
+** use different -i settings, so each remote interval goes with the local
+** one whose end is nearest to its own.
+*/
+static void
+print_remote_intervals(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    struct iperf_stream_result *rp;
+    struct iperf_interval_stats *is;
+    cJSON *json_interval, *json_stream, *json_socket, *json_end, *json_seconds, *json_remote;
+
+    if (!test->json_output || test->json_intervals == NULL)
+	return;
+    SLIST_FOREACH(sp, &test->streams, streams)
+	sp->result->remote_interval_printed = 0;
+
+    for (json_interval = test->json_intervals->child; json_interval != NULL; json_interval = json_interval->next) {
+	json_stream = cJSON_GetObjectItem(json_interval, "streams");
+	for (json_stream = json_stream != NULL ? json_stream->child : NULL; json_stream != NULL; json_stream = json_stream->next) {
+	    json_socket = cJSON_GetObjectItem(json_stream, "socket");
+	    json_end = cJSON_GetObjectItem(json_stream, "end");
+	    json_seconds = cJSON_GetObjectItem(json_stream, "seconds");
+	    if (json_socket == NULL || json_end == NULL || json_seconds == NULL)
+		continue;
+	    SLIST_FOREACH(sp, &test->streams, streams)
+		if (sp->socket == json_socket->valueint) break;
+	    if (sp == NULL)
+		continue;
+	    rp = sp->result;
+	    json_remote = NULL;
+	    while (rp->remote_interval_printed < rp->remote_interval_count) {
+		is = &rp->remote_intervals[rp->remote_interval_printed];
+		/* The last local interval takes whatever is left. */
+		if (json_interval->next != NULL && is->end >= json_end->valuefloat + json_seconds->valuefloat / 2)
+		    break;
+		if (json_remote == NULL) {
+		    json_remote = cJSON_CreateArray();
+		    if (json_remote == NULL)
+			return;
+		    cJSON_AddItemToObject(json_stream, "remote", json_remote);
+		}
+		cJSON_AddItemToArray(json_remote, remote_interval_json(test, is));
+		++rp->remote_interval_printed;
+	    }
+	}
+    }
+}
+
+/* Print the peer's intervals not shown yet, tagged with the peer's role.
+** Unless all is set, only those that end by the end of the last local
+** interval shown go out, so that each follows its own local line; the
+** rest wait for the next local interval or the final results.  None go
+** out before the first local interval, which prints the header.
+*/
+static void
+print_remote_interval_lines(struct iperf_test *test, int all)
+{
+    struct iperf_stream *sp;
+    struct iperf_stream_result *rp;
+    struct iperf_interval_stats *is;
+    char ubuf[UNIT_LEN];
+    char nbuf[UNIT_LEN];
+    char cbuf[UNIT_LEN];
+    char tbuf[UNIT_LEN];
+    const char *role, *tag;
+
+    if (test->json_output)
+	return;
+    role = test->sender ? report_receiver : report_sender;
+    snprintf(tbuf, sizeof(tbuf), "%s %s", role, report_omitted);
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	rp = sp->result;
+	if (TAILQ_EMPTY(&rp->interval_results))
+	    continue;
+	for (; rp->remote_interval_printed < rp->remote_interval_count; ++rp->remote_interval_printed) {
+	    is = &rp->remote_intervals[rp->remote_interval_printed];
+	    /* The two clocks differ a little; allow for a tenth. */
+	    if (!all && is->end - is->duration / 10 > rp->interval_printed_end)
+		break;
+	    tag = is->omitted ? tbuf : role;
+	    unit_snprintf(ubuf, UNIT_LEN, (double) is->bytes, 'A');
+	    unit_snprintf(nbuf, UNIT_LEN, is->bits_per_second / 8, test->settings->unit_format);
+	    if (test->protocol->id != Pudp) {
+		if (!test->sender && test->sender_has_retransmits) {
+		    unit_snprintf(cbuf, UNIT_LEN, is->snd_cwnd, 'A');
+		    iprintf(test, report_bw_retrans_cwnd_format, sp->socket, is->start, is->end, ubuf, nbuf, (unsigned) is->retransmits, cbuf, tag);
+		} else
+		    iprintf(test, report_bw_format, sp->socket, is->start, is->end, ubuf, nbuf, tag);
+	    } else if (!test->sender)
+		iprintf(test, report_bw_udp_sender_format, sp->socket, is->start, is->end, ubuf, nbuf, is->packets, tag);
+	    else
+		iprintf(test, report_bw_udp_format, sp->socket, is->start, is->end, ubuf, nbuf, is->jitter_ms, is->lost_packets, is->packets, is->lost_percent, tag);
+	}
+    }
+}
+
+/**************************************************************************/
+
+/**
+ * iperf_reporter_callback -- handles the report printing
+ *
+ */
+
+void
+iperf_reporter_callback(struct iperf_test *test)
+{
+    cJSON_Arena *prev;
+
+    /* Only the -J tree goes in the arena; the results exchange and
+    ** anything the caller builds meanwhile stay on the heap.
+    */
+    prev = cJSON_SetArena(test->json_arena);
+    switch (test->state) {
+        case TEST_RUNNING:
+        case STREAM_RUNNING:
             /* print interval results for each stream */
             iperf_print_intermediate(test);
+            print_remote_interval_lines(test, 0);
             break;
         case DISPLAY_RESULTS:
             iperf_print_intermediate(test);
+            print_remote_interval_lines(test, 1);
             iperf_print_results(test);
             break;
     } 
+    cJSON_SetArena(prev);
 
 }
 
@@ -2137,9 +3812,11 @@ print_interval_results(struct iperf_test *test, struct iperf_stream *sp, cJSON *
     char ubuf[UNIT_LEN];
     char nbuf[UNIT_LEN];
     char cbuf[UNIT_LEN];
+    char qbuf[UNIT_LEN];
     double st = 0., et = 0.;
     struct iperf_interval_results *irp = NULL;
     double bandwidth, lost_percent;
+    cJSON *json_interval_stream;
 
     irp = TAILQ_LAST(&sp->result->interval_results, irlisthead); /* get last entry in linked list */
     if (irp == NULL) {
@@ -2154,7 +3831,7 @@ print_interval_results(struct iperf_test *test, struct iperf_stream *sp, cJSON *
 	    ** else nothing.
 	    */
 	    if (timeval_equals(&sp->result->start_time, &irp->interval_start_time)) {
-		if (test->protocol->id == Ptcp || test->protocol->id == Psctp) {
+		if (test->protocol->id != Pudp) {
 		    if (test->sender && test->sender_has_retransmits)
 			iprintf(test, "%s", report_bw_retrans_cwnd_header);
 		    else
@@ -2176,15 +3853,17 @@ print_interval_results(struct iperf_test *test, struct iperf_stream *sp, cJSON *
     
     st = timeval_diff(&sp->result->start_time, &irp->interval_start_time);
     et = timeval_diff(&sp->result->start_time, &irp->interval_end_time);
+    sp->result->interval_printed_end = et;
     
-    if (test->protocol->id == Ptcp || test->protocol->id == Psctp) {
+    if (test->protocol->id != Pudp) {
 	if (test->sender && test->sender_has_retransmits) {
 	    /* Interval, TCP with retransmits. */
 	    if (test->json_output)
 		cJSON_AddItemToArray(json_interval_streams, iperf_json_printf("socket: %d  start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  retransmits: %d  snd_cwnd:  %d  omitted: %b", (int64_t) sp->socket, (double) st, (double) et, (double) irp->interval_duration, (int64_t) irp->bytes_transferred, bandwidth * 8, (int64_t) irp->interval_retrans, (int64_t) irp->snd_cwnd, irp->omitted));
-	    else
+	    else {
 		unit_snprintf(cbuf, UNIT_LEN, irp->snd_cwnd, 'A');
 		iprintf(test, report_bw_retrans_cwnd_format, sp->socket, st, et, ubuf, nbuf, irp->interval_retrans, cbuf, irp->omitted?report_omitted:"");
+	    }
 	} else {
 	    /* Interval, TCP without retransmits. */
 	    if (test->json_output)
@@ -2207,23 +3886,298 @@ print_interval_results(struct iperf_test *test, struct iperf_stream *sp, cJSON *
 		iprintf(test, report_bw_udp_format, sp->socket, st, et, ubuf, nbuf, irp->jitter * 1000.0, irp->interval_cnt_error, irp->interval_packet_count, lost_percent, irp->omitted?report_omitted:"");
 	}
     }
+
+    if (test->verify && !test->sender) {
+	if (test->json_output) {
+	    json_interval_stream = cJSON_GetArrayItem(json_interval_streams, cJSON_GetArraySize(json_interval_streams) - 1);
+	    if (json_interval_stream != NULL) {
+		cJSON_AddIntToObject(json_interval_stream, "corrupted_bytes", irp->interval_bytes_corrupted);
+		cJSON_AddIntToObject(json_interval_stream, "misordered_blocks", irp->interval_blocks_misordered);
+	    }
+	} else if (irp->interval_bytes_corrupted || irp->interval_blocks_misordered)
+	    iprintf(test, report_verify_interval, sp->socket, st, et, (unsigned long long) irp->interval_bytes_corrupted, irp->interval_blocks_misordered);
+    }
+
+    if (sp->diskfile_fd >= 0 && !test->sender) {
+	bandwidth = irp->interval_disk_time > 0 ? irp->interval_disk_bytes / irp->interval_disk_time : 0.0;
+	if (test->json_output) {
+	    json_interval_stream = cJSON_GetArrayItem(json_interval_streams, cJSON_GetArraySize(json_interval_streams) - 1);
+	    if (json_interval_stream != NULL) {
+		cJSON_AddIntToObject(json_interval_stream, "disk_bytes", irp->interval_disk_bytes);
+		cJSON_AddFloatToObject(json_interval_stream, "disk_seconds", irp->interval_disk_time);
+		cJSON_AddIntToObject(json_interval_stream, "disk_queued", irp->disk_queued);
+	    }
+	} else if (test->verbose) {
+	    unit_snprintf(ubuf, UNIT_LEN, (double) irp->interval_disk_bytes, 'A');
+	    unit_snprintf(nbuf, UNIT_LEN, bandwidth, test->settings->unit_format);
+	    unit_snprintf(qbuf, UNIT_LEN, (double) irp->disk_queued, 'A');
+	    iprintf(test, report_disk_interval, sp->socket, st, et, ubuf, nbuf, qbuf);
+	}
+    }
+
+    if (sp->mptcp) {
+	if (test->json_output) {
+	    json_interval_stream = cJSON_GetArrayItem(json_interval_streams, cJSON_GetArraySize(json_interval_streams) - 1);
+	    if (json_interval_stream != NULL)
+		iperf_mptcp_print(sp, st, et, irp->interval_duration, json_interval_stream);
+	} else
+	    iperf_mptcp_print(sp, st, et, irp->interval_duration, NULL);
+    }
+
+    if (sp->sctp && test->verbose) {
+	if (test->json_output) {
+	    json_interval_stream = cJSON_GetArrayItem(json_interval_streams, cJSON_GetArraySize(json_interval_streams) - 1);
+	    if (json_interval_stream != NULL)
+		iperf_sctp_print(sp, st, et, irp->interval_duration, json_interval_stream);
+	} else
+	    iperf_sctp_print(sp, st, et, irp->interval_duration, NULL);
+    }
+
+    if (test->verbose) {
+	bandwidth = irp->interval_net.syscalls > 0 ? (double) irp->interval_net.bytes / irp->interval_net.syscalls : 0.0;
+	if (test->json_output) {
+	    json_interval_stream = cJSON_GetArrayItem(json_interval_streams, cJSON_GetArraySize(json_interval_streams) - 1);
+	    if (json_interval_stream != NULL)
+		cJSON_AddItemToObject(json_interval_stream, "overhead", iperf_json_printf("syscalls: %d  bytes_per_syscall: %f  short_calls: %d  soft_errors: %d", (int64_t) irp->interval_net.syscalls, bandwidth, (int64_t) irp->interval_net.short_calls, (int64_t) irp->interval_net.soft_errors));
+	} else {
+	    unit_snprintf(ubuf, UNIT_LEN, bandwidth, 'A');
+	    iprintf(test, report_overhead_interval, sp->socket, st, et, (unsigned long long) irp->interval_net.syscalls, ubuf, (unsigned long long) irp->interval_net.short_calls, (unsigned long long) irp->interval_net.soft_errors);
+	}
+    }
 }
 
 /**************************************************************************/
+
+/* A buffer goes on huge pages only if rounding it up to whole pages
+** wastes no more than this fraction of it.
+*/
+#define HUGEPAGE_SLACK 8
+
+/* Stream buffers in the test's mapping start on a cache line. */
+#define BUFFER_ALIGN 64
+
+/* The default huge page size, from /proc/meminfo; 2 MB if that can't
+** be read.
+*/
+static size_t
+hugepage_size(void)
+{
+    static size_t size;
+    char line[128];
+    unsigned long kb;
+    FILE *fp;
+
+    if (size != 0)
+	return size;
+    size = 2 * MB;
+    fp = fopen("/proc/meminfo", "r");
+    if (fp == NULL)
+	return size;
+    while (fgets(line, sizeof(line), fp) != NULL)
+	if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1) {
+	    if (kb != 0 && (kb & (kb - 1)) == 0)
+		size = kb * 1024;
+	    break;
+	}
+    fclose(fp);
+    return size;
+}
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/* Map a buffer of at least size bytes.  -Z needs a file behind the
+** buffer to sendfile() from; otherwise the buffer is anonymous memory,
+** on hugetlb pages if any are reserved, else advised for transparent
+** huge pages.
+*/
+static char *
+iperf_map_buffer(struct iperf_test *test, size_t size, int *fdp, size_t *lenp)
+{
+    char template[] = "/tmp/iperf3.XXXXXX";
+    char *buf;
+    size_t len, hp;
+    int fd;
+
+    *fdp = -1;
+    if (test->zerocopy) {
+	fd = mkstemp(template);
+	if (fd == -1)
+	    return NULL;
+	if (unlink(template) < 0 || ftruncate(fd, size) < 0) {
+	    close(fd);
+	    return NULL;
+	}
+	buf = (char *) mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+	if (buf == MAP_FAILED) {
+	    close(fd);
+	    return NULL;
+	}
+	*fdp = fd;
+	*lenp = size;
+	test->buffer_bytes += size;
+	return buf;
+    }
+
+    hp = hugepage_size();
+    len = (size + hp - 1) & ~(hp - 1);
+    if (len - size > size / HUGEPAGE_SLACK) {
+	buf = (char *) mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED)
+	    return NULL;
+	*lenp = size;
+	test->buffer_bytes += size;
+	return buf;
+    }
+
+#ifdef MAP_HUGETLB
+    buf = (char *) mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+    if (buf != MAP_FAILED) {
+	*lenp = len;
+	test->buffer_bytes += len;
+	test->buffer_hugetlb_bytes += len;
+	return buf;
+    }
+#endif
+    buf = (char *) mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (buf == MAP_FAILED)
+	return NULL;
+#ifdef MADV_HUGEPAGE
+    if (madvise(buf, len, MADV_HUGEPAGE) == 0)
+	test->buffer_thp_bytes += len;
+#endif
+    *lenp = len;
+    test->buffer_bytes += len;
+    return buf;
+}
+
+/* Map the test's stream buffers.  They are carved out of one mapping,
+** so that it is num_streams * blksize that gets rounded up to huge
+** pages; a single block rarely comes close to a multiple of one.  With
+** --shared-buffer the mapping is that one block.  Without it, -Z keeps
+** a file per stream, since sendfile() sends from the start of it.
+*/
+static int
+iperf_map_buffers(struct iperf_test *test)
+{
+    size_t stride = (test->settings->blksize + BUFFER_ALIGN - 1) & ~(size_t) (BUFFER_ALIGN - 1);
+    size_t size;
+
+    if (test->shared_buffer)
+	size = test->settings->blksize;
+    else if (test->zerocopy)
+	return 0;
+    else
+	size = stride * (test->num_streams > 0 ? test->num_streams : 1);
+    test->buffers = iperf_map_buffer(test, size, &test->buffers_fd, &test->buffers_len);
+    if (test->buffers == NULL)
+	return -1;
+    test->buffers_used = 0;
+    return 0;
+}
+
+/* Give a stream its buffer, filled with the --payload content.  With
+** --shared-buffer every stream of the test uses the same one; nothing
+** holds on to the buffer contents between one send or receive and the
+** next, so this is safe in a single-threaded process.
+*/
+static int
+iperf_alloc_stream_buffer(struct iperf_test *test, struct iperf_stream *sp, int s)
+{
+    int blksize = test->settings->blksize;
+    size_t stride = (blksize + BUFFER_ALIGN - 1) & ~(size_t) (BUFFER_ALIGN - 1);
+    char *buf;
+    size_t len;
+    int fd;
+
+    if (test->buffers == NULL && iperf_map_buffers(test) < 0)
+	return -1;
+
+    if (test->shared_buffer && test->buffers_used != 0) {
+	sp->buffer = test->buffers;
+	sp->buffer_fd = test->buffers_fd;
+	sp->buffer_len = 0;
+	return 0;
+    }
+
+    if (test->verify && test->verify_template == NULL) {
+	test->verify_template = (char *) malloc(blksize);
+	if (test->verify_template == NULL)
+	    return -1;
+	payload_generate(test->verify_template, blksize, test->payload_type, test->payload_compress, payload_key(test->cookie));
+    }
+
+    if (test->buffers != NULL && test->buffers_used + blksize <= test->buffers_len) {
+	/* The next block of the test's mapping. */
+	buf = test->buffers + test->buffers_used;
+	fd = test->buffers_fd;
+	len = 0;
+	test->buffers_used += stride;
+    } else {
+	/* -Z, or a stream beyond -P: a mapping of its own. */
+	buf = iperf_map_buffer(test, blksize, &fd, &len);
+	if (buf == NULL)
+	    return -1;
+    }
+    test->buffer_count++;
+    if (test->verify)
+	memcpy(buf, test->verify_template, blksize);
+    else {
+	/* Each stream gets its own data, seeded from the test cookie. */
+	payload_generate(buf, blksize, test->payload_type, test->payload_compress, payload_key(test->cookie) + (uint64_t) s * 0x9e3779b97f4a7c15ULL);
+    }
+
+    sp->buffer = buf;
+    sp->buffer_fd = fd;
+    sp->buffer_len = len;
+    return 0;
+}
+
+static void
+iperf_free_stream_buffer(struct iperf_stream *sp)
+{
+    if (sp->buffer_len == 0)
+	return;
+    munmap(sp->buffer, sp->buffer_len);
+    if (sp->buffer_fd >= 0)
+	close(sp->buffer_fd);
+}
+
+static void
+iperf_free_buffers(struct iperf_test *test)
+{
+    if (test->buffers == NULL)
+	return;
+    munmap(test->buffers, test->buffers_len);
+    if (test->buffers_fd >= 0)
+	close(test->buffers_fd);
+    test->buffers = NULL;
+    test->buffers_fd = -1;
+    test->buffers_len = 0;
+    test->buffers_used = 0;
+}
+
 void
 iperf_free_stream(struct iperf_stream *sp)
 {
     struct iperf_interval_results *irp, *nirp;
 
     /* XXX: need to free interval list too! */
-    munmap(sp->buffer, sp->test->settings->blksize);
-    close(sp->buffer_fd);
-    if (sp->diskfile_fd >= 0)
+    iperf_free_stream_buffer(sp);
+    iperf_shm_free(sp);
+    iperf_tcp_tls_free(sp);
+    iperf_mptcp_free(sp);
+    iperf_sctp_free(sp);
+    if (sp->diskfile_fd >= 0 && !sp->test->sender)
+	diskfile_close_recv(sp);
+    else if (sp->diskfile_fd >= 0)
 	close(sp->diskfile_fd);
     for (irp = TAILQ_FIRST(&sp->result->interval_results); irp != TAILQ_END(sp->result->interval_results); irp = nirp) {
         nirp = TAILQ_NEXT(irp, irlistentries);
         free(irp);
     }
+    free(sp->result->remote_intervals);
     free(sp->result);
     if (sp->send_timer != NULL)
 	tmr_cancel(sp->send_timer);
@@ -2234,9 +4188,7 @@ iperf_free_stream(struct iperf_stream *sp)
 struct iperf_stream *
 iperf_new_stream(struct iperf_test *test, int s)
 {
-    int i;
     struct iperf_stream *sp;
-    char template[] = "/tmp/iperf3.XXXXXX";
 
     h_errno = 0;
 
@@ -2260,63 +4212,77 @@ iperf_new_stream(struct iperf_test *test, int s)
     memset(sp->result, 0, sizeof(struct iperf_stream_result));
     TAILQ_INIT(&sp->result->interval_results);
     
-    /* Create and randomize the buffer */
-    sp->buffer_fd = mkstemp(template);
-    if (sp->buffer_fd == -1) {
-        i_errno = IECREATESTREAM;
-        free(sp->result);
-        free(sp);
-        return NULL;
-    }
-    if (unlink(template) < 0) {
-        i_errno = IECREATESTREAM;
-        free(sp->result);
-        free(sp);
-        return NULL;
-    }
-    if (ftruncate(sp->buffer_fd, test->settings->blksize) < 0) {
+    /* Create and fill the buffer */
+    if (iperf_alloc_stream_buffer(test, sp, s) < 0) {
         i_errno = IECREATESTREAM;
         free(sp->result);
         free(sp);
         return NULL;
     }
-    sp->buffer = (char *) mmap(NULL, test->settings->blksize, PROT_READ|PROT_WRITE, MAP_PRIVATE, sp->buffer_fd, 0);
-    if (sp->buffer == MAP_FAILED) {
-        i_errno = IECREATESTREAM;
-        free(sp->result);
-        free(sp);
-        return NULL;
-    }
-    srandom(time(NULL));
-    for (i = 0; i < test->settings->blksize; ++i)
-        sp->buffer[i] = random();
 
     /* Set socket */
     sp->socket = s;
 
     sp->snd = test->protocol->send;
     sp->rcv = test->protocol->recv;
+    /* -F and --verify still wrap it, so their cost is measured too. */
+    if (test->null_send)
+	sp->snd = null_send;
 
+    sp->diskfile_pipe[0] = sp->diskfile_pipe[1] = -1;
     if (test->diskfile_name != (char*) 0) {
-	sp->diskfile_fd = open(test->diskfile_name, test->sender ? O_RDONLY : (O_WRONLY|O_CREAT|O_TRUNC));
+	if (test->sender) {
+	    sp->diskfile_fd = open(test->diskfile_name, O_RDONLY);
+	    if (sp->diskfile_fd >= 0 && diskfile_range(sp) < 0) {
+		close(sp->diskfile_fd);
+		sp->diskfile_fd = -1;
+	    }
+	} else
+	    (void) diskfile_open_recv(sp);
 	if (sp->diskfile_fd == -1) {
 	    i_errno = IEFILE;
-            munmap(sp->buffer, sp->test->settings->blksize);
+            iperf_free_stream_buffer(sp);
             free(sp->result);
             free(sp);
 	    return NULL;
 	}
-        sp->snd2 = sp->snd;
-	sp->snd = diskfile_send;
-	sp->rcv2 = sp->rcv;
-	sp->rcv = diskfile_recv;
+	/* With -Z, TCP can send straight from the file. */
+	if (test->zerocopy && test->protocol->id == Ptcp)
+	    sp->snd = diskfile_sendfile;
+	else {
+	    sp->snd2 = sp->snd;
+	    sp->snd = diskfile_send;
+	}
+#if defined(linux) && defined(SPLICE_F_MOVE)
+	if (sp->diskfile_pipe[0] >= 0)
+	    sp->rcv = diskfile_splice;
+	else
+#endif
+	{
+	    sp->rcv2 = sp->rcv;
+	    sp->rcv = diskfile_recv;
+	}
     } else
         sp->diskfile_fd = -1;
 
+    if (test->verify) {
+	/* snd2 and rcv2 hold one wrapped routine; -F has them already.
+	** The option checks keep the two apart, and this makes sure.
+	*/
+	if (sp->snd2 != NULL || sp->rcv2 != NULL || sp->diskfile_fd >= 0) {
+	    iperf_free_stream(sp);
+	    i_errno = IEVERIFY;
+	    return NULL;
+	}
+        sp->snd2 = sp->snd;
+	sp->snd = verify_send;
+	sp->rcv2 = sp->rcv;
+	sp->rcv = verify_recv;
+    }
+
     /* Initialize stream */
     if (iperf_init_stream(sp, test) < 0) {
-        close(sp->buffer_fd);
-        munmap(sp->buffer, sp->test->settings->blksize);
+        iperf_free_stream_buffer(sp);
         free(sp->result);
         free(sp);
         return NULL;
@@ -2397,28 +4363,365 @@ iperf_add_stream(struct iperf_test *test, struct iperf_stream *sp)
 ** case of no -F flag, there is zero extra overhead.
 */
 
+/* Give each sending stream its own slice of the -F file, in whole
+** blocks, so that parallel streams send the file between them.
+*/
+static int
+diskfile_range(struct iperf_stream *sp)
+{
+    struct iperf_test *test = sp->test;
+    struct iperf_stream *s;
+    struct stat sb;
+    off_t chunk;
+    int idx = 0;
+
+    if (fstat(sp->diskfile_fd, &sb) < 0)
+	return -1;
+    SLIST_FOREACH(s, &test->streams, streams)
+	++idx;
+    chunk = (sb.st_size + test->num_streams - 1) / test->num_streams;
+    chunk = (chunk + test->settings->blksize - 1) / test->settings->blksize * test->settings->blksize;
+    sp->diskfile_start = (off_t) idx * chunk;
+    if (sp->diskfile_start > sb.st_size)
+	sp->diskfile_start = sb.st_size;
+    sp->diskfile_end = sp->diskfile_start + chunk;
+    if (sp->diskfile_end > sb.st_size)
+	sp->diskfile_end = sb.st_size;
+    sp->diskfile_offset = sp->diskfile_start;
+    return 0;
+}
+
+/* The test is over once every stream has sent its slice of the file. */
+static void
+diskfile_eof(struct iperf_stream *sp)
+{
+    struct iperf_stream *s;
+
+    sp->diskfile_eof = 1;
+    SLIST_FOREACH(s, &sp->test->streams, streams)
+	if (!s->diskfile_eof)
+	    return;
+    sp->test->done = 1;
+}
+
 static int
 diskfile_send(struct iperf_stream *sp)
 {
+    struct timeval before, after;
+    size_t n;
     int r;
 
-    r = read(sp->diskfile_fd, sp->buffer, sp->test->settings->blksize);
-    if (r == 0)
-        sp->test->done = 1;
-    else
-	r = sp->snd2(sp);
+    n = sp->settings->blksize;
+    if (sp->diskfile_end - sp->diskfile_offset < n)
+	n = sp->diskfile_end - sp->diskfile_offset;
+    if (n == 0) {
+	diskfile_eof(sp);
+	return 0;
+    }
+
+    gettimeofday(&before, NULL);
+    r = pread(sp->diskfile_fd, sp->buffer, n, sp->diskfile_offset);
+    gettimeofday(&after, NULL);
+    if (r < 0)
+	return NET_HARDERROR;
+    if (r == 0) {
+	/* The file got shorter under us. */
+	diskfile_eof(sp);
+	return 0;
+    }
+    sp->diskfile_offset += r;
+    sp->diskfile_read_bytes += r;
+    sp->diskfile_read_time += timeval_diff(&before, &after);
+
+    return sp->snd2(sp);
+}
+
+/* diskfile_sendfile
+ *
+ * -F with -Z over TCP: the kernel reads the file and sends it, with no
+ * copy through sp->buffer.  The time spent here covers the disk read
+ * and the socket send together.
+ */
+static int
+diskfile_sendfile(struct iperf_stream *sp)
+{
+    struct timeval before, after;
+    size_t n;
+    int r;
+
+    n = sp->settings->blksize;
+    if (sp->diskfile_end - sp->diskfile_offset < n)
+	n = sp->diskfile_end - sp->diskfile_offset;
+    if (n == 0) {
+	diskfile_eof(sp);
+	return 0;
+    }
+
+    gettimeofday(&before, NULL);
+    r = Nsendfile_at(sp->diskfile_fd, sp->socket, sp->diskfile_offset, n);
+    gettimeofday(&after, NULL);
+    if (r < 0)
+	return r;
+    sp->diskfile_offset += r;
+    sp->diskfile_read_bytes += r;
+    sp->diskfile_read_time += timeval_diff(&before, &after);
+
+    sp->result->bytes_sent += r;
+    sp->result->bytes_sent_this_interval += r;
     return r;
 }
 
+/* diskfile_open_recv
+ *
+ * Open the -F file for a receiving stream.  Data is gathered in a
+ * write-behind buffer and written DISKFILE_WB_SIZE at a time, so the
+ * receive loop does not wait on the disk for every block; for
+ * --file-write direct the buffer and the writes are aligned for
+ * O_DIRECT.  --file-write splice instead moves TCP data from the socket
+ * to the file through a pipe, without it passing through user space.
+ */
+static int
+diskfile_open_recv(struct iperf_stream *sp)
+{
+    struct iperf_test *test = sp->test;
+    int flags = O_WRONLY|O_CREAT|O_TRUNC;
+    void *wb;
+
+#ifdef O_DIRECT
+    if (test->diskfile_write == DISKFILE_WRITE_DIRECT)
+	flags |= O_DIRECT;
+#endif
+    sp->diskfile_fd = open(test->diskfile_name, flags, 0644);
+    if (sp->diskfile_fd == -1)
+	return -1;
+
+#if defined(linux) && defined(SPLICE_F_MOVE)
+    if (test->diskfile_write == DISKFILE_WRITE_SPLICE && test->protocol->id == Ptcp) {
+	if (pipe(sp->diskfile_pipe) < 0)
+	    goto fail;
+#ifdef F_SETPIPE_SZ
+	(void) fcntl(sp->diskfile_pipe[1], F_SETPIPE_SZ, test->settings->blksize);
+#endif
+	return 0;
+    }
+#endif
+
+    if (posix_memalign(&wb, DISKFILE_ALIGN, DISKFILE_WB_SIZE + test->settings->blksize) != 0)
+	goto fail;
+    sp->diskfile_wb = (char *) wb;
+    sp->diskfile_wb_len = 0;
+    return 0;
+
+  fail:
+    close(sp->diskfile_fd);
+    sp->diskfile_fd = -1;
+    return -1;
+}
+
+/* Write out the write-behind buffer.  O_DIRECT writes must be whole
+** aligned blocks, so until the final flush any unaligned tail is kept
+** back for next time; the final flush writes it with O_DIRECT turned off.
+*/
+static void
+diskfile_flush(struct iperf_stream *sp, int final)
+{
+    struct timeval before, after;
+    size_t n, done;
+    ssize_t r;
+
+    n = sp->diskfile_wb_len;
+    if (sp->test->diskfile_write == DISKFILE_WRITE_DIRECT && n % DISKFILE_ALIGN != 0) {
+#ifdef O_DIRECT
+	if (final)
+	    (void) fcntl(sp->diskfile_fd, F_SETFL, fcntl(sp->diskfile_fd, F_GETFL) & ~O_DIRECT);
+	else
+#endif
+	    n -= n % DISKFILE_ALIGN;
+    }
+    if (n == 0)
+	return;
+
+    gettimeofday(&before, NULL);
+    for (done = 0; done < n; done += r) {
+	r = write(sp->diskfile_fd, sp->diskfile_wb + done, n - done);
+	if (r < 0 && errno == EINTR)
+	    r = 0;
+	else if (r <= 0)
+	    break;
+    }
+    gettimeofday(&after, NULL);
+    sp->diskfile_written += done;
+    sp->diskfile_write_time += timeval_diff(&before, &after);
+
+    /* Whatever could not be written is dropped, as before. */
+    memmove(sp->diskfile_wb, sp->diskfile_wb + n, sp->diskfile_wb_len - n);
+    sp->diskfile_wb_len -= n;
+}
+
+static void
+diskfile_sync(struct iperf_stream *sp)
+{
+    struct timeval before, after;
+
+    gettimeofday(&before, NULL);
+    (void) fsync(sp->diskfile_fd);
+    gettimeofday(&after, NULL);
+    sp->diskfile_write_time += timeval_diff(&before, &after);
+    sp->diskfile_syncs++;
+}
+
+/* Called from the stats callback: apply the --file-sync policy at the
+** end of each interval and of the test.
+*/
+static void
+diskfile_interval(struct iperf_stream *sp, int final)
+{
+    int policy = sp->test->diskfile_sync;
+
+    if (!final && policy != DISKFILE_SYNC_INTERVAL)
+	return;
+    if (sp->diskfile_wb != NULL)
+	diskfile_flush(sp, final);
+    if (policy != DISKFILE_SYNC_NONE)
+	diskfile_sync(sp);
+}
+
+static void
+diskfile_close_recv(struct iperf_stream *sp)
+{
+    /* Anything drained after the end of the test. */
+    if (sp->diskfile_wb != NULL) {
+	diskfile_flush(sp, 1);
+	free(sp->diskfile_wb);
+    }
+    if (sp->diskfile_pipe[0] >= 0) {
+	close(sp->diskfile_pipe[0]);
+	close(sp->diskfile_pipe[1]);
+    }
+    close(sp->diskfile_fd);
+}
+
 static int
 diskfile_recv(struct iperf_stream *sp)
+{
+    char *buffer;
+    int r;
+
+    /* Receive straight into the write-behind buffer; it always has room
+    ** for one more block.
+    */
+    buffer = sp->buffer;
+    sp->buffer = sp->diskfile_wb + sp->diskfile_wb_len;
+    r = sp->rcv2(sp);
+    sp->buffer = buffer;
+    if (r > 0) {
+	sp->diskfile_wb_len += r;
+	if (sp->diskfile_wb_len >= DISKFILE_WB_SIZE)
+	    diskfile_flush(sp, 0);
+    }
+    return r;
+}
+
+#if defined(linux) && defined(SPLICE_F_MOVE)
+static int
+diskfile_splice(struct iperf_stream *sp)
+{
+    struct timeval before, after;
+    size_t nleft = sp->settings->blksize;
+    ssize_t r, w;
+
+    while (nleft > 0) {
+	r = splice(sp->socket, NULL, sp->diskfile_pipe[1], NULL, nleft, SPLICE_F_MOVE);
+	if (r < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return NET_HARDERROR;
+	} else if (r == 0)
+	    break;
+	nleft -= r;
+
+	gettimeofday(&before, NULL);
+	while (r > 0) {
+	    w = splice(sp->diskfile_pipe[0], NULL, sp->diskfile_fd, NULL, r, SPLICE_F_MOVE);
+	    if (w < 0 && errno == EINTR)
+		continue;
+	    if (w <= 0)
+		return NET_HARDERROR;
+	    r -= w;
+	    sp->diskfile_written += w;
+	}
+	gettimeofday(&after, NULL);
+	sp->diskfile_write_time += timeval_diff(&before, &after);
+    }
+
+    r = sp->settings->blksize - nleft;
+    sp->result->bytes_received += r;
+    sp->result->bytes_received_this_interval += r;
+    return r;
+}
+#endif
+
+
+/* --null: count the block as sent and drop it, with no system call,
+** so the test shows how many blocks iperf_send(), the throttle, timers
+** and statistics can drive by themselves.
+*/
+static int
+null_send(struct iperf_stream *sp)
+{
+    sp->result->bytes_sent += sp->settings->blksize;
+    sp->result->bytes_sent_this_interval += sp->settings->blksize;
+    return sp->settings->blksize;
+}
+
+/* The UDP header (timestamp and sequence number) occupies the start of
+** each datagram; everything after it is checked against the template.
+*/
+#define VERIFY_UDP_HEADER 12
+
+/* On a byte stream, a send cut short (by a signal) leaves the rest of
+** its block to go out before the next one: the receiver checks each byte
+** against its offset in the stream.  The stamp is always that of the
+** block the next byte belongs to, so it changes only once a whole block
+** has gone out.
+*/
+static int
+verify_send(struct iperf_stream *sp)
+{
+    size_t blksize = sp->settings->blksize;
+    size_t pos = sp->verify.offset % blksize;
+    int r;
+
+    if (sp->test->protocol->id == Pudp)
+	r = sp->snd2(sp);
+    else {
+	payload_stamp(sp->buffer, sp->verify.offset / blksize);
+	if (pos == 0)
+	    r = sp->snd2(sp);
+	else {
+	    r = Nwrite(sp->socket, sp->buffer + pos, blksize - pos, sp->test->protocol->id);
+	    if (r > 0) {
+		sp->result->bytes_sent += r;
+		sp->result->bytes_sent_this_interval += r;
+	    }
+	}
+    }
+    if (r > 0)
+	sp->verify.offset += r;
+    return r;
+}
+
+static int
+verify_recv(struct iperf_stream *sp)
 {
     int r;
 
     r = sp->rcv2(sp);
     if (r > 0) {
-	(void) write(sp->diskfile_fd, sp->buffer, r);
-	(void) fsync(sp->diskfile_fd);
+	if (sp->test->protocol->id == Pudp)
+	    payload_check_block(&sp->verify, sp->test->verify_template, VERIFY_UDP_HEADER, sp->buffer, r);
+	else
+	    payload_check_stream(&sp->verify, sp->test->verify_template, sp->settings->blksize, sp->buffer, r);
     }
     return r;
 }
@@ -2453,8 +4756,12 @@ iperf_got_sigend(struct iperf_test *test)
 
     if (test->ctrl_sck >= 0) {
 	test->state = (test->role == 'c') ? CLIENT_TERMINATE : SERVER_TERMINATE;
+	(void) iperf_ctrl_flush(test, 1);
 	(void) Nwrite(test->ctrl_sck, (char*) &test->state, sizeof(signed char), Ptcp);
     }
+    if (test->role == 's' && test->settings->domain == AF_UNIX)
+	iperf_unix_unlink(test);
+    iperf_mptcp_del_endpoints(test);
     i_errno = (test->role == 'c') ? IECLIENTTERM : IESERVERTERM;
     iperf_errexit(test, "interrupt - %s", iperf_strerror(i_errno));
 }
@@ -2496,39 +4803,60 @@ iperf_delete_pidfile(struct iperf_test *test)
 int
 iperf_json_start(struct iperf_test *test)
 {
+    cJSON_Arena *prev;
+    int r = -1;
+
+    /* The tree grows by an object per interval for the whole test and
+    ** is thrown away at the end, so build it in an arena.  The arena is
+    ** current only while something is added to the tree: other trees
+    ** built in this thread meanwhile must not end up in it.
+    */
+    if (test->json_arena)
+	cJSON_DeleteArena(test->json_arena);
+    test->json_arena = cJSON_NewArena();
+    if (test->json_arena == NULL)
+        return -1;
+    prev = cJSON_SetArena(test->json_arena);
     test->json_top = cJSON_CreateObject();
     if (test->json_top == NULL)
-        return -1;
+        goto out;
     if (test->title)
 	cJSON_AddStringToObject(test->json_top, "title", test->title);
     test->json_start = cJSON_CreateObject();
     if (test->json_start == NULL)
-        return -1;
+        goto out;
     cJSON_AddItemToObject(test->json_top, "start", test->json_start);
     test->json_intervals = cJSON_CreateArray();
     if (test->json_intervals == NULL)
-        return -1;
+        goto out;
     cJSON_AddItemToObject(test->json_top, "intervals", test->json_intervals);
     test->json_end = cJSON_CreateObject();
     if (test->json_end == NULL)
-        return -1;
+        goto out;
     cJSON_AddItemToObject(test->json_top, "end", test->json_end);
-    return 0;
+    r = 0;
+out:
+    cJSON_SetArena(prev);
+    return r;
 }
 
 int
 iperf_json_finish(struct iperf_test *test)
 {
-    char *str;
+    int rc;
 
-    str = cJSON_Print(test->json_top);
-    if (str == NULL)
-        return -1;
-    fputs(str, stdout);
-    putchar('\n');
+    /* Stream the document rather than building it in memory first; the
+    ** lock keeps it in one piece when several threads run tests.
+    */
+    flockfile(stdout);
+    rc = cJSON_PrintToFile(test->json_top, stdout, 1);
+    putchar_unlocked('\n');
     fflush(stdout);
-    free(str);
-    cJSON_Delete(test->json_top);
+    funlockfile(stdout);
+    if (rc < 0)
+        return -1;
+    cJSON_DeleteArena(test->json_arena);
+    test->json_arena = NULL;
     test->json_top = test->json_start = test->json_intervals = test->json_end = NULL;
     return 0;
 }
@@ -12,6 +12,15 @@
 
 #include <setjmp.h>
 
+/* Library state that is not kept in a struct iperf_test - the timer
+** lists, i_errno and the CPU accounting - is kept per thread, so that
+** separate threads can each run their own tests.  Such programs should
+** leave may_use_sigalrm off, since SIGALRM and its timer are process-wide.
+*/
+#ifndef IPERF_TLS
+#define IPERF_TLS __thread
+#endif
+
 struct iperf_test;
 struct iperf_stream_result;
 struct iperf_interval_results;
@@ -21,12 +30,43 @@ struct iperf_stream;
 #define Ptcp SOCK_STREAM
 #define Pudp SOCK_DGRAM
 #define Psctp 12
+#define Punix 13	/* AF_UNIX SOCK_STREAM */
+#define Punixseq 14	/* AF_UNIX SOCK_SEQPACKET */
+#define Pshm 15	/* shared-memory ring, AF_UNIX for wakeups */
 #define DEFAULT_UDP_BLKSIZE 8192
 #define DEFAULT_TCP_BLKSIZE (128 * 1024)  /* default read/write block size */
 #define DEFAULT_SCTP_BLKSIZE (64 * 1024)
 
 /* short option equivalents, used to support options that only have long form */
 #define OPT_SCTP 1
+#define OPT_FAST_OPEN 2
+#define OPT_VERIFY 3
+#define OPT_PAYLOAD 4
+#define OPT_SHARED_BUFFER 5
+#define OPT_FILE_SYNC 6
+#define OPT_FILE_WRITE 7
+#define OPT_PERF_COUNTERS 8
+#define OPT_UNIX 9
+#define OPT_UNIX_SEQPACKET 10
+#define OPT_SHM 11
+#define OPT_NULL 12
+#define OPT_KTLS 13
+#define OPT_MPTCP 14
+#define OPT_MPTCP_ENDPOINT 15
+#define OPT_SCTP_STREAMS 16
+#define OPT_SCTP_UNORDERED 17
+#define OPT_SCTP_PR 18
+#define OPT_SCTP_BINDX 19
+
+/* --file-sync policies */
+#define DISKFILE_SYNC_NONE 0
+#define DISKFILE_SYNC_END 1
+#define DISKFILE_SYNC_INTERVAL 2
+
+/* --file-write methods */
+#define DISKFILE_WRITE_BUFFERED 0
+#define DISKFILE_WRITE_DIRECT 1
+#define DISKFILE_WRITE_SPLICE 2
 
 /* states */
 #define TEST_START 1
@@ -45,6 +85,7 @@ struct iperf_stream;
 #define DISPLAY_RESULTS 14
 #define IPERF_START 15
 #define IPERF_DONE 16
+#define INTERVAL_RESULTS 17	/* server to client, when "live_intervals" was asked for */
 #define ACCESS_DENIED (-1)
 #define SERVER_ERROR (-2)
 
@@ -85,12 +126,62 @@ void	iperf_set_test_socket_bufsize( struct iperf_test* ipt, int socket_bufsize )
 void	iperf_set_test_num_streams( struct iperf_test* ipt, int num_streams );
 void	iperf_set_test_role( struct iperf_test* ipt, char role );
 void	iperf_set_test_server_hostname( struct iperf_test* ipt, char* server_hostname );
+void	iperf_set_test_bind_address( struct iperf_test* ipt, char* bind_address );
+/* Use AF_UNIX sockets: the server hostname and bind address are paths. */
+void	iperf_set_test_unix( struct iperf_test* ipt, int seqpacket );
 void	iperf_set_test_reverse( struct iperf_test* ipt, int reverse );
 void	iperf_set_test_json_output( struct iperf_test* ipt, int json_output );
 int	iperf_has_zerocopy( void );
 void	iperf_set_test_zerocopy( struct iperf_test* ipt, int zerocopy );
+/* Senders discard every block (--null). */
+void	iperf_set_test_null( struct iperf_test* ipt, int null_send );
 void	iperf_set_test_may_use_sigalrm( struct iperf_test* ipt, int may_use_sigalrm );
 
+/* Results of one reporting interval, for one stream or summed over
+** all of them, as handed to an interval callback.  Fields that do not
+** apply to the test (retransmits for a receiver, jitter for TCP, ...)
+** are zero; TCP fields the OS cannot report are -1.  The sum adds up
+** the streams' counts; its rtt and rcv_rtt are the largest of theirs.
+*/
+struct iperf_interval_stats
+{
+    int       stream_id;		/* 0 for the sum */
+    int       omitted;			/* interval falls in the -O period */
+    double    start;			/* seconds since the test started */
+    double    end;
+    double    duration;
+    uint64_t  bytes;
+    double    bits_per_second;
+
+    /* TCP sender */
+    long      retransmits;		/* -1 if unknown */
+    long      snd_cwnd;			/* bytes, -1 if unknown */
+    long      rtt;			/* microseconds, smoothed, -1 if unknown */
+
+    /* UDP */
+    int       packets;
+    int       lost_packets;
+    double    lost_percent;
+    double    jitter_ms;		/* mean of the streams in the sum */
+
+    /* TCP receiver */
+    long      rcv_rtt;			/* microseconds, -1 if unknown */
+};
+
+/* Called as each stats interval closes, before any report is printed.
+** streams holds nstreams entries; the array and sum are only valid for
+** the duration of the call.  Nothing on this path formats text or
+** builds JSON, so it is cheap to use with short -i intervals.
+** Returns 0 to go on, or -1 to stop the test: a client then ends it as
+** when its time is up (after any -O period), with full results.  A
+** server's test runs until the client ends it, whatever this returns.
+*/
+typedef int (*iperf_interval_callback)(struct iperf_test *test,
+    const struct iperf_interval_stats *streams, int nstreams,
+    const struct iperf_interval_stats *sum, void *arg);
+
+void	iperf_set_test_interval_callback( struct iperf_test* ipt, iperf_interval_callback callback, void *arg );
+
 /**
  * exchange_parameters - handles the param_Exchange part for client
  *
@@ -170,10 +261,14 @@ int has_tcpinfo_retransmits(void);
 void save_tcpinfo(struct iperf_stream *sp, struct iperf_interval_results *irp);
 long get_total_retransmits(struct iperf_interval_results *irp);
 long get_snd_cwnd(struct iperf_interval_results *irp);
+long get_rtt(struct iperf_interval_results *irp);
+long get_rcv_rtt(struct iperf_interval_results *irp);
 void print_tcpinfo(struct iperf_test *test);
 void build_tcpinfo_message(struct iperf_interval_results *r, char *message);
 
 int iperf_set_send_state(struct iperf_test *test, signed char state);
+int iperf_ctrl_flush(struct iperf_test *test, int block);
+int iperf_recv_interval_push(struct iperf_test *test);
 void iperf_check_throttle(struct iperf_stream *sp, struct timeval *nowP);
 int iperf_send(struct iperf_test *, fd_set *) /* __attribute__((hot)) */;
 int iperf_recv(struct iperf_test *, fd_set *);
@@ -185,12 +280,14 @@ void warning(char *);
 int iperf_exchange_results(struct iperf_test *);
 int iperf_init_test(struct iperf_test *);
 int iperf_create_send_timers(struct iperf_test *);
+/* Uses getopt(), so only one thread may parse arguments at a time. */
 int iperf_parse_arguments(struct iperf_test *, int, char **);
 void iperf_reset_test(struct iperf_test *);
 void iperf_reset_stats(struct iperf_test * test);
 
 struct protocol *get_protocol(struct iperf_test *, int);
 int set_protocol(struct iperf_test *, int);
+int iperf_resolve_addresses(struct iperf_test *);
 
 void iperf_on_new_stream(struct iperf_stream *);
 void iperf_on_test_start(struct iperf_test *);
@@ -231,7 +328,7 @@ int iprintf(struct iperf_test *test, const char *format, ...) __attribute__ ((fo
 void iperf_err(struct iperf_test *test, const char *format, ...) __attribute__ ((format(printf,2,3)));
 void iperf_errexit(struct iperf_test *test, const char *format, ...) __attribute__ ((format(printf,2,3),noreturn));
 char *iperf_strerror(int);
-extern int i_errno;
+extern IPERF_TLS int i_errno;
 enum {
     IENONE = 0,             // No error
     /* Parameter errors */
@@ -251,6 +348,17 @@ enum {
     IEFILE = 14,            // -F file couldn't be opened
     IEBURST = 15,           // Invalid burst count. Maximum value = %dMAX_BURST
     IEENDCONDITIONS = 16,   // Only one test end condition (-t, -n, -k) may be specified
+    IEVERIFY = 17,          // --verify cannot be combined with -F or -Z
+    IEPAYLOAD = 18,         // Bogus value for --payload
+    IEFILESYNC = 19,        // Bogus value for --file-sync
+    IEFILEWRITE = 20,       // Bogus or unsupported value for --file-write
+    IEUNIX = 21,            // --unix cannot be combined with -u, --sctp, -4 or -6
+    IEKTLS = 22,            // --ktls works only with TCP, and not with --mptcp
+    IEMPTCP = 23,           // --mptcp works only with TCP
+    IEMPTCPENDPOINT = 24,   // Bogus --mptcp-endpoint address, or too many. Maximum = %dMAX_MPTCP_ENDPOINTS
+    IESCTP = 25,            // Bogus --sctp-streams, --sctp-pr or --sctp-bindx value, or used without --sctp
+    IESERVERUNIX = 26,      // The client's protocol does not go with whether the server is --unix
+    IEFASTOPEN = 27,        // --fast-open works only with TCP
     /* Test errors */
     IENEWTEST = 100,        // Unable to create a new test (check perror)
     IEINITTEST = 101,       // Test initialization failed (check perror)
@@ -290,6 +398,11 @@ enum {
     IEPIDFILE = 135,	    // Unable to write PID file
     IEV6ONLY = 136,  	    // Unable to set/unset IPV6_V6ONLY (check perror)
     IESETSCTPDISABLEFRAG = 137, // Unable to set SCTP Fragmentation (check perror)
+    IESETFASTOPEN = 138,    // Unable to set TCP_FASTOPEN (check perror)
+    IESETKTLS = 139,        // Unable to start TLS on a stream (check perror)
+    IESETMPTCP = 140,       // Unable to add an MPTCP endpoint (check perror)
+    IESETSCTP = 141,        // Unable to set SCTP stream or PR-SCTP options (check perror)
+    IESCTPBINDX = 142,      // Unable to bind the --sctp-bindx addresses (check perror)
     /* Stream errors */
     IECREATESTREAM = 200,   // Unable to create a new stream (check herror/perror)
     IEINITSTREAM = 201,     // Unable to initialize stream (check herror/perror)
@@ -300,6 +413,7 @@ enum {
     IESTREAMREAD = 206,     // Unable to read from stream (check perror)
     IESTREAMCLOSE = 207,    // Stream has closed unexpectedly
     IESTREAMID = 208,       // Stream has invalid ID
+    IESHM = 209,            // Unable to set up the shared-memory ring (check perror)
     /* Timer errors */
     IENEWTIMER = 300,       // Unable to create new timer (check perror)
     IEUPDATETIMER = 301,    // Unable to update timer (check perror)
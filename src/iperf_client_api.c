@@ -21,38 +21,116 @@
 
 #include "iperf.h"
 #include "iperf_api.h"
+#include "iperf_tcp.h"
+#include "iperf_mptcp.h"
 #include "iperf_util.h"
 #include "locale.h"
 #include "net.h"
 #include "timer.h"
 
 
-int
-iperf_create_streams(struct iperf_test *test)
+static int
+iperf_add_client_stream(struct iperf_test *test, int s)
 {
-    int i, s;
     struct iperf_stream *sp;
 
-    for (i = 0; i < test->num_streams; ++i) {
+    if (test->sender)
+	FD_SET(s, &test->write_set);
+    else
+	FD_SET(s, &test->read_set);
+    if (s > test->max_fd) test->max_fd = s;
 
-        if ((s = test->protocol->connect(test)) < 0)
-            return -1;
+    sp = iperf_new_stream(test, s);
+    if (!sp)
+	return -1;
 
-	if (test->sender)
-	    FD_SET(s, &test->write_set);
-	else
-	    FD_SET(s, &test->read_set);
-	if (s > test->max_fd) test->max_fd = s;
+    /* Perform the new stream callback */
+    if (test->on_new_stream)
+	test->on_new_stream(sp);
 
-        sp = iperf_new_stream(test, s);
-        if (!sp)
-            return -1;
+    return 0;
+}
+
+/* Start all the TCP connects at once and finish each one (cookie
+** exchange included) as its socket becomes writable, so -P streams
+** cost about one round trip to set up instead of one each.
+*/
+static int
+iperf_create_tcp_streams(struct iperf_test *test)
+{
+    int pending[MAX_STREAMS], sent[MAX_STREAMS];
+    int i, n, r, s, max_fd;
+    fd_set write_set;
 
-        /* Perform the new stream callback */
-        if (test->on_new_stream)
-            test->on_new_stream(sp);
+    for (n = 0; n < test->num_streams; ++n) {
+	if ((pending[n] = iperf_tcp_connect_start(test, &sent[n])) < 0)
+	    goto fail;
+    }
+
+    while (n > 0) {
+	FD_ZERO(&write_set);
+	max_fd = -1;
+	for (i = 0; i < n; ++i) {
+	    FD_SET(pending[i], &write_set);
+	    if (pending[i] > max_fd) max_fd = pending[i];
+	}
+	r = select(max_fd + 1, NULL, &write_set, NULL, NULL);
+	if (r < 0) {
+	    if (errno == EINTR)
+		continue;
+	    i_errno = IESELECT;
+	    goto fail;
+	}
+	for (i = 0; i < n; ) {
+	    if (!FD_ISSET(pending[i], &write_set)) {
+		++i;
+		continue;
+	    }
+	    s = pending[i];
+	    r = sent[i];
+	    --n;
+	    pending[i] = pending[n];
+	    sent[i] = sent[n];
+	    if (iperf_tcp_connect_finish(test, s, r) < 0)
+		goto fail;
+	    if (iperf_add_client_stream(test, s) < 0)
+		goto fail;
+	}
     }
 
+    return 0;
+
+  fail:
+    for (i = 0; i < n; ++i)
+	close(pending[i]);
+    return -1;
+}
+
+int
+iperf_create_streams(struct iperf_test *test)
+{
+    int i, s;
+    struct timeval now;
+
+    (void) gettimeofday(&test->stream_setup_start, NULL);
+
+    if (test->mptcp && iperf_mptcp_add_endpoints(test) < 0)
+	return -1;
+    if (test->protocol->id == Ptcp) {
+	if (iperf_create_tcp_streams(test) < 0)
+	    return -1;
+    } else {
+	for (i = 0; i < test->num_streams; ++i) {
+	    if ((s = test->protocol->connect(test)) < 0)
+		return -1;
+	    if (iperf_add_client_stream(test, s) < 0)
+		return -1;
+	}
+    }
+
+    (void) gettimeofday(&now, NULL);
+    test->stream_setup_time = timeval_diff(&test->stream_setup_start, &now);
+
     return 0;
 }
 
@@ -172,9 +250,14 @@ iperf_handle_message_client(struct iperf_test *test)
 {
     int rval;
     int32_t err;
+    signed char state;
+
+    /* A pushed interval may arrive in pieces; finish it before anything else. */
+    if (test->ctrl_in_pending)
+	return iperf_recv_interval_push(test);
 
     /*!!! Why is this read() and not Nread()? */
-    if ((rval = read(test->ctrl_sck, (char*) &test->state, sizeof(signed char))) <= 0) {
+    if ((rval = read(test->ctrl_sck, (char*) &state, sizeof(signed char))) <= 0) {
         if (rval == 0) {
             i_errno = IECTRLCLOSE;
             return -1;
@@ -183,6 +266,10 @@ iperf_handle_message_client(struct iperf_test *test)
             return -1;
         }
     }
+    /* Pushed intervals come in the middle of a state, not as a new one. */
+    if (state == INTERVAL_RESULTS)
+	return iperf_recv_interval_push(test);
+    test->state = state;
 
     switch (test->state) {
         case PARAM_EXCHANGE:
@@ -266,9 +353,18 @@ iperf_connect(struct iperf_test *test)
 
     make_cookie(test->cookie);
 
-    /* Create and connect the control channel */
-    if (test->ctrl_sck < 0)
-	test->ctrl_sck = netdial(test->settings->domain, Ptcp, test->bind_address, test->server_hostname, test->server_port);
+    /* Create and connect the control channel.  The resolved addresses
+    ** are kept on the test and reused for every stream.
+    */
+    if (test->ctrl_sck < 0 && test->settings->domain == AF_UNIX)
+	test->ctrl_sck = netdial_unix(SOCK_STREAM, test->server_hostname);
+    else if (test->ctrl_sck < 0) {
+	if (iperf_resolve_addresses(test) < 0) {
+	    i_errno = IECONNECT;
+	    return -1;
+	}
+	test->ctrl_sck = netdial_res(Ptcp, test->local_res, test->server_res, test->server_port);
+    }
     if (test->ctrl_sck < 0) {
         i_errno = IECONNECT;
         return -1;
@@ -295,6 +391,7 @@ iperf_client_end(struct iperf_test *test)
     SLIST_FOREACH(sp, &test->streams, streams) {
         close(sp->socket);
     }
+    iperf_mptcp_del_endpoints(test);
 
     /* show final summary */
     test->reporter_callback(test);
@@ -306,11 +403,21 @@ iperf_client_end(struct iperf_test *test)
 }
 
 
-static jmp_buf sigend_jmp_buf;
+static IPERF_TLS jmp_buf sigend_jmp_buf;
+static IPERF_TLS int sigend_armed;
 
+/* The signal goes to whichever thread the kernel picks.  If that one is
+** not inside iperf_run_client(), there is nothing to jump back to, so take
+** the default action instead.
+*/
 static void
 sigend_handler(int sig)
 {
+    if (!sigend_armed) {
+	signal(sig, SIG_DFL);
+	raise(sig);
+	return;
+    }
     longjmp(sigend_jmp_buf, 1);
 }
 
@@ -325,8 +432,25 @@ sigalrm_handler(int sig)
     sigalrm_triggered = 1;
 }
 
+static int run_client(struct iperf_test *test);
+
 int
-iperf_run_client(struct iperf_test * test)
+iperf_run_client(struct iperf_test *test)
+{
+    int r;
+
+    /* Termination signals. */
+    iperf_catch_sigend(sigend_handler);
+    if (setjmp(sigend_jmp_buf))
+	iperf_got_sigend(test);
+    sigend_armed = 1;
+    r = run_client(test);
+    sigend_armed = 0;
+    return r;
+}
+
+static int
+run_client(struct iperf_test *test)
 {
     cm_t concurrency_model;
     int startup;
@@ -335,11 +459,9 @@ iperf_run_client(struct iperf_test * test)
     struct timeval now;
     struct timeval* timeout = NULL;
     struct itimerval itv;
-
-    /* Termination signals. */
-    iperf_catch_sigend(sigend_handler);
-    if (setjmp(sigend_jmp_buf))
-	iperf_got_sigend(test);
+    struct timeval poll_timeout;
+    int blocks;
+    uint64_t timer_runs;
 
     if (test->affinity != -1)
 	if (iperf_setaffinity(test, test->affinity) != 0)
@@ -350,8 +472,11 @@ iperf_run_client(struct iperf_test * test)
 	    return -1;
 
     if (test->json_output) {
+	cJSON_Arena *prev = cJSON_SetArena(test->json_arena);
+
 	cJSON_AddItemToObject(test->json_start, "version", cJSON_CreateString(version));
 	cJSON_AddItemToObject(test->json_start, "system_info", cJSON_CreateString(get_system_info()));
+	cJSON_SetArena(prev);
     } else if (test->verbose) {
 	iprintf(test, "%s\n", version);
 	iprintf(test, "%s", "");
@@ -417,6 +542,8 @@ iperf_run_client(struct iperf_test * test)
 
 	    }
 
+	    blocks = test->blocks_sent;
+	    timer_runs = test->loop.timer_runs;
 	    if (test->reverse) {
 		// Reverse mode. Client receives.
 		if (iperf_recv(test, &read_set) < 0)
@@ -433,14 +560,31 @@ iperf_run_client(struct iperf_test * test)
 	        (concurrency_model == cm_itimer && sigalrm_triggered)) {
 		/* Run the timers. */
 		(void) gettimeofday(&now, NULL);
+		++test->loop.timer_runs;
 		tmr_run(&now);
-	        if (concurrency_model == cm_itimer)
+	        if (concurrency_model == cm_itimer) {
 		    sigalrm_triggered = 0;
+		    /* Nothing select()s on the control socket in this
+		    ** model, so look for pushed intervals here.
+		    */
+		    FD_ZERO(&read_set);
+		    FD_SET(test->ctrl_sck, &read_set);
+		    poll_timeout.tv_sec = 0;
+		    poll_timeout.tv_usec = 0;
+		    if (select(test->ctrl_sck + 1, &read_set, NULL, NULL, &poll_timeout) > 0)
+			if (iperf_handle_message_client(test) < 0)
+			    return -1;
+		}
+	    }
+	    if (concurrency_model == cm_select) {
+		++test->loop.wakeups;
+		if (test->blocks_sent == blocks && test->loop.timer_runs == timer_runs)
+		    ++test->loop.idle_wakeups;
 	    }
 
 	    /* Is the test done yet? */
 	    if ((!test->omitting) &&
-	        ((test->duration != 0 && test->done) ||
+	        (test->done ||
 	         (test->settings->bytes != 0 && test->bytes_sent >= test->settings->bytes) ||
 	         (test->settings->blocks != 0 && test->blocks_sent >= test->settings->blocks))) {
 		/* Yes, done!  Send TEST_END. */
@@ -15,6 +15,8 @@
 #include <stdarg.h>
 #include "iperf.h"
 #include "iperf_api.h"
+#include "iperf_mptcp.h"
+#include "iperf_sctp.h"
 
 /* Do a printf to stderr. */
 void
@@ -25,9 +27,12 @@ iperf_err(struct iperf_test *test, const char *format, ...)
 
     va_start(argp, format);
     vsnprintf(str, sizeof(str), format, argp);
-    if (test != NULL && test->json_output && test->json_top != NULL)
+    if (test != NULL && test->json_output && test->json_top != NULL) {
+	cJSON_Arena *prev = cJSON_SetArena(test->json_arena);
+
 	cJSON_AddStringToObject(test->json_top, "error", str);
-    else
+	cJSON_SetArena(prev);
+    } else
 	fprintf(stderr, "iperf3: %s\n", str);
     va_end(argp);
 }
@@ -42,21 +47,26 @@ iperf_errexit(struct iperf_test *test, const char *format, ...)
     va_start(argp, format);
     vsnprintf(str, sizeof(str), format, argp);
     if (test != NULL && test->json_output && test->json_top != NULL) {
+	cJSON_Arena *prev = cJSON_SetArena(test->json_arena);
+
 	cJSON_AddStringToObject(test->json_top, "error", str);
+	cJSON_SetArena(prev);
 	iperf_json_finish(test);
     } else
 	fprintf(stderr, "iperf3: %s\n", str);
     va_end(argp);
     iperf_delete_pidfile(test);
+    if (test != NULL)
+	iperf_mptcp_del_endpoints(test);
     exit(1);
 }
 
-int i_errno;
+IPERF_TLS int i_errno;
 
 char *
 iperf_strerror(int i_errno)
 {
-    static char errstr[256];
+    static IPERF_TLS char errstr[256];
     int len, perr, herr;
     perr = herr = 0;
 
@@ -116,6 +126,39 @@ iperf_strerror(int i_errno)
         case IEENDCONDITIONS:
             snprintf(errstr, len, "only one test end condition (-t, -n, -k) may be specified");
             break;
+        case IEVERIFY:
+            snprintf(errstr, len, "--verify cannot be used with -F or -Z");
+            break;
+        case IEFILESYNC:
+            snprintf(errstr, len, "bogus value for --file-sync (none, interval or end)");
+            break;
+        case IEFILEWRITE:
+            snprintf(errstr, len, "bogus value for --file-write, or not supported on this OS");
+            break;
+        case IEUNIX:
+            snprintf(errstr, len, "--unix cannot be combined with -u, --sctp, -4 or -6");
+            break;
+        case IEKTLS:
+            snprintf(errstr, len, "--ktls works only with TCP, and not with --mptcp");
+            break;
+        case IEMPTCP:
+            snprintf(errstr, len, "--mptcp works only with TCP");
+            break;
+        case IEFASTOPEN:
+            snprintf(errstr, len, "--fast-open works only with TCP");
+            break;
+        case IEMPTCPENDPOINT:
+            snprintf(errstr, len, "bogus --mptcp-endpoint (a numeric address), or more than %d", MAX_MPTCP_ENDPOINTS);
+            break;
+        case IESERVERUNIX:
+            snprintf(errstr, len, "the protocol does not match the server's socket family (--unix or not)");
+            break;
+        case IESCTP:
+            snprintf(errstr, len, "bogus --sctp-streams (1 to %d), --sctp-pr or --sctp-bindx (up to %d numeric addresses), or used without --sctp", MAX_SCTP_STREAMS, SCTP_MAX_PATHS);
+            break;
+        case IEPAYLOAD:
+            snprintf(errstr, len, "bogus value for --payload (random[:N], zeros or pattern)");
+            break;
         case IENEWTEST:
             snprintf(errstr, len, "unable to create a new test");
             perr = 1;
@@ -283,6 +326,10 @@ iperf_strerror(int i_errno)
         case IESTREAMID:
             snprintf(errstr, len, "stream has an invalid id");
             break;
+        case IESHM:
+            snprintf(errstr, len, "unable to set up the shared-memory ring");
+            perr = 1;
+            break;
         case IENEWTIMER:
             snprintf(errstr, len, "unable to create new timer");
             perr = 1;
@@ -307,6 +354,26 @@ iperf_strerror(int i_errno)
             snprintf(errstr, len, "unable to set SCTP_DISABLE_FRAG");
             perr = 1;
             break;
+        case IESETFASTOPEN:
+            snprintf(errstr, len, "unable to set TCP_FASTOPEN");
+            perr = 1;
+            break;
+        case IESETKTLS:
+            snprintf(errstr, len, "unable to start TLS on a stream");
+            perr = 1;
+            break;
+        case IESETMPTCP:
+            snprintf(errstr, len, "unable to add an MPTCP endpoint");
+            perr = 1;
+            break;
+        case IESETSCTP:
+            snprintf(errstr, len, "unable to set the SCTP stream or PR-SCTP options");
+            perr = 1;
+            break;
+        case IESCTPBINDX:
+            snprintf(errstr, len, "unable to bind the --sctp-bindx addresses");
+            perr = 1;
+            break;
     }
 
     if (herr || perr)
@@ -0,0 +1,504 @@
+/*
+ * Copyright (c) 2014, The Regents of the University of California,
+ * through Lawrence Berkeley National Laboratory (subject to receipt of any
+ * required approvals from the U.S. Dept. of Energy).  All rights reserved.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE file
+ * for complete information.
+ */
+
+/* iperf_mptcp.c: Multipath TCP streams (--mptcp)
+ *
+ * An --mptcp stream is an ordinary TCP stream whose socket is opened
+ * with IPPROTO_MPTCP, so everything in iperf_tcp.c applies to it.  What
+ * is here is reading its subflows at every interval, and adding local
+ * addresses as subflow endpoints of the kernel's path manager, over
+ * generic netlink, for --mptcp-endpoint.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_mptcp.h"
+#include "iperf_util.h"
+#include "locale.h"
+#include "units.h"
+
+#if defined(linux) && defined(__has_include)
+#if __has_include(<linux/mptcp.h>) && __has_include(<linux/genetlink.h>)
+#include <linux/mptcp.h>
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#endif
+#endif
+#if defined(MPTCP_TCPINFO) && defined(MPTCP_SUBFLOW_ADDRS) && defined(MPTCP_PM_NAME)
+#define HAVE_MPTCP 1
+#ifndef SOL_MPTCP
+#define SOL_MPTCP 284
+#endif
+#endif
+
+
+int
+has_mptcp(void)
+{
+#ifdef HAVE_MPTCP
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+void
+iperf_mptcp_free(struct iperf_stream *sp)
+{
+    free(sp->mptcp);
+    sp->mptcp = NULL;
+}
+
+#ifdef HAVE_MPTCP
+/* The C library's struct tcp_info stops at tcpi_total_retrans.  The
+** kernel's carries on, and the byte counts come a little later, at
+** offsets that, like the rest of the structure, never move.
+*/
+#define TCPI_BYTES_ACKED 120
+#define TCPI_BYTES_RECEIVED 128
+#define TCPI_SIZE 136
+
+struct subflow_tcpinfo {
+    struct mptcp_subflow_data d;
+    unsigned char ti[MPTCP_MAX_SUBFLOWS][TCPI_SIZE];
+};
+
+struct subflow_addrs {
+    struct mptcp_subflow_data d;
+    struct mptcp_subflow_addrs a[MPTCP_MAX_SUBFLOWS];
+};
+
+/* Fetch one of the per-subflow arrays; the number of subflows, or -1. */
+static int
+subflow_data(int s, int opt, struct mptcp_subflow_data *d, socklen_t len, size_t elem)
+{
+    memset(d, 0, len);
+    d->size_subflow_data = sizeof(*d);
+    d->size_user = elem;
+    if (getsockopt(s, SOL_MPTCP, opt, d, &len) < 0)
+	return -1;
+    return d->num_subflows;
+}
+
+static int
+same_addr(const struct sockaddr_storage *a, const struct sockaddr_storage *b)
+{
+    if (a->ss_family != b->ss_family)
+	return 0;
+    if (a->ss_family == AF_INET)
+	return memcmp(a, b, sizeof(struct sockaddr_in)) == 0;
+    if (a->ss_family == AF_INET6)
+	return memcmp(a, b, sizeof(struct sockaddr_in6)) == 0;
+    return 0;
+}
+
+static uint64_t
+tcpi_u64(const unsigned char *ti, size_t size, int off)
+{
+    uint64_t v = 0;
+
+    if (size >= off + sizeof(v))
+	memcpy(&v, ti + off, sizeof(v));
+    return v;
+}
+#endif
+
+void
+iperf_mptcp_sample(struct iperf_stream *sp, struct tcp_info *ti)
+{
+#ifdef HAVE_MPTCP
+    struct iperf_mptcp *mp = sp->mptcp;
+    struct subflow_tcpinfo t;
+    struct subflow_addrs a;
+    struct mptcp_subflow sub[MPTCP_MAX_SUBFLOWS], *sf, *old;
+    struct tcp_info sti;
+    size_t size;
+    uint64_t cwnd = 0;
+    int i, j, n, tries;
+
+    if (mp == NULL) {
+	if ((mp = calloc(1, sizeof(*mp))) == NULL)
+	    return;
+	sp->mptcp = mp;
+    }
+
+    /* Two calls, so the subflows may change in between; then the
+    ** arrays do not line up, and one more try should do.
+    */
+    for (tries = 0; ; ++tries) {
+	n = subflow_data(sp->socket, MPTCP_TCPINFO, &t.d, sizeof(t), TCPI_SIZE);
+	if (n >= 0 && subflow_data(sp->socket, MPTCP_SUBFLOW_ADDRS, &a.d, sizeof(a), sizeof(a.a[0])) == n)
+	    break;
+	if (n < 0 || tries > 0) {
+	    /* A connection that fell back to plain TCP has no subflows. */
+	    mp->count = 0;
+	    ti->tcpi_total_retrans = mp->retrans;
+	    return;
+	}
+    }
+    if (n > MPTCP_MAX_SUBFLOWS)
+	n = MPTCP_MAX_SUBFLOWS;
+    size = t.d.size_kernel < TCPI_SIZE ? t.d.size_kernel : TCPI_SIZE;
+
+    memset(sub, 0, sizeof(sub));
+    for (i = 0; i < n; ++i) {
+	sf = &sub[i];
+	memcpy(&sf->local, &a.a[i].ss_local, sizeof(sf->local));
+	memcpy(&sf->remote, &a.a[i].ss_remote, sizeof(sf->remote));
+	memset(&sti, 0, sizeof(sti));
+	memcpy(&sti, t.ti[i], size < sizeof(sti) ? size : sizeof(sti));
+	sf->bytes = tcpi_u64(t.ti[i], size, sp->test->sender ? TCPI_BYTES_ACKED : TCPI_BYTES_RECEIVED);
+	sf->retrans = sti.tcpi_total_retrans;
+	sf->rtt = sti.tcpi_rtt;
+	sf->snd_cwnd = (uint64_t) sti.tcpi_snd_cwnd * sti.tcpi_snd_mss;
+	cwnd += sf->snd_cwnd;
+
+	/* A subflow new since the last sample did all of its work in
+	** this interval.
+	*/
+	old = NULL;
+	for (j = 0; j < mp->count; ++j)
+	    if (same_addr(&mp->sub[j].local, &sf->local) && same_addr(&mp->sub[j].remote, &sf->remote))
+		old = &mp->sub[j];
+	sf->interval_bytes = sf->bytes - (old ? old->bytes : 0);
+	sf->interval_retrans = sf->retrans - (old ? old->retrans : 0);
+	mp->retrans += sf->interval_retrans;
+    }
+    memcpy(mp->sub, sub, sizeof(sub));
+    mp->count = n;
+
+    ti->tcpi_total_retrans = mp->retrans;
+    if (n > 0 && ti->tcpi_snd_mss > 0)
+	ti->tcpi_snd_cwnd = cwnd / ti->tcpi_snd_mss;
+#endif
+}
+
+#ifdef HAVE_MPTCP
+static void
+addr_string(const struct sockaddr_storage *ss, char *buf, size_t len)
+{
+    const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6 *) ss;
+    struct sockaddr_in sin;
+    char host[NI_MAXHOST], serv[NI_MAXSERV];
+
+    /* A dual-stack listener's IPv4 peers, shown the way connect_msg does. */
+    if (ss->ss_family == AF_INET6 && IN6_IS_ADDR_V4MAPPED(&sin6->sin6_addr)) {
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = sin6->sin6_port;
+	memcpy(&sin.sin_addr, &sin6->sin6_addr.s6_addr[12], sizeof(sin.sin_addr));
+	ss = (const struct sockaddr_storage *) &sin;
+    }
+    if (getnameinfo((const struct sockaddr *) ss, ss->ss_family == AF_INET ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6), host, sizeof(host), serv, sizeof(serv), NI_NUMERICHOST | NI_NUMERICSERV) != 0)
+	snprintf(buf, len, "?");
+    else if (ss->ss_family == AF_INET6)
+	snprintf(buf, len, "[%s]:%s", host, serv);
+    else
+	snprintf(buf, len, "%s:%s", host, serv);
+}
+#endif
+
+void
+iperf_mptcp_print(struct iperf_stream *sp, double st, double et, double duration, cJSON *json_stream)
+{
+#ifdef HAVE_MPTCP
+    struct iperf_mptcp *mp = sp->mptcp;
+    struct mptcp_subflow *sf;
+    char lbuf[NI_MAXHOST + NI_MAXSERV + 4], rbuf[NI_MAXHOST + NI_MAXSERV + 4];
+    char ubuf[UNIT_LEN], nbuf[UNIT_LEN], cbuf[UNIT_LEN];
+    double bandwidth;
+    cJSON *json_subflows = NULL;
+    int i;
+
+    if (mp == NULL)
+	return;
+    if (json_stream != NULL) {
+	if ((json_subflows = cJSON_CreateArray()) == NULL)
+	    return;
+	cJSON_AddItemToObject(json_stream, "subflows", json_subflows);
+    }
+    for (i = 0; i < mp->count; ++i) {
+	sf = &mp->sub[i];
+	addr_string(&sf->local, lbuf, sizeof(lbuf));
+	addr_string(&sf->remote, rbuf, sizeof(rbuf));
+	bandwidth = duration > 0 ? (double) sf->interval_bytes / duration : 0.0;
+	if (json_subflows != NULL)
+	    cJSON_AddItemToArray(json_subflows, iperf_json_printf("local: %s  remote: %s  bytes: %d  bits_per_second: %f  retransmits: %d  snd_cwnd: %d  rtt: %d", lbuf, rbuf, (int64_t) sf->interval_bytes, bandwidth * 8, (int64_t) sf->interval_retrans, (int64_t) sf->snd_cwnd, (int64_t) sf->rtt));
+	else {
+	    unit_snprintf(ubuf, UNIT_LEN, (double) sf->interval_bytes, 'A');
+	    unit_snprintf(nbuf, UNIT_LEN, bandwidth, sp->test->settings->unit_format);
+	    unit_snprintf(cbuf, UNIT_LEN, (double) sf->snd_cwnd, 'A');
+	    iprintf(sp->test, report_mptcp_subflow, sp->socket, st, et, lbuf, rbuf, ubuf, nbuf, sf->interval_retrans, cbuf, sf->rtt);
+	}
+    }
+#endif
+}
+
+
+#ifdef HAVE_MPTCP
+/* A generic netlink request, to the controller or the path manager. */
+struct pm_msg {
+    struct nlmsghdr n;
+    struct genlmsghdr g;
+    char attrs[256];
+};
+
+static void
+pm_msg_init(struct pm_msg *m, int family, int cmd, int flags)
+{
+    memset(m, 0, sizeof(*m));
+    m->n.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+    m->n.nlmsg_type = family;
+    m->n.nlmsg_flags = NLM_F_REQUEST | flags;
+    m->g.cmd = cmd;
+    m->g.version = family == GENL_ID_CTRL ? 1 : MPTCP_PM_VER;
+}
+
+static struct nlattr *
+nla_put(struct pm_msg *m, int type, const void *data, int len)
+{
+    struct nlattr *nla = (struct nlattr *) ((char *) m + NLMSG_ALIGN(m->n.nlmsg_len));
+
+    nla->nla_type = type;
+    nla->nla_len = NLA_HDRLEN + len;
+    if (len > 0)
+	memcpy((char *) nla + NLA_HDRLEN, data, len);
+    m->n.nlmsg_len = NLMSG_ALIGN(m->n.nlmsg_len) + NLA_ALIGN(nla->nla_len);
+    return nla;
+}
+
+/* The end of a nested attribute begun with nla_put(m, type, NULL, 0). */
+static void
+nla_nest_end(struct pm_msg *m, struct nlattr *nest)
+{
+    nest->nla_type |= NLA_F_NESTED;
+    nest->nla_len = (char *) m + m->n.nlmsg_len - (char *) nest;
+}
+
+/* The attribute of a type in [attr, attr + len), or NULL. */
+static struct nlattr *
+nla_find(struct nlattr *attr, int len, int type)
+{
+    while (len >= NLA_HDRLEN && attr->nla_len >= NLA_HDRLEN && attr->nla_len <= len) {
+	if ((attr->nla_type & NLA_TYPE_MASK) == type)
+	    return attr;
+	len -= NLA_ALIGN(attr->nla_len);
+	attr = (struct nlattr *) ((char *) attr + NLA_ALIGN(attr->nla_len));
+    }
+    return NULL;
+}
+
+#define NLA_DATA(nla) ((void *) ((char *) (nla) + NLA_HDRLEN))
+
+/* Send a request and read until its acknowledgement, or the end of a
+** dump, handing every other reply to fn.  0, or -1 with errno set.
+*/
+static int
+pm_talk(int fd, struct pm_msg *m, void (*fn)(struct nlmsghdr *, void *), void *arg)
+{
+    char buf[8192];
+    struct nlmsghdr *nh;
+    struct nlmsgerr *err;
+    int len;
+
+    m->n.nlmsg_flags |= NLM_F_ACK;
+    if (send(fd, m, m->n.nlmsg_len, 0) < 0)
+	return -1;
+    for (;;) {
+	if ((len = recv(fd, buf, sizeof(buf), 0)) < 0)
+	    return -1;
+	for (nh = (struct nlmsghdr *) buf; NLMSG_OK(nh, len); nh = NLMSG_NEXT(nh, len)) {
+	    if (nh->nlmsg_type == NLMSG_DONE)
+		return 0;
+	    if (nh->nlmsg_type == NLMSG_ERROR) {
+		err = NLMSG_DATA(nh);
+		if (err->error == 0)
+		    return 0;
+		errno = -err->error;
+		return -1;
+	    }
+	    if (fn != NULL)
+		fn(nh, arg);
+	}
+    }
+}
+
+static void
+family_id(struct nlmsghdr *nh, void *arg)
+{
+    struct nlattr *nla;
+
+    nla = nla_find((struct nlattr *) ((char *) NLMSG_DATA(nh) + GENL_HDRLEN), nh->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN), CTRL_ATTR_FAMILY_ID);
+    if (nla != NULL)
+	*(int *) arg = *(uint16_t *) NLA_DATA(nla);
+}
+
+/* A socket to the path manager, with its family id; -1 if none. */
+static int
+pm_open(int *family)
+{
+    struct pm_msg m;
+    int fd;
+
+    if ((fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_GENERIC)) < 0)
+	return -1;
+    *family = -1;
+    pm_msg_init(&m, GENL_ID_CTRL, CTRL_CMD_GETFAMILY, 0);
+    nla_put(&m, CTRL_ATTR_FAMILY_NAME, MPTCP_PM_NAME, sizeof(MPTCP_PM_NAME));
+    if (pm_talk(fd, &m, family_id, family) < 0 || *family < 0) {
+	close(fd);
+	return -1;
+    }
+    return fd;
+}
+
+struct endpoint {
+    int family;
+    unsigned char addr[16];
+    int id;			/* as the path manager knows it, or -1 */
+};
+
+static int
+endpoint_parse(const char *s, struct endpoint *e)
+{
+    memset(e, 0, sizeof(*e));
+    e->id = -1;
+    if (inet_pton(AF_INET, s, e->addr) == 1)
+	e->family = AF_INET;
+    else if (inet_pton(AF_INET6, s, e->addr) == 1)
+	e->family = AF_INET6;
+    else
+	return -1;
+    return 0;
+}
+
+/* The address of an endpoint, nested in the request. */
+static struct nlattr *
+endpoint_put(struct pm_msg *m, const struct endpoint *e)
+{
+    struct nlattr *nest;
+    uint16_t family = e->family;
+
+    nest = nla_put(m, MPTCP_PM_ATTR_ADDR, NULL, 0);
+    nla_put(m, MPTCP_PM_ADDR_ATTR_FAMILY, &family, sizeof(family));
+    if (e->family == AF_INET)
+	nla_put(m, MPTCP_PM_ADDR_ATTR_ADDR4, e->addr, sizeof(struct in_addr));
+    else
+	nla_put(m, MPTCP_PM_ADDR_ATTR_ADDR6, e->addr, sizeof(struct in6_addr));
+    return nest;
+}
+
+/* One entry of the endpoint dump: the id, if it is the one looked for. */
+static void
+endpoint_id(struct nlmsghdr *nh, void *arg)
+{
+    struct endpoint *e = arg;
+    struct nlattr *addr, *nla;
+    int len;
+
+    addr = nla_find((struct nlattr *) ((char *) NLMSG_DATA(nh) + GENL_HDRLEN), nh->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN), MPTCP_PM_ATTR_ADDR);
+    if (addr == NULL)
+	return;
+    len = addr->nla_len - NLA_HDRLEN;
+    nla = nla_find(NLA_DATA(addr), len, MPTCP_PM_ADDR_ATTR_FAMILY);
+    if (nla == NULL || *(uint16_t *) NLA_DATA(nla) != e->family)
+	return;
+    nla = nla_find(NLA_DATA(addr), len, e->family == AF_INET ? MPTCP_PM_ADDR_ATTR_ADDR4 : MPTCP_PM_ADDR_ATTR_ADDR6);
+    if (nla == NULL || memcmp(NLA_DATA(nla), e->addr, e->family == AF_INET ? 4 : 16) != 0)
+	return;
+    if ((nla = nla_find(NLA_DATA(addr), len, MPTCP_PM_ADDR_ATTR_ID)) != NULL)
+	e->id = *(uint8_t *) NLA_DATA(nla);
+}
+#endif
+
+int
+iperf_mptcp_add_endpoints(struct iperf_test *test)
+{
+#ifdef HAVE_MPTCP
+    struct pm_msg m;
+    struct nlattr *nest;
+    struct endpoint e;
+    uint32_t flags = MPTCP_PM_ADDR_FLAG_SUBFLOW;
+    int fd, family, i;
+
+    if (test->mptcp_endpoints == 0)
+	return 0;
+    if ((fd = pm_open(&family)) < 0) {
+	i_errno = IESETMPTCP;
+	return -1;
+    }
+    for (i = 0; i < test->mptcp_endpoints; ++i) {
+	if (endpoint_parse(test->mptcp_endpoint[i], &e) < 0)
+	    continue;
+	pm_msg_init(&m, family, MPTCP_PM_CMD_ADD_ADDR, 0);
+	nest = endpoint_put(&m, &e);
+	nla_put(&m, MPTCP_PM_ADDR_ATTR_FLAGS, &flags, sizeof(flags));
+	nla_nest_end(&m, nest);
+	if (pm_talk(fd, &m, NULL, NULL) == 0)
+	    test->mptcp_endpoints_added |= 1u << i;
+	else if (errno != EEXIST) {
+	    close(fd);
+	    i_errno = IESETMPTCP;
+	    return -1;
+	}
+    }
+    close(fd);
+    if (test->debug)
+	printf("MPTCP endpoints added: %#x\n", test->mptcp_endpoints_added);
+    return 0;
+#else
+    i_errno = IEUNIMP;
+    return -1;
+#endif
+}
+
+void
+iperf_mptcp_del_endpoints(struct iperf_test *test)
+{
+#ifdef HAVE_MPTCP
+    struct pm_msg m;
+    struct nlattr *nest;
+    struct endpoint e;
+    uint8_t id;
+    int fd, family, i;
+
+    if (test->mptcp_endpoints_added == 0)
+	return;
+    if ((fd = pm_open(&family)) < 0)
+	return;
+    for (i = 0; i < test->mptcp_endpoints; ++i) {
+	if (!(test->mptcp_endpoints_added & (1u << i)) ||
+	    endpoint_parse(test->mptcp_endpoint[i], &e) < 0)
+	    continue;
+	/* Removal goes by the id the path manager gave the address. */
+	pm_msg_init(&m, family, MPTCP_PM_CMD_GET_ADDR, NLM_F_DUMP);
+	if (pm_talk(fd, &m, endpoint_id, &e) < 0 || e.id <= 0)
+	    continue;
+	id = e.id;
+	pm_msg_init(&m, family, MPTCP_PM_CMD_DEL_ADDR, 0);
+	nest = nla_put(&m, MPTCP_PM_ATTR_ADDR, NULL, 0);
+	nla_put(&m, MPTCP_PM_ADDR_ATTR_ID, &id, sizeof(id));
+	nla_nest_end(&m, nest);
+	(void) pm_talk(fd, &m, NULL, NULL);
+    }
+    close(fd);
+#endif
+    test->mptcp_endpoints_added = 0;
+}
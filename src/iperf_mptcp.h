@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2014, The Regents of the University of California,
+ * through Lawrence Berkeley National Laboratory (subject to receipt of any
+ * required approvals from the U.S. Dept. of Energy).  All rights reserved.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE file
+ * for complete information.
+ */
+
+#ifndef        IPERF_MPTCP_H
+#define        IPERF_MPTCP_H
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#ifndef IPPROTO_MPTCP
+#define IPPROTO_MPTCP 262
+#endif
+
+/* Subflows of one stream that are reported; any beyond are not. */
+#define MPTCP_MAX_SUBFLOWS 8
+
+struct mptcp_subflow
+{
+    struct sockaddr_storage local;
+    struct sockaddr_storage remote;
+    uint64_t  bytes;		/* acked (sender) or received, since the subflow opened */
+    uint64_t  interval_bytes;
+    uint32_t  retrans;		/* since the subflow opened */
+    uint32_t  interval_retrans;
+    uint32_t  rtt;		/* usecs */
+    uint64_t  snd_cwnd;		/* bytes */
+};
+
+/* The subflows of one --mptcp stream, as of the last sample. */
+struct iperf_mptcp
+{
+    int       count;
+    uint32_t  retrans;		/* over every subflow, closed ones included */
+    struct mptcp_subflow sub[MPTCP_MAX_SUBFLOWS];
+};
+
+int has_mptcp(void);
+
+/**
+ * iperf_mptcp_sample -- read a stream's subflows and what each did
+ * since the last sample.  The connection-level tcp_info, which is the
+ * first subflow's, gets the retransmits and window of all of them.
+ *
+ */
+void iperf_mptcp_sample(struct iperf_stream *sp, struct tcp_info *ti);
+
+/**
+ * iperf_mptcp_print -- the last sample's subflows, as lines under the
+ * stream's interval line or as a "subflows" array in its JSON object
+ *
+ */
+void iperf_mptcp_print(struct iperf_stream *sp, double st, double et, double duration, cJSON *json_stream);
+
+void iperf_mptcp_free(struct iperf_stream *sp);
+
+/**
+ * iperf_mptcp_add_endpoints -- make each --mptcp-endpoint address a
+ * subflow endpoint of the in-kernel path manager, for the test's length
+ *
+ */
+int iperf_mptcp_add_endpoints(struct iperf_test *test);
+
+/**
+ * iperf_mptcp_del_endpoints -- remove the endpoints the test added;
+ * ones that were already there are left alone
+ *
+ */
+void iperf_mptcp_del_endpoints(struct iperf_test *test);
+
+#endif
@@ -19,13 +19,337 @@
 #include <netinet/tcp.h>
 #include <sys/time.h>
 #include <sys/select.h>
+#include <arpa/inet.h>
+
+#if defined(linux) && defined(__has_include)
+#if __has_include(<netinet/sctp.h>)
+#include <netinet/sctp.h>
+#elif __has_include(<linux/sctp.h>)
+#include <linux/sctp.h>
+#endif
+#endif
+/* What follows uses the socket API of RFC 6458 directly, sendmsg with
+** an SCTP_SNDINFO cmsg in place of libsctp's sctp_sendmsg and the
+** SCTP_SOCKOPT_BINDX_ADD option in place of its sctp_bindx, so iperf
+** needs nothing more than the kernel's header to link.
+*/
+#if defined(SCTP_INITMSG) && defined(SCTP_SNDINFO) && defined(SCTP_RCVINFO) && defined(SCTP_RECVRCVINFO) && defined(SCTP_STATUS) && defined(SCTP_GET_PEER_ADDRS)
+#define HAVE_SCTP_STREAMS 1
+#endif
+#ifdef SCTP_SOCKOPT_BINDX_ADD
+#define HAVE_SCTP_BINDX 1
+#endif
+#if defined(SCTP_PR_SUPPORTED) && defined(SCTP_DEFAULT_PRINFO) && defined(SCTP_PR_ASSOC_STATUS)
+#define HAVE_SCTP_PR 1
+#endif
 
 #include "iperf.h"
 #include "iperf_api.h"
 #include "iperf_sctp.h"
+#include "iperf_util.h"
+#include "locale.h"
 #include "net.h"
+#include "units.h"
 
 
+int
+has_sctp_streams(void)
+{
+#ifdef HAVE_SCTP_STREAMS
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+int
+has_sctp_bindx(void)
+{
+#ifdef HAVE_SCTP_BINDX
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+int
+has_sctp_pr(void)
+{
+#ifdef HAVE_SCTP_PR
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+void
+iperf_sctp_free(struct iperf_stream *sp)
+{
+    free(sp->sctp);
+    sp->sctp = NULL;
+}
+
+#ifdef HAVE_SCTP_STREAMS
+/* A stream's association state, made the first time it is wanted, when
+** the association is up and its stream counts are known.
+*/
+static struct iperf_sctp *
+sctp_state(struct iperf_stream *sp)
+{
+    struct iperf_sctp *sc;
+    struct sctp_status st;
+    socklen_t len;
+    int n;
+
+    if (sp->sctp != NULL)
+	return sp->sctp;
+    if ((sc = calloc(1, sizeof(*sc))) == NULL)
+	return NULL;
+    n = sp->test->sctp_streams > 0 ? sp->test->sctp_streams : 1;
+    memset(&st, 0, sizeof(st));
+    len = sizeof(st);
+    if (getsockopt(sp->socket, IPPROTO_SCTP, SCTP_STATUS, &st, &len) == 0) {
+	/* The peer may have granted fewer than were asked for. */
+	if (sp->test->sender && st.sstat_outstrms < n)
+	    n = st.sstat_outstrms;
+	else if (!sp->test->sender && st.sstat_instrms < n)
+	    n = st.sstat_instrms;
+    }
+    /* The counts are kept for MAX_SCTP_STREAMS stream ids at most,
+    ** whatever a peer asked for.
+    */
+    if (n > MAX_SCTP_STREAMS)
+	n = MAX_SCTP_STREAMS;
+    sc->streams = n > 0 ? n : 1;
+    sp->sctp = sc;
+    return sc;
+}
+
+/* Receive one message, or what of it fits, and count it against the
+** stream id it came on.
+*/
+static int
+sctp_recv_message(struct iperf_stream *sp)
+{
+    struct iperf_sctp *sc;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    struct sctp_rcvinfo ri;
+    char cbuf[CMSG_SPACE(sizeof(struct sctp_rcvinfo))];
+    ssize_t r;
+
+    if ((sc = sctp_state(sp)) == NULL)
+	return NET_HARDERROR;
+    iov.iov_base = sp->buffer;
+    iov.iov_len = sp->settings->blksize;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    r = recvmsg(sp->socket, &msg, 0);
+    if (net_counters)
+	++net_counters->syscalls;
+    if (r < 0)
+	return errno == EINTR ? 0 : NET_HARDERROR;
+    if (net_counters)
+	net_counters->bytes += r;
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+	if (cmsg->cmsg_level == IPPROTO_SCTP && cmsg->cmsg_type == SCTP_RCVINFO) {
+	    memcpy(&ri, CMSG_DATA(cmsg), sizeof(ri));
+	    if (ri.rcv_sid < MAX_SCTP_STREAMS)
+		sc->bytes[ri.rcv_sid] += r;
+	}
+    return r;
+}
+
+/* Send one block as one message, on the next stream id in turn. */
+static int
+sctp_send_message(struct iperf_stream *sp)
+{
+    struct iperf_sctp *sc;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    struct sctp_sndinfo si;
+    char cbuf[CMSG_SPACE(sizeof(struct sctp_sndinfo))];
+    ssize_t r;
+
+    if ((sc = sctp_state(sp)) == NULL)
+	return NET_HARDERROR;
+    memset(&si, 0, sizeof(si));
+    si.snd_sid = sc->next_sid;
+    if (sp->test->sctp_unordered)
+	si.snd_flags = SCTP_UNORDERED;
+    iov.iov_base = sp->buffer;
+    iov.iov_len = sp->settings->blksize;
+    memset(&msg, 0, sizeof(msg));
+    memset(cbuf, 0, sizeof(cbuf));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = IPPROTO_SCTP;
+    cmsg->cmsg_type = SCTP_SNDINFO;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(si));
+    memcpy(CMSG_DATA(cmsg), &si, sizeof(si));
+    r = sendmsg(sp->socket, &msg, 0);
+    if (net_counters)
+	++net_counters->syscalls;
+    if (r < 0) {
+	switch (errno) {
+	    case EINTR:
+	    return 0;
+
+	    case EAGAIN:
+	    case ENOBUFS:
+	    if (net_counters)
+		++net_counters->soft_errors;
+	    return NET_SOFTERROR;
+
+	    default:
+	    return NET_HARDERROR;
+	}
+    }
+    if (net_counters)
+	net_counters->bytes += r;
+    sc->bytes[si.snd_sid] += r;
+    if (++sc->next_sid >= sc->streams)
+	sc->next_sid = 0;
+    return r;
+}
+
+/* Whether blocks go one message at a time through sendmsg/recvmsg,
+** rather than through the plain read and write of one ordered stream.
+*/
+static int
+sctp_messages(struct iperf_test *test)
+{
+    return test->sctp_streams > 1 || test->sctp_unordered;
+}
+#endif
+
+
+/* Options that shape the association, set before it is made: on the
+** client's socket before connect, on the server's listener.
+*/
+static int
+set_sctp_init_options(struct iperf_test *test, int s)
+{
+#ifdef HAVE_SCTP_STREAMS
+    struct sctp_initmsg im;
+#endif
+#ifdef HAVE_SCTP_PR
+    struct sctp_assoc_value av;
+#endif
+
+#ifdef HAVE_SCTP_STREAMS
+    if (test->sctp_streams) {
+	memset(&im, 0, sizeof(im));
+	im.sinit_num_ostreams = test->sctp_streams;
+	im.sinit_max_instreams = test->sctp_streams;
+	if (setsockopt(s, IPPROTO_SCTP, SCTP_INITMSG, &im, sizeof(im)) < 0) {
+	    i_errno = IESETSCTP;
+	    return -1;
+	}
+    }
+#endif
+#ifdef HAVE_SCTP_PR
+    if (test->sctp_pr_ttl) {
+	memset(&av, 0, sizeof(av));
+	av.assoc_value = 1;
+	if (setsockopt(s, IPPROTO_SCTP, SCTP_PR_SUPPORTED, &av, sizeof(av)) < 0) {
+	    i_errno = IESETSCTP;
+	    return -1;
+	}
+    }
+#endif
+    return 0;
+}
+
+/* Options of an association's data socket, once it is up.  The cookie
+** has gone over by then, so it is never sent unreliably.
+*/
+static int
+set_sctp_options(struct iperf_test *test, int s)
+{
+#ifdef HAVE_SCTP_STREAMS
+    int opt;
+#endif
+#ifdef HAVE_SCTP_PR
+    struct sctp_default_prinfo pi;
+#endif
+
+#ifdef HAVE_SCTP_STREAMS
+    if (sctp_messages(test)) {
+	opt = 1;
+	if (setsockopt(s, IPPROTO_SCTP, SCTP_RECVRCVINFO, &opt, sizeof(opt)) < 0) {
+	    i_errno = IESETSCTP;
+	    return -1;
+	}
+    }
+#endif
+#ifdef HAVE_SCTP_PR
+    if (test->sctp_pr_ttl) {
+	memset(&pi, 0, sizeof(pi));
+	pi.pr_policy = SCTP_PR_SCTP_TTL;
+	pi.pr_value = test->sctp_pr_ttl;
+	if (setsockopt(s, IPPROTO_SCTP, SCTP_DEFAULT_PRINFO, &pi, sizeof(pi)) < 0) {
+	    i_errno = IESETSCTP;
+	    return -1;
+	}
+    }
+#endif
+    return 0;
+}
+
+/* Bind the --sctp-bindx addresses, a comma separated list, to s as
+** well, so the association is multihomed on this side.
+*/
+static int
+sctp_bind_addresses(struct iperf_test *test, int s, int port)
+{
+#ifdef HAVE_SCTP_BINDX
+    char *list, *addr, *save;
+    char buf[SCTP_MAX_PATHS * sizeof(struct sockaddr_in6)];
+    struct sockaddr_in sin;
+    struct sockaddr_in6 sin6;
+    size_t len = 0;
+    int r;
+
+    if (test->sctp_bindx == NULL)
+	return 0;
+    if ((list = strdup(test->sctp_bindx)) == NULL) {
+	i_errno = IESCTPBINDX;
+	return -1;
+    }
+    for (addr = strtok_r(list, ",", &save); addr != NULL; addr = strtok_r(NULL, ",", &save)) {
+	memset(&sin, 0, sizeof(sin));
+	memset(&sin6, 0, sizeof(sin6));
+	if (inet_pton(AF_INET, addr, &sin.sin_addr) == 1 && len + sizeof(sin) <= sizeof(buf)) {
+	    sin.sin_family = AF_INET;
+	    sin.sin_port = htons(port);
+	    memcpy(buf + len, &sin, sizeof(sin));
+	    len += sizeof(sin);
+	} else if (inet_pton(AF_INET6, addr, &sin6.sin6_addr) == 1 && len + sizeof(sin6) <= sizeof(buf)) {
+	    sin6.sin6_family = AF_INET6;
+	    sin6.sin6_port = htons(port);
+	    memcpy(buf + len, &sin6, sizeof(sin6));
+	    len += sizeof(sin6);
+	}
+    }
+    free(list);
+    r = setsockopt(s, IPPROTO_SCTP, SCTP_SOCKOPT_BINDX_ADD, buf, len);
+    if (r < 0) {
+	i_errno = IESCTPBINDX;
+	return -1;
+    }
+#endif
+    return 0;
+}
+
 
 /* iperf_sctp_recv
  *
@@ -36,6 +360,11 @@ iperf_sctp_recv(struct iperf_stream *sp)
 {
     int r;
 
+#ifdef HAVE_SCTP_STREAMS
+    if (sctp_messages(sp->test))
+	r = sctp_recv_message(sp);
+    else
+#endif
     r = Nread(sp->socket, sp->buffer, sp->settings->blksize, Psctp);
     if (r < 0)
         return r;
@@ -56,6 +385,11 @@ iperf_sctp_send(struct iperf_stream *sp)
 {
     int r;
 
+#ifdef HAVE_SCTP_STREAMS
+    if (sctp_messages(sp->test))
+	r = sctp_send_message(sp);
+    else
+#endif
     r = Nwrite(sp->socket, sp->buffer, sp->settings->blksize, Psctp);
     if (r < 0)
         return r;    
@@ -99,6 +433,9 @@ iperf_sctp_accept(struct iperf_test * test)
             return -1;
         }
         close(s);
+    } else if (set_sctp_options(test, s) < 0) {
+        close(s);
+        return -1;
     }
 
     return s;
@@ -156,7 +493,11 @@ iperf_sctp_listen(struct iperf_test *test)
         return -1;
     }
 
-    if (bind(s, (struct sockaddr *) res->ai_addr, res->ai_addrlen) < 0) {
+    /* With --sctp-bindx and no -B, the listener has just those addresses
+    ** rather than the wildcard, which would take in all of them anyway.
+    */
+    if ((test->bind_address != NULL || test->sctp_bindx == NULL) &&
+        bind(s, (struct sockaddr *) res->ai_addr, res->ai_addrlen) < 0) {
         close(s);
         freeaddrinfo(res);
         i_errno = IESTREAMLISTEN;
@@ -165,6 +506,12 @@ iperf_sctp_listen(struct iperf_test *test)
 
     freeaddrinfo(res);
 
+    if (sctp_bind_addresses(test, s, test->server_port) < 0 ||
+        set_sctp_init_options(test, s) < 0) {
+        close(s);
+        return -1;
+    }
+
     if (listen(s, 5) < 0) {
         i_errno = IESTREAMLISTEN;
         return -1;
@@ -184,47 +531,39 @@ int
 iperf_sctp_connect(struct iperf_test *test)
 {
     int s, opt;
-    char portstr[6];
-    struct addrinfo hints, *local_res, *server_res;
+    struct addrinfo *server_res;
 
-    if (test->bind_address) {
-        memset(&hints, 0, sizeof(hints));
-        hints.ai_family = test->settings->domain;
-        hints.ai_socktype = SOCK_STREAM;
-        if (getaddrinfo(test->bind_address, NULL, &hints, &local_res) != 0) {
-            i_errno = IESTREAMCONNECT;
-            return -1;
-        }
-    }
-
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_family = test->settings->domain;
-    hints.ai_socktype = SOCK_STREAM;
-    snprintf(portstr, sizeof(portstr), "%d", test->server_port);
-    if (getaddrinfo(test->server_hostname, portstr, &hints, &server_res) != 0) {
-	if (test->bind_address)
-	    freeaddrinfo(local_res);
+    if (iperf_resolve_addresses(test) < 0) {
         i_errno = IESTREAMCONNECT;
         return -1;
     }
+    server_res = test->server_res;
 
     s = socket(server_res->ai_family, SOCK_STREAM, IPPROTO_SCTP);
     if (s < 0) {
-	if (test->bind_address)
-	    freeaddrinfo(local_res);
-	freeaddrinfo(server_res);
         i_errno = IESTREAMCONNECT;
         return -1;
     }
 
-   
+    if (test->local_res) {
+        if (bind(s, (struct sockaddr *) test->local_res->ai_addr, test->local_res->ai_addrlen) < 0) {
+            close(s);
+            i_errno = IESTREAMCONNECT;
+            return -1;
+        }
+    }
+
+    if (sctp_bind_addresses(test, s, 0) < 0 ||
+        set_sctp_init_options(test, s) < 0) {
+        close(s);
+        return -1;
+    }
+
     if (connect(s, (struct sockaddr *) server_res->ai_addr, server_res->ai_addrlen) < 0 && errno != EINPROGRESS) {
 	close(s);
-	freeaddrinfo(server_res);
         i_errno = IESTREAMCONNECT;
         return -1;
     }
-    freeaddrinfo(server_res);
 
     /* Send cookie for verification */
     if (Nwrite(s, test->cookie, COOKIE_SIZE, Psctp) < 0) {
@@ -236,11 +575,15 @@ iperf_sctp_connect(struct iperf_test *test)
     opt = 0;
     if(setsockopt(s, IPPROTO_SCTP, SCTP_DISABLE_FRAGMENTS, &opt, sizeof(opt)) < 0) {
         close(s);
-        freeaddrinfo(server_res);
         i_errno = IESETSCTPDISABLEFRAG;
         return -1;
     }
 
+    if (set_sctp_options(test, s) < 0) {
+        close(s);
+        return -1;
+    }
+
     return s;
 }
 
@@ -252,3 +595,204 @@ iperf_sctp_init(struct iperf_test *test)
     return 0;
 }
 
+
+
+#ifdef HAVE_SCTP_STREAMS
+static size_t
+addr_len(const struct sockaddr *sa)
+{
+    return sa->sa_family == AF_INET ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6);
+}
+
+static int
+same_addr(const struct sockaddr_storage *a, const struct sockaddr_storage *b)
+{
+    return a->ss_family == b->ss_family && memcmp(a, b, addr_len((const struct sockaddr *) a)) == 0;
+}
+
+/* Read the peer's addresses, and each one's path as the association
+** sees it.
+*/
+static void
+sctp_sample_paths(struct iperf_stream *sp, const struct sockaddr_storage *primary)
+{
+    struct iperf_sctp *sc = sp->sctp;
+    struct sctp_getaddrs *ga;
+    struct sctp_paddrinfo pi;
+    struct sctp_path *p;
+    char buf[sizeof(struct sctp_getaddrs) + SCTP_MAX_PATHS * sizeof(struct sockaddr_in6)];
+    unsigned char *a, *end;
+    socklen_t len;
+    uint32_t i;
+
+    sc->paths = 0;
+    ga = (struct sctp_getaddrs *) buf;
+    memset(buf, 0, sizeof(buf));
+    len = sizeof(buf);
+    /* ENOMEM if there are more than fit; those few are enough. */
+    if (getsockopt(sp->socket, IPPROTO_SCTP, SCTP_GET_PEER_ADDRS, buf, &len) < 0)
+	return;
+    a = ga->addrs;
+    end = (unsigned char *) buf + len;
+    for (i = 0; i < ga->addr_num && sc->paths < SCTP_MAX_PATHS; ++i) {
+	if (a + sizeof(struct sockaddr) > end ||
+	    a + addr_len((struct sockaddr *) a) > end)
+	    break;
+	p = &sc->path[sc->paths];
+	memset(p, 0, sizeof(*p));
+	memcpy(&p->addr, a, addr_len((struct sockaddr *) a));
+	a += addr_len((struct sockaddr *) a);
+
+	memset(&pi, 0, sizeof(pi));
+	memcpy(&pi.spinfo_address, &p->addr, sizeof(p->addr));
+	len = sizeof(pi);
+	if (getsockopt(sp->socket, IPPROTO_SCTP, SCTP_GET_PEER_ADDR_INFO, &pi, &len) < 0)
+	    continue;
+	p->state = pi.spinfo_state;
+	p->cwnd = pi.spinfo_cwnd;
+	p->srtt = pi.spinfo_srtt;
+	p->rto = pi.spinfo_rto;
+	p->mtu = pi.spinfo_mtu;
+	p->primary = same_addr(&p->addr, primary);
+	++sc->paths;
+    }
+}
+#endif
+
+void
+iperf_sctp_sample(struct iperf_stream *sp)
+{
+#ifdef HAVE_SCTP_STREAMS
+    struct iperf_sctp *sc;
+    struct sctp_status st;
+    struct sockaddr_storage primary;
+    socklen_t len;
+    int i;
+#ifdef HAVE_SCTP_PR
+    struct sctp_prstatus pr;
+    uint64_t abandoned;
+#endif
+
+    if ((sc = sctp_state(sp)) == NULL)
+	return;
+    for (i = 0; i < sc->streams; ++i) {
+	sc->interval_bytes[i] = sc->bytes[i];
+	sc->bytes[i] = 0;
+    }
+
+    memset(&st, 0, sizeof(st));
+    len = sizeof(st);
+    if (getsockopt(sp->socket, IPPROTO_SCTP, SCTP_STATUS, &st, &len) < 0) {
+	sc->paths = 0;
+	return;
+    }
+    sc->rwnd = st.sstat_rwnd;
+    sc->unacked = st.sstat_unackdata;
+    sc->pending = st.sstat_penddata;
+    sc->instreams = st.sstat_instrms;
+    sc->outstreams = st.sstat_outstrms;
+    /* sctp_paddrinfo is packed; its address is copied out to be compared. */
+    memcpy(&primary, &st.sstat_primary.spinfo_address, sizeof(primary));
+    sctp_sample_paths(sp, &primary);
+
+#ifdef HAVE_SCTP_PR
+    if (sp->test->sctp_pr_ttl) {
+	memset(&pr, 0, sizeof(pr));
+	pr.sprstat_policy = SCTP_PR_SCTP_ALL;
+	len = sizeof(pr);
+	if (getsockopt(sp->socket, IPPROTO_SCTP, SCTP_PR_ASSOC_STATUS, &pr, &len) == 0) {
+	    abandoned = pr.sprstat_abandoned_unsent + pr.sprstat_abandoned_sent;
+	    sc->interval_abandoned = abandoned - sc->abandoned;
+	    sc->abandoned = abandoned;
+	}
+    }
+#endif
+#endif
+}
+
+#ifdef HAVE_SCTP_STREAMS
+static void
+addr_string(const struct sockaddr_storage *ss, char *buf, size_t len)
+{
+    char host[NI_MAXHOST];
+
+    if (getnameinfo((const struct sockaddr *) ss, addr_len((const struct sockaddr *) ss), host, sizeof(host), NULL, 0, NI_NUMERICHOST) != 0)
+	snprintf(buf, len, "?");
+    else
+	snprintf(buf, len, "%s", host);
+}
+
+static const char *
+path_state(int state)
+{
+    switch (state) {
+	case SCTP_ACTIVE:
+	return "active";
+	case SCTP_PF:
+	return "potentially-failed";
+	case SCTP_INACTIVE:
+	return "inactive";
+	case SCTP_UNCONFIRMED:
+	return "unconfirmed";
+	default:
+	return "unknown";
+    }
+}
+#endif
+
+void
+iperf_sctp_print(struct iperf_stream *sp, double st, double et, double duration, cJSON *json_stream)
+{
+#ifdef HAVE_SCTP_STREAMS
+    struct iperf_sctp *sc = sp->sctp;
+    struct sctp_path *p;
+    char abuf[NI_MAXHOST];
+    char ubuf[UNIT_LEN], nbuf[UNIT_LEN], cbuf[UNIT_LEN];
+    double bandwidth;
+    cJSON *json_sctp = NULL, *json_paths = NULL, *json_streams = NULL;
+    int i;
+
+    if (sc == NULL)
+	return;
+    if (json_stream != NULL) {
+	json_sctp = iperf_json_printf("rwnd: %d  unacked: %d  pending: %d  instreams: %d  outstreams: %d  abandoned: %d", (int64_t) sc->rwnd, (int64_t) sc->unacked, (int64_t) sc->pending, (int64_t) sc->instreams, (int64_t) sc->outstreams, (int64_t) sc->interval_abandoned);
+	if (json_sctp == NULL)
+	    return;
+	cJSON_AddItemToObject(json_stream, "sctp", json_sctp);
+	if ((json_paths = cJSON_CreateArray()) != NULL)
+	    cJSON_AddItemToObject(json_sctp, "paths", json_paths);
+	if ((json_streams = cJSON_CreateArray()) != NULL)
+	    cJSON_AddItemToObject(json_sctp, "streams", json_streams);
+    } else {
+	unit_snprintf(ubuf, UNIT_LEN, (double) sc->rwnd, 'A');
+	iprintf(sp->test, report_sctp_assoc_interval, sp->socket, st, et, sc->outstreams, sc->instreams, ubuf, sc->unacked, sc->pending, (unsigned long long) sc->interval_abandoned);
+    }
+
+    for (i = 0; i < sc->paths; ++i) {
+	p = &sc->path[i];
+	addr_string(&p->addr, abuf, sizeof(abuf));
+	if (json_stream != NULL) {
+	    if (json_paths != NULL)
+		cJSON_AddItemToArray(json_paths, iperf_json_printf("address: %s  state: %s  primary: %b  cwnd: %d  srtt: %d  rto: %d  mtu: %d", abuf, path_state(p->state), p->primary, (int64_t) p->cwnd, (int64_t) p->srtt, (int64_t) p->rto, (int64_t) p->mtu));
+	} else {
+	    unit_snprintf(cbuf, UNIT_LEN, (double) p->cwnd, 'A');
+	    iprintf(sp->test, report_sctp_path_interval, sp->socket, st, et, abuf, path_state(p->state), p->primary ? " (primary)" : "", cbuf, p->srtt, p->rto, p->mtu);
+	}
+    }
+
+    /* One stream id says nothing the stream's own line does not. */
+    if (sc->streams < 2)
+	return;
+    for (i = 0; i < sc->streams; ++i) {
+	bandwidth = duration > 0 ? (double) sc->interval_bytes[i] / duration : 0.0;
+	if (json_stream != NULL) {
+	    if (json_streams != NULL)
+		cJSON_AddItemToArray(json_streams, iperf_json_printf("sid: %d  bytes: %d  bits_per_second: %f", (int64_t) i, (int64_t) sc->interval_bytes[i], bandwidth * 8));
+	} else {
+	    unit_snprintf(ubuf, UNIT_LEN, (double) sc->interval_bytes[i], 'A');
+	    unit_snprintf(nbuf, UNIT_LEN, bandwidth, sp->test->settings->unit_format);
+	    iprintf(sp->test, report_sctp_stream_interval, sp->socket, st, et, i, ubuf, nbuf);
+	}
+    }
+#endif
+}
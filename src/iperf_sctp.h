@@ -10,11 +10,53 @@
 #ifndef        IPERF_SCTP_H
 #define        IPERF_SCTP_H
 
+#include <stdint.h>
+#include <sys/socket.h>
 
 #ifndef SCTP_DISABLE_FRAGMENTS
 #define SCTP_DISABLE_FRAGMENTS  8
 #endif
 
+/* Most stream ids one association may use with --sctp-streams. */
+#define MAX_SCTP_STREAMS 1024
+/* Peer addresses of one association that are reported; any beyond are not. */
+#define SCTP_MAX_PATHS 8
+
+struct sctp_path
+{
+    struct sockaddr_storage addr;
+    int       state;		/* SCTP_ACTIVE, SCTP_INACTIVE, ... */
+    int       primary;
+    uint32_t  cwnd;		/* bytes */
+    uint32_t  srtt;		/* msecs */
+    uint32_t  rto;		/* msecs */
+    uint32_t  mtu;
+};
+
+/* The association behind one --sctp stream, as of the last sample. */
+struct iperf_sctp
+{
+    int       streams;		/* stream ids in use, 0 .. streams - 1 */
+    int       next_sid;		/* the sender's next stream id, round robin */
+    uint64_t  bytes[MAX_SCTP_STREAMS];	/* per stream id, since the last sample */
+    uint64_t  interval_bytes[MAX_SCTP_STREAMS];
+    uint32_t  rwnd;
+    int       unacked;		/* chunks */
+    int       pending;		/* chunks */
+    int       instreams;
+    int       outstreams;
+    uint64_t  abandoned;	/* PR-SCTP messages given up on, since the association started */
+    uint64_t  interval_abandoned;
+    int       paths;
+    struct sctp_path path[SCTP_MAX_PATHS];
+};
+
+int has_sctp_streams(void);
+
+int has_sctp_bindx(void);
+
+int has_sctp_pr(void);
+
 /**
  * iperf_sctp_accept -- accepts a new SCTP connection
  * on sctp_listener_socket for SCTP data and param/result
@@ -48,4 +90,20 @@ int iperf_sctp_connect(struct iperf_test *);
 
 int iperf_sctp_init(struct iperf_test *test);
 
+/**
+ * iperf_sctp_sample -- read a stream's association: its status, every
+ * peer address, and what went over each stream id since the last sample
+ *
+ */
+void iperf_sctp_sample(struct iperf_stream *sp);
+
+/**
+ * iperf_sctp_print -- the last sample, as lines under the stream's
+ * interval line or as an "sctp" object in its JSON object
+ *
+ */
+void iperf_sctp_print(struct iperf_stream *sp, double st, double et, double duration, cJSON *json_stream);
+
+void iperf_sctp_free(struct iperf_stream *sp);
+
 #endif
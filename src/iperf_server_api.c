@@ -30,11 +30,13 @@
 #include <sys/resource.h>
 #include <sched.h>
 #include <setjmp.h>
+#include <signal.h>
 
 #include "iperf.h"
 #include "iperf_api.h"
 #include "iperf_udp.h"
 #include "iperf_tcp.h"
+#include "iperf_unix.h"
 #include "iperf_util.h"
 #include "timer.h"
 #include "net.h"
@@ -47,8 +49,15 @@
 int
 iperf_server_listen(struct iperf_test *test)
 {
+    char path[UNIX_PATH_LEN];
+
     retry:
-    if((test->listener = netannounce(test->settings->domain, Ptcp, test->bind_address, test->server_port)) < 0) {
+    if (test->settings->domain == AF_UNIX) {
+	iperf_unix_path(test, 0, path, sizeof(path));
+	test->listener = netannounce_unix(SOCK_STREAM, path);
+    } else
+	test->listener = netannounce(test->settings->domain, Ptcp, test->bind_address, test->server_port);
+    if (test->listener < 0) {
 	if (errno == EAFNOSUPPORT && (test->settings->domain == AF_INET6 || test->settings->domain == AF_UNSPEC)) {
 	    /* If we get "Address family not supported by protocol", that
 	    ** probably means we were compiled with IPv6 but the running
@@ -63,10 +72,14 @@ iperf_server_listen(struct iperf_test *test)
 	    return -1;
 	}
     }
+    setnonblocking(test->listener, 1);
 
     if (!test->json_output) {
 	printf("-----------------------------------------------------------\n");
-	printf("Server listening on %d\n", test->server_port);
+	if (test->settings->domain == AF_UNIX)
+	    printf("Server listening on %s\n", path);
+	else
+	    printf("Server listening on %d\n", test->server_port);
     }
 
     // This needs to be changed to reflect if client has different window size
@@ -109,7 +122,7 @@ iperf_server_listen(struct iperf_test *test)
 int
 iperf_accept(struct iperf_test *test)
 {
-    int s;
+    int s, r;
     signed char rbuf = ACCESS_DENIED;
     char cookie[COOKIE_SIZE];
     socklen_t len;
@@ -117,17 +130,32 @@ iperf_accept(struct iperf_test *test)
 
     len = sizeof(addr);
     if ((s = accept(test->listener, (struct sockaddr *) &addr, &len)) < 0) {
+	/* The listener is non-blocking; a connection that went away
+	** between select and accept is not an error.
+	*/
+	if (errno == EAGAIN || errno == EWOULDBLOCK)
+	    return 0;
         i_errno = IEACCEPT;
         return -1;
     }
+    setnonblocking(s, 0);
 
     if (test->ctrl_sck == -1) {
         /* Server free, accept new client */
-        test->ctrl_sck = s;
-        if (Nread(test->ctrl_sck, test->cookie, COOKIE_SIZE, Ptcp) < 0) {
+        if ((r = Nread(s, test->cookie, COOKIE_SIZE, Ptcp)) < 0) {
+	    close(s);
             i_errno = IERECVCOOKIE;
             return -1;
         }
+	/* Closed without a cookie, as a --unix server checking whether
+	** the path is still in use does: not a client, and nothing to
+	** answer.
+	*/
+	if (r != COOKIE_SIZE) {
+	    close(s);
+	    return 0;
+	}
+        test->ctrl_sck = s;
 	FD_SET(test->ctrl_sck, &test->read_set);
 	if (test->ctrl_sck > test->max_fd) test->max_fd = test->ctrl_sck;
 
@@ -142,10 +170,14 @@ iperf_accept(struct iperf_test *test)
             test->on_connect(test);
     } else {
         /* XXX: Do we even need to receive cookie if we're just going to deny anyways? */
-        if (Nread(s, cookie, COOKIE_SIZE, Ptcp) < 0) {
+        if ((r = Nread(s, cookie, COOKIE_SIZE, Ptcp)) < 0) {
             i_errno = IERECVCOOKIE;
             return -1;
         }
+	if (r != COOKIE_SIZE) {
+	    close(s);
+	    return 0;
+	}
         if (Nwrite(s, (char*) &rbuf, sizeof(rbuf), Ptcp) < 0) {
             i_errno = IESENDMESSAGE;
             return -1;
@@ -395,6 +427,8 @@ cleanup_server(struct iperf_test *test)
     /* Close open test sockets */
     close(test->ctrl_sck);
     close(test->listener);
+    if (test->settings->domain == AF_UNIX)
+	iperf_unix_unlink(test);
 
     /* Cancel any remaining timers. */
     if (test->stats_timer != NULL) {
@@ -412,28 +446,51 @@ cleanup_server(struct iperf_test *test)
 }
 
 
-static jmp_buf sigend_jmp_buf;
+static IPERF_TLS jmp_buf sigend_jmp_buf;
+static IPERF_TLS int sigend_armed;
 
+/* The signal goes to whichever thread the kernel picks.  If that one is
+** not inside iperf_run_server(), there is nothing to jump back to, so take
+** the default action instead.
+*/
 static void
 sigend_handler(int sig)
 {
+    if (!sigend_armed) {
+	signal(sig, SIG_DFL);
+	raise(sig);
+	return;
+    }
     longjmp(sigend_jmp_buf, 1);
 }
 
 
+static int run_server(struct iperf_test *test);
+
 int
 iperf_run_server(struct iperf_test *test)
 {
-    int result, s, streams_accepted;
-    fd_set read_set, write_set;
-    struct iperf_stream *sp;
-    struct timeval now;
-    struct timeval* timeout;
+    int r;
 
     /* Termination signals. */
     iperf_catch_sigend(sigend_handler);
     if (setjmp(sigend_jmp_buf))
 	iperf_got_sigend(test);
+    sigend_armed = 1;
+    r = run_server(test);
+    sigend_armed = 0;
+    return r;
+}
+
+static int
+run_server(struct iperf_test *test)
+{
+    int result, s, streams_accepted, blocks;
+    fd_set read_set, write_set;
+    struct iperf_stream *sp;
+    struct timeval now;
+    struct timeval* timeout;
+    uint64_t timer_runs;
 
     if (test->affinity != -1) 
 	if (iperf_setaffinity(test, test->affinity) != 0)
@@ -444,8 +501,11 @@ iperf_run_server(struct iperf_test *test)
 	    return -1;
 
     if (test->json_output) {
+	cJSON_Arena *prev = cJSON_SetArena(test->json_arena);
+
 	cJSON_AddItemToObject(test->json_start, "version", cJSON_CreateString(version));
 	cJSON_AddItemToObject(test->json_start, "system_info", cJSON_CreateString(get_system_info()));
+	cJSON_SetArena(prev);
     } else if (test->verbose) {
 	iprintf(test, "%s\n", version);
 	iprintf(test, "%s", "");
@@ -477,6 +537,11 @@ iperf_run_server(struct iperf_test *test)
             i_errno = IESELECT;
             return -1;
         }
+	blocks = test->blocks_sent;
+	timer_runs = test->loop.timer_runs;
+	/* Pushed intervals the control socket would not take earlier. */
+	if (test->ctrl_out_len > 0 && iperf_ctrl_flush(test, 0) < 0)
+	    test->ctrl_live = 0;
 	if (result > 0) {
             if (FD_ISSET(test->listener, &read_set)) {
                 if (test->state != CREATE_STREAMS) {
@@ -497,37 +562,61 @@ iperf_run_server(struct iperf_test *test)
 
             if (test->state == CREATE_STREAMS) {
                 if (FD_ISSET(test->prot_listener, &read_set)) {
-    
-                    if ((s = test->protocol->accept(test)) < 0) {
-			cleanup_server(test);
-                        return -1;
-		    }
 
-                    if (!is_closed(s)) {
-                        sp = iperf_new_stream(test, s);
-                        if (!sp) {
+		    /* A non-blocking TCP or AF_UNIX byte stream listener
+		    ** is drained until it would block, so all pending
+		    ** streams get picked up in one pass.
+		    */
+		    do {
+			if ((s = test->protocol->accept(test)) < 0) {
+			    if ((test->protocol->id == Ptcp || test->protocol->id == Punix ||
+				 test->protocol->id == Pshm) &&
+				(errno == EAGAIN || errno == EWOULDBLOCK))
+				break;
 			    cleanup_server(test);
-                            return -1;
+			    return -1;
 			}
 
-			if (test->sender)
-			    FD_SET(s, &test->write_set);
-			else
-			    FD_SET(s, &test->read_set);
-			if (s > test->max_fd) test->max_fd = s;
-
-                        streams_accepted++;
-                        if (test->on_new_stream)
-                            test->on_new_stream(sp);
-                    }
+			if (!is_closed(s)) {
+			    /* A UDP stream is the old listener socket, which
+			    ** select() just reported for the datagram accept
+			    ** read; the test may start in this same pass.
+			    */
+			    FD_CLR(s, &read_set);
+			    sp = iperf_new_stream(test, s);
+			    if (!sp) {
+				cleanup_server(test);
+				return -1;
+			    }
+
+			    if (test->sender)
+				FD_SET(s, &test->write_set);
+			    else
+				FD_SET(s, &test->read_set);
+			    if (s > test->max_fd) test->max_fd = s;
+
+			    streams_accepted++;
+			    if (test->on_new_stream)
+				test->on_new_stream(sp);
+			}
+		    } while ((test->protocol->id == Ptcp || test->protocol->id == Punix ||
+			      test->protocol->id == Pshm) &&
+			     streams_accepted < test->num_streams);
                     FD_CLR(test->prot_listener, &read_set);
                 }
 
                 if (streams_accepted == test->num_streams) {
-                    if (test->protocol->id != Ptcp) {
+		    (void) gettimeofday(&now, NULL);
+		    test->stream_setup_time = timeval_diff(&test->stream_setup_start, &now);
+                    if (test->protocol->id != Ptcp && test->protocol->id != Punix &&
+			test->protocol->id != Pshm) {
                         FD_CLR(test->prot_listener, &test->read_set);
                         close(test->prot_listener);
-                    } else { 
+                    } else if (test->protocol->id == Ptcp && !test->mptcp) {
+			/* An MPTCP listener stays, for the subflows that
+			** join the streams later; it takes the plain TCP
+			** of control connections as well.
+			*/
                         if (test->no_delay || test->settings->mss || test->settings->socket_bufsize) {
                             FD_CLR(test->listener, &test->read_set);
                             close(test->listener);
@@ -537,6 +626,7 @@ iperf_run_server(struct iperf_test *test)
                                 return -1;
                             }
                             test->listener = s;
+                            setnonblocking(test->listener, 1);
                             FD_SET(test->listener, &test->read_set);
 			    if (test->listener > test->max_fd) test->max_fd = test->listener;
                         }
@@ -591,8 +681,14 @@ iperf_run_server(struct iperf_test *test)
 	    (timeout != NULL && timeout->tv_sec == 0 && timeout->tv_usec == 0)) {
 	    /* Run the timers. */
 	    (void) gettimeofday(&now, NULL);
+	    ++test->loop.timer_runs;
 	    tmr_run(&now);
 	}
+	if (test->state == TEST_RUNNING) {
+	    ++test->loop.wakeups;
+	    if (test->blocks_sent == blocks && test->loop.timer_runs == timer_runs)
+		++test->loop.idle_wakeups;
+	}
     }
 
     cleanup_server(test);
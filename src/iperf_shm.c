@@ -0,0 +1,480 @@
+/*
+ * Copyright (c) 2014, The Regents of the University of California,
+ * through Lawrence Berkeley National Laboratory (subject to receipt of any
+ * required approvals from the U.S. Dept. of Energy).  All rights reserved.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE file
+ * for complete information.
+ */
+
+/* iperf_shm.c: streams through shared memory (--shm)
+ *
+ * Each stream is an AF_UNIX connection, set up as for --unix, plus a
+ * single-producer single-consumer byte ring in memory both processes
+ * map.  At TEST_START the client creates the ring, in a memfd where
+ * there is one and an unlinked temporary file elsewhere, and passes
+ * the descriptor to the server over the stream's connection.
+ *
+ * Blocks go through the ring without system calls.  The connection
+ * carries only one-byte wakeups, and only when a side has found the
+ * ring empty (receiver) or full (sender) and said so in the ring
+ * header.  A waiting receiver leaves its wakeup unread until it finds
+ * the ring empty again, so its socket stays readable, and select()
+ * keeps calling it, for as long as there is data.  A sender with a full
+ * ring waits in poll() for its wakeup or for the control connection,
+ * no longer than the next timer, so the test can still end.
+ *
+ * The ring's file is sealed against shrinking and growing before it is
+ * passed on, and the server maps only a file so sealed: otherwise the
+ * client could cut it short under the server's mapping, and the server
+ * would take SIGBUS at its next access.
+ */
+
+#define _GNU_SOURCE		/* F_ADD_SEALS, MFD_ALLOW_SEALING */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#ifdef linux
+#include <sys/syscall.h>
+#endif
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_shm.h"
+#include "net.h"
+#include "timer.h"
+
+#if defined(linux) && defined(F_ADD_SEALS) && defined(F_SEAL_SHRINK) && defined(F_SEAL_GROW)
+#define HAVE_SHM_SEALS 1
+#define SHM_SEALS (F_SEAL_SHRINK | F_SEAL_GROW)
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+#define SHM_MEMFD_FLAGS MFD_ALLOW_SEALING
+#else
+#define SHM_MEMFD_FLAGS 0
+#endif
+
+/* The shared header, a page ahead of the data.  Each side's position
+** and waiting flag share a cache line, and nothing else does.
+*/
+#define SHM_HEADER 4096
+
+struct shm_ring
+{
+    uint64_t  size;		/* of the data, a power of two */
+    char      pad0[56];
+    uint64_t  head;		/* bytes written, by the sender */
+    int       receiver_waiting;	/* set by the receiver, cleared by whoever wakes it */
+    char      pad1[52];
+    uint64_t  tail;		/* bytes read, by the receiver */
+    int       sender_waiting;
+    char      pad2[52];
+};
+
+#define shm_load(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define shm_store(p, v) __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+#define shm_exchange(p, v) __atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+/* Whoever sets its waiting flag re-reads the other's position after,
+** and whoever moves its position reads the flag after, so at least one
+** of them sees the other: sequentially consistent on both sides.
+*/
+#define shm_load_sc(p) __atomic_load_n((p), __ATOMIC_SEQ_CST)
+
+
+static int
+shm_wake(int s)
+{
+    char c = 0;
+
+    if (net_counters)
+	++net_counters->syscalls;
+    return write(s, &c, 1) == 1 ? 0 : NET_HARDERROR;
+}
+
+/* Take one wakeup: 1, or 0 if the peer has closed, or NET_HARDERROR. */
+static int
+shm_woken(int s)
+{
+    char c;
+    int r;
+
+    do {
+	r = read(s, &c, 1);
+	if (net_counters)
+	    ++net_counters->syscalls;
+    } while (r < 0 && errno == EINTR);
+    return r < 0 ? NET_HARDERROR : r;
+}
+
+/* The sender, with a full ring: 0 once woken, NET_SOFTERROR if a
+** timer, or on the server the control connection, needs the main loop
+** first.  The client's test ends by its own timers, and it may not be
+** select()ing on the control connection at all (SIGALRM mode).
+*/
+static int
+shm_wait(struct iperf_stream *sp)
+{
+    struct pollfd fds[2];
+    struct timeval now, *timeout;
+    int ms = 1000, r;
+
+    if (gettimeofday(&now, NULL) == 0 && (timeout = tmr_timeout(&now)) != NULL &&
+	timeout->tv_sec < 1)
+	ms = (timeout->tv_usec + 999) / 1000;
+    fds[0].fd = sp->socket;
+    fds[0].events = POLLIN;
+    fds[1].fd = sp->test->ctrl_sck;
+    fds[1].events = POLLIN;
+    r = poll(fds, sp->test->role == 's' ? 2 : 1, ms);
+    if (net_counters)
+	++net_counters->syscalls;
+    if (r < 0 && errno != EINTR)
+	return NET_HARDERROR;
+    if (r > 0 && fds[0].revents) {
+	if (shm_woken(sp->socket) <= 0)
+	    return NET_HARDERROR;
+	/* The receiver cleared the flag when it woke us. */
+	sp->shm->waiting = 0;
+	return 0;
+    }
+    if (net_counters)
+	++net_counters->soft_errors;
+    return NET_SOFTERROR;
+}
+
+
+/* iperf_shm_send
+ *
+ * copies a block into the ring
+ */
+int
+iperf_shm_send(struct iperf_stream *sp)
+{
+    struct iperf_shm *shm = sp->shm;
+    struct shm_ring *ring = shm->ring;
+    uint64_t size = shm->mask + 1, off;
+    size_t n = sp->settings->blksize, first;
+    int r;
+
+    while (shm->pos + n > shm->limit) {
+	shm->limit = shm_load_sc(&ring->tail) + size;
+	if (shm->pos + n <= shm->limit)
+	    break;
+	if (!shm->waiting) {
+	    shm_store(&ring->sender_waiting, 1);
+	    shm->waiting = 1;
+	    continue;
+	}
+	if ((r = shm_wait(sp)) < 0)
+	    return r;
+    }
+    /* Room after all.  If the receiver got to the flag first, its
+    ** wakeup is on the way and has to be taken.
+    */
+    if (shm->waiting) {
+	shm->waiting = 0;
+	if (!shm_exchange(&ring->sender_waiting, 0) && shm_woken(sp->socket) <= 0)
+	    return NET_HARDERROR;
+    }
+
+    off = shm->pos & shm->mask;
+    first = n < size - off ? n : size - off;
+    memcpy(shm->data + off, sp->buffer, first);
+    memcpy(shm->data, sp->buffer + first, n - first);
+    shm->pos += n;
+    shm_store(&ring->head, shm->pos);
+    if (shm_load_sc(&ring->receiver_waiting) && shm_exchange(&ring->receiver_waiting, 0))
+	if (shm_wake(sp->socket) < 0)
+	    return NET_HARDERROR;
+
+    if (net_counters)
+	net_counters->bytes += n;
+    sp->result->bytes_sent += n;
+    sp->result->bytes_sent_this_interval += n;
+
+    return n;
+}
+
+
+/* iperf_shm_recv
+ *
+ * copies up to a block out of the ring; 0 once the sender has gone
+ */
+int
+iperf_shm_recv(struct iperf_stream *sp)
+{
+    struct iperf_shm *shm = sp->shm;
+    struct shm_ring *ring = shm->ring;
+    uint64_t size = shm->mask + 1, off;
+    size_t n, first;
+    int r;
+
+    if (shm->pos == shm->limit)
+	shm->limit = shm_load(&ring->head);
+    n = shm->limit - shm->pos;
+    if (n > sp->settings->blksize)
+	n = sp->settings->blksize;
+    if (n > 0) {
+	off = shm->pos & shm->mask;
+	first = n < size - off ? n : size - off;
+	memcpy(sp->buffer, shm->data + off, first);
+	memcpy(sp->buffer + first, shm->data, n - first);
+	shm->pos += n;
+	shm_store(&ring->tail, shm->pos);
+	/* Let a waiting sender sleep until the ring is half empty, so it
+	** is not woken for every block.  Whatever is left, we will read.
+	*/
+	if (shm_load_sc(&ring->sender_waiting) && shm->limit - shm->pos <= size / 2 &&
+	    shm_exchange(&ring->sender_waiting, 0))
+	    if (shm_wake(sp->socket) < 0)
+		return NET_HARDERROR;
+    }
+
+    /* Empty: ask to be woken, then take the wakeup that brought us
+    ** here, unless more data came in the meantime and nobody woke us
+    ** for it, in which case that wakeup has to keep us readable.
+    */
+    if (shm->pos == shm->limit && shm->pos == (shm->limit = shm_load(&ring->head))) {
+	shm_store(&ring->receiver_waiting, 1);
+	shm->limit = shm_load_sc(&ring->head);
+	if (shm->pos == shm->limit || !shm_exchange(&ring->receiver_waiting, 0)) {
+	    if ((r = shm_woken(sp->socket)) < 0)
+		return r;
+	}
+    }
+
+    if (net_counters)
+	net_counters->bytes += n;
+    sp->result->bytes_received += n;
+    sp->result->bytes_received_this_interval += n;
+
+    return n;
+}
+
+
+/* A file to hold the ring: a memfd where the kernel has them, else an
+** unlinked temporary file.  Where files can be sealed, only a memfd
+** will do, since the server takes nothing else.
+*/
+static int
+shm_file(void)
+{
+    char template[] = "/tmp/iperf3.XXXXXX";
+    int fd;
+
+#if defined(linux) && defined(__NR_memfd_create)
+    if ((fd = syscall(__NR_memfd_create, "iperf3-shm", SHM_MEMFD_FLAGS)) >= 0)
+	return fd;
+#ifdef HAVE_SHM_SEALS
+    return -1;
+#endif
+#endif
+    if ((fd = mkstemp(template)) < 0)
+	return -1;
+    unlink(template);
+    return fd;
+}
+
+static int
+shm_send_fd(int s, int fd)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    union {
+	struct cmsghdr align;
+	char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    char c = 0;
+
+    memset(&msg, 0, sizeof(msg));
+    memset(&control, 0, sizeof(control));
+    iov.iov_base = &c;
+    iov.iov_len = 1;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    return sendmsg(s, &msg, 0) == 1 ? 0 : -1;
+}
+
+static int
+shm_recv_fd(int s)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    union {
+	struct cmsghdr align;
+	char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    char c;
+    int fd;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = &c;
+    iov.iov_len = 1;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    if (recvmsg(s, &msg, 0) != 1)
+	return -1;
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+	cmsg->cmsg_len != CMSG_LEN(sizeof(int))) {
+	errno = EPROTO;
+	return -1;
+    }
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    return fd;
+}
+
+/* Map the ring behind fd, checking what the peer put in the header. */
+static int
+shm_map(struct iperf_stream *sp, int fd)
+{
+    struct iperf_shm *shm;
+    struct stat st;
+    uint64_t size;
+    char *p;
+
+#ifdef HAVE_SHM_SEALS
+    /* Sealed, its size is the size for good; unsealed, it is not. */
+    if ((fcntl(fd, F_GET_SEALS) & SHM_SEALS) != SHM_SEALS) {
+	errno = EPERM;
+	return -1;
+    }
+#endif
+    if (fstat(fd, &st) < 0)
+	return -1;
+    if (st.st_size <= SHM_HEADER) {
+	errno = EINVAL;
+	return -1;
+    }
+    p = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+	return -1;
+    size = ((struct shm_ring *) p)->size;
+    if (size < (uint64_t) sp->settings->blksize || (size & (size - 1)) != 0 ||
+	size > (uint64_t) st.st_size - SHM_HEADER) {
+	munmap(p, st.st_size);
+	errno = EINVAL;
+	return -1;
+    }
+    if ((shm = (struct iperf_shm *) calloc(1, sizeof(*shm))) == NULL) {
+	munmap(p, st.st_size);
+	return -1;
+    }
+    shm->ring = (struct shm_ring *) p;
+    shm->data = p + SHM_HEADER;
+    shm->map_len = st.st_size;
+    shm->mask = size - 1;
+    if (sp->test->sender)
+	shm->limit = size;
+    sp->shm = shm;
+    return 0;
+}
+
+/* The client's side: make the ring, sized by -w, and pass it on. */
+static int
+shm_create(struct iperf_stream *sp)
+{
+    struct shm_ring *ring;
+    uint64_t want, size;
+    char *p;
+    int fd;
+
+    want = sp->settings->socket_bufsize ? sp->settings->socket_bufsize : SHM_RING_SIZE;
+    if (want < 2 * (uint64_t) sp->settings->blksize)
+	want = 2 * (uint64_t) sp->settings->blksize;
+    for (size = SHM_HEADER; size < want; size <<= 1)
+	;
+
+    if ((fd = shm_file()) < 0)
+	return -1;
+    if (ftruncate(fd, SHM_HEADER + size) < 0) {
+	close(fd);
+	return -1;
+    }
+#ifdef HAVE_SHM_SEALS
+    if (fcntl(fd, F_ADD_SEALS, SHM_SEALS) < 0) {
+	close(fd);
+	return -1;
+    }
+#endif
+    p = mmap(NULL, sizeof(*ring), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+	close(fd);
+	return -1;
+    }
+    /* The receiver starts out waiting for its first wakeup. */
+    ring = (struct shm_ring *) p;
+    ring->size = size;
+    ring->receiver_waiting = 1;
+    munmap(p, sizeof(*ring));
+
+    if (shm_map(sp, fd) < 0 || shm_send_fd(sp->socket, fd) < 0) {
+	close(fd);
+	return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+static int
+shm_receive(struct iperf_stream *sp)
+{
+    int fd, r;
+
+    if ((fd = shm_recv_fd(sp->socket)) < 0)
+	return -1;
+    r = shm_map(sp, fd);
+    close(fd);
+    return r;
+}
+
+
+void
+iperf_shm_free(struct iperf_stream *sp)
+{
+    if (sp->shm == NULL)
+	return;
+    munmap(sp->shm->ring, sp->shm->map_len);
+    free(sp->shm);
+    sp->shm = NULL;
+}
+
+
+int
+iperf_shm_init(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	iperf_shm_free(sp);
+	if ((test->role == 'c' ? shm_create(sp) : shm_receive(sp)) < 0) {
+	    i_errno = IESHM;
+	    return -1;
+	}
+    }
+    return 0;
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2014, The Regents of the University of California,
+ * through Lawrence Berkeley National Laboratory (subject to receipt of any
+ * required approvals from the U.S. Dept. of Energy).  All rights reserved.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE file
+ * for complete information.
+ */
+
+#ifndef        IPERF_SHM_H
+#define        IPERF_SHM_H
+
+#include <stdint.h>
+
+/* Ring size when -w is not given; it is rounded up to a power of two
+ * and to at least two blocks.
+ */
+#define SHM_RING_SIZE (1024 * 1024)
+
+/* One stream's end of the ring. */
+struct iperf_shm
+{
+    struct shm_ring *ring;	/* shared with the peer */
+    char     *data;		/* the ring's bytes, after the header */
+    size_t    map_len;
+    uint64_t  mask;		/* ring size - 1 */
+    uint64_t  pos;		/* head for the sender, tail for the receiver */
+    uint64_t  limit;		/* how far pos may go, as of the peer's last position seen */
+    int       waiting;		/* the sender has asked to be woken */
+};
+
+/**
+ * iperf_shm_free -- unmap a stream's ring
+ *
+ */
+void iperf_shm_free(struct iperf_stream *sp);
+
+int iperf_shm_recv(struct iperf_stream *);
+
+int iperf_shm_send(struct iperf_stream *);
+
+int iperf_shm_init(struct iperf_test *test);
+
+#endif
@@ -19,16 +19,48 @@
 #include <netinet/tcp.h>
 #include <sys/time.h>
 #include <sys/select.h>
+#include <fcntl.h>
 
 #include "iperf.h"
 #include "iperf_api.h"
 #include "iperf_tcp.h"
+#include "iperf_mptcp.h"
 #include "net.h"
 
 #if defined(linux)
 #include "flowlabel.h"
 #endif
 
+#if defined(linux) && defined(__has_include)
+#if __has_include(<linux/tls.h>)
+#include <linux/tls.h>
+#endif
+#endif
+#if defined(TCP_ULP) && defined(TLS_1_3_VERSION) && defined(TLS_CIPHER_AES_GCM_128)
+#define HAVE_KTLS 1
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#endif
+#include "tls.h"
+
+/* A --ktls stream direction the kernel would not take is sealed or
+** opened here instead, into the same records.
+*/
+struct iperf_tls
+{
+    struct tls_dir tx, rx;
+    int       user_tx, user_rx;	/* directions done in user space */
+    char     *out;		/* the sealed block being sent */
+    size_t    out_len, out_off;
+    size_t    plain_off, plain_len;	/* what is left of the record in in */
+    char      in[TLS_BODY_MAX];	/* the record last opened */
+};
+
+static int iperf_tcp_syn_data(int s);
+static int tls_recv(struct iperf_stream *sp);
+static int tls_send(struct iperf_stream *sp);
+
 /* iperf_tcp_recv
  *
  * receives the data for TCP
@@ -38,7 +70,10 @@ iperf_tcp_recv(struct iperf_stream *sp)
 {
     int r;
 
-    r = Nread(sp->socket, sp->buffer, sp->settings->blksize, Ptcp);
+    if (sp->tls && sp->tls->user_rx)
+	r = tls_recv(sp);
+    else
+	r = Nread(sp->socket, sp->buffer, sp->settings->blksize, Ptcp);
 
     if (r < 0)
         return r;
@@ -59,7 +94,9 @@ iperf_tcp_send(struct iperf_stream *sp)
 {
     int r;
 
-    if (sp->test->zerocopy)
+    if (sp->tls && sp->tls->user_tx)
+	r = tls_send(sp);
+    else if (sp->test->zerocopy)
 	r = Nsendfile(sp->buffer_fd, sp->socket, sp->buffer, sp->settings->blksize);
     else
 	r = Nwrite(sp->socket, sp->buffer, sp->settings->blksize, Ptcp);
@@ -92,6 +129,7 @@ iperf_tcp_accept(struct iperf_test * test)
         i_errno = IESTREAMCONNECT;
         return -1;
     }
+    setnonblocking(s, 0);
 
     if (Nread(s, cookie, COOKIE_SIZE, Ptcp) < 0) {
         i_errno = IERECVCOOKIE;
@@ -104,7 +142,10 @@ iperf_tcp_accept(struct iperf_test * test)
             return -1;
         }
         close(s);
+        return s;
     }
+    if (test->fast_open && iperf_tcp_syn_data(s))
+        test->fast_open_streams++;
 
     return s;
 }
@@ -124,7 +165,10 @@ iperf_tcp_listen(struct iperf_test *test)
 
     s = test->listener;
 
-    if (test->no_delay || test->settings->mss || test->settings->socket_bufsize) {
+    /* The control connection's listener will not do for the streams if
+    ** they need options set before the connection, or MPTCP.
+    */
+    if (test->no_delay || test->settings->mss || test->settings->socket_bufsize || test->mptcp) {
         FD_CLR(s, &test->read_set);
         close(s);
 
@@ -138,7 +182,7 @@ iperf_tcp_listen(struct iperf_test *test)
             return -1;
         }
 
-        if ((s = socket(res->ai_family, SOCK_STREAM, 0)) < 0) {
+        if ((s = socket(res->ai_family, SOCK_STREAM, test->mptcp ? IPPROTO_MPTCP : 0)) < 0) {
 	    freeaddrinfo(res);
             i_errno = IESTREAMLISTEN;
             return -1;
@@ -230,70 +274,275 @@ iperf_tcp_listen(struct iperf_test *test)
 
         freeaddrinfo(res);
 
-        if (listen(s, 5) < 0) {
+        if (listen(s, SOMAXCONN) < 0) {
             i_errno = IESTREAMLISTEN;
             return -1;
         }
+        setnonblocking(s, 1);
 
         test->listener = s;
     }
+
+#if defined(linux) && defined(TCP_FASTOPEN)
+    if (test->fast_open) {
+        opt = MAX_STREAMS;
+        if (setsockopt(s, IPPROTO_TCP, TCP_FASTOPEN, &opt, sizeof(opt)) < 0) {
+            i_errno = IESETFASTOPEN;
+            return -1;
+        }
+    }
+#endif
     
     return s;
 }
 
 
-/* iperf_tcp_connect
+/* iperf_tcp_syn_data
  *
- * connect to a TCP stream listener
+ * did the SYN of this connection carry data, i.e. was the cookie
+ * delivered with TCP Fast Open?
+ */
+static int
+iperf_tcp_syn_data(int s)
+{
+#if defined(linux) && defined(TCPI_OPT_SYN_DATA)
+    struct tcp_info info;
+    socklen_t len;
+
+    len = sizeof(info);
+    if (getsockopt(s, IPPROTO_TCP, TCP_INFO, &info, &len) < 0)
+        return 0;
+    return (info.tcpi_options & TCPI_OPT_SYN_DATA) != 0;
+#else
+    return 0;
+#endif
+}
+
+
+#ifdef HAVE_KTLS
+/* k is TLS_KEY_MATERIAL bytes: key, salt, IV. */
+static int
+ktls_set(int s, int dir, const unsigned char *k)
+{
+    struct tls12_crypto_info_aes_gcm_128 ci;
+
+    memset(&ci, 0, sizeof(ci));
+    ci.info.version = TLS_1_3_VERSION;
+    ci.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+    memcpy(ci.key, k, sizeof(ci.key));
+    memcpy(ci.salt, k + sizeof(ci.key), sizeof(ci.salt));
+    memcpy(ci.iv, k + sizeof(ci.key) + sizeof(ci.salt), sizeof(ci.iv));
+    /* rec_seq starts at zero, as after a handshake. */
+    return setsockopt(s, SOL_TLS, dir, &ci, sizeof(ci));
+}
+#endif
+
+/* Hand each direction of the stream to the kernel's TLS layer, or, if
+** it will not take it, to tls.c.
+*/
+static int
+tls_start(struct iperf_stream *sp, const unsigned char *tx, const unsigned char *rx)
+{
+    struct iperf_test *test = sp->test;
+    struct iperf_tls *t;
+    int user_tx = 1, user_rx = 1;
+
+#ifdef HAVE_KTLS
+    if (setsockopt(sp->socket, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls")) == 0) {
+	user_tx = ktls_set(sp->socket, TLS_TX, tx) < 0;
+	user_rx = ktls_set(sp->socket, TLS_RX, rx) < 0;
+    }
+#endif
+    if (!(test->sender ? user_tx : user_rx))
+	test->ktls_kernel_streams++;
+    if (!user_tx && !user_rx)
+	return 0;
+
+    /* -F's zero-copy paths move the data without it passing through here. */
+    if ((user_tx && test->sender && test->diskfile_name && test->zerocopy) ||
+	(user_rx && sp->diskfile_pipe[0] >= 0)) {
+	errno = EOPNOTSUPP;
+	i_errno = IESETKTLS;
+	return -1;
+    }
+    if ((t = calloc(1, sizeof(*t))) == NULL) {
+	i_errno = IESETKTLS;
+	return -1;
+    }
+    if (user_tx) {
+	tls_dir_init(&t->tx, tx);
+	t->user_tx = 1;
+	if ((t->out = malloc(TLS_SEALED_SIZE(sp->settings->blksize))) == NULL) {
+	    free(t);
+	    i_errno = IESETKTLS;
+	    return -1;
+	}
+    }
+    if (user_rx) {
+	tls_dir_init(&t->rx, rx);
+	t->user_rx = 1;
+    }
+    sp->tls = t;
+    return 0;
+}
+
+/* iperf_tcp_init
+ *
+ * --ktls: at TEST_START the client picks fresh keys for each stream,
+ * one set for each direction, and sends them down the stream for the
+ * server to read before any data.  Standing in for a handshake, this
+ * measures the record layer, not key exchange: the keys cross the wire
+ * in the clear, and the encryption hides nothing.
  */
 int
-iperf_tcp_connect(struct iperf_test *test)
+iperf_tcp_init(struct iperf_test *test)
 {
-    struct addrinfo hints, *local_res, *server_res;
-    char portstr[6];
-    int s, opt;
-    int saved_errno;
+    struct iperf_stream *sp;
+    unsigned char keys[2 * TLS_KEY_MATERIAL];
+    int fd = -1, r = 0;
+
+    if (!test->ktls)
+	return 0;
+    if (test->role == 'c' && (fd = open("/dev/urandom", O_RDONLY)) < 0) {
+	i_errno = IESETKTLS;
+	return -1;
+    }
+    test->ktls_kernel_streams = 0;
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	iperf_tcp_tls_free(sp);
+	if (test->role == 'c') {
+	    if (Nread(fd, (char *) keys, sizeof(keys), Ptcp) != sizeof(keys)) {
+		i_errno = IESETKTLS;
+		r = -1;
+	    } else if (Nwrite(sp->socket, (char *) keys, sizeof(keys), Ptcp) != sizeof(keys)) {
+		i_errno = IESENDCOOKIE;
+		r = -1;
+	    } else
+		r = tls_start(sp, keys, keys + TLS_KEY_MATERIAL);
+	} else {
+	    if (Nread(sp->socket, (char *) keys, sizeof(keys), Ptcp) != sizeof(keys)) {
+		i_errno = IERECVCOOKIE;
+		r = -1;
+	    } else
+		r = tls_start(sp, keys + TLS_KEY_MATERIAL, keys);
+	}
+	if (r < 0)
+	    break;
+    }
+    if (fd >= 0)
+	close(fd);
+    return r < 0 ? -1 : 0;
+}
 
-    if (test->bind_address) {
-        memset(&hints, 0, sizeof(hints));
-        hints.ai_family = test->settings->domain;
-        hints.ai_socktype = SOCK_STREAM;
-        if (getaddrinfo(test->bind_address, NULL, &hints, &local_res) != 0) {
-            i_errno = IESTREAMCONNECT;
-            return -1;
-        }
+void
+iperf_tcp_tls_free(struct iperf_stream *sp)
+{
+    if (sp->tls == NULL)
+	return;
+    free(sp->tls->out);
+    free(sp->tls);
+    sp->tls = NULL;
+}
+
+/* tls_send
+ *
+ * Seal a block and send it.  A send cut short leaves the rest of the
+ * sealed block to go out on the next call, with nothing counted until
+ * the whole block is sent.
+ */
+static int
+tls_send(struct iperf_stream *sp)
+{
+    struct iperf_tls *t = sp->tls;
+    int r;
+
+    if (t->out_off == t->out_len) {
+	t->out_len = tls_seal(&t->tx, sp->buffer, sp->settings->blksize, t->out);
+	t->out_off = 0;
+    }
+    r = Nwrite(sp->socket, t->out + t->out_off, t->out_len - t->out_off, Ptcp);
+    if (r < 0)
+	return r;
+    t->out_off += r;
+    if (t->out_off < t->out_len)
+	return NET_SOFTERROR;
+    return sp->settings->blksize;
+}
+
+/* tls_recv
+ *
+ * Open records until there is a block of plaintext, or the stream ends.
+ */
+static int
+tls_recv(struct iperf_stream *sp)
+{
+    struct iperf_tls *t = sp->tls;
+    char header[TLS_HEADER_SIZE];
+    size_t got = 0, n;
+    int len, r;
+
+    while (got < sp->settings->blksize) {
+	if (t->plain_off == t->plain_len) {
+	    r = Nread(sp->socket, header, TLS_HEADER_SIZE, Ptcp);
+	    if (r < 0)
+		return r;
+	    if (r == 0)
+		break;
+	    if (r != TLS_HEADER_SIZE || (len = tls_record_length(header)) < 0 ||
+		Nread(sp->socket, t->in, len, Ptcp) != len ||
+		(r = tls_open(&t->rx, header, t->in, len)) < 0) {
+		errno = EBADMSG;
+		return NET_HARDERROR;
+	    }
+	    t->plain_off = 0;
+	    t->plain_len = r;
+	}
+	n = sp->settings->blksize - got;
+	if (n > t->plain_len - t->plain_off)
+	    n = t->plain_len - t->plain_off;
+	memcpy(sp->buffer + got, t->in + t->plain_off, n);
+	t->plain_off += n;
+	got += n;
     }
+    return got;
+}
+
 
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_family = test->settings->domain;
-    hints.ai_socktype = SOCK_STREAM;
-    snprintf(portstr, sizeof(portstr), "%d", test->server_port);
-    if (getaddrinfo(test->server_hostname, portstr, &hints, &server_res) != 0) {
-	if (test->bind_address)
-	    freeaddrinfo(local_res);
+/* iperf_tcp_connect_start
+ *
+ * create a TCP stream socket and start a non-blocking connect to the
+ * stream listener.  The connect is usually still in progress on return;
+ * iperf_tcp_connect_finish completes it once the socket is writable.
+ * With --fast-open the cookie is offered in the SYN, and *sent is set
+ * to the number of cookie bytes the kernel accepted that way.
+ */
+int
+iperf_tcp_connect_start(struct iperf_test *test, int *sent)
+{
+    struct addrinfo *server_res;
+    int s, opt;
+    int saved_errno;
+
+    *sent = 0;
+    if (iperf_resolve_addresses(test) < 0) {
         i_errno = IESTREAMCONNECT;
         return -1;
     }
+    server_res = test->server_res;
 
-    if ((s = socket(server_res->ai_family, SOCK_STREAM, 0)) < 0) {
-	if (test->bind_address)
-	    freeaddrinfo(local_res);
-	freeaddrinfo(server_res);
+    if ((s = socket(server_res->ai_family, SOCK_STREAM, test->mptcp ? IPPROTO_MPTCP : 0)) < 0) {
         i_errno = IESTREAMCONNECT;
         return -1;
     }
 
-    if (test->bind_address) {
-        if (bind(s, (struct sockaddr *) local_res->ai_addr, local_res->ai_addrlen) < 0) {
+    if (test->local_res) {
+        if (bind(s, (struct sockaddr *) test->local_res->ai_addr, test->local_res->ai_addrlen) < 0) {
 	    saved_errno = errno;
 	    close(s);
-	    freeaddrinfo(local_res);
-	    freeaddrinfo(server_res);
 	    errno = saved_errno;
             i_errno = IESTREAMCONNECT;
             return -1;
         }
-        freeaddrinfo(local_res);
     }
 
     /* Set socket options */
@@ -302,7 +551,6 @@ iperf_tcp_connect(struct iperf_test *test)
         if (setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt)) < 0) {
 	    saved_errno = errno;
 	    close(s);
-	    freeaddrinfo(server_res);
 	    errno = saved_errno;
             i_errno = IESETNODELAY;
             return -1;
@@ -312,7 +560,6 @@ iperf_tcp_connect(struct iperf_test *test)
         if (setsockopt(s, IPPROTO_TCP, TCP_MAXSEG, &opt, sizeof(opt)) < 0) {
 	    saved_errno = errno;
 	    close(s);
-	    freeaddrinfo(server_res);
 	    errno = saved_errno;
             i_errno = IESETMSS;
             return -1;
@@ -322,7 +569,6 @@ iperf_tcp_connect(struct iperf_test *test)
         if (setsockopt(s, SOL_SOCKET, SO_RCVBUF, &opt, sizeof(opt)) < 0) {
 	    saved_errno = errno;
 	    close(s);
-	    freeaddrinfo(server_res);
 	    errno = saved_errno;
             i_errno = IESETBUF;
             return -1;
@@ -330,7 +576,6 @@ iperf_tcp_connect(struct iperf_test *test)
         if (setsockopt(s, SOL_SOCKET, SO_SNDBUF, &opt, sizeof(opt)) < 0) {
 	    saved_errno = errno;
 	    close(s);
-	    freeaddrinfo(server_res);
 	    errno = saved_errno;
             i_errno = IESETBUF;
             return -1;
@@ -341,7 +586,6 @@ iperf_tcp_connect(struct iperf_test *test)
         if (server_res->ai_addr->sa_family != AF_INET6) {
 	    saved_errno = errno;
 	    close(s);
-	    freeaddrinfo(server_res);
 	    errno = saved_errno;
             i_errno = IESETFLOW;
             return -1;
@@ -361,7 +605,6 @@ iperf_tcp_connect(struct iperf_test *test)
             if (setsockopt(s, IPPROTO_IPV6, IPV6_FLOWLABEL_MGR, freq, freq_len) < 0) {
 		saved_errno = errno;
                 close(s);
-                freeaddrinfo(server_res);
 		errno = saved_errno;
                 i_errno = IESETFLOW;
                 return -1;
@@ -372,7 +615,6 @@ iperf_tcp_connect(struct iperf_test *test)
             if (setsockopt(s, IPPROTO_IPV6, IPV6_FLOWINFO_SEND, &opt, sizeof(opt)) < 0) {
 		saved_errno = errno;
                 close(s);
-                freeaddrinfo(server_res);
 		errno = saved_errno;
                 i_errno = IESETFLOW;
                 return -1;
@@ -385,26 +627,82 @@ iperf_tcp_connect(struct iperf_test *test)
     if (test->congestion) {
 	if (setsockopt(s, IPPROTO_TCP, TCP_CONGESTION, test->congestion, strlen(test->congestion)) < 0) {
 	    close(s);
-	    freeaddrinfo(server_res);
 	    i_errno = IESETCONGESTION;
 	    return -1;
 	}
     }
 #endif
 
+    if (setnonblocking(s, 1) < 0) {
+	saved_errno = errno;
+	close(s);
+	errno = saved_errno;
+        i_errno = IESTREAMCONNECT;
+        return -1;
+    }
+
+#if defined(linux) && defined(MSG_FASTOPEN)
+    if (test->fast_open) {
+        int r;
+
+        /* Without a Fast Open cookie from the server the kernel sends a
+         * plain SYN and returns EINPROGRESS, and the cookie goes out
+         * the usual way once the connection is up.
+         */
+        r = sendto(s, test->cookie, COOKIE_SIZE, MSG_FASTOPEN, server_res->ai_addr, server_res->ai_addrlen);
+        if (r >= 0) {
+            *sent = r;
+            return s;
+        }
+        if (errno != EINPROGRESS) {
+            saved_errno = errno;
+            close(s);
+            errno = saved_errno;
+            i_errno = IESTREAMCONNECT;
+            return -1;
+        }
+        return s;
+    }
+#endif
+
     if (connect(s, (struct sockaddr *) server_res->ai_addr, server_res->ai_addrlen) < 0 && errno != EINPROGRESS) {
 	saved_errno = errno;
 	close(s);
-	freeaddrinfo(server_res);
 	errno = saved_errno;
         i_errno = IESTREAMCONNECT;
         return -1;
     }
 
-    freeaddrinfo(server_res);
+    return s;
+}
+
+
+/* iperf_tcp_connect_finish
+ *
+ * complete a connect started by iperf_tcp_connect_start once the socket
+ * has become writable: check the connect result, put the socket back
+ * into blocking mode and send whatever part of the cookie did not
+ * already go out in the SYN
+ */
+int
+iperf_tcp_connect_finish(struct iperf_test *test, int s, int sent)
+{
+    int opt;
+    socklen_t len;
+    int saved_errno;
+
+    len = sizeof(opt);
+    if (getsockopt(s, SOL_SOCKET, SO_ERROR, &opt, &len) < 0)
+        opt = errno;
+    if (opt != 0 || setnonblocking(s, 0) < 0) {
+	close(s);
+	errno = opt;
+        i_errno = IESTREAMCONNECT;
+        return -1;
+    }
 
     /* Send cookie for verification */
-    if (Nwrite(s, test->cookie, COOKIE_SIZE, Ptcp) < 0) {
+    if (sent < COOKIE_SIZE && Nwrite(s, test->cookie + sent, COOKIE_SIZE - sent, Ptcp) < 0) {
 	saved_errno = errno;
 	close(s);
 	errno = saved_errno;
@@ -412,5 +710,36 @@ iperf_tcp_connect(struct iperf_test *test)
         return -1;
     }
 
+    if (test->fast_open && iperf_tcp_syn_data(s))
+        test->fast_open_streams++;
+
     return s;
 }
+
+
+/* iperf_tcp_connect
+ *
+ * connect to a TCP stream listener, waiting for the connect to complete
+ */
+int
+iperf_tcp_connect(struct iperf_test *test)
+{
+    fd_set write_set;
+    int s, r, sent;
+
+    if ((s = iperf_tcp_connect_start(test, &sent)) < 0)
+        return -1;
+
+    do {
+        FD_ZERO(&write_set);
+        FD_SET(s, &write_set);
+        r = select(s + 1, NULL, &write_set, NULL, NULL);
+    } while (r < 0 && errno == EINTR);
+    if (r < 0) {
+	close(s);
+        i_errno = IESTREAMCONNECT;
+        return -1;
+    }
+
+    return iperf_tcp_connect_finish(test, s, sent);
+}
@@ -42,5 +42,27 @@ int iperf_tcp_listen(struct iperf_test *);
 
 int iperf_tcp_connect(struct iperf_test *);
 
+/**
+ * iperf_tcp_connect_start -- starts a non-blocking connect for a
+ * TCP stream, returns the socket and how much of the cookie was
+ * already sent in the SYN (--fast-open)
+ *
+ * iperf_tcp_connect_finish -- completes the connect once the socket
+ * is writable and sends the rest of the cookie, returns the socket
+ *
+ */
+int iperf_tcp_connect_start(struct iperf_test *, int *);
+int iperf_tcp_connect_finish(struct iperf_test *, int, int);
+
+/**
+ * iperf_tcp_init -- --ktls: exchange keys on every stream and start
+ * TLS on it, in the kernel where it will, else in user space
+ *
+ * iperf_tcp_tls_free -- free a stream's user-space TLS state
+ *
+ */
+int iperf_tcp_init(struct iperf_test *);
+void iperf_tcp_tls_free(struct iperf_stream *);
+
 
 #endif
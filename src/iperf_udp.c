@@ -26,6 +26,7 @@
 #include "iperf_udp.h"
 #include "timer.h"
 #include "net.h"
+#include "probes.h"
 
 
 /* iperf_udp_recv
@@ -62,10 +63,12 @@ iperf_udp_recv(struct iperf_stream *sp)
     if (pcount >= sp->packet_count + 1) {
         if (pcount > sp->packet_count + 1) {
             sp->cnt_error += (pcount - 1) - sp->packet_count;
+            IPERF_PROBE3(udp_loss, sp->id, pcount, (pcount - 1) - sp->packet_count);
         }
         sp->packet_count = pcount;
     } else {
         sp->outoforder_packets++;
+        IPERF_PROBE3(udp_reorder, sp->id, pcount, sp->packet_count + 1);
 	iperf_err(sp->test, "OUT OF ORDER - incoming packet = %d and received packet = %d AND SP = %d", pcount, sp->packet_count, sp->socket);
     }
 
@@ -194,7 +197,11 @@ iperf_udp_connect(struct iperf_test *test)
 {
     int s, buf, sz;
 
-    if ((s = netdial(test->settings->domain, Pudp, test->bind_address, test->server_hostname, test->server_port)) < 0) {
+    if (iperf_resolve_addresses(test) < 0) {
+        i_errno = IESTREAMCONNECT;
+        return -1;
+    }
+    if ((s = netdial_res(Pudp, test->local_res, test->server_res, test->server_port)) < 0) {
         i_errno = IESTREAMCONNECT;
         return -1;
     }
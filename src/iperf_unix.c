@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2014, The Regents of the University of California,
+ * through Lawrence Berkeley National Laboratory (subject to receipt of any
+ * required approvals from the U.S. Dept. of Energy).  All rights reserved.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE file
+ * for complete information.
+ */
+
+/* iperf_unix.c: streams over AF_UNIX sockets (--unix)
+ *
+ * The control connection goes to the server's SOCK_STREAM socket, and
+ * byte streams connect to the same socket, the way TCP streams share
+ * the server's port.  SOCK_SEQPACKET streams have a listener of their
+ * own for the duration of stream setup.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/select.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_unix.h"
+#include "net.h"
+
+
+void
+iperf_unix_path(struct iperf_test *test, int data, char *buf, size_t len)
+{
+    char def[UNIX_PATH_LEN];
+    const char *path;
+
+    if (test->role == 'c')
+	path = test->server_hostname;
+    else {
+	/* A server's -B goes with the first test it resets after; the
+	** path it listens on does not.
+	*/
+	if (test->unix_path == NULL && test->bind_address != NULL)
+	    test->unix_path = strdup(test->bind_address);
+	path = test->unix_path;
+    }
+    if (path == NULL) {
+	snprintf(def, sizeof(def), UNIX_PATH, test->server_port);
+	path = def;
+    }
+    /* Too long to use: leave it empty, which nothing will accept. */
+    if (snprintf(buf, len, "%s%s", path, data ? ".data" : "") >= (int) len)
+	buf[0] = '\0';
+}
+
+void
+iperf_unix_unlink(struct iperf_test *test)
+{
+    char path[UNIX_PATH_LEN];
+
+    iperf_unix_path(test, 0, path, sizeof(path));
+    netunlink_unix(path);
+    iperf_unix_path(test, 1, path, sizeof(path));
+    netunlink_unix(path);
+}
+
+/* -w applies to both ends; on AF_UNIX it is the sender's buffer that
+** limits how much is in flight.
+*/
+static int
+set_unix_options(struct iperf_test *test, int s)
+{
+    int opt;
+
+    if ((opt = test->settings->socket_bufsize)) {
+	if (setsockopt(s, SOL_SOCKET, SO_SNDBUF, &opt, sizeof(opt)) < 0 ||
+	    setsockopt(s, SOL_SOCKET, SO_RCVBUF, &opt, sizeof(opt)) < 0) {
+	    i_errno = IESETBUF;
+	    return -1;
+	}
+    }
+    return 0;
+}
+
+
+/* iperf_unix_recv
+ *
+ * receives the data for AF_UNIX streams; a SOCK_SEQPACKET read takes
+ * one block, as the peer sends blocks of the same size
+ */
+int
+iperf_unix_recv(struct iperf_stream *sp)
+{
+    int r;
+
+    r = Nread(sp->socket, sp->buffer, sp->settings->blksize, sp->test->protocol->id);
+    if (r < 0)
+        return r;
+
+    sp->result->bytes_received += r;
+    sp->result->bytes_received_this_interval += r;
+
+    return r;
+}
+
+
+/* iperf_unix_send
+ *
+ * sends the data for AF_UNIX streams
+ */
+int
+iperf_unix_send(struct iperf_stream *sp)
+{
+    int r;
+
+    r = Nwrite(sp->socket, sp->buffer, sp->settings->blksize, sp->test->protocol->id);
+    if (r < 0)
+        return r;
+
+    sp->result->bytes_sent += r;
+    sp->result->bytes_sent_this_interval += r;
+
+    return r;
+}
+
+
+/* iperf_unix_accept
+ *
+ * accept a new AF_UNIX stream connection
+ */
+int
+iperf_unix_accept(struct iperf_test *test)
+{
+    int     s;
+    signed char rbuf = ACCESS_DENIED;
+    char    cookie[COOKIE_SIZE];
+
+    if ((s = accept(test->prot_listener, NULL, NULL)) < 0) {
+        i_errno = IESTREAMCONNECT;
+        return -1;
+    }
+    setnonblocking(s, 0);
+
+    if (Nread(s, cookie, COOKIE_SIZE, test->protocol->id) < 0) {
+	close(s);
+        i_errno = IERECVCOOKIE;
+        return -1;
+    }
+
+    if (strcmp(test->cookie, cookie) != 0) {
+        if (Nwrite(s, (char*) &rbuf, sizeof(rbuf), test->protocol->id) < 0) {
+	    close(s);
+            i_errno = IESENDMESSAGE;
+            return -1;
+        }
+        close(s);
+    } else if (set_unix_options(test, s) < 0) {
+	close(s);
+	return -1;
+    }
+
+    return s;
+}
+
+
+/* iperf_unix_listen
+ *
+ * start up a listener for AF_UNIX stream connections
+ */
+int
+iperf_unix_listen(struct iperf_test *test)
+{
+    char path[UNIX_PATH_LEN];
+    int s;
+
+    if (test->protocol->id != Punixseq)
+	return test->listener;
+
+    iperf_unix_path(test, 1, path, sizeof(path));
+    if ((s = netannounce_unix(SOCK_SEQPACKET, path)) < 0) {
+        i_errno = IESTREAMLISTEN;
+        return -1;
+    }
+
+    return s;
+}
+
+
+/* iperf_unix_connect
+ *
+ * connect to an AF_UNIX stream listener
+ */
+int
+iperf_unix_connect(struct iperf_test *test)
+{
+    char path[UNIX_PATH_LEN];
+    int s;
+
+    iperf_unix_path(test, test->protocol->id == Punixseq, path, sizeof(path));
+    s = netdial_unix(test->protocol->id == Punixseq ? SOCK_SEQPACKET : SOCK_STREAM, path);
+    if (s < 0) {
+        i_errno = IESTREAMCONNECT;
+        return -1;
+    }
+
+    if (set_unix_options(test, s) < 0) {
+	close(s);
+	return -1;
+    }
+
+    /* Send cookie for verification */
+    if (Nwrite(s, test->cookie, COOKIE_SIZE, test->protocol->id) < 0) {
+	close(s);
+        i_errno = IESENDCOOKIE;
+        return -1;
+    }
+
+    return s;
+}
+
+
+int
+iperf_unix_init(struct iperf_test *test)
+{
+    return 0;
+}
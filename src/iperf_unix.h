@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2014, The Regents of the University of California,
+ * through Lawrence Berkeley National Laboratory (subject to receipt of any
+ * required approvals from the U.S. Dept. of Energy).  All rights reserved.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE file
+ * for complete information.
+ */
+
+#ifndef        IPERF_UNIX_H
+#define        IPERF_UNIX_H
+
+#include <stddef.h>
+
+/* Longer than any sun_path, so a path that does not fit is refused
+ * rather than cut short.
+ */
+#define UNIX_PATH_LEN 128
+
+/**
+ * iperf_unix_path -- the server's socket path: the client's -c or the
+ * server's -B argument, or UNIX_PATH for the port.  SOCK_SEQPACKET
+ * streams need a listener of their own, at the same path plus ".data".
+ *
+ */
+void iperf_unix_path(struct iperf_test *test, int data, char *buf, size_t len);
+
+/**
+ * iperf_unix_unlink -- remove the server's socket files, if any
+ *
+ */
+void iperf_unix_unlink(struct iperf_test *test);
+
+int iperf_unix_accept(struct iperf_test *);
+
+int iperf_unix_recv(struct iperf_stream *);
+
+int iperf_unix_send(struct iperf_stream *);
+
+int iperf_unix_listen(struct iperf_test *);
+
+int iperf_unix_connect(struct iperf_test *);
+
+int iperf_unix_init(struct iperf_test *test);
+
+#endif
@@ -13,8 +13,10 @@
  *
  */
 
+#define _GNU_SOURCE		/* RUSAGE_THREAD */
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdarg.h>
@@ -28,6 +30,7 @@
 
 #include "config.h"
 #include "cjson.h"
+#include "iperf_api.h"
 
 /* make_cookie
  *
@@ -41,18 +44,26 @@
 void
 make_cookie(char *cookie)
 {
-    static int randomized = 0;
+    /* A private generator per thread: srandom() from one thread would
+    ** otherwise hand another thread the same "random" cookie.
+    */
+    static IPERF_TLS uint64_t state = 0;
     char hostname[500];
     struct timeval tv;
     char temp[1000];
-
-    if ( ! randomized )
-        srandom((int) time(0) ^ getpid());
+    uint64_t r;
 
     /* Generate a string based on hostname, time, randomness, and filler. */
     (void) gethostname(hostname, sizeof(hostname));
     (void) gettimeofday(&tv, 0);
-    (void) snprintf(temp, sizeof(temp), "%s.%ld.%06ld.%08lx%08lx.%s", hostname, (unsigned long int) tv.tv_sec, (unsigned long int) tv.tv_usec, (unsigned long int) random(), (unsigned long int) random(), "1234567890123456789012345678901234567890");
+    if (state == 0)
+        state = ((uint64_t) tv.tv_sec << 20) ^ tv.tv_usec ^ ((uint64_t) getpid() << 32) ^ (uint64_t) (uintptr_t) &state;
+    /* xorshift64* */
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    r = state * 0x2545f4914f6cdd1dULL;
+    (void) snprintf(temp, sizeof(temp), "%s.%ld.%06ld.%08lx%08lx.%s", hostname, (unsigned long int) tv.tv_sec, (unsigned long int) tv.tv_usec, (unsigned long int) (r >> 32), (unsigned long int) (r & 0xffffffff), "1234567890123456789012345678901234567890");
 
     /* Now truncate it to 36 bytes and terminate. */
     memcpy(cookie, temp, 36);
@@ -158,14 +169,21 @@ delay(int us)
 #endif
 
 
+/* Where the OS can, count only the calling thread, which is what ran
+** the test when several tests share the process.
+*/
+#ifdef RUSAGE_THREAD
+#define CPU_UTIL_WHO RUSAGE_THREAD
+#else
+#define CPU_UTIL_WHO RUSAGE_SELF
+#endif
+
 void
 cpu_util(double pcpu[3])
 {
-    static struct timeval last;
-    static clock_t clast;
-    static struct rusage rlast;
+    static IPERF_TLS struct timeval last;
+    static IPERF_TLS struct rusage rlast;
     struct timeval temp;
-    clock_t ctemp;
     struct rusage rtemp;
     double timediff;
     double userdiff;
@@ -173,14 +191,12 @@ cpu_util(double pcpu[3])
 
     if (pcpu == NULL) {
         gettimeofday(&last, NULL);
-        clast = clock();
-	getrusage(RUSAGE_SELF, &rlast);
+	getrusage(CPU_UTIL_WHO, &rlast);
         return;
     }
 
     gettimeofday(&temp, NULL);
-    ctemp = clock();
-    getrusage(RUSAGE_SELF, &rtemp);
+    getrusage(CPU_UTIL_WHO, &rtemp);
 
     timediff = ((temp.tv_sec * 1000000.0 + temp.tv_usec) -
                 (last.tv_sec * 1000000.0 + last.tv_usec));
@@ -189,15 +205,26 @@ cpu_util(double pcpu[3])
     systemdiff = ((rtemp.ru_stime.tv_sec * 1000000.0 + rtemp.ru_stime.tv_usec) -
                   (rlast.ru_stime.tv_sec * 1000000.0 + rlast.ru_stime.tv_usec));
 
-    pcpu[0] = ((ctemp - clast) / timediff) * 100;
+    pcpu[0] = ((userdiff + systemdiff) / timediff) * 100;
     pcpu[1] = (userdiff / timediff) * 100;
     pcpu[2] = (systemdiff / timediff) * 100;
 }
 
+/* CPU seconds used so far in user and system mode, counted the same way. */
+void
+cpu_times(double *user, double *system)
+{
+    struct rusage r;
+
+    getrusage(CPU_UTIL_WHO, &r);
+    *user = r.ru_utime.tv_sec + r.ru_utime.tv_usec / 1000000.0;
+    *system = r.ru_stime.tv_sec + r.ru_stime.tv_usec / 1000000.0;
+}
+
 char *
 get_system_info(void)
 {
-    static char buf[1024];
+    static IPERF_TLS char buf[1024];
     struct utsname  uts;
 
     memset(buf, 0, 1024);
@@ -26,6 +26,8 @@ int delay(int64_t ns);
 
 void cpu_util(double pcpu[3]);
 
+void cpu_times(double *user, double *system);
+
 char* get_system_info(void);
 
 cJSON* iperf_json_printf(const char *format, ...);
@@ -51,6 +51,9 @@
  * Strings and other stuff that is locale specific.
  * ------------------------------------------------------------------- */
 
+#include <sys/types.h>
+#include <sys/socket.h>		/* MSG_FASTOPEN */
+
 #include "version.h"
 
 #ifdef __cplusplus
@@ -74,8 +77,17 @@ const char usage_longstr[] = "Usage: iperf [-s|-c host] [options]\n"
                            "  -i, --interval  #         seconds between periodic bandwidth reports\n"
                            "  -F, --file name           xmit/recv the specified file\n"
 #if defined(linux) || defined(__FreeBSD__)
+                           "  --file-sync policy        fsync the -F file: none, interval, end (default)\n"
+                           "  --file-write method       write the -F file: buffered (default), direct,\n"
+                           "                            splice\n"
                            "  -A, --affinity n/n,m      set CPU affinity\n"
 #endif
+#if defined(linux)
+                           "  --perf-counters           count CPU events (cycles, instructions, cache\n"
+                           "                            misses, context switches, page faults)\n"
+#endif
+                           "  --unix                    use AF_UNIX sockets; -c and -B give the path\n"
+                           "                            (default /tmp/iperf3-<port>.sock)\n"
                            "  -V, --verbose             more detailed output\n"
                            "  -J, --json                output in JSON format\n"
                            "  -d, --debug               emit debugging output\n"
@@ -89,8 +101,18 @@ const char usage_longstr[] = "Usage: iperf [-s|-c host] [options]\n"
                            "  -c, --client    <host>    run in client mode, connecting to <host>\n"
 #if defined(linux) || defined(__FreeBSD__)
                            "  --sctp                    use SCTP rather than TCP\n"
+                           "  --sctp-streams #          send on # SCTP streams of each association,\n"
+                           "                            round robin, and report each one with -V\n"
+                           "  --sctp-unordered          send SCTP messages unordered\n"
+                           "  --sctp-pr #               give up on SCTP messages not sent within # ms\n"
+                           "                            (PR-SCTP)\n"
+                           "  --sctp-bindx <addr>[,<addr>...]  bind more local addresses to every\n"
+                           "                            association (server or client); -V reports\n"
+                           "                            each path\n"
 #endif
                            "  -u, --udp                 use UDP rather than TCP\n"
+                           "  --unix-seqpacket          like --unix, with SOCK_SEQPACKET streams\n"
+                           "  --shm                     like --unix, with the data in shared memory\n"
                            "  -b, --bandwidth #[KMG][/#] target bandwidth in bits/sec\n"
                            "                            (default %d Mbit/sec for UDP, unlimited for TCP)\n"
                            "                            (optional slash and packet count for burst mode)\n"
@@ -108,6 +130,18 @@ const char usage_longstr[] = "Usage: iperf [-s|-c host] [options]\n"
 #endif
                            "  -M, --set-mss   #         set TCP maximum segment size (MTU - 40 bytes)\n"
                            "  -N, --nodelay             set TCP no delay, disabling Nagle's Algorithm\n"
+#if defined(linux) && defined(MSG_FASTOPEN)
+                           "  --fast-open               use TCP Fast Open for the stream connections\n"
+#endif
+                           "  --ktls                    encrypt the streams with TLS 1.3, AES-128-GCM,\n"
+                           "                            in the kernel where it can (keys are sent in\n"
+                           "                            the clear: this measures cost, not privacy)\n"
+#if defined(linux)
+                           "  --mptcp                   use Multipath TCP for the streams, and report\n"
+                           "                            every subflow at each interval\n"
+                           "  --mptcp-endpoint <addr>   add a local address as a subflow endpoint\n"
+                           "                            for the test (implies --mptcp)\n"
+#endif
                            "  -4, --version4            only use IPv4\n"
                            "  -6, --version6            only use IPv6\n"
                            "  -S, --tos N               set the IP 'type of service'\n"
@@ -115,6 +149,12 @@ const char usage_longstr[] = "Usage: iperf [-s|-c host] [options]\n"
                            "  -L, --flowlabel N         set the IPv6 flow label (only supported on Linux)\n"
 #endif
                            "  -Z, --zerocopy            use a 'zero copy' method of sending data\n"
+                           "  --verify                  check the payload of every block received\n"
+                           "  --null                    discard blocks instead of sending them, to\n"
+                           "                            measure iperf3's own ceiling\n"
+                           "  --shared-buffer           use one buffer for all streams\n"
+                           "  --payload type[:N]        content to send: random (default), zeros,\n"
+                           "                            pattern; random:N makes N%% compressible\n"
                            "  -O, --omit N              omit the first n seconds\n"
                            "  -T, --title str           prefix every output line with this string\n"
 
@@ -205,12 +245,39 @@ const char report_reverse[] =
 const char report_accepted[] =
 "Accepted connection from %s, port %d\n";
 
+const char report_connecting_unix[] =
+"Connecting to %s\n";
+
+const char report_accepted_unix[] =
+"Accepted connection on %s\n";
+
+const char report_connected_unix[] =
+"[%3d] connected on %s\n";
+
 const char report_cookie[] =
 "      Cookie: %s\n";
 
 const char report_connected[] =
 "[%3d] local %s port %d connected to %s port %d\n";
 
+const char report_stream_setup[] =
+"Stream setup: %d streams established in %.3f ms\n";
+
+const char report_buffers[] =
+"Buffer memory: %s in %d buffers, %s on hugetlb pages, %s advised for THP\n";
+
+const char report_fast_open[] =
+"TCP Fast Open: cookie carried in the SYN on %d of %d streams\n";
+
+const char report_ktls[] =
+"TLS: %s, %s on every stream, in the kernel on %d of %d\n";
+
+const char report_mptcp[] =
+"Multipath TCP on every stream\n";
+
+const char report_mptcp_endpoints[] =
+"MPTCP subflow endpoints: %d of %d added for the test, the rest already there\n";
+
 const char report_window[] =
 "TCP window size: %s\n";
 
@@ -223,6 +290,51 @@ const char report_omit_done[] =
 const char report_diskfile[] =
 "        Sent %s / %s (%d%%) of %s\n";
 
+const char report_diskfile_read[] =
+"        Read %s from disk in %.3f sec = %s/sec\n";
+
+const char report_diskfile_sendfile[] =
+"        Read and sent %s with sendfile in %.3f sec = %s/sec\n";
+
+const char report_diskfile_written[] =
+"        Wrote %s to %s in %.3f sec = %s/sec, %d syncs\n";
+
+const char report_disk_interval[] =
+"[%3d] %6.2f-%-6.2f sec  disk %ss  %ss/sec  %s queued\n";
+
+const char report_mptcp_subflow[] =
+"[%3d] %6.2f-%-6.2f sec  subflow %s -> %s  %ss  %ss/sec  %u retr  %s cwnd  %u us rtt\n";
+
+const char report_sctp_assoc_interval[] =
+"[%3d] %6.2f-%-6.2f sec  association  %d/%d streams out/in  %s rwnd  %d unacked  %d pending  %llu abandoned\n";
+
+const char report_sctp_path_interval[] =
+"[%3d] %6.2f-%-6.2f sec  path %s %s%s  %s cwnd  %u ms srtt  %u ms rto  %u mtu\n";
+
+const char report_sctp_stream_interval[] =
+"[%3d] %6.2f-%-6.2f sec  stream %d  %ss  %ss/sec\n";
+
+const char report_overhead_interval[] =
+"[%3d] %6.2f-%-6.2f sec  %llu syscalls, %s/call, %llu short, %llu EAGAIN\n";
+
+const char report_loop_interval[] =
+"[LOOP] %5.2f-%-6.2f sec  %llu wakeups, %llu idle, %llu timer runs\n";
+
+const char report_cpu_interval[] =
+"[CPU]  %5.2f-%-6.2f sec  %.3f s user, %.3f s system, %s CPU s/GB\n";
+
+const char report_perf_interval[] =
+"[PERF] %5.2f-%-6.2f sec  IPC %s, %s cycles/byte, %s cache misses, %s context switches, %s page faults\n";
+
+const char report_verify_interval[] =
+"[%3d] %6.2f-%-6.2f sec  payload check: %llu bytes corrupted, %d blocks misordered\n";
+
+const char report_verify[] =
+"[%3d] %6.2f-%-6.2f sec  verified %s: %llu bytes corrupted, %llu blocks misordered\n";
+
+const char report_sum_verify[] =
+"[SUM] %6.2f-%-6.2f sec  verified %s: %llu bytes corrupted, %llu blocks misordered\n";
+
 const char report_done[] =
 "iperf Done.\n";
 
@@ -312,6 +424,15 @@ const char reportCSV_peer[] =
 const char report_cpu[] =
 "CPU Utilization: %s/%s %.1f%% (%.1f%%u/%.1f%%s), %s/%s %.1f%% (%.1f%%u/%.1f%%s)\n";
 
+const char report_perf[] =
+"Perf counters%s: %s cycles, %s instructions, IPC %s, %s cycles/byte,\n"
+"    %s cache misses, %s context switches, %s page faults\n";
+
+const char report_perf_user_only[] = " (user mode only)";
+
+const char report_cpu_per_gb[] =
+"CPU cost: %s/%s %s CPU s/GB, %s/%s %s CPU s/GB\n";
+
 const char report_local[] = "local";
 const char report_remote[] = "remote";
 const char report_sender[] = "sender";
@@ -37,10 +37,34 @@ extern const char report_reverse[] ;
 extern const char report_accepted[] ;
 extern const char report_cookie[] ;
 extern const char report_connected[] ;
+extern const char report_connecting_unix[] ;
+extern const char report_accepted_unix[] ;
+extern const char report_connected_unix[] ;
+extern const char report_stream_setup[] ;
+extern const char report_buffers[] ;
+extern const char report_fast_open[] ;
+extern const char report_ktls[] ;
+extern const char report_mptcp[] ;
+extern const char report_mptcp_endpoints[] ;
 extern const char report_window[] ;
 extern const char report_autotune[] ;
 extern const char report_omit_done[] ;
 extern const char report_diskfile[] ;
+extern const char report_diskfile_read[] ;
+extern const char report_diskfile_sendfile[] ;
+extern const char report_diskfile_written[] ;
+extern const char report_disk_interval[] ;
+extern const char report_mptcp_subflow[] ;
+extern const char report_sctp_assoc_interval[] ;
+extern const char report_sctp_path_interval[] ;
+extern const char report_sctp_stream_interval[] ;
+extern const char report_overhead_interval[] ;
+extern const char report_loop_interval[] ;
+extern const char report_cpu_interval[] ;
+extern const char report_perf_interval[] ;
+extern const char report_verify_interval[] ;
+extern const char report_verify[] ;
+extern const char report_sum_verify[] ;
 extern const char report_done[] ;
 extern const char report_read_lengths[] ;
 extern const char report_read_length_times[] ;
@@ -72,6 +96,9 @@ extern const char server_reporting[] ;
 extern const char reportCSV_peer[] ;
 
 extern const char report_cpu[] ;
+extern const char report_cpu_per_gb[] ;
+extern const char report_perf[] ;
+extern const char report_perf_user_only[] ;
 extern const char report_local[] ;
 extern const char report_remote[] ;
 extern const char report_sender[] ;
@@ -19,6 +19,9 @@
 #include <netdb.h>
 #include <string.h>
 #include <sys/fcntl.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <stddef.h>
 
 #ifdef linux
 #include <sys/sendfile.h>
@@ -39,6 +42,8 @@
 #include "net.h"
 #include "timer.h"
 
+IPERF_TLS struct net_counters *net_counters;
+
 /* netdial and netannouce code comes from libtask: http://swtch.com/libtask/
  * Copyright: http://swtch.com/libtask/COPYRIGHT
 */
@@ -50,6 +55,7 @@ netdial(int domain, int proto, char *local, char *server, int port)
     struct addrinfo hints, *local_res, *server_res;
     int s;
 
+    local_res = NULL;
     if (local) {
         memset(&hints, 0, sizeof(hints));
         hints.ai_family = domain;
@@ -61,35 +67,49 @@ netdial(int domain, int proto, char *local, char *server, int port)
     memset(&hints, 0, sizeof(hints));
     hints.ai_family = domain;
     hints.ai_socktype = proto;
-    if (getaddrinfo(server, NULL, &hints, &server_res) != 0)
+    if (getaddrinfo(server, NULL, &hints, &server_res) != 0) {
+	if (local_res)
+	    freeaddrinfo(local_res);
         return -1;
+    }
+
+    s = netdial_res(proto, local_res, server_res, port);
+
+    if (local_res)
+	freeaddrinfo(local_res);
+    freeaddrinfo(server_res);
+    return s;
+}
+
+/* make connection to an already resolved server address, optionally
+ * binding to an already resolved local address first
+ */
+int
+netdial_res(int proto, struct addrinfo *local_res, struct addrinfo *server_res, int port)
+{
+    int s, saved_errno;
 
     s = socket(server_res->ai_family, proto, 0);
-    if (s < 0) {
-	if (local)
-	    freeaddrinfo(local_res);
-	freeaddrinfo(server_res);
+    if (s < 0)
         return -1;
-    }
 
-    if (local) {
+    if (local_res) {
         if (bind(s, (struct sockaddr *) local_res->ai_addr, local_res->ai_addrlen) < 0) {
+	    saved_errno = errno;
 	    close(s);
-	    freeaddrinfo(local_res);
-	    freeaddrinfo(server_res);
+	    errno = saved_errno;
             return -1;
 	}
-        freeaddrinfo(local_res);
     }
 
     ((struct sockaddr_in *) server_res->ai_addr)->sin_port = htons(port);
     if (connect(s, (struct sockaddr *) server_res->ai_addr, server_res->ai_addrlen) < 0 && errno != EINPROGRESS) {
+	saved_errno = errno;
 	close(s);
-	freeaddrinfo(server_res);
+	errno = saved_errno;
         return -1;
     }
 
-    freeaddrinfo(server_res);
     return s;
 }
 
@@ -145,7 +165,7 @@ netannounce(int domain, int proto, char *local, int port)
     freeaddrinfo(res);
     
     if (proto == SOCK_STREAM) {
-        if (listen(s, 5) < 0) {
+        if (listen(s, SOMAXCONN) < 0) {
 	    close(s);
             return -1;
         }
@@ -155,6 +175,112 @@ netannounce(int domain, int proto, char *local, int port)
 }
 
 
+/***************************************************************/
+
+/* Fill in an AF_UNIX address.  A path starting with '@' names a socket
+ * in the Linux abstract namespace, which needs no file and no cleanup.
+ */
+static int
+unix_address(const char *path, struct sockaddr_un *sun, socklen_t *len)
+{
+    size_t n = strlen(path);
+
+    memset(sun, 0, sizeof(*sun));
+    sun->sun_family = AF_UNIX;
+    if (n == 0 || n >= sizeof(sun->sun_path)) {
+	errno = ENAMETOOLONG;
+	return -1;
+    }
+    memcpy(sun->sun_path, path, n);
+#ifdef linux
+    if (path[0] == '@') {
+	sun->sun_path[0] = '\0';
+	*len = offsetof(struct sockaddr_un, sun_path) + n;
+	return 0;
+    }
+#endif
+    *len = sizeof(*sun);
+    return 0;
+}
+
+/* make connection to a server's AF_UNIX socket */
+int
+netdial_unix(int proto, const char *path)
+{
+    struct sockaddr_un sun;
+    socklen_t len;
+    int s, saved_errno;
+
+    if (unix_address(path, &sun, &len) < 0)
+	return -1;
+    s = socket(AF_UNIX, proto, 0);
+    if (s < 0)
+	return -1;
+    if (connect(s, (struct sockaddr *) &sun, len) < 0) {
+	saved_errno = errno;
+	close(s);
+	errno = saved_errno;
+	return -1;
+    }
+    return s;
+}
+
+/* listen on an AF_UNIX socket, replacing any socket file left behind
+ * by a server that did not clean up
+ */
+int
+netannounce_unix(int proto, const char *path)
+{
+    struct sockaddr_un sun;
+    struct stat st;
+    socklen_t len;
+    int s, saved_errno;
+
+    if (unix_address(path, &sun, &len) < 0)
+	return -1;
+    /* A socket file left by a server that has gone is removed; one that
+    ** a server still listens on is not taken over.
+    */
+    if (sun.sun_path[0] != '\0' && lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+	if ((s = socket(AF_UNIX, proto, 0)) < 0)
+	    return -1;
+	if (connect(s, (struct sockaddr *) &sun, len) == 0 || errno != ECONNREFUSED) {
+	    close(s);
+	    errno = EADDRINUSE;
+	    return -1;
+	}
+	close(s);
+	(void) unlink(path);
+    }
+
+    s = socket(AF_UNIX, proto, 0);
+    if (s < 0)
+	return -1;
+    if (bind(s, (struct sockaddr *) &sun, len) < 0 ||
+	(proto != SOCK_DGRAM && listen(s, SOMAXCONN) < 0)) {
+	saved_errno = errno;
+	close(s);
+	errno = saved_errno;
+	return -1;
+    }
+    return s;
+}
+
+/* remove the file of a socket made by netannounce_unix() */
+void
+netunlink_unix(const char *path)
+{
+    struct stat st;
+
+#ifdef linux
+    if (path[0] == '@')
+	return;
+#endif
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+	(void) unlink(path);
+}
+
+
 /*******************************************************************/
 /* reads 'count' bytes from a socket  */
 /********************************************************************/
@@ -167,16 +293,26 @@ Nread(int fd, char *buf, size_t count, int prot)
 
     while (nleft > 0) {
         r = read(fd, buf, nleft);
+	if (net_counters)
+	    ++net_counters->syscalls;
         if (r < 0) {
             if (errno == EINTR)
                 r = 0;
-            else
+            else {
+		if (net_counters && errno == EAGAIN)
+		    ++net_counters->soft_errors;
                 return NET_HARDERROR;
+	    }
         } else if (r == 0)
             break;
 
         nleft -= r;
         buf += r;
+	if (net_counters) {
+	    net_counters->bytes += r;
+	    if (nleft > 0)
+		++net_counters->short_calls;
+	}
     }
     return count - nleft;
 }
@@ -194,6 +330,8 @@ Nwrite(int fd, const char *buf, size_t count, int prot)
 
     while (nleft > 0) {
 	r = write(fd, buf, nleft);
+	if (net_counters)
+	    ++net_counters->syscalls;
 	if (r < 0) {
 	    switch (errno) {
 		case EINTR:
@@ -201,15 +339,25 @@ Nwrite(int fd, const char *buf, size_t count, int prot)
 
 		case EAGAIN:
 		case ENOBUFS:
+		if (net_counters)
+		    ++net_counters->soft_errors;
 		return NET_SOFTERROR;
 
 		default:
 		return NET_HARDERROR;
 	    }
-	} else if (r == 0)
+	} else if (r == 0) {
+	    if (net_counters)
+		++net_counters->soft_errors;
 	    return NET_SOFTERROR;
+	}
 	nleft -= r;
 	buf += r;
+	if (net_counters) {
+	    net_counters->bytes += r;
+	    if (nleft > 0)
+		++net_counters->short_calls;
+	}
     }
     return count;
 }
@@ -240,6 +388,13 @@ has_sendfile(void)
 
 int
 Nsendfile(int fromfd, int tofd, const char *buf, size_t count)
+{
+    return Nsendfile_at(fromfd, tofd, 0, count);
+}
+
+/* Send count bytes of fromfd, starting at byte start of the file. */
+int
+Nsendfile_at(int fromfd, int tofd, off_t start, size_t count)
 {
     off_t offset;
 #if defined(__FreeBSD__) || (defined(__APPLE__) && defined(__MACH__) && defined(MAC_OS_X_VERSION_10_6))
@@ -250,7 +405,7 @@ Nsendfile(int fromfd, int tofd, const char *buf, size_t count)
 
     nleft = count;
     while (nleft > 0) {
-	offset = count - nleft;
+	offset = start + count - nleft;
 #ifdef linux
 	r = sendfile(tofd, fromfd, &offset, nleft);
 #else
@@ -271,6 +426,8 @@ Nsendfile(int fromfd, int tofd, const char *buf, size_t count)
 #endif
 #endif
 #endif
+	if (net_counters)
+	    ++net_counters->syscalls;
 	if (r < 0) {
 	    switch (errno) {
 		case EINTR:
@@ -279,14 +436,24 @@ Nsendfile(int fromfd, int tofd, const char *buf, size_t count)
 		case EAGAIN:
 		case ENOBUFS:
 		case ENOMEM:
+		if (net_counters)
+		    ++net_counters->soft_errors;
 		return NET_SOFTERROR;
 
 		default:
 		return NET_HARDERROR;
 	    }
-	} else if (r == 0)
+	} else if (r == 0) {
+	    if (net_counters)
+		++net_counters->soft_errors;
 	    return NET_SOFTERROR;
+	}
 	nleft -= r;
+	if (net_counters) {
+	    net_counters->bytes += r;
+	    if (nleft > 0)
+		++net_counters->short_calls;
+	}
     }
     return count;
 }
@@ -10,12 +10,38 @@
 #ifndef __NET_H
 #define __NET_H
 
+#include <stdint.h>
+
+#ifndef IPERF_TLS
+#define IPERF_TLS __thread
+#endif
+
+struct addrinfo;
+
+/* What Nread(), Nwrite() and Nsendfile() did for one stream. */
+struct net_counters {
+    uint64_t syscalls;
+    uint64_t bytes;
+    uint64_t short_calls;	/* moved less than asked, so went round again */
+    uint64_t soft_errors;	/* EAGAIN or ENOBUFS, or nothing written */
+};
+
+/* Where those calls count their work.  The data paths point this at
+** the stream they are serving; it is NULL the rest of the time.
+*/
+extern IPERF_TLS struct net_counters *net_counters;
+
 int netdial(int domain, int proto, char *local, char *server, int port);
+int netdial_res(int proto, struct addrinfo *local_res, struct addrinfo *server_res, int port);
 int netannounce(int domain, int proto, char *local, int port);
+int netdial_unix(int proto, const char *path);
+int netannounce_unix(int proto, const char *path);
+void netunlink_unix(const char *path);
 int Nread(int fd, char *buf, size_t count, int prot);
 int Nwrite(int fd, const char *buf, size_t count, int prot) /* __attribute__((hot)) */;
 int has_sendfile(void);
 int Nsendfile(int fromfd, int tofd, const char *buf, size_t count) /* __attribute__((hot)) */;
+int Nsendfile_at(int fromfd, int tofd, off_t start, size_t count) /* __attribute__((hot)) */;
 int getsock_tcp_mss(int inSock);
 int set_tcp_options(int sock, int no_delay, int mss);
 int setnonblocking(int fd, int nonblocking);
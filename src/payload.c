@@ -0,0 +1,296 @@
+/*
+ * Copyright (c) 2014, The Regents of the University of California,
+ * through Lawrence Berkeley National Laboratory (subject to receipt of any
+ * required approvals from the U.S. Dept. of Energy).  All rights reserved.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE file
+ * for complete information.
+ */
+
+/* payload.c
+ *
+ * Deterministic payload generation and verification.  The comparison
+ * is the hot path on the receiver, so it is vectorized: AVX2 when the
+ * CPU has it, SSE2 otherwise on x86-64, and a word-at-a-time loop
+ * everywhere else.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "payload.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define PAYLOAD_X86 1
+#include <immintrin.h>
+#endif
+
+
+/* payload_key
+ *
+ * FNV-1a hash of the cookie, shared by both ends of the test.
+ */
+uint64_t
+payload_key(const char *cookie)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    while (*cookie) {
+	h ^= (unsigned char) *cookie++;
+	h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static uint64_t
+splitmix64(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/* payload_fill
+ *
+ * Fill buf with pseudo-random bytes: byte i depends only on the key and i,
+ * and is laid out the same way whatever the host byte order.  Being
+ * counter-based, the words are independent of each other, so the loop
+ * runs at memory speed rather than at the latency of a generator chain.
+ */
+void
+payload_fill(char *buf, size_t len, uint64_t key)
+{
+    size_t i, j;
+    uint64_t w;
+
+    for (i = 0; i + 8 <= len; i += 8) {
+	w = splitmix64(key + (i >> 3));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	memcpy(buf + i, &w, 8);
+#else
+	for (j = 0; j < 8; ++j)
+	    buf[i + j] = (char) (w >> (8 * j));
+#endif
+    }
+    if (i < len) {
+	w = splitmix64(key + (i >> 3));
+	for (j = 0; i + j < len; ++j)
+	    buf[i + j] = (char) (w >> (8 * j));
+    }
+}
+
+/* payload_generate
+ *
+ * Fill buf according to the --payload content class.  For random data,
+ * compress is the percentage of each PAYLOAD_SEGMENT that is zeroed,
+ * which makes the block roughly that much compressible.
+ */
+void
+payload_generate(char *buf, size_t len, int type, int compress, uint64_t key)
+{
+    static const char digits[] = "0123456789";
+    size_t i, n, z;
+
+    switch (type) {
+	case PAYLOAD_ZEROS:
+	    memset(buf, 0, len);
+	    break;
+	case PAYLOAD_PATTERN:
+	    for (i = 0; i < len; ++i)
+		buf[i] = digits[i % 10];
+	    break;
+	default:
+	    payload_fill(buf, len, key);
+	    if (compress <= 0)
+		break;
+	    for (i = 0; i < len; i += PAYLOAD_SEGMENT) {
+		n = len - i < PAYLOAD_SEGMENT ? len - i : PAYLOAD_SEGMENT;
+		z = n * compress / 100;
+		memset(buf + i + n - z, 0, z);
+	    }
+	    break;
+    }
+}
+
+/* payload_stamp
+ *
+ * The stamp is the low 32 bits of the block number, big-endian, followed
+ * by their complement, so a damaged stamp can be told apart from one
+ * that belongs to a different block.
+ */
+void
+payload_stamp(char *buf, uint64_t block)
+{
+    uint32_t b = (uint32_t) block;
+    int i;
+
+    for (i = 0; i < 4; ++i) {
+	buf[i] = (char) (b >> (24 - 8 * i));
+	buf[4 + i] = (char) (~b >> (24 - 8 * i));
+    }
+}
+
+static int
+payload_unstamp(const char *buf, uint32_t *block)
+{
+    uint32_t b = 0, c = 0;
+    int i;
+
+    for (i = 0; i < 4; ++i) {
+	b = (b << 8) | (unsigned char) buf[i];
+	c = (c << 8) | (unsigned char) buf[4 + i];
+    }
+    *block = b;
+    return b == ~c;
+}
+
+/* Count the non-zero bytes of a 64-bit word. */
+static inline size_t
+nonzero_bytes(uint64_t x)
+{
+    const uint64_t lo7 = 0x7f7f7f7f7f7f7f7fULL;
+
+    x = ((x & lo7) + lo7) | x;
+    return __builtin_popcountll(x & ~lo7);
+}
+
+static size_t
+mismatch_generic(const char *a, const char *b, size_t len)
+{
+    size_t n = 0;
+    uint64_t x, y;
+
+    for (; len >= 8; a += 8, b += 8, len -= 8) {
+	memcpy(&x, a, 8);
+	memcpy(&y, b, 8);
+	if (x != y)
+	    n += nonzero_bytes(x ^ y);
+    }
+    for (; len > 0; --len)
+	n += (*a++ != *b++);
+    return n;
+}
+
+#ifdef PAYLOAD_X86
+static size_t
+mismatch_sse2(const char *a, const char *b, size_t len)
+{
+    size_t n = 0;
+    __m128i x, y;
+    unsigned int m;
+
+    for (; len >= 16; a += 16, b += 16, len -= 16) {
+	x = _mm_loadu_si128((const __m128i *) a);
+	y = _mm_loadu_si128((const __m128i *) b);
+	m = _mm_movemask_epi8(_mm_cmpeq_epi8(x, y));
+	if (m != 0xffff)
+	    n += 16 - __builtin_popcount(m);
+    }
+    return n + mismatch_generic(a, b, len);
+}
+
+__attribute__((target("avx2")))
+static size_t
+mismatch_avx2(const char *a, const char *b, size_t len)
+{
+    size_t n = 0;
+    __m256i e0, e1;
+    unsigned int m;
+
+    /* Two vectors per iteration; only a block with a difference in it
+    ** pays for the popcounts.
+    */
+    for (; len >= 64; a += 64, b += 64, len -= 64) {
+	e0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) a),
+			       _mm256_loadu_si256((const __m256i *) b));
+	e1 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (a + 32)),
+			       _mm256_loadu_si256((const __m256i *) (b + 32)));
+	if ((unsigned int) _mm256_movemask_epi8(_mm256_and_si256(e0, e1)) != 0xffffffffU) {
+	    m = _mm256_movemask_epi8(e0);
+	    n += 32 - __builtin_popcount(m);
+	    m = _mm256_movemask_epi8(e1);
+	    n += 32 - __builtin_popcount(m);
+	}
+    }
+    return n + mismatch_sse2(a, b, len);
+}
+#endif
+
+static size_t (*mismatch_impl)(const char *, const char *, size_t);
+
+size_t
+payload_mismatch(const char *a, const char *b, size_t len)
+{
+    if (mismatch_impl == NULL) {
+#ifdef PAYLOAD_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+	    mismatch_impl = mismatch_avx2;
+	else
+	    mismatch_impl = mismatch_sse2;
+#else
+	mismatch_impl = mismatch_generic;
+#endif
+    }
+    return mismatch_impl(a, b, len);
+}
+
+/* payload_check_stream
+ *
+ * Reads of a byte stream need not line up with the sender's blocks, so
+ * walk the data one block (or part of one) at a time, using the stream
+ * offset to work out which block and which template bytes to expect.
+ */
+void
+payload_check_stream(struct payload_check *pc, const char *template, size_t blksize, const char *buf, size_t len)
+{
+    char expect[PAYLOAD_STAMP_SIZE];
+    uint64_t block;
+    uint32_t got;
+    size_t pos, n, s;
+
+    while (len > 0) {
+	block = pc->offset / blksize;
+	pos = pc->offset % blksize;
+	n = blksize - pos;
+	if (n > len)
+	    n = len;
+
+	s = 0;
+	if (pos < PAYLOAD_STAMP_SIZE) {
+	    s = PAYLOAD_STAMP_SIZE - pos;
+	    if (s > n)
+		s = n;
+	    payload_stamp(expect, block);
+	    if (memcmp(buf, expect + pos, s) != 0) {
+		if (pos == 0 && s == PAYLOAD_STAMP_SIZE && payload_unstamp(buf, &got))
+		    pc->misordered++;
+		else
+		    pc->corrupted += payload_mismatch(buf, expect + pos, s);
+	    }
+	}
+	pc->corrupted += payload_mismatch(buf + s, template + pos + s, n - s);
+
+	pc->checked += n;
+	pc->offset += n;
+	buf += n;
+	len -= n;
+    }
+}
+
+/* payload_check_block
+ *
+ * Datagrams are self-contained: the payload after the header always
+ * starts at the same template offset, and ordering is left to the
+ * header's sequence number.
+ */
+void
+payload_check_block(struct payload_check *pc, const char *template, size_t skip, const char *buf, size_t len)
+{
+    if (len <= skip)
+	return;
+    pc->corrupted += payload_mismatch(buf + skip, template + skip, len - skip);
+    pc->checked += len - skip;
+    pc->offset += len;
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2014, The Regents of the University of California,
+ * through Lawrence Berkeley National Laboratory (subject to receipt of any
+ * required approvals from the U.S. Dept. of Energy).  All rights reserved.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE file
+ * for complete information.
+ */
+
+/* payload.h
+ *
+ * Deterministic payload generation and verification (--verify).
+ *
+ * Both ends derive the same template block from the test cookie.  The
+ * sender transmits the template over and over, with the first
+ * PAYLOAD_STAMP_SIZE bytes of every block overwritten by a stamp that
+ * carries the block's sequence number.  The receiver knows the stream
+ * offset of every byte it reads and so knows exactly what it should
+ * have received.
+ */
+
+#ifndef __PAYLOAD_H
+#define __PAYLOAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PAYLOAD_STAMP_SIZE 8
+
+/* Content classes for --payload. */
+#define PAYLOAD_RANDOM 0
+#define PAYLOAD_ZEROS 1
+#define PAYLOAD_PATTERN 2
+
+/* Granularity at which --payload random:N zeroes N percent of the data. */
+#define PAYLOAD_SEGMENT 512
+
+struct payload_check
+{
+    uint64_t  offset;		/* stream offset of the next byte */
+    uint64_t  checked;		/* bytes compared against the template */
+    uint64_t  corrupted;	/* bytes that did not match */
+    uint64_t  misordered;	/* blocks stamped with another block's number */
+};
+
+uint64_t payload_key(const char *cookie);
+void payload_fill(char *buf, size_t len, uint64_t key);
+void payload_generate(char *buf, size_t len, int type, int compress, uint64_t key);
+void payload_stamp(char *buf, uint64_t block);
+
+/* Number of bytes that differ between a and b. */
+size_t payload_mismatch(const char *a, const char *b, size_t len);
+
+/* Check len bytes of a byte stream (TCP, SCTP) read at pc->offset. */
+void payload_check_stream(struct payload_check *pc, const char *template, size_t blksize, const char *buf, size_t len);
+
+/* Check one datagram, ignoring its first skip bytes of header. */
+void payload_check_block(struct payload_check *pc, const char *template, size_t skip, const char *buf, size_t len);
+
+#endif
@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2014, The Regents of the University of California,
+ * through Lawrence Berkeley National Laboratory (subject to receipt of any
+ * required approvals from the U.S. Dept. of Energy).  All rights reserved.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE file
+ * for complete information.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef linux
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "perf_counters.h"
+
+#if defined(linux) && defined(__NR_perf_event_open)
+#define HAVE_PERF_EVENTS 1
+#endif
+
+int
+has_perf_counters(void)
+{
+#ifdef HAVE_PERF_EVENTS
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+void
+perf_counters_init(struct perf_counters *pc)
+{
+    int i;
+
+    memset(pc, 0, sizeof(*pc));
+    for (i = 0; i < PC_COUNT; ++i) {
+	pc->fd[i] = -1;
+	pc->interval[i] = pc->total[i] = -1;
+    }
+}
+
+#ifdef HAVE_PERF_EVENTS
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} events[PC_COUNT] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+};
+
+static int
+open_event(int i, int user_only)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[i].type;
+    attr.config = events[i].config;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.exclude_kernel = user_only;
+    attr.exclude_hv = 1;
+    /* This thread, on whatever CPU it runs. */
+    return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* The event's count so far, scaled up for any time the kernel had it
+** switched out to make room for other events.
+*/
+static int
+read_event(int fd, uint64_t *count)
+{
+    uint64_t v[3];
+
+    if (read(fd, v, sizeof(v)) != sizeof(v))
+	return -1;
+    if (v[2] > 0 && v[2] < v[1])
+	v[0] = (uint64_t) ((double) v[0] * v[1] / v[2]);
+    *count = v[0];
+    return 0;
+}
+
+/* Open every event, counting how many could be.  -1 if the kernel
+** refused to count kernel mode, so it is worth trying user mode alone.
+*/
+static int
+open_events(struct perf_counters *pc)
+{
+    int i, n = 0;
+
+    for (i = 0; i < PC_COUNT; ++i) {
+	if ((pc->fd[i] = open_event(i, pc->user_only)) < 0) {
+	    if ((errno == EACCES || errno == EPERM) && !pc->user_only)
+		return -1;
+	    continue;
+	}
+	if (read_event(pc->fd[i], &pc->mark[i]) < 0) {
+	    close(pc->fd[i]);
+	    pc->fd[i] = -1;
+	    continue;
+	}
+	pc->total[i] = 0;
+	++n;
+    }
+    return n;
+}
+#endif
+
+int
+perf_counters_open(struct perf_counters *pc)
+{
+    int n = 0;
+
+    perf_counters_init(pc);
+#ifdef HAVE_PERF_EVENTS
+    if ((n = open_events(pc)) < 0) {
+	perf_counters_close(pc);
+	perf_counters_init(pc);
+	pc->user_only = 1;
+	n = open_events(pc);
+    }
+#endif
+    return n;
+}
+
+void
+perf_counters_sample(struct perf_counters *pc, int omitted)
+{
+#ifdef HAVE_PERF_EVENTS
+    uint64_t count;
+    int i;
+
+    for (i = 0; i < PC_COUNT; ++i) {
+	pc->interval[i] = -1;
+	if (pc->fd[i] < 0 || read_event(pc->fd[i], &count) < 0)
+	    continue;
+	pc->interval[i] = count - pc->mark[i];
+	pc->mark[i] = count;
+	if (!omitted)
+	    pc->total[i] += pc->interval[i];
+    }
+#endif
+}
+
+void
+perf_counters_close(struct perf_counters *pc)
+{
+    int i;
+
+    for (i = 0; i < PC_COUNT; ++i) {
+	if (pc->fd[i] >= 0)
+	    close(pc->fd[i]);
+	pc->fd[i] = -1;
+    }
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2014, The Regents of the University of California,
+ * through Lawrence Berkeley National Laboratory (subject to receipt of any
+ * required approvals from the U.S. Dept. of Energy).  All rights reserved.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE file
+ * for complete information.
+ */
+
+/* perf_counters.h
+ *
+ * Hardware and software event counts for the thread running a test
+ * (--perf-counters), from perf_event_open() on Linux.
+ *
+ * Each event is opened on its own, so whatever the system allows is
+ * counted and the rest is reported as unavailable: virtual machines
+ * often have no PMU, leaving only the software events.  If the kernel
+ * refuses to count kernel mode (perf_event_paranoid), the events are
+ * opened for user mode only and user_only is set.
+ */
+
+#ifndef __PERF_COUNTERS_H
+#define __PERF_COUNTERS_H
+
+#include <stdint.h>
+
+#define PC_CYCLES		0
+#define PC_INSTRUCTIONS		1
+#define PC_CACHE_MISSES		2
+#define PC_CONTEXT_SWITCHES	3
+#define PC_PAGE_FAULTS		4
+#define PC_COUNT		5
+
+struct perf_counters
+{
+    int       fd[PC_COUNT];		/* -1 where the event is unavailable */
+    uint64_t  mark[PC_COUNT];		/* counts at the last sample */
+    int       user_only;
+    int64_t   interval[PC_COUNT];	/* counts in the last interval, -1 if unavailable */
+    int64_t   total[PC_COUNT];		/* ... over the intervals not omitted */
+};
+
+int has_perf_counters(void);
+void perf_counters_init(struct perf_counters *pc);
+/* Start counting for the calling thread.  Returns how many events opened. */
+int perf_counters_open(struct perf_counters *pc);
+/* Close one interval, adding it to the totals unless it was omitted. */
+void perf_counters_sample(struct perf_counters *pc, int omitted);
+void perf_counters_close(struct perf_counters *pc);
+
+#endif
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2014, The Regents of the University of California,
+ * through Lawrence Berkeley National Laboratory (subject to receipt of any
+ * required approvals from the U.S. Dept. of Energy).  All rights reserved.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE file
+ * for complete information.
+ */
+
+/* probes.h
+ *
+ * Statically defined tracing probes, for bpftrace, perf or SystemTap,
+ * under the provider name "iperf3".  Each is a single no-op instruction
+ * until a tracer attaches.  They compile to nothing where <sys/sdt.h>
+ * is missing, or with -DIPERF_NO_PROBES.
+ *
+ *   send_entry(id, socket)			before a stream's send call
+ *   send_return(id, socket, result)		after it: bytes, or < 0
+ *   recv_entry(id, socket)
+ *   recv_return(id, socket, result)
+ *   udp_loss(id, packet, lost)			a gap before this packet
+ *   udp_reorder(id, packet, expected)		a packet older than expected
+ *   timer_fire(proc, usecs, periodic)		a timer's function is called
+ *   state(old, new)				the control state sent to the peer
+ *   stats(streams, bytes, omitted)		an interval closed
+ *
+ * The bpftrace scripts in examples/ show some uses.
+ */
+
+#ifndef __PROBES_H
+#define __PROBES_H
+
+#if !defined(IPERF_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define IPERF_HAVE_PROBES 1
+#endif
+#endif
+
+#ifdef IPERF_HAVE_PROBES
+#define IPERF_PROBE2(name, a, b) DTRACE_PROBE2(iperf3, name, a, b)
+#define IPERF_PROBE3(name, a, b, c) DTRACE_PROBE3(iperf3, name, a, b, c)
+#else
+#define IPERF_PROBE2(name, a, b) do { } while (0)
+#define IPERF_PROBE3(name, a, b, c) do { } while (0)
+#endif
+
+#endif
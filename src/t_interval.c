@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2014, The Regents of the University of California,
+ * through Lawrence Berkeley National Laboratory (subject to receipt of any
+ * required approvals from the U.S. Dept. of Energy).  All rights reserved.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE file
+ * for complete information.
+ */
+
+/* An interval callback that returns -1 ends the client's test early,
+** timed (-t) or counted (-n), and the test still completes normally.
+** Client and server run in this process, over loopback.
+*/
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_util.h"
+
+#define STOP_AFTER 3	/* intervals */
+
+struct server {
+    pthread_t thread;
+    struct iperf_test *test;
+    int rc;
+};
+
+static void *
+run_server(void *arg)
+{
+    struct server *server = (struct server *) arg;
+
+    server->rc = iperf_run_server(server->test);
+    return NULL;
+}
+
+static int
+on_interval(struct iperf_test *test, const struct iperf_interval_stats *streams, int nstreams, const struct iperf_interval_stats *sum, void *arg)
+{
+    int *calls = (int *) arg;
+
+    assert(nstreams == 1);
+    return ++*calls >= STOP_AFTER ? -1 : 0;
+}
+
+static struct iperf_test *
+new_test(char role, int port)
+{
+    struct iperf_test *test;
+
+    test = iperf_new_test();
+    assert(test != NULL);
+    iperf_defaults(test);
+    iperf_set_test_role(test, role);
+    iperf_set_test_server_port(test, port);
+    iperf_set_test_json_output(test, 1);
+    return test;
+}
+
+/* Run a test that would take a minute; returns the seconds it took. */
+static double
+run(int port, int by_bytes)
+{
+    struct server server;
+    struct iperf_test *client;
+    struct timeval start, end;
+    int calls = 0, tries, rc;
+
+    server.test = new_test('s', port);
+    rc = pthread_create(&server.thread, NULL, run_server, &server);
+    assert(rc == 0);
+
+    gettimeofday(&start, NULL);
+    /* The server thread may not be listening yet. */
+    for (tries = 0; ; ++tries) {
+	client = new_test('c', port);
+	iperf_set_test_server_hostname(client, "127.0.0.1");
+	iperf_set_test_reporter_interval(client, MIN_INTERVAL);
+	iperf_set_test_stats_interval(client, MIN_INTERVAL);
+	iperf_set_test_rate(client, 10000000);
+	if (by_bytes) {
+	    /* As -n sets it: no time limit. */
+	    client->settings->bytes = 75000000;
+	    iperf_set_test_duration(client, 0);
+	} else
+	    iperf_set_test_duration(client, 60);
+	iperf_set_test_interval_callback(client, on_interval, &calls);
+	rc = iperf_run_client(client);
+	if (rc == 0 || i_errno != IECONNECT || tries == 50)
+	    break;
+	iperf_free_test(client);
+	usleep(20000);
+    }
+    gettimeofday(&end, NULL);
+    assert(rc == 0);
+    pthread_join(server.thread, NULL);
+    assert(server.rc == 0);
+
+    /* The callback runs once more for the part interval at the end. */
+    assert(calls == STOP_AFTER || calls == STOP_AFTER + 1);
+    assert(client->bytes_sent > 0);
+    iperf_free_test(client);
+    iperf_free_test(server.test);
+    return timeval_diff(&start, &end);
+}
+
+int
+main(int argc, char **argv)
+{
+    int port = 5200 + getpid() % 1000;
+    double seconds;
+    FILE *out;
+
+    /* Only the results matter here, not the JSON. */
+    out = freopen("/dev/null", "w", stdout);
+    assert(out != NULL);
+
+    seconds = run(port, 0);
+    assert(seconds < 10.0);
+    seconds = run(port + 1, 1);
+    assert(seconds < 10.0);
+    return 0;
+}
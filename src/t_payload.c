@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2014, The Regents of the University of California,
+ * through Lawrence Berkeley National Laboratory (subject to receipt of any
+ * required approvals from the U.S. Dept. of Energy).  All rights reserved.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE file
+ * for complete information.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "payload.h"
+
+#define BLKSIZE 1000
+#define NBLOCKS 8
+
+/* Build what the sender would transmit for blocks first..first+n-1. */
+static void
+make_stream(char *out, const char *template, int first, int n)
+{
+    int i;
+
+    for (i = 0; i < n; ++i) {
+	memcpy(out + i * BLKSIZE, template, BLKSIZE);
+	payload_stamp(out + i * BLKSIZE, first + i);
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    char template[BLKSIZE], again[BLKSIZE];
+    char stream[BLKSIZE * NBLOCKS], tmp[BLKSIZE];
+    struct payload_check pc;
+    size_t off, n;
+    int i;
+
+    /* Both ends derive the same template from the same cookie. */
+    payload_fill(template, BLKSIZE, payload_key("abcdefghijklmnopqrstuvwxyz234567"));
+    payload_fill(again, BLKSIZE, payload_key("abcdefghijklmnopqrstuvwxyz234567"));
+    assert(memcmp(template, again, BLKSIZE) == 0);
+    payload_fill(again, BLKSIZE, payload_key("bbcdefghijklmnopqrstuvwxyz234567"));
+    assert(payload_mismatch(template, again, BLKSIZE) > BLKSIZE / 2);
+
+    /* Clean stream, read in one go. */
+    make_stream(stream, template, 0, NBLOCKS);
+    memset(&pc, 0, sizeof(pc));
+    payload_check_stream(&pc, template, BLKSIZE, stream, sizeof(stream));
+    assert(pc.checked == sizeof(stream));
+    assert(pc.corrupted == 0 && pc.misordered == 0);
+
+    /* Same stream, read in pieces that straddle blocks and stamps. */
+    memset(&pc, 0, sizeof(pc));
+    for (off = 0, i = 0; off < sizeof(stream); off += n, ++i) {
+	n = (i % 2) ? 3 : 777;
+	if (n > sizeof(stream) - off)
+	    n = sizeof(stream) - off;
+	payload_check_stream(&pc, template, BLKSIZE, stream + off, n);
+    }
+    assert(pc.checked == sizeof(stream));
+    assert(pc.corrupted == 0 && pc.misordered == 0);
+
+    /* Flipped bytes, in the body and in a stamp. */
+    stream[BLKSIZE + 100] ^= 0x01;
+    stream[BLKSIZE * 3 + 999] ^= 0x80;
+    stream[BLKSIZE * 5 + 2] ^= 0x10;
+    memset(&pc, 0, sizeof(pc));
+    payload_check_stream(&pc, template, BLKSIZE, stream, sizeof(stream));
+    assert(pc.corrupted == 3 && pc.misordered == 0);
+
+    /* Swapped blocks are misordered, not corrupted. */
+    make_stream(stream, template, 0, NBLOCKS);
+    memcpy(tmp, stream + BLKSIZE * 2, BLKSIZE);
+    memcpy(stream + BLKSIZE * 2, stream + BLKSIZE * 6, BLKSIZE);
+    memcpy(stream + BLKSIZE * 6, tmp, BLKSIZE);
+    memset(&pc, 0, sizeof(pc));
+    payload_check_stream(&pc, template, BLKSIZE, stream, sizeof(stream));
+    assert(pc.corrupted == 0 && pc.misordered == 2);
+
+    /* Datagrams: the header is skipped, the rest must match. */
+    memcpy(tmp, template, BLKSIZE);
+    memset(tmp, 0xff, 12);
+    memset(&pc, 0, sizeof(pc));
+    payload_check_block(&pc, template, 12, tmp, BLKSIZE);
+    assert(pc.checked == BLKSIZE - 12 && pc.corrupted == 0);
+    tmp[12] ^= 0x01;
+    payload_check_block(&pc, template, 12, tmp, BLKSIZE);
+    assert(pc.corrupted == 1);
+
+    /* Every length and alignment takes the same answer, whichever of
+    ** the vector or scalar paths handles it.
+    */
+    memcpy(again, template, BLKSIZE);
+    for (i = 0; i < BLKSIZE; i += 37)
+	again[i] ^= 0x5a;
+    for (off = 0; off < 40; ++off)
+	for (n = 0; n + off <= BLKSIZE; n += 61) {
+	    size_t expect = 0, j;
+
+	    for (j = off; j < off + n; ++j)
+		expect += template[j] != again[j];
+	    assert(payload_mismatch(template + off, again + off, n) == expect);
+	}
+
+    /* Content classes. */
+    payload_generate(tmp, BLKSIZE, PAYLOAD_ZEROS, 0, 1);
+    for (i = 0; i < BLKSIZE; ++i)
+	assert(tmp[i] == 0);
+    payload_generate(tmp, BLKSIZE, PAYLOAD_PATTERN, 0, 1);
+    assert(memcmp(tmp, "01234567890123", 14) == 0);
+    payload_generate(tmp, BLKSIZE, PAYLOAD_RANDOM, 0, 1);
+    payload_fill(again, BLKSIZE, 1);
+    assert(memcmp(tmp, again, BLKSIZE) == 0);
+    payload_generate(again, BLKSIZE, PAYLOAD_RANDOM, 0, 2);
+    assert(payload_mismatch(tmp, again, BLKSIZE) > BLKSIZE / 2);
+
+    /* random:25 zeroes the last quarter of every segment. */
+    payload_generate(stream, sizeof(stream), PAYLOAD_RANDOM, 25, 1);
+    for (off = 0, n = 0; off < sizeof(stream); ++off)
+	n += stream[off] == 0;
+    assert(n >= sizeof(stream) / 4 && n < sizeof(stream) / 4 + sizeof(stream) / 64);
+    for (off = PAYLOAD_SEGMENT * 3 / 4; off < PAYLOAD_SEGMENT; ++off)
+	assert(stream[off] == 0);
+
+    /* Odd lengths match a prefix of the longer fill. */
+    payload_fill(tmp, 13, 7);
+    payload_fill(again, BLKSIZE, 7);
+    assert(memcmp(tmp, again, 13) == 0);
+
+    return 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2014, The Regents of the University of California,
+ * through Lawrence Berkeley National Laboratory (subject to receipt of any
+ * required approvals from the U.S. Dept. of Energy).  All rights reserved.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE file
+ * for complete information.
+ */
+
+/* The --sctp-streams data path, run over an AF_UNIX SOCK_SEQPACKET pair
+** so that no kernel SCTP is needed: the pair keeps message boundaries,
+** and ignores the SCTP cmsgs and socket options, which leaves the peer's
+** grant of streams unknown and the requested count in force.
+*/
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_sctp.h"
+
+#define BLKSIZE 1000
+
+static struct iperf_test *
+new_test(int streams, int sender)
+{
+    struct iperf_test *test;
+    int r;
+
+    test = iperf_new_test();
+    assert(test != NULL);
+    iperf_defaults(test);
+    r = set_protocol(test, Psctp);
+    assert(r == 0);
+    test->settings->blksize = BLKSIZE;
+    test->sctp_streams = streams;
+    test->sender = sender;
+    return test;
+}
+
+int
+main(int argc, char **argv)
+{
+    struct iperf_test *tx, *rx;
+    struct iperf_stream *sp, *rp;
+    int sv[2];
+    int i, r;
+
+    if (!has_sctp_streams()) {
+	printf("SCTP streams not supported here, skipping\n");
+	return 0;
+    }
+
+    /* Blocks go round robin over the stream ids, one message each. */
+    r = socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv);
+    assert(r == 0);
+    tx = new_test(4, 1);
+    rx = new_test(4, 0);
+    sp = iperf_new_stream(tx, sv[0]);
+    rp = iperf_new_stream(rx, sv[1]);
+    assert(sp != NULL && rp != NULL);
+    for (i = 0; i < 10; ++i) {
+	r = sp->snd(sp);
+	assert(r == BLKSIZE);
+	r = rp->rcv(rp);
+	assert(r == BLKSIZE);
+    }
+    assert(sp->sctp != NULL && sp->sctp->streams == 4);
+    assert(sp->sctp->bytes[0] == 3 * BLKSIZE && sp->sctp->bytes[1] == 3 * BLKSIZE);
+    assert(sp->sctp->bytes[2] == 2 * BLKSIZE && sp->sctp->bytes[3] == 2 * BLKSIZE);
+    assert(sp->sctp->next_sid == 2);
+    assert(sp->result->bytes_sent == 10 * BLKSIZE);
+    assert(rp->result->bytes_received == 10 * BLKSIZE);
+
+    /* A sample moves the counts to the interval and starts again. */
+    iperf_sctp_sample(sp);
+    assert(sp->sctp->interval_bytes[0] == 3 * BLKSIZE && sp->sctp->interval_bytes[3] == 2 * BLKSIZE);
+    assert(sp->sctp->bytes[0] == 0 && sp->sctp->bytes[3] == 0);
+    assert(sp->sctp->paths == 0);
+    iperf_free_test(tx);
+    iperf_free_test(rx);
+
+    /* However many streams a peer gets, ids past MAX_SCTP_STREAMS are
+    ** never used or counted.
+    */
+    r = socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv);
+    assert(r == 0);
+    tx = new_test(65535, 1);
+    sp = iperf_new_stream(tx, sv[0]);
+    assert(sp != NULL);
+    r = sp->snd(sp);
+    assert(r == BLKSIZE);
+    assert(sp->sctp->streams == MAX_SCTP_STREAMS);
+    sp->sctp->next_sid = MAX_SCTP_STREAMS - 1;
+    r = sp->snd(sp);
+    assert(r == BLKSIZE);
+    assert(sp->sctp->next_sid == 0);
+    assert(sp->sctp->bytes[MAX_SCTP_STREAMS - 1] == BLKSIZE);
+    iperf_sctp_sample(sp);
+    iperf_free_test(tx);
+    close(sv[1]);
+
+    return 0;
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2014, The Regents of the University of California,
+ * through Lawrence Berkeley National Laboratory (subject to receipt of any
+ * required approvals from the U.S. Dept. of Energy).  All rights reserved.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE file
+ * for complete information.
+ */
+
+/* AES-128-GCM against the test cases in the GCM specification, then
+** the record layer on a few blocks' worth of data.
+*/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tls.h"
+
+static size_t
+unhex(unsigned char *out, const char *hex)
+{
+    size_t n;
+    unsigned int b;
+    int r;
+
+    for (n = 0; hex[2 * n] != '\0'; ++n) {
+	r = sscanf(hex + 2 * n, "%2x", &b);
+	assert(r == 1);
+	out[n] = b;
+    }
+    return n;
+}
+
+static void
+check(const char *key, const char *iv, const char *aad, const char *pt, const char *ct, const char *tag)
+{
+    unsigned char k[16], v[12], a[64], p[64], c[64], t[16], out[64], tout[16];
+    struct aes_gcm g;
+    size_t alen, len, clen;
+    int r;
+
+    unhex(k, key);
+    unhex(v, iv);
+    alen = unhex(a, aad);
+    len = unhex(p, pt);
+    clen = unhex(c, ct);
+    assert(clen == len);
+    unhex(t, tag);
+
+    aes_gcm_init(&g, k);
+    aes_gcm_seal(&g, v, a, alen, p, len, out, tout);
+    assert(memcmp(out, c, len) == 0);
+    assert(memcmp(tout, t, 16) == 0);
+    r = aes_gcm_open(&g, v, a, alen, c, len, t, out);
+    assert(r == 0);
+    assert(memcmp(out, p, len) == 0);
+    t[15] ^= 1;
+    r = aes_gcm_open(&g, v, a, alen, c, len, t, out);
+    assert(r == -1);
+}
+
+#define P3 "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a721c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b391aafd255"
+#define C3 "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091473f5985"
+
+int
+main(int argc, char **argv)
+{
+    unsigned char material[TLS_KEY_MATERIAL];
+    struct tls_dir tx, rx;
+    char *in, *rec, *p;
+    size_t len = 40000, n, got;
+    int i, blen, r;
+
+    check("00000000000000000000000000000000", "000000000000000000000000", "",
+	  "", "", "58e2fccefa7e3061367f1d57a4e7455a");
+    check("00000000000000000000000000000000", "000000000000000000000000", "",
+	  "00000000000000000000000000000000", "0388dace60b6a392f328c2b971b2fe78",
+	  "ab6e47d42cec13bdf53a67b21257bddf");
+    check("feffe9928665731c6d6a8f9467308308", "cafebabefacedbaddecaf888", "",
+	  P3, C3, "4d5c2af327cd64a62cf35abd2ba6fab4");
+    /* Test case 4 is 3 cut to 60 bytes, with additional data. */
+    check("feffe9928665731c6d6a8f9467308308", "cafebabefacedbaddecaf888",
+	  "feedfacedeadbeeffeedfacedeadbeefabaddad2",
+	  "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a721c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39",
+	  "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091",
+	  "5bc94fbc3221a5db94fae95ae7121a47");
+
+    /* 40000 bytes are two full records and a short one. */
+    for (i = 0; i < TLS_KEY_MATERIAL; ++i)
+	material[i] = i;
+    tls_dir_init(&tx, material);
+    tls_dir_init(&rx, material);
+    in = malloc(len);
+    rec = malloc(TLS_SEALED_SIZE(len));
+    assert(in != NULL && rec != NULL);
+    for (n = 0; n < len; ++n)
+	in[n] = n * 7;
+    n = tls_seal(&tx, in, len, rec);
+    assert(n == len + 3 * TLS_RECORD_OVERHEAD);
+    assert(tx.seq == 3);
+    for (p = rec, got = 0; got < len; p += TLS_HEADER_SIZE + blen) {
+	blen = tls_record_length(p);
+	assert(blen > 0);
+	n = tls_open(&rx, p, p + TLS_HEADER_SIZE, blen);
+	assert(n == (got < 2 * TLS_RECORD_MAX ? TLS_RECORD_MAX : len - 2 * TLS_RECORD_MAX));
+	assert(memcmp(p + TLS_HEADER_SIZE, in + got, n) == 0);
+	got += n;
+    }
+
+    /* A changed byte, or a record out of order, does not open. */
+    tls_seal(&tx, in, 100, rec);
+    rec[TLS_HEADER_SIZE + 50] ^= 1;
+    r = tls_open(&rx, rec, rec + TLS_HEADER_SIZE, tls_record_length(rec));
+    assert(r == -1);
+    tls_seal(&tx, in, 100, rec);
+    r = tls_open(&rx, rec, rec + TLS_HEADER_SIZE, tls_record_length(rec));
+    assert(r == -1);
+    rec[0] = 22;
+    assert(tls_record_length(rec) == -1);
+
+    free(in);
+    free(rec);
+    return 0;
+}
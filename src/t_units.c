@@ -83,5 +83,12 @@ main(int argc, char **argv)
     unit_snprintf(s, 11, d, 'a');
     assert(strncmp(s, "34.4 Gbit", 11) == 0);
 
+    /* Past the largest unit, the number grows instead. */
+    unit_snprintf(s, 11, 2.0 * 1024 * d, 'A');
+    assert(strncmp(s, "8192 GByte", 11) == 0);
+
+    unit_snprintf(s, 11, 1000.0 * d, 'a');
+    assert(strncmp(s, "34360 Gbit", 11) == 0);
+
     return 0;
 }
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2014, The Regents of the University of California,
+ * through Lawrence Berkeley National Laboratory (subject to receipt of any
+ * required approvals from the U.S. Dept. of Energy).  All rights reserved.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE file
+ * for complete information.
+ */
+
+/* A client's --verify against a server started with -F is refused on
+** both ends, sending or receiving (-R), rather than wrapping the disk
+** file routines a second time.  Client and server run in this process,
+** over loopback.
+*/
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+
+struct server {
+    pthread_t thread;
+    struct iperf_test *test;
+    int rc;
+    int err;
+};
+
+static void *
+run_server(void *arg)
+{
+    struct server *server = (struct server *) arg;
+
+    server->rc = iperf_run_server(server->test);
+    server->err = i_errno;
+    return NULL;
+}
+
+static struct iperf_test *
+new_test(char role, int port)
+{
+    struct iperf_test *test;
+
+    test = iperf_new_test();
+    assert(test != NULL);
+    iperf_defaults(test);
+    iperf_set_test_role(test, role);
+    iperf_set_test_server_port(test, port);
+    iperf_set_test_json_output(test, 1);
+    return test;
+}
+
+/* Returns the client's result; the server's is left in *server. */
+static int
+run(int port, char *diskfile, int reverse, struct server *server)
+{
+    struct iperf_test *client;
+    int tries, rc;
+
+    server->test = new_test('s', port);
+    server->test->diskfile_name = diskfile;
+    rc = pthread_create(&server->thread, NULL, run_server, server);
+    assert(rc == 0);
+
+    /* The server thread may not be listening yet. */
+    for (tries = 0; ; ++tries) {
+	client = new_test('c', port);
+	iperf_set_test_server_hostname(client, "127.0.0.1");
+	iperf_set_test_duration(client, 1);
+	iperf_set_test_reverse(client, reverse);
+	client->verify = 1;
+	rc = iperf_run_client(client);
+	if (rc == 0 || i_errno != IECONNECT || tries == 50)
+	    break;
+	iperf_free_test(client);
+	usleep(20000);
+    }
+    pthread_join(server->thread, NULL);
+    iperf_free_test(client);
+    iperf_free_test(server->test);
+    return rc;
+}
+
+int
+main(int argc, char **argv)
+{
+    int port = 6200 + getpid() % 1000;
+    char diskfile[] = "/tmp/t_verify.XXXXXX";
+    struct server server;
+    FILE *out;
+    int fd, rc;
+
+    /* Only the results matter here, not the JSON. */
+    out = freopen("/dev/null", "w", stdout);
+    assert(out != NULL);
+    fd = mkstemp(diskfile);
+    assert(fd >= 0);
+    close(fd);
+
+    /* --verify on its own still runs. */
+    rc = run(port, NULL, 0, &server);
+    assert(rc == 0);
+    assert(server.rc == 0);
+
+    /* Against -F, both ends refuse it, sending or receiving. */
+    rc = run(port + 1, diskfile, 0, &server);
+    assert(rc < 0);
+    assert(server.rc < 0 && server.err == IEVERIFY);
+    rc = run(port + 2, diskfile, 1, &server);
+    assert(rc < 0);
+    assert(server.rc < 0 && server.err == IEVERIFY);
+
+    unlink(diskfile);
+    return 0;
+}
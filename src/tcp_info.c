@@ -39,6 +39,7 @@
 #include "iperf.h"
 #include "iperf_api.h"
 #include "locale.h"
+#include "iperf_mptcp.h"
 
 /*************************************************************/
 int
@@ -81,6 +82,8 @@ save_tcpinfo(struct iperf_stream *sp, struct iperf_interval_results *irp)
 
     if (getsockopt(sp->socket, IPPROTO_TCP, TCP_INFO, (void *)&irp->tcpInfo, &tcp_info_length) < 0)
 	iperf_err(sp->test, "getsockopt - %s", strerror(errno));
+    if (sp->test->mptcp)
+	iperf_mptcp_sample(sp, &irp->tcpInfo);
 
     if (sp->test->debug) {
 	printf("tcpi_snd_cwnd %u tcpi_snd_mss %u\n",
@@ -123,6 +126,38 @@ get_snd_cwnd(struct iperf_interval_results *irp)
 #endif
 }
 
+/*************************************************************/
+/*
+ * Return the smoothed RTT in microseconds.
+ */
+long
+get_rtt(struct iperf_interval_results *irp)
+{
+#if defined(linux) && defined(TCP_MD5SIG)
+    return irp->tcpInfo.tcpi_rtt;
+#else
+#if defined(__FreeBSD__) && __FreeBSD_version >= 600000
+    return irp->tcpInfo.tcpi_rtt;
+#else
+    return -1;
+#endif
+#endif
+}
+
+/*************************************************************/
+/*
+ * Return the receiver's RTT estimate in microseconds.
+ */
+long
+get_rcv_rtt(struct iperf_interval_results *irp)
+{
+#if defined(linux) && defined(TCP_MD5SIG)
+    return irp->tcpInfo.tcpi_rcv_rtt;
+#else
+    return -1;
+#endif
+}
+
 #ifdef notdef
 /*************************************************************/
 //print_tcpinfo(struct iperf_interval_results *r)
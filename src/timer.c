@@ -13,10 +13,11 @@
 #include <stdlib.h>
 
 #include "timer.h"
+#include "probes.h"
 
 
-static Timer* timers = NULL;
-static Timer* free_timers = NULL;
+static IPERF_TLS Timer* timers = NULL;
+static IPERF_TLS Timer* free_timers = NULL;
 
 TimerClientData JunkClientData;
 
@@ -153,7 +154,7 @@ tmr_timeout( struct timeval* nowP )
 {
     struct timeval now;
     int64_t usecs;
-    static struct timeval timeout;
+    static IPERF_TLS struct timeval timeout;
 
     getnow( nowP, &now );
     /* Since the list is sorted, we only need to look at the first timer. */
@@ -186,6 +187,7 @@ tmr_run( struct timeval* nowP )
 	     ( t->time.tv_sec == now.tv_sec &&
 	       t->time.tv_usec > now.tv_usec ) )
 	    break;
+	IPERF_PROBE3( timer_fire, t->timer_proc, t->usecs, t->periodic );
 	(t->timer_proc)( t->client_data, &now );
 	if ( t->periodic ) {
 	    /* Reschedule. */
@@ -14,6 +14,11 @@
 
 #include <sys/time.h>
 
+/* Each thread has its own list of timers (see iperf_api.h). */
+#ifndef IPERF_TLS
+#define IPERF_TLS __thread
+#endif
+
 /* TimerClientData is an opaque value that tags along with a timer.  The
 ** client can use it for whatever, and it gets passed to the callback when
 ** the timer triggers.
@@ -53,7 +58,8 @@ extern Timer* tmr_create(
 
 /* Returns a timeout indicating how long until the next timer triggers.  You
 ** can just put the call to this routine right in your select().  Returns
-** (struct timeval*) 0 if no timers are pending.
+** (struct timeval*) 0 if no timers are pending.  The result points to
+** per-thread storage that is overwritten by the next call.
 */
 extern struct timeval* tmr_timeout( struct timeval* nowP ) /* __attribute__((hot)) */;
 
@@ -0,0 +1,540 @@
+/*
+ * Copyright (c) 2014, The Regents of the University of California,
+ * through Lawrence Berkeley National Laboratory (subject to receipt of any
+ * required approvals from the U.S. Dept. of Energy).  All rights reserved.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE file
+ * for complete information.
+ */
+
+/* tls.c
+ *
+ * AES-128-GCM and the TLS 1.3 record layer on top of it.  Where the
+ * kernel's tls module is missing, this is what --ktls costs, so it uses
+ * AES-NI and PCLMULQDQ when the CPU has them; everywhere else, a plain C
+ * AES and a 4-bit table GHASH.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "tls.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define TLS_X86 1
+#include <immintrin.h>
+#endif
+
+#define TLS_APPLICATION_DATA 23
+
+static const unsigned char sbox[256] = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16,
+};
+
+static uint32_t
+load32(const unsigned char *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static void
+store32(unsigned char *p, uint32_t w)
+{
+    p[0] = w;
+    p[1] = w >> 8;
+    p[2] = w >> 16;
+    p[3] = w >> 24;
+}
+
+static uint64_t
+load64_be(const unsigned char *p)
+{
+    uint64_t x = 0;
+    int i;
+
+    for (i = 0; i < 8; ++i)
+	x = (x << 8) | p[i];
+    return x;
+}
+
+static void
+store64_be(unsigned char *p, uint64_t x)
+{
+    int i;
+
+    for (i = 7; i >= 0; --i, x >>= 8)
+	p[i] = x;
+}
+
+/* A column is a little-endian word, row 0 in the low byte. */
+#define XTIME(w) ((((w) & 0x7f7f7f7fU) << 1) ^ ((((w) >> 7) & 0x01010101U) * 0x1b))
+#define ROR8(w) (((w) >> 8) | ((w) << 24))
+
+static void
+aes_encrypt(const unsigned char *rk, const unsigned char *in, unsigned char *out)
+{
+    uint32_t s[4], t[4], u;
+    int r, c;
+
+    for (c = 0; c < 4; ++c)
+	s[c] = load32(in + 4 * c) ^ load32(rk + 4 * c);
+    for (r = 1; r <= 10; ++r) {
+	/* SubBytes and ShiftRows... */
+	for (c = 0; c < 4; ++c)
+	    t[c] = sbox[s[c] & 0xff] |
+		sbox[(s[(c + 1) & 3] >> 8) & 0xff] << 8 |
+		sbox[(s[(c + 2) & 3] >> 16) & 0xff] << 16 |
+		(uint32_t) sbox[s[(c + 3) & 3] >> 24] << 24;
+	/* ...MixColumns, but not in the last round, and AddRoundKey. */
+	for (c = 0; c < 4; ++c) {
+	    if (r < 10) {
+		u = ROR8(t[c]);
+		t[c] = XTIME(t[c] ^ u) ^ u ^ ROR8(u) ^ ROR8(ROR8(u));
+	    }
+	    s[c] = t[c] ^ load32(rk + 16 * r + 4 * c);
+	}
+    }
+    for (c = 0; c < 4; ++c)
+	store32(out + 4 * c, s[c]);
+}
+
+static void
+aes_expand_key(unsigned char *rk, const unsigned char *key)
+{
+    unsigned char t[4], x, rcon = 1;
+    int i;
+
+    memcpy(rk, key, 16);
+    for (i = 16; i < 176; i += 4) {
+	memcpy(t, rk + i - 4, 4);
+	if (i % 16 == 0) {
+	    x = t[0];
+	    t[0] = sbox[t[1]] ^ rcon;
+	    t[1] = sbox[t[2]];
+	    t[2] = sbox[t[3]];
+	    t[3] = sbox[x];
+	    rcon = (rcon << 1) ^ ((rcon >> 7) * 0x1b);
+	}
+	rk[i] = rk[i - 16] ^ t[0];
+	rk[i + 1] = rk[i - 15] ^ t[1];
+	rk[i + 2] = rk[i - 14] ^ t[2];
+	rk[i + 3] = rk[i - 13] ^ t[3];
+    }
+}
+
+/* GHASH four bits at a time (Shoup's method): hl/hh hold h times each
+** 4-bit value, and last4 the reduction of the bits shifted out.
+*/
+static const uint64_t last4[16] = {
+    0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+    0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0
+};
+
+static void
+ghash_tables(struct aes_gcm *g)
+{
+    uint64_t vh, vl, t;
+    int i, j;
+
+    vh = load64_be(g->h);
+    vl = load64_be(g->h + 8);
+    g->hh[0] = g->hl[0] = 0;
+    g->hh[8] = vh;
+    g->hl[8] = vl;
+    for (i = 4; i > 0; i >>= 1) {
+	t = (vl & 1) * 0xe1000000U;
+	vl = (vh << 63) | (vl >> 1);
+	vh = (vh >> 1) ^ (t << 32);
+	g->hh[i] = vh;
+	g->hl[i] = vl;
+    }
+    for (i = 2; i <= 8; i *= 2)
+	for (j = 1; j < i; ++j) {
+	    g->hh[i + j] = g->hh[i] ^ g->hh[j];
+	    g->hl[i + j] = g->hl[i] ^ g->hl[j];
+	}
+}
+
+/* x = x * h */
+static void
+ghash_mult(const struct aes_gcm *g, unsigned char *x)
+{
+    uint64_t zh, zl;
+    unsigned char lo, hi, rem;
+    int i;
+
+    lo = x[15] & 0xf;
+    zh = g->hh[lo];
+    zl = g->hl[lo];
+    for (i = 15; i >= 0; --i) {
+	lo = x[i] & 0xf;
+	hi = x[i] >> 4;
+	if (i != 15) {
+	    rem = zl & 0xf;
+	    zl = (zh << 60) | (zl >> 4);
+	    zh = (zh >> 4) ^ (last4[rem] << 48) ^ g->hh[lo];
+	    zl ^= g->hl[lo];
+	}
+	rem = zl & 0xf;
+	zl = (zh << 60) | (zl >> 4);
+	zh = (zh >> 4) ^ (last4[rem] << 48) ^ g->hh[hi];
+	zl ^= g->hl[hi];
+    }
+    store64_be(x, zh);
+    store64_be(x + 8, zl);
+}
+
+/* Fold len bytes into x, the last block padded with zeroes. */
+static void
+ghash_update(const struct aes_gcm *g, unsigned char *x, const unsigned char *p, size_t len)
+{
+    size_t i, n;
+
+    for (; len > 0; p += n, len -= n) {
+	n = len < 16 ? len : 16;
+	for (i = 0; i < n; ++i)
+	    x[i] ^= p[i];
+	ghash_mult(g, x);
+    }
+}
+
+static void
+gcm_generic(const struct aes_gcm *g, const unsigned char *iv, const unsigned char *aad, size_t aad_len, const unsigned char *in, size_t len, unsigned char *out, unsigned char *tag, int open)
+{
+    unsigned char ctr[16], ks[16], x[16], lens[16];
+    uint32_t c;
+    size_t i, n, bits = len * 8;
+
+    memset(x, 0, sizeof(x));
+    ghash_update(g, x, aad, aad_len);
+    memcpy(ctr, iv, 12);
+    for (c = 1; len > 0; in += n, out += n, len -= n) {
+	n = len < 16 ? len : 16;
+	++c;
+	ctr[12] = c >> 24;
+	ctr[13] = c >> 16;
+	ctr[14] = c >> 8;
+	ctr[15] = c;
+	aes_encrypt(g->rk, ctr, ks);
+	/* The hash is of the ciphertext: the input when opening. */
+	if (open)
+	    ghash_update(g, x, in, n);
+	for (i = 0; i < n; ++i)
+	    out[i] = in[i] ^ ks[i];
+	if (!open)
+	    ghash_update(g, x, out, n);
+    }
+    store64_be(lens, (uint64_t) aad_len * 8);
+    store64_be(lens + 8, bits);
+    for (i = 0; i < 16; ++i)
+	x[i] ^= lens[i];
+    ghash_mult(g, x);
+    ctr[12] = ctr[13] = ctr[14] = 0;
+    ctr[15] = 1;
+    aes_encrypt(g->rk, ctr, ks);
+    for (i = 0; i < 16; ++i)
+	tag[i] = x[i] ^ ks[i];
+}
+
+#ifdef TLS_X86
+/* The product of two byte-reflected field elements: carry-less multiply
+** with Karatsuba, then shift and reduce, after Gueron and Kounavis.
+*/
+__attribute__((target("pclmul,sse2")))
+static __m128i
+gfmul(__m128i a, __m128i b)
+{
+    __m128i t2, t3, t4, t5, t6, t7, t8, t9;
+
+    t3 = _mm_clmulepi64_si128(a, b, 0x00);
+    t4 = _mm_clmulepi64_si128(a, b, 0x10);
+    t5 = _mm_clmulepi64_si128(a, b, 0x01);
+    t6 = _mm_clmulepi64_si128(a, b, 0x11);
+    t4 = _mm_xor_si128(t4, t5);
+    t5 = _mm_slli_si128(t4, 8);
+    t4 = _mm_srli_si128(t4, 8);
+    t3 = _mm_xor_si128(t3, t5);
+    t6 = _mm_xor_si128(t6, t4);
+
+    t7 = _mm_srli_epi32(t3, 31);
+    t8 = _mm_srli_epi32(t6, 31);
+    t3 = _mm_slli_epi32(t3, 1);
+    t6 = _mm_slli_epi32(t6, 1);
+    t9 = _mm_srli_si128(t7, 12);
+    t8 = _mm_slli_si128(t8, 4);
+    t7 = _mm_slli_si128(t7, 4);
+    t3 = _mm_or_si128(t3, t7);
+    t6 = _mm_or_si128(t6, t8);
+    t6 = _mm_or_si128(t6, t9);
+
+    t7 = _mm_slli_epi32(t3, 31);
+    t8 = _mm_slli_epi32(t3, 30);
+    t9 = _mm_slli_epi32(t3, 25);
+    t7 = _mm_xor_si128(t7, t8);
+    t7 = _mm_xor_si128(t7, t9);
+    t8 = _mm_srli_si128(t7, 4);
+    t7 = _mm_slli_si128(t7, 12);
+    t3 = _mm_xor_si128(t3, t7);
+
+    t2 = _mm_srli_epi32(t3, 1);
+    t4 = _mm_srli_epi32(t3, 2);
+    t5 = _mm_srli_epi32(t3, 7);
+    t2 = _mm_xor_si128(t2, t4);
+    t2 = _mm_xor_si128(t2, t5);
+    t2 = _mm_xor_si128(t2, t8);
+    t3 = _mm_xor_si128(t3, t2);
+    return _mm_xor_si128(t6, t3);
+}
+
+/* Load up to 16 bytes, zero-padded. */
+__attribute__((target("sse2")))
+static __m128i
+load_partial(const unsigned char *p, size_t n)
+{
+    unsigned char b[16];
+
+    if (n == 16)
+	return _mm_loadu_si128((const __m128i *) p);
+    memset(b, 0, sizeof(b));
+    memcpy(b, p, n);
+    return _mm_loadu_si128((const __m128i *) b);
+}
+
+/* Four blocks at a time, so the AES rounds of one overlap the others'. */
+__attribute__((target("aes,pclmul,ssse3")))
+static void
+gcm_x86(const struct aes_gcm *g, const unsigned char *iv, const unsigned char *aad, size_t aad_len, const unsigned char *in, size_t len, unsigned char *out, unsigned char *tag, int open)
+{
+    const __m128i bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m128i one = _mm_set_epi32(0, 0, 0, 1);
+    __m128i rk[11], h, x, ctr, k0, k1, k2, k3, d0, d1, d2, d3;
+    unsigned char j0[16], b[16];
+    size_t n, aad_bits = aad_len * 8, bits = len * 8;
+    int i;
+
+    for (i = 0; i < 11; ++i)
+	rk[i] = _mm_loadu_si128((const __m128i *) (g->rk + 16 * i));
+    h = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) g->h), bswap);
+    x = _mm_setzero_si128();
+    for (; aad_len > 0; aad += n, aad_len -= n) {
+	n = aad_len < 16 ? aad_len : 16;
+	x = gfmul(_mm_xor_si128(x, _mm_shuffle_epi8(load_partial(aad, n), bswap)), h);
+    }
+
+    /* Reflected, the counter is the low lane. */
+    memcpy(j0, iv, 12);
+    j0[12] = j0[13] = j0[14] = 0;
+    j0[15] = 1;
+    ctr = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) j0), bswap);
+
+    for (; len >= 64; in += 64, out += 64, len -= 64) {
+	k0 = _mm_shuffle_epi8(ctr = _mm_add_epi32(ctr, one), bswap);
+	k1 = _mm_shuffle_epi8(ctr = _mm_add_epi32(ctr, one), bswap);
+	k2 = _mm_shuffle_epi8(ctr = _mm_add_epi32(ctr, one), bswap);
+	k3 = _mm_shuffle_epi8(ctr = _mm_add_epi32(ctr, one), bswap);
+	k0 = _mm_xor_si128(k0, rk[0]);
+	k1 = _mm_xor_si128(k1, rk[0]);
+	k2 = _mm_xor_si128(k2, rk[0]);
+	k3 = _mm_xor_si128(k3, rk[0]);
+	for (i = 1; i < 10; ++i) {
+	    k0 = _mm_aesenc_si128(k0, rk[i]);
+	    k1 = _mm_aesenc_si128(k1, rk[i]);
+	    k2 = _mm_aesenc_si128(k2, rk[i]);
+	    k3 = _mm_aesenc_si128(k3, rk[i]);
+	}
+	k0 = _mm_aesenclast_si128(k0, rk[10]);
+	k1 = _mm_aesenclast_si128(k1, rk[10]);
+	k2 = _mm_aesenclast_si128(k2, rk[10]);
+	k3 = _mm_aesenclast_si128(k3, rk[10]);
+	d0 = _mm_loadu_si128((const __m128i *) in);
+	d1 = _mm_loadu_si128((const __m128i *) (in + 16));
+	d2 = _mm_loadu_si128((const __m128i *) (in + 32));
+	d3 = _mm_loadu_si128((const __m128i *) (in + 48));
+	k0 = _mm_xor_si128(k0, d0);
+	k1 = _mm_xor_si128(k1, d1);
+	k2 = _mm_xor_si128(k2, d2);
+	k3 = _mm_xor_si128(k3, d3);
+	_mm_storeu_si128((__m128i *) out, k0);
+	_mm_storeu_si128((__m128i *) (out + 16), k1);
+	_mm_storeu_si128((__m128i *) (out + 32), k2);
+	_mm_storeu_si128((__m128i *) (out + 48), k3);
+	if (!open) {
+	    d0 = k0;
+	    d1 = k1;
+	    d2 = k2;
+	    d3 = k3;
+	}
+	x = gfmul(_mm_xor_si128(x, _mm_shuffle_epi8(d0, bswap)), h);
+	x = gfmul(_mm_xor_si128(x, _mm_shuffle_epi8(d1, bswap)), h);
+	x = gfmul(_mm_xor_si128(x, _mm_shuffle_epi8(d2, bswap)), h);
+	x = gfmul(_mm_xor_si128(x, _mm_shuffle_epi8(d3, bswap)), h);
+    }
+    for (; len > 0; in += n, out += n, len -= n) {
+	n = len < 16 ? len : 16;
+	k0 = _mm_shuffle_epi8(ctr = _mm_add_epi32(ctr, one), bswap);
+	k0 = _mm_xor_si128(k0, rk[0]);
+	for (i = 1; i < 10; ++i)
+	    k0 = _mm_aesenc_si128(k0, rk[i]);
+	k0 = _mm_aesenclast_si128(k0, rk[10]);
+	d0 = load_partial(in, n);
+	k0 = _mm_xor_si128(k0, d0);
+	_mm_storeu_si128((__m128i *) b, k0);
+	memcpy(out, b, n);
+	/* What goes into the hash is zero-padded ciphertext. */
+	x = gfmul(_mm_xor_si128(x, _mm_shuffle_epi8(open ? d0 : load_partial(b, n), bswap)), h);
+    }
+
+    x = gfmul(_mm_xor_si128(x, _mm_set_epi64x(aad_bits, bits)), h);
+    k0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) j0), rk[0]);
+    for (i = 1; i < 10; ++i)
+	k0 = _mm_aesenc_si128(k0, rk[i]);
+    k0 = _mm_aesenclast_si128(k0, rk[10]);
+    _mm_storeu_si128((__m128i *) tag, _mm_xor_si128(_mm_shuffle_epi8(x, bswap), k0));
+}
+#endif
+
+static void (*gcm_impl)(const struct aes_gcm *, const unsigned char *, const unsigned char *, size_t, const unsigned char *, size_t, unsigned char *, unsigned char *, int);
+
+static void
+gcm(const struct aes_gcm *g, const unsigned char *iv, const unsigned char *aad, size_t aad_len, const unsigned char *in, size_t len, unsigned char *out, unsigned char *tag, int open)
+{
+    if (gcm_impl == NULL) {
+#ifdef TLS_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("aes") && __builtin_cpu_supports("pclmul") &&
+	    __builtin_cpu_supports("ssse3"))
+	    gcm_impl = gcm_x86;
+	else
+#endif
+	    gcm_impl = gcm_generic;
+    }
+    gcm_impl(g, iv, aad, aad_len, in, len, out, tag, open);
+}
+
+void
+aes_gcm_init(struct aes_gcm *g, const unsigned char *key)
+{
+    unsigned char zero[16];
+
+    aes_expand_key(g->rk, key);
+    memset(zero, 0, sizeof(zero));
+    aes_encrypt(g->rk, zero, g->h);
+    ghash_tables(g);
+}
+
+void
+aes_gcm_seal(const struct aes_gcm *g, const unsigned char *iv, const unsigned char *aad, size_t aad_len, const unsigned char *in, size_t len, unsigned char *out, unsigned char *tag)
+{
+    gcm(g, iv, aad, aad_len, in, len, out, tag, 0);
+}
+
+int
+aes_gcm_open(const struct aes_gcm *g, const unsigned char *iv, const unsigned char *aad, size_t aad_len, const unsigned char *in, size_t len, const unsigned char *tag, unsigned char *out)
+{
+    unsigned char t[TLS_TAG_SIZE], diff = 0;
+    int i;
+
+    gcm(g, iv, aad, aad_len, in, len, out, t, 1);
+    for (i = 0; i < TLS_TAG_SIZE; ++i)
+	diff |= t[i] ^ tag[i];
+    return diff == 0 ? 0 : -1;
+}
+
+void
+tls_dir_init(struct tls_dir *d, const unsigned char *material)
+{
+    aes_gcm_init(&d->gcm, material);
+    memcpy(d->iv, material + TLS_KEY_SIZE, TLS_IV_SIZE);
+    d->seq = 0;
+}
+
+/* Each record's nonce is the IV with the record number xored into its
+** last eight bytes.
+*/
+static void
+tls_nonce(const struct tls_dir *d, unsigned char *nonce)
+{
+    int i;
+
+    store64_be(nonce + 4, d->seq);
+    for (i = 0; i < 4; ++i)
+	nonce[i] = d->iv[i];
+    for (i = 4; i < TLS_IV_SIZE; ++i)
+	nonce[i] ^= d->iv[i];
+}
+
+size_t
+tls_seal(struct tls_dir *d, const char *in, size_t len, char *out)
+{
+    unsigned char nonce[TLS_IV_SIZE];
+    unsigned char *hdr, *body;
+    size_t n, done = 0;
+
+    for (; len > 0; in += n, len -= n) {
+	n = len < TLS_RECORD_MAX ? len : TLS_RECORD_MAX;
+	hdr = (unsigned char *) out + done;
+	body = hdr + TLS_HEADER_SIZE;
+	hdr[0] = TLS_APPLICATION_DATA;
+	hdr[1] = hdr[2] = 3;	/* legacy_record_version, TLS 1.2 */
+	hdr[3] = (n + 1 + TLS_TAG_SIZE) >> 8;
+	hdr[4] = (n + 1 + TLS_TAG_SIZE) & 0xff;
+	memcpy(body, in, n);
+	body[n] = TLS_APPLICATION_DATA;	/* the real content type */
+	tls_nonce(d, nonce);
+	aes_gcm_seal(&d->gcm, nonce, hdr, TLS_HEADER_SIZE, body, n + 1, body, body + n + 1);
+	d->seq++;
+	done += n + TLS_RECORD_OVERHEAD;
+    }
+    return done;
+}
+
+int
+tls_record_length(const char *header)
+{
+    const unsigned char *h = (const unsigned char *) header;
+    int len;
+
+    if (h[0] != TLS_APPLICATION_DATA || h[1] != 3 || h[2] != 3)
+	return -1;
+    len = h[3] << 8 | h[4];
+    if (len < 1 + TLS_TAG_SIZE || len > TLS_BODY_MAX)
+	return -1;
+    return len;
+}
+
+int
+tls_open(struct tls_dir *d, const char *header, char *body, size_t len)
+{
+    unsigned char nonce[TLS_IV_SIZE];
+    unsigned char *b = (unsigned char *) body;
+    size_t n;
+
+    if (len < 1 + TLS_TAG_SIZE)
+	return -1;
+    n = len - TLS_TAG_SIZE;
+    tls_nonce(d, nonce);
+    if (aes_gcm_open(&d->gcm, nonce, (const unsigned char *) header, TLS_HEADER_SIZE, b, n, b + n, b) < 0)
+	return -1;
+    d->seq++;
+    /* Strip the padding, then the content type. */
+    while (n > 0 && b[n - 1] == 0)
+	--n;
+    if (n == 0 || b[n - 1] != TLS_APPLICATION_DATA)
+	return -1;
+    return n - 1;
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2014, The Regents of the University of California,
+ * through Lawrence Berkeley National Laboratory (subject to receipt of any
+ * required approvals from the U.S. Dept. of Energy).  All rights reserved.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE file
+ * for complete information.
+ */
+
+/* tls.h
+ *
+ * The TLS 1.3 record layer with AES-128-GCM, for --ktls streams the
+ * kernel cannot take.  The records are the ones kernel TLS sends and
+ * expects, so either end may fall back on its own.  There is no
+ * handshake: the keys come from iperf_tcp.c, and only application data
+ * records are sealed or opened.
+ */
+
+#ifndef __TLS_H
+#define __TLS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TLS_KEY_SIZE 16		/* AES-128 */
+#define TLS_IV_SIZE 12		/* the 4-byte salt, then the 8-byte IV */
+#define TLS_TAG_SIZE 16
+#define TLS_HEADER_SIZE 5
+#define TLS_RECORD_MAX 16384	/* plaintext in one record */
+
+/* Key and IV for one direction of a stream. */
+#define TLS_KEY_MATERIAL (TLS_KEY_SIZE + TLS_IV_SIZE)
+
+/* Record bytes beyond the plaintext: header, inner content type, tag. */
+#define TLS_RECORD_OVERHEAD (TLS_HEADER_SIZE + 1 + TLS_TAG_SIZE)
+
+/* The most a record body may hold, padding and all. */
+#define TLS_BODY_MAX (TLS_RECORD_MAX + 256)
+
+/* Room for len bytes of plaintext once sealed into records. */
+#define TLS_SEALED_SIZE(len) \
+    ((len) + ((len) + TLS_RECORD_MAX - 1) / TLS_RECORD_MAX * TLS_RECORD_OVERHEAD)
+
+struct aes_gcm
+{
+    unsigned char rk[176];	/* AES-128 round keys */
+    unsigned char h[16];	/* the hash key, E(K, 0^128) */
+    uint64_t  hl[16], hh[16];	/* multiples of h for the table GHASH */
+};
+
+/* One direction of a connection. */
+struct tls_dir
+{
+    struct aes_gcm gcm;
+    unsigned char iv[TLS_IV_SIZE];
+    uint64_t  seq;		/* number of the next record */
+};
+
+void aes_gcm_init(struct aes_gcm *g, const unsigned char *key);
+
+/* Encrypt len bytes of in to out, and authenticate them with aad. */
+void aes_gcm_seal(const struct aes_gcm *g, const unsigned char *iv, const unsigned char *aad, size_t aad_len, const unsigned char *in, size_t len, unsigned char *out, unsigned char *tag);
+
+/* Check the tag and decrypt; in and out may be the same.  Returns 0, or
+ * -1 if the tag does not match, leaving out undefined.
+ */
+int aes_gcm_open(const struct aes_gcm *g, const unsigned char *iv, const unsigned char *aad, size_t aad_len, const unsigned char *in, size_t len, const unsigned char *tag, unsigned char *out);
+
+/* Set up a direction from TLS_KEY_MATERIAL bytes: key, salt, IV. */
+void tls_dir_init(struct tls_dir *d, const unsigned char *material);
+
+/* Seal len bytes into as many records as they need.  out must have room
+ * for TLS_SEALED_SIZE(len) bytes; returns the bytes put there.
+ */
+size_t tls_seal(struct tls_dir *d, const char *in, size_t len, char *out);
+
+/* The body length from a record header, or -1 if it is not that of an
+ * application data record.
+ */
+int tls_record_length(const char *header);
+
+/* Open a record body in place.  Returns the plaintext length, or -1 if
+ * the record does not authenticate or holds anything but application
+ * data.
+ */
+int tls_open(struct tls_dir *d, const char *header, char *body, size_t len);
+
+#endif
@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2014, The Regents of the University of California,
+ * through Lawrence Berkeley National Laboratory (subject to receipt of any
+ * required approvals from the U.S. Dept. of Energy).  All rights reserved.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE file
+ * for complete information.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tlv.h"
+
+
+void
+tlv_init(struct tlv_buf *b)
+{
+    memset(b, 0, sizeof(*b));
+}
+
+void
+tlv_free(struct tlv_buf *b)
+{
+    free(b->data);
+    tlv_init(b);
+}
+
+static unsigned char *
+tlv_reserve(struct tlv_buf *b, size_t n)
+{
+    unsigned char *d;
+    size_t size;
+
+    if (b->fail)
+	return NULL;
+    if (b->len + n > b->size) {
+	size = b->size ? b->size : 256;
+	while (size < b->len + n)
+	    size *= 2;
+	d = (unsigned char *) realloc(b->data, size);
+	if (d == NULL) {
+	    b->fail = 1;
+	    return NULL;
+	}
+	b->data = d;
+	b->size = size;
+    }
+    return b->data + b->len;
+}
+
+static void
+tlv_append_varint(struct tlv_buf *b, uint64_t u)
+{
+    unsigned char *d = tlv_reserve(b, 10);
+
+    if (d == NULL)
+	return;
+    while (u >= 0x80) {
+	*d++ = (unsigned char) (u | 0x80);
+	u >>= 7;
+	b->len++;
+    }
+    *d = (unsigned char) u;
+    b->len++;
+}
+
+static int
+tlv_varint_size(uint64_t u)
+{
+    int n = 1;
+
+    while (u >= 0x80) {
+	u >>= 7;
+	++n;
+    }
+    return n;
+}
+
+void
+tlv_start_message(struct tlv_buf *b)
+{
+    unsigned char *d = tlv_reserve(b, TLV_MAGIC_LEN + 1);
+
+    if (d == NULL)
+	return;
+    memcpy(d, TLV_MAGIC, TLV_MAGIC_LEN);
+    d[TLV_MAGIC_LEN] = TLV_VERSION;
+    b->len += TLV_MAGIC_LEN + 1;
+}
+
+void
+tlv_append_int(struct tlv_buf *b, int64_t v)
+{
+    tlv_append_varint(b, ((uint64_t) v << 1) ^ (uint64_t) (v >> 63));
+}
+
+void
+tlv_append_double(struct tlv_buf *b, double d)
+{
+    unsigned char *p = tlv_reserve(b, 8);
+    uint64_t u;
+    int i;
+
+    if (p == NULL)
+	return;
+    memcpy(&u, &d, 8);
+    for (i = 0; i < 8; ++i)
+	p[i] = (unsigned char) (u >> (56 - 8 * i));
+    b->len += 8;
+}
+
+void
+tlv_put_int(struct tlv_buf *b, unsigned tag, int64_t v)
+{
+    uint64_t z = ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+
+    tlv_append_varint(b, tag);
+    tlv_append_varint(b, tlv_varint_size(z));
+    tlv_append_varint(b, z);
+}
+
+void
+tlv_put_double(struct tlv_buf *b, unsigned tag, double d)
+{
+    tlv_append_varint(b, tag);
+    tlv_append_varint(b, 8);
+    tlv_append_double(b, d);
+}
+
+void
+tlv_put_bytes(struct tlv_buf *b, unsigned tag, const void *p, size_t len)
+{
+    unsigned char *d;
+
+    tlv_append_varint(b, tag);
+    tlv_append_varint(b, len);
+    if ((d = tlv_reserve(b, len)) != NULL) {
+	memcpy(d, p, len);
+	b->len += len;
+    }
+}
+
+
+int
+tlv_is_message(const char *msg, size_t len)
+{
+    return len > TLV_MAGIC_LEN && memcmp(msg, TLV_MAGIC, TLV_MAGIC_LEN) == 0;
+}
+
+int
+tlv_open_message(struct tlv_reader *r, const char *msg, size_t len)
+{
+    if (!tlv_is_message(msg, len) || (unsigned char) msg[TLV_MAGIC_LEN] != TLV_VERSION)
+	return -1;
+    tlv_open(r, msg + TLV_MAGIC_LEN + 1, len - TLV_MAGIC_LEN - 1);
+    return 0;
+}
+
+void
+tlv_open(struct tlv_reader *r, const void *p, size_t len)
+{
+    r->p = (const unsigned char *) p;
+    r->end = r->p + len;
+}
+
+static int
+tlv_get_varint(struct tlv_reader *r, uint64_t *u)
+{
+    int shift;
+
+    *u = 0;
+    for (shift = 0; r->p < r->end && shift < 64; shift += 7) {
+	*u |= (uint64_t) (*r->p & 0x7f) << shift;
+	if ((*r->p++ & 0x80) == 0)
+	    return 0;
+    }
+    return -1;
+}
+
+int
+tlv_next(struct tlv_reader *r, unsigned *tag, struct tlv_reader *value)
+{
+    uint64_t t, len;
+
+    if (r->p >= r->end)
+	return 0;
+    if (tlv_get_varint(r, &t) < 0 || tlv_get_varint(r, &len) < 0 ||
+	len > (uint64_t) (r->end - r->p))
+	return -1;
+    *tag = (unsigned) t;
+    tlv_open(value, r->p, len);
+    r->p += len;
+    return 1;
+}
+
+int
+tlv_get_int(struct tlv_reader *r, int64_t *v)
+{
+    uint64_t z;
+
+    if (tlv_get_varint(r, &z) < 0)
+	return -1;
+    *v = (int64_t) (z >> 1) ^ -(int64_t) (z & 1);
+    return 0;
+}
+
+int
+tlv_get_double(struct tlv_reader *r, double *d)
+{
+    uint64_t u = 0;
+    int i;
+
+    if (r->end - r->p < 8)
+	return -1;
+    for (i = 0; i < 8; ++i)
+	u = (u << 8) | *r->p++;
+    memcpy(d, &u, 8);
+    return 0;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2014, The Regents of the University of California,
+ * through Lawrence Berkeley National Laboratory (subject to receipt of any
+ * required approvals from the U.S. Dept. of Energy).  All rights reserved.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE file
+ * for complete information.
+ */
+
+/* tlv.h
+ *
+ * Binary encoding for control-channel messages.
+ *
+ * A message is TLV_MAGIC, a version byte, then a sequence of fields.
+ * Each field is a tag and a length, both as LEB128 varints, followed by
+ * that many bytes of value.  Integers are zigzag varints, doubles are
+ * 8 bytes of IEEE 754 in network byte order, and a nested record or a
+ * packed column of numbers is simply a value holding more of the same.
+ * Readers skip tags they do not know, so fields can be added without
+ * bumping the version.
+ */
+
+#ifndef __TLV_H
+#define __TLV_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TLV_MAGIC "I3T"		/* never the start of a JSON message */
+#define TLV_MAGIC_LEN 3
+#define TLV_VERSION 1
+
+struct tlv_buf
+{
+    unsigned char *data;
+    size_t    len;
+    size_t    size;
+    int       fail;		/* out of memory; the contents are incomplete */
+};
+
+struct tlv_reader
+{
+    const unsigned char *p;
+    const unsigned char *end;
+};
+
+/* Writing. */
+void tlv_init(struct tlv_buf *b);
+void tlv_free(struct tlv_buf *b);
+void tlv_start_message(struct tlv_buf *b);
+void tlv_put_int(struct tlv_buf *b, unsigned tag, int64_t v);
+void tlv_put_double(struct tlv_buf *b, unsigned tag, double d);
+void tlv_put_bytes(struct tlv_buf *b, unsigned tag, const void *p, size_t len);
+/* Bare values, for building packed columns. */
+void tlv_append_int(struct tlv_buf *b, int64_t v);
+void tlv_append_double(struct tlv_buf *b, double d);
+
+/* Reading.  Functions return 0, or -1 on malformed input. */
+int tlv_is_message(const char *msg, size_t len);
+int tlv_open_message(struct tlv_reader *r, const char *msg, size_t len);
+void tlv_open(struct tlv_reader *r, const void *p, size_t len);
+/* The next field: 1 with its tag and value, 0 at the end, -1 if malformed. */
+int tlv_next(struct tlv_reader *r, unsigned *tag, struct tlv_reader *value);
+int tlv_get_int(struct tlv_reader *r, int64_t *v);
+int tlv_get_double(struct tlv_reader *r, double *d);
+
+#endif
@@ -240,14 +240,14 @@ extern    "C"
 
 		if (isupper((int) inFormat))
 		{
-		    while (tmpNum >= 1024.0 && conv <= GIGA_CONV)
+		    while (tmpNum >= 1024.0 && conv < GIGA_CONV)
 		    {
 			tmpNum /= 1024.0;
 			conv++;
 		    }
 		} else
 		{
-		    while (tmpNum >= 1000.0 && conv <= GIGA_CONV)
+		    while (tmpNum >= 1000.0 && conv < GIGA_CONV)
 		    {
 			tmpNum /= 1000.0;
 			conv++;